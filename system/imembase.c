@@ -12,6 +12,14 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined(ICPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef ICPU_X86
+#include <immintrin.h>
+#endif
+
 
 #if (defined(__BORLANDC__) || defined(__WATCOMC__))
 #if defined(_WIN32) || defined(WIN32)
@@ -96,6 +104,469 @@ void ikmem_free(void *ptr)
 }
 
 
+/*====================================================================*/
+/* ICPU - runtime cpu features                                        */
+/*====================================================================*/
+static volatile int icpu_cached = -1;
+static volatile int icpu_mask = -1;
+
+#ifdef ICPU_X86
+static void icpu_cpuid(int leaf, int sub, IUINT32 *regs)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, leaf, sub);
+	regs[0] = (IUINT32)info[0];
+	regs[1] = (IUINT32)info[1];
+	regs[2] = (IUINT32)info[2];
+	regs[3] = (IUINT32)info[3];
+#elif defined(__i386__) && defined(__PIC__)
+	IUINT32 a, b, c, d;
+	__asm__ __volatile__ ("xchgl %%ebx, %1\n\tcpuid\n\txchgl %%ebx, %1"
+		: "=a"(a), "=&r"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(sub));
+	regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#else
+	IUINT32 a, b, c, d;
+	__asm__ __volatile__ ("cpuid"
+		: "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(sub));
+	regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+
+static IUINT32 icpu_xgetbv(void)
+{
+#if defined(_MSC_VER)
+	return (IUINT32)_xgetbv(0);
+#else
+	IUINT32 a, d;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" 
+		: "=a"(a), "=d"(d) : "c"(0));
+	return a;
+#endif
+}
+#endif
+
+static int icpu_detect(void)
+{
+	int features = 0;
+#ifdef ICPU_X86
+	IUINT32 r[4], maxleaf;
+	int ymm = 0;
+	icpu_cpuid(0, 0, r);
+	maxleaf = r[0];
+	if (maxleaf < 1) return 0;
+	icpu_cpuid(1, 0, r);
+	if (r[3] & (1u << 26)) features |= ICPU_SSE2;
+	if (r[2] & (1u << 9)) features |= ICPU_SSSE3;
+	if (r[2] & (1u << 19)) features |= ICPU_SSE41;
+	if (r[2] & (1u << 20)) features |= ICPU_SSE42;
+	if (r[2] & (1u << 23)) features |= ICPU_POPCNT;
+	if (r[2] & (1u << 25)) features |= ICPU_AES;
+	if (r[2] & (1u << 1)) features |= ICPU_PCLMUL;
+	/* avx requires os support of ymm state (osxsave + xcr0) */
+	if ((r[2] & (1u << 27)) && (r[2] & (1u << 28))) {
+		if ((icpu_xgetbv() & 6) == 6) {
+			features |= ICPU_AVX;
+			ymm = 1;
+		}
+	}
+	if (maxleaf >= 7) {
+		icpu_cpuid(7, 0, r);
+		if ((r[1] & (1u << 5)) && ymm) features |= ICPU_AVX2;
+		if (r[1] & (1u << 8)) features |= ICPU_BMI2;
+		if (r[1] & (1u << 29)) features |= ICPU_SHA;
+	}
+#endif
+	return features;
+}
+
+int icpu_features(void)
+{
+	int features = icpu_cached;
+	if (features < 0) {
+		features = icpu_detect();
+		icpu_cached = features;
+	}
+	return features & icpu_mask;
+}
+
+void icpu_features_mask(int mask)
+{
+	icpu_mask = mask;
+}
+
+
+/*====================================================================*/
+/* IMEMFIND - substring search                                        */
+/*====================================================================*/
+#define IMEM_UPPER(c) ((((c) >= 'a') && ((c) <= 'z'))? ((c) - 32) : (c))
+
+#ifdef ICPU_X86
+/* ascii letters to upper case: 'a'-'z' are moved to the bottom of the 
+ * signed range, so one compare selects them */
+ICPU_TARGET("sse2")
+static inline __m128i imem_upper_sse2(__m128i x)
+{
+	__m128i t = _mm_add_epi8(x, _mm_set1_epi8((char)(0x80 - 'a')));
+	__m128i m = _mm_cmpgt_epi8(_mm_set1_epi8((char)(-128 + 26)), t);
+	return _mm_sub_epi8(x, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+}
+
+ICPU_TARGET("avx2")
+static inline __m256i imem_upper_avx2(__m256i x)
+{
+	__m256i t = _mm256_add_epi8(x, _mm256_set1_epi8((char)(0x80 - 'a')));
+	__m256i m = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 26)), t);
+	return _mm256_sub_epi8(x, _mm256_and_si256(m, _mm256_set1_epi8(0x20)));
+}
+
+ICPU_TARGET("sse2")
+static ilong imem_casediff_sse2(const unsigned char *a, 
+	const unsigned char *b, ilong size)
+{
+	ilong i;
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i x = imem_upper_sse2(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m128i y = imem_upper_sse2(_mm_loadu_si128((const __m128i*)(b + i)));
+		unsigned int mask = (unsigned int)
+			_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+		if (mask) return i + icpu_ctz(mask);
+	}
+	return i;
+}
+
+ICPU_TARGET("avx2")
+static ilong imem_casediff_avx2(const unsigned char *a, 
+	const unsigned char *b, ilong size)
+{
+	ilong i;
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		unsigned int mask;
+		x = imem_upper_avx2(x);
+		y = imem_upper_avx2(y);
+		mask = ~((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+		if (mask) return i + icpu_ctz(mask);
+	}
+	return i;
+}
+#endif
+
+/* first difference after case folding */
+ilong imem_casediff(const void *a, const void *b, ilong size)
+{
+	const unsigned char *x = (const unsigned char*)a;
+	const unsigned char *y = (const unsigned char*)b;
+	ilong i = 0;
+#ifdef ICPU_X86
+	if (size >= 16) {
+		int features = icpu_features();
+		if (features & ICPU_AVX2) {
+			i = imem_casediff_avx2(x, y, size);
+		}
+		if (features & ICPU_SSE2) {
+			i += imem_casediff_sse2(x + i, y + i, size - i);
+		}
+	}
+#endif
+	for (; i < size; i++) {
+		if (IMEM_UPPER(x[i]) != IMEM_UPPER(y[i])) break;
+	}
+	return i;
+}
+
+/* candidate at text is a full match */
+static inline int imem_verify(const unsigned char *text, 
+	const struct IMEMFINDER *f)
+{
+	if (f->incase == 0) 
+		return memcmp(text, f->needle, f->size) == 0;
+	return imem_casediff(text, f->needle, f->size) == f->size;
+}
+
+#ifdef ICPU_X86
+/* forward: blocks of candidates from *pos, a block is scanned only if 
+ * every candidate of it fits in the text */
+ICPU_TARGET("sse2")
+static ilong imem_scan_sse2(const unsigned char *text, ilong size, 
+	const struct IMEMFINDER *f, ilong *pos)
+{
+	__m128i c1 = _mm_set1_epi8((char)f->c1);
+	__m128i c2 = _mm_set1_epi8((char)f->c2);
+	ilong i = *pos;
+	for (; i + 15 + f->size <= size; i += 16) {
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(text + i + f->i1));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(text + i + f->i2));
+		unsigned int mask;
+		if (f->incase) {
+			x1 = imem_upper_sse2(x1);
+			x2 = imem_upper_sse2(x2);
+		}
+		mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(x1, c1), _mm_cmpeq_epi8(x2, c2)));
+		for (; mask; mask &= mask - 1) {
+			ilong k = i + icpu_ctz(mask);
+			if (imem_verify(text + k, f)) {
+				*pos = i;
+				return k;
+			}
+		}
+	}
+	*pos = i;
+	return -1;
+}
+
+ICPU_TARGET("avx2")
+static ilong imem_scan_avx2(const unsigned char *text, ilong size, 
+	const struct IMEMFINDER *f, ilong *pos)
+{
+	__m256i c1 = _mm256_set1_epi8((char)f->c1);
+	__m256i c2 = _mm256_set1_epi8((char)f->c2);
+	ilong i = *pos;
+	for (; i + 31 + f->size <= size; i += 32) {
+		__m256i x1 = _mm256_loadu_si256((const __m256i*)(text + i + f->i1));
+		__m256i x2 = _mm256_loadu_si256((const __m256i*)(text + i + f->i2));
+		unsigned int mask;
+		if (f->incase) {
+			x1 = imem_upper_avx2(x1);
+			x2 = imem_upper_avx2(x2);
+		}
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(x1, c1), _mm256_cmpeq_epi8(x2, c2)));
+		for (; mask; mask &= mask - 1) {
+			ilong k = i + icpu_ctz(mask);
+			if (imem_verify(text + k, f)) {
+				*pos = i;
+				return k;
+			}
+		}
+	}
+	*pos = i;
+	return -1;
+}
+
+/* reverse: *pos is the end of the remaining candidates, blocks below it
+ * are scanned highest candidate first */
+ICPU_TARGET("sse2")
+static ilong imem_rscan_sse2(const unsigned char *text,
+	const struct IMEMFINDER *f, ilong *pos)
+{
+	__m128i c1 = _mm_set1_epi8((char)f->c1);
+	__m128i c2 = _mm_set1_epi8((char)f->c2);
+	ilong i = *pos;
+	for (; i >= 16; i -= 16) {
+		const unsigned char *p = text + i - 16;
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(p + f->i1));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(p + f->i2));
+		unsigned int mask;
+		if (f->incase) {
+			x1 = imem_upper_sse2(x1);
+			x2 = imem_upper_sse2(x2);
+		}
+		mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(x1, c1), _mm_cmpeq_epi8(x2, c2)));
+		while (mask) {
+			int bit = 31 - icpu_clz(mask);
+			if (imem_verify(p + bit, f)) {
+				*pos = i;
+				return (ilong)(p - text) + bit;
+			}
+			mask &= ~(1u << bit);
+		}
+	}
+	*pos = i;
+	return -1;
+}
+
+ICPU_TARGET("avx2")
+static ilong imem_rscan_avx2(const unsigned char *text,
+	const struct IMEMFINDER *f, ilong *pos)
+{
+	__m256i c1 = _mm256_set1_epi8((char)f->c1);
+	__m256i c2 = _mm256_set1_epi8((char)f->c2);
+	ilong i = *pos;
+	for (; i >= 32; i -= 32) {
+		const unsigned char *p = text + i - 32;
+		__m256i x1 = _mm256_loadu_si256((const __m256i*)(p + f->i1));
+		__m256i x2 = _mm256_loadu_si256((const __m256i*)(p + f->i2));
+		unsigned int mask;
+		if (f->incase) {
+			x1 = imem_upper_avx2(x1);
+			x2 = imem_upper_avx2(x2);
+		}
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(x1, c1), _mm256_cmpeq_epi8(x2, c2)));
+		while (mask) {
+			int bit = 31 - icpu_clz(mask);
+			if (imem_verify(p + bit, f)) {
+				*pos = i;
+				return (ilong)(p - text) + bit;
+			}
+			mask &= ~(1u << bit);
+		}
+	}
+	*pos = i;
+	return -1;
+}
+#endif
+
+/* search with filter bytes set up */
+static ilong imem_search(const struct IMEMFINDER *f, 
+	const unsigned char *text, ilong size, int reverse)
+{
+	ilong count, pos, k;
+	int c1 = f->c1, c2 = f->c2;
+#ifdef ICPU_X86
+	int features = icpu_features();
+#endif
+
+	if (f->size == 0) return reverse? size : 0;
+	if (f->size > size) return -1;
+
+	count = size - f->size + 1;
+
+	if (reverse == 0) {
+		pos = 0;
+#ifdef ICPU_X86
+		if (features & ICPU_AVX2) {
+			k = imem_scan_avx2(text, size, f, &pos);
+			if (k >= 0) return k;
+		}
+		if (features & ICPU_SSE2) {
+			k = imem_scan_sse2(text, size, f, &pos);
+			if (k >= 0) return k;
+		}
+#endif
+		for (; pos < count; pos++) {
+			int x1, x2;
+			if (f->incase == 0) {
+				const unsigned char *p = (const unsigned char*)
+					memchr(text + pos + f->i1, c1, count - pos);
+				if (p == NULL) break;
+				pos = (ilong)(p - text) - f->i1;
+			}
+			x1 = text[pos + f->i1];
+			x2 = text[pos + f->i2];
+			if (f->incase) x1 = IMEM_UPPER(x1), x2 = IMEM_UPPER(x2);
+			if (x1 == c1 && x2 == c2 && imem_verify(text + pos, f)) 
+				return pos;
+		}
+	}
+	else {
+		pos = count;
+#ifdef ICPU_X86
+		if (features & ICPU_AVX2) {
+			k = imem_rscan_avx2(text, f, &pos);
+			if (k >= 0) return k;
+		}
+		if (features & ICPU_SSE2) {
+			k = imem_rscan_sse2(text, f, &pos);
+			if (k >= 0) return k;
+		}
+#endif
+		for (pos--; pos >= 0; pos--) {
+			int x1 = text[pos + f->i1];
+			int x2 = text[pos + f->i2];
+			if (f->incase) x1 = IMEM_UPPER(x1), x2 = IMEM_UPPER(x2);
+			if (x1 == c1 && x2 == c2 && imem_verify(text + pos, f)) 
+				return pos;
+		}
+	}
+
+	return -1;
+}
+
+/* filter on the first and the last byte */
+ilong imem_find(const void *text, ilong size, const void *needle,
+	ilong len, int incase, int reverse)
+{
+	const unsigned char *p = (const unsigned char*)needle;
+	struct IMEMFINDER f;
+	if (len <= 0) return reverse? size : 0;
+	if (len == 1 && incase == 0) {
+		const void *x;
+		if (reverse == 0) {
+			x = memchr(text, p[0], size);
+			return x? (ilong)((const char*)x - (const char*)text) : -1;
+		}
+	}
+	f.needle = p;
+	f.buffer = NULL;
+	f.size = len;
+	f.incase = incase;
+	f.i1 = 0;
+	f.i2 = len - 1;
+	f.c1 = incase? IMEM_UPPER(p[0]) : p[0];
+	f.c2 = incase? IMEM_UPPER(p[len - 1]) : p[len - 1];
+	return imem_search(&f, (const unsigned char*)text, size, reverse);
+}
+
+/* rough frequency class of a byte in text */
+static int imem_rank(int c)
+{
+	if (c == ' ' || c == 'e' || c == 't' || c == 'a' || c == 'o') return 4;
+	if (c >= 'a' && c <= 'z') return 3;
+	if (c == 0 || c == '\n' || (c >= '0' && c <= '9')) return 2;
+	if (c >= 'A' && c <= 'Z') return 2;
+	return 1;
+}
+
+/* preprocess needle */
+int imem_finder_init(struct IMEMFINDER *finder, const void *needle,
+	ilong size, int incase)
+{
+	const unsigned char *src = (const unsigned char*)needle;
+	unsigned char *buffer = NULL;
+	ilong i, i1 = 0, i2 = 0;
+	if (size < 0) size = 0;
+	if (size > 0) {
+		buffer = (unsigned char*)ikmem_malloc(size);
+		if (buffer == NULL) return -1;
+		for (i = 0; i < size; i++) {
+			buffer[i] = incase? (unsigned char)IMEM_UPPER(src[i]) : src[i];
+		}
+		for (i = 1; i < size; i++) {
+			if (imem_rank(buffer[i]) < imem_rank(buffer[i1])) i1 = i;
+		}
+		i2 = (i1 == size - 1)? 0 : size - 1;
+		for (i = size - 1; i >= 0; i--) {
+			int better = imem_rank(buffer[i]) < imem_rank(buffer[i2]);
+			if (i == i1) continue;
+			if (buffer[i2] == buffer[i1] && buffer[i] != buffer[i1]) 
+				better = 1;
+			else if (buffer[i] == buffer[i1] && buffer[i2] != buffer[i1])
+				better = 0;
+			if (better) i2 = i;
+		}
+	}
+	finder->needle = buffer;
+	finder->buffer = buffer;
+	finder->size = size;
+	finder->incase = incase;
+	finder->i1 = i1;
+	finder->i2 = i2;
+	finder->c1 = (size > 0)? buffer[i1] : 0;
+	finder->c2 = (size > 0)? buffer[i2] : 0;
+	return 0;
+}
+
+void imem_finder_destroy(struct IMEMFINDER *finder)
+{
+	if (finder->buffer) ikmem_free(finder->buffer);
+	finder->buffer = NULL;
+	finder->needle = NULL;
+	finder->size = 0;
+}
+
+/* search with a preprocessed needle */
+ilong imem_finder_find(const struct IMEMFINDER *finder, const void *text,
+	ilong size, int reverse)
+{
+	return imem_search(finder, (const unsigned char*)text, size, reverse);
+}
+
+
 /*====================================================================*/
 /* IVECTOR                                                            */
 /*====================================================================*/
@@ -469,6 +940,239 @@ const void* imnode_data_const(const struct IMEMNODE *mnode, ilong index)
 
 
 
+/*====================================================================*/
+/* IEPOCH                                                             */
+/*====================================================================*/
+struct IEPOCHITEM
+{
+	void *ptr;
+	void (*dtor)(void*);
+};
+
+static void iepoch_limbo_init(struct IEPOCHLIMBO *limbo)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		limbo->tag[i] = 0;
+		iv_init(&limbo->items[i], ikmem_allocator);
+	}
+	limbo->count = 0;
+}
+
+/* destroy items of one bucket */
+static void iepoch_limbo_flush(struct IEPOCHLIMBO *limbo, int index)
+{
+	struct IVECTOR *v = &limbo->items[index];
+	struct IEPOCHITEM *items = iv_entry(v, struct IEPOCHITEM);
+	size_t count = iv_obj_size(v, struct IEPOCHITEM), i;
+	for (i = 0; i < count; i++) {
+		if (items[i].dtor) items[i].dtor(items[i].ptr);
+		else ikmem_free(items[i].ptr);
+	}
+	limbo->count -= (ilong)count;
+	v->size = 0;
+}
+
+static void iepoch_limbo_destroy(struct IEPOCHLIMBO *limbo)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		iepoch_limbo_flush(limbo, i);
+		iv_destroy(&limbo->items[i]);
+	}
+}
+
+/* destroy buckets retired two epochs ago or earlier */
+static void iepoch_limbo_reclaim(struct IEPOCHLIMBO *limbo, iulong global)
+{
+	int i;
+	for (i = 0; i < 3 && limbo->count > 0; i++) {
+		if (iv_size(&limbo->items[i]) == 0) continue;
+		if (global - limbo->tag[i] >= 2) {
+			iepoch_limbo_flush(limbo, i);
+		}
+	}
+}
+
+/* add item retired in epoch: a bucket holding epoch - 3 or older is 
+ * safe to flush, a bucket with a newer tag (merging older items) keeps
+ * its tag, waiting longer for the older items is still safe */
+static int iepoch_limbo_push(struct IEPOCHLIMBO *limbo, iulong epoch,
+	const struct IEPOCHITEM *item)
+{
+	int index = (int)(epoch % 3);
+	struct IVECTOR *v = &limbo->items[index];
+	if (iv_size(v) == 0) {
+		limbo->tag[index] = epoch;
+	}
+	else if ((ilong)(epoch - limbo->tag[index]) >= 3) {
+		iepoch_limbo_flush(limbo, index);
+		limbo->tag[index] = epoch;
+	}
+	if (iv_obj_push(v, struct IEPOCHITEM, item) != 0) return -1;
+	limbo->count++;
+	return 0;
+}
+
+/* move items of src into dst */
+static void iepoch_limbo_merge(struct IEPOCHLIMBO *dst, 
+	struct IEPOCHLIMBO *src)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		struct IVECTOR *v = &src->items[i];
+		struct IEPOCHITEM *items = iv_entry(v, struct IEPOCHITEM);
+		size_t count = iv_obj_size(v, struct IEPOCHITEM), k;
+		for (k = 0; k < count; k++) {
+			/* no memory: leak the node, readers may still hold it */
+			iepoch_limbo_push(dst, src->tag[i], &items[k]);
+		}
+		src->count -= (ilong)count;
+		v->size = 0;
+	}
+}
+
+iepoch_t *iepoch_create(void)
+{
+	iepoch_t *ep = (iepoch_t*)ikmem_malloc(sizeof(iepoch_t));
+	if (ep == NULL) return NULL;
+	ep->global = 0;
+	ep->threads = NULL;
+	IMUTEX_INIT(&ep->lock);
+	iepoch_limbo_init(&ep->orphans);
+	return ep;
+}
+
+void iepoch_delete(iepoch_t *ep)
+{
+	assert(ep);
+	while (ep->threads) {
+		struct IEPOCHTHREAD *th = ep->threads;
+		ep->threads = th->next;
+		assert(th->nesting == 0);
+		iepoch_limbo_destroy(&th->limbo);
+		ikmem_free(th);
+	}
+	iepoch_limbo_destroy(&ep->orphans);
+	IMUTEX_DESTROY(&ep->lock);
+	ikmem_free(ep);
+}
+
+iepoch_thread_t *iepoch_register(iepoch_t *ep)
+{
+	struct IEPOCHTHREAD *th;
+	th = (struct IEPOCHTHREAD*)ikmem_malloc(sizeof(struct IEPOCHTHREAD));
+	if (th == NULL) return NULL;
+	th->local = 0;
+	th->nesting = 0;
+	th->epoch = ep;
+	th->threshold = IEPOCH_THRESHOLD;
+	iepoch_limbo_init(&th->limbo);
+	IMUTEX_LOCK(&ep->lock);
+	th->next = ep->threads;
+	ep->threads = th;
+	IMUTEX_UNLOCK(&ep->lock);
+	return th;
+}
+
+void iepoch_unregister(iepoch_thread_t *th)
+{
+	struct IEPOCH *ep = th->epoch;
+	struct IEPOCHTHREAD **link;
+	assert(th->nesting == 0);
+	iepoch_collect(th);
+	IMUTEX_LOCK(&ep->lock);
+	for (link = &ep->threads; *link; link = &(*link)->next) {
+		if (*link == th) {
+			*link = th->next;
+			break;
+		}
+	}
+	iepoch_limbo_merge(&ep->orphans, &th->limbo);
+	IMUTEX_UNLOCK(&ep->lock);
+	iepoch_limbo_destroy(&th->limbo);
+	ikmem_free(th);
+}
+
+void iepoch_enter(iepoch_thread_t *th)
+{
+	if (th->nesting++ == 0) {
+		ilong global = iatomic_get(&th->epoch->global);
+		/* full barrier: reads of shared nodes can't move above it */
+		iatomic_xchg(&th->local, global * 2 + 1);
+	}
+}
+
+void iepoch_exit(iepoch_thread_t *th)
+{
+	assert(th->nesting > 0);
+	if (--th->nesting == 0) {
+		iatomic_set(&th->local, 0);
+		if (th->limbo.count >= th->threshold) {
+			iepoch_collect(th);
+		}
+	}
+}
+
+void iepoch_quiescent(iepoch_thread_t *th)
+{
+	if (th->nesting > 0) {
+		ilong global = iatomic_get(&th->epoch->global);
+		if (iatomic_get(&th->local) != global * 2 + 1) {
+			iatomic_xchg(&th->local, global * 2 + 1);
+		}
+	}
+	if (th->limbo.count > 0) {
+		iepoch_collect(th);
+	}
+}
+
+int iepoch_retire(iepoch_thread_t *th, void *ptr, void (*dtor)(void*))
+{
+	struct IEPOCHITEM item;
+	iulong epoch;
+	if (ptr == NULL) return 0;
+	item.ptr = ptr;
+	item.dtor = dtor;
+	/* full barrier: the unlink is visible before the epoch is read */
+	epoch = (iulong)iatomic_add(&th->epoch->global, 0);
+	if (iepoch_limbo_push(&th->limbo, epoch, &item) != 0) {
+		return -1;
+	}
+	if (th->nesting == 0 && th->limbo.count >= th->threshold) {
+		iepoch_collect(th);
+	}
+	return 0;
+}
+
+ilong iepoch_collect(iepoch_thread_t *th)
+{
+	struct IEPOCH *ep = th->epoch;
+	struct IEPOCHTHREAD *it;
+	ilong global = iatomic_get(&ep->global);
+	int ready = 1;
+	IMUTEX_LOCK(&ep->lock);
+	for (it = ep->threads; it; it = it->next) {
+		ilong local = iatomic_get(&it->local);
+		if (local != 0 && local != global * 2 + 1) {
+			ready = 0;
+			break;
+		}
+	}
+	if (ready) {
+		iatomic_cas(&ep->global, global, global + 1);
+	}
+	global = iatomic_get(&ep->global);
+	if (ep->orphans.count > 0) {
+		iepoch_limbo_reclaim(&ep->orphans, (iulong)global);
+	}
+	IMUTEX_UNLOCK(&ep->lock);
+	iepoch_limbo_reclaim(&th->limbo, (iulong)global);
+	return th->limbo.count;
+}
+
+
+
 /*====================================================================*/
 /* IVECTOR / IMEMNODE MANAGEMENT                                      */
 /*====================================================================*/
@@ -1525,26 +2229,21 @@ int ib_string_find(const ib_string *str, const char *src, int len, int start)
 	int pos = (start < 0)? 0 : start;
 	int length = (len >= 0)? len : ((int)strlen(src));
 	int endup = str->size - length;
-	char ch;
+	ilong k;
 	if (length <= 0) return pos;
-	for (ch = src[0]; pos <= endup; pos++) {
-		if (text[pos] == ch) {
-			if (memcmp(text + pos, src, length) == 0)
-				return pos;
-		}
-	}
-	return -1;
+	if (pos > endup) return -1;
+	k = imem_find(text + pos, str->size - pos, src, length, 0, 0);
+	return (k >= 0)? pos + (int)k : -1;
 }
 
 int ib_string_find_c(const ib_string *str, char ch, int start)
 {
 	const char *text = str->ptr;
 	int pos = (start < 0)? 0 : start;
-	int endup = str->size;
-	for (; pos < endup; pos++) {
-		if (text[pos] == ch) return pos;
-	}
-	return -1;
+	const char *p;
+	if (pos >= str->size) return -1;
+	p = (const char*)memchr(text + pos, ch, str->size - pos);
+	return p? (int)(p - text) : -1;
 }
 
 ib_array* ib_string_split(const ib_string *str, const char *sep, int len)
@@ -131,6 +131,70 @@ typedef ISTDUINT32 IUINT32;
 #endif
 
 
+/*--------------------------------------------------------------------*/
+/* SIMD: ICPU_TARGET("avx2") compiles one function for an instruction */
+/* set, call it only when icpu_features() reports it                  */
+/*--------------------------------------------------------------------*/
+#ifndef ICPU_DISABLE
+#if (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define ICPU_X86 1
+#define ICPU_TARGET(x) __attribute__((target(x)))
+#elif defined(_MSC_VER) && (_MSC_VER >= 1800) && \
+	(defined(_M_X64) || defined(_M_IX86))
+#define ICPU_X86 1
+#define ICPU_TARGET(x)
+#endif
+#endif
+
+#define ICPU_SSE2       0x0001
+#define ICPU_SSSE3      0x0002
+#define ICPU_SSE41      0x0004
+#define ICPU_SSE42      0x0008
+#define ICPU_POPCNT     0x0010
+#define ICPU_AVX        0x0020
+#define ICPU_AVX2       0x0040
+#define ICPU_BMI2       0x0080
+#define ICPU_AES        0x0100
+#define ICPU_PCLMUL     0x0200
+#define ICPU_SHA        0x0400
+
+/* index of the lowest set bit of a movemask result, x must not be 0 */
+#if defined(__GNUC__) || defined(__clang__)
+#define icpu_ctz(x) __builtin_ctz(x)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static inline int icpu_ctz(unsigned int x) {
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return (int)index;
+}
+#else
+static inline int icpu_ctz(unsigned int x) {
+	int index = 0;
+	for (; (x & 1) == 0; x >>= 1) index++;
+	return index;
+}
+#endif
+
+/* number of leading zero bits, x must not be 0 */
+#if defined(__GNUC__) || defined(__clang__)
+#define icpu_clz(x) __builtin_clz(x)
+#elif defined(_MSC_VER)
+static inline int icpu_clz(unsigned int x) {
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return 31 - (int)index;
+}
+#else
+static inline int icpu_clz(unsigned int x) {
+	int index = 0;
+	for (; (x & 0x80000000u) == 0; x <<= 1) index++;
+	return index;
+}
+#endif
+
+
 /*====================================================================*/
 /* IULONG/ILONG (ensure sizeof(iulong) == sizeof(void*))              */
 /*====================================================================*/
@@ -140,6 +204,87 @@ typedef ptrdiff_t ilong;
 typedef size_t iulong;
 #endif
 
+
+/*====================================================================*/
+/* IATOMIC - word/pointer atomics: get acquires, set releases and     */
+/* read-modify-write operations are full barriers                     */
+/*====================================================================*/
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define IATOMIC_BARRIER() _ReadWriteBarrier()
+#endif
+
+static inline ilong iatomic_get(const volatile ilong *p) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+	ilong x = *p;
+	IATOMIC_BARRIER();
+	return x;
+#endif
+}
+
+static inline void iatomic_set(volatile ilong *p, ilong x) {
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_store_n(p, x, __ATOMIC_RELEASE);
+#else
+	IATOMIC_BARRIER();
+	*p = x;
+#endif
+}
+
+/* returns the new value */
+static inline ilong iatomic_add(volatile ilong *p, ilong x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_add_fetch(p, x, __ATOMIC_SEQ_CST);
+#elif defined(_WIN64)
+	return _InterlockedExchangeAdd64((volatile __int64*)p, x) + x;
+#else
+	return _InterlockedExchangeAdd((volatile long*)p, x) + x;
+#endif
+}
+
+/* returns the old value */
+static inline ilong iatomic_xchg(volatile ilong *p, ilong x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_exchange_n(p, x, __ATOMIC_SEQ_CST);
+#elif defined(_WIN64)
+	return _InterlockedExchange64((volatile __int64*)p, x);
+#else
+	return _InterlockedExchange((volatile long*)p, x);
+#endif
+}
+
+/* set to x if it equals cmp, returns the old value */
+static inline ilong iatomic_cas(volatile ilong *p, ilong cmp, ilong x) {
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_compare_exchange_n(p, &cmp, x, 0, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return cmp;
+#elif defined(_WIN64)
+	return _InterlockedCompareExchange64((volatile __int64*)p, x, cmp);
+#else
+	return _InterlockedCompareExchange((volatile long*)p, x, cmp);
+#endif
+}
+
+static inline void *iatomic_ptr_get(void * const volatile *p) {
+	return (void*)iatomic_get((const volatile ilong*)p);
+}
+
+static inline void iatomic_ptr_set(void * volatile *p, void *x) {
+	iatomic_set((volatile ilong*)p, (ilong)x);
+}
+
+static inline void *iatomic_ptr_xchg(void * volatile *p, void *x) {
+	return (void*)iatomic_xchg((volatile ilong*)p, (ilong)x);
+}
+
+static inline void *iatomic_ptr_cas(void * volatile *p, void *cmp, void *x) {
+	return (void*)iatomic_cas((volatile ilong*)p, (ilong)cmp, (ilong)x);
+}
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -171,6 +316,56 @@ void* ikmem_realloc(void *ptr, size_t size);
 void ikmem_free(void *ptr);
 
 
+/*====================================================================*/
+/* ICPU - runtime cpu features                                        */
+/*====================================================================*/
+
+/* returns ICPU_* bits supported by both cpu and os, cached */
+int icpu_features(void);
+
+/* restrict features reported by icpu_features (for testing) */
+void icpu_features_mask(int mask);
+
+
+/*====================================================================*/
+/* IMEMFIND - substring search                                        */
+/*====================================================================*/
+
+/* candidates are filtered by two needle bytes compared 16/32 at a time
+ * (sse2/avx2), survivors are verified. incase folds ascii letters. */
+struct IMEMFINDER
+{
+	const unsigned char *needle;
+	unsigned char *buffer;		/* owned copy for imem_finder_init */
+	ilong size;
+	ilong i1;					/* positions of the filter bytes */
+	ilong i2;
+	int c1;						/* filter bytes, upper case if incase */
+	int c2;
+	int incase;
+};
+
+/* offset of the first byte that differs in a and b after folding ascii
+ * letters to upper case, returns size if they are equal */
+ilong imem_casediff(const void *a, const void *b, ilong size);
+
+/* find needle in text, reverse returns the last match. returns offset
+ * or -1, an empty needle matches at 0 (or at size when reverse) */
+ilong imem_find(const void *text, ilong size, const void *needle,
+	ilong len, int incase, int reverse);
+
+/* preprocess a needle for repeated searches: it is copied, and the two
+ * least common bytes are picked as filter, returns 0 for success */
+int imem_finder_init(struct IMEMFINDER *finder, const void *needle,
+	ilong size, int incase);
+
+void imem_finder_destroy(struct IMEMFINDER *finder);
+
+/* search with a preprocessed needle, same result as imem_find */
+ilong imem_finder_find(const struct IMEMFINDER *finder, const void *text,
+	ilong size, int reverse);
+
+
 /*====================================================================*/
 /* IVECTOR                                                            */
 /*====================================================================*/
@@ -421,6 +616,133 @@ typedef struct ILISTHEAD ilist_head;
 #endif
 
 
+/*====================================================================*/
+/* IRWLOCK - reader-writer lock interfaces                            */
+/*====================================================================*/
+#ifndef IRWLOCK_TYPE
+
+#ifndef IMUTEX_DISABLE
+#if (defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64))
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0600)
+#define IRWLOCK_TYPE        SRWLOCK
+#define IRWLOCK_INIT(m)     InitializeSRWLock((SRWLOCK*)(m))
+#define IRWLOCK_DESTROY(m)  { (*(m)) = (*(m)); }
+#define IRWLOCK_RDLOCK(m)   AcquireSRWLockShared((SRWLOCK*)(m))
+#define IRWLOCK_RDUNLOCK(m) ReleaseSRWLockShared((SRWLOCK*)(m))
+#define IRWLOCK_WRLOCK(m)   AcquireSRWLockExclusive((SRWLOCK*)(m))
+#define IRWLOCK_WRUNLOCK(m) ReleaseSRWLockExclusive((SRWLOCK*)(m))
+#else
+/* no slim rwlock before vista: readers are exclusive too */
+#define IRWLOCK_TYPE        IMUTEX_TYPE
+#define IRWLOCK_INIT(m)     IMUTEX_INIT(m)
+#define IRWLOCK_DESTROY(m)  IMUTEX_DESTROY(m)
+#define IRWLOCK_RDLOCK(m)   IMUTEX_LOCK(m)
+#define IRWLOCK_RDUNLOCK(m) IMUTEX_UNLOCK(m)
+#define IRWLOCK_WRLOCK(m)   IMUTEX_LOCK(m)
+#define IRWLOCK_WRUNLOCK(m) IMUTEX_UNLOCK(m)
+#endif
+
+#elif defined(__unix) || defined(__unix__) || defined(__MACH__)
+#define IRWLOCK_TYPE        pthread_rwlock_t
+#define IRWLOCK_INIT(m)     pthread_rwlock_init((pthread_rwlock_t*)(m), 0)
+#define IRWLOCK_DESTROY(m)  pthread_rwlock_destroy((pthread_rwlock_t*)(m))
+#define IRWLOCK_RDLOCK(m)   pthread_rwlock_rdlock((pthread_rwlock_t*)(m))
+#define IRWLOCK_RDUNLOCK(m) pthread_rwlock_unlock((pthread_rwlock_t*)(m))
+#define IRWLOCK_WRLOCK(m)   pthread_rwlock_wrlock((pthread_rwlock_t*)(m))
+#define IRWLOCK_WRUNLOCK(m) pthread_rwlock_unlock((pthread_rwlock_t*)(m))
+#endif
+#endif
+
+#ifndef IRWLOCK_TYPE
+#define IRWLOCK_TYPE        int
+#define IRWLOCK_INIT(m)     { (*(m)) = (*(m)); }
+#define IRWLOCK_DESTROY(m)  { (*(m)) = (*(m)); }
+#define IRWLOCK_RDLOCK(m)   { (*(m)) = (*(m)); }
+#define IRWLOCK_RDUNLOCK(m) { (*(m)) = (*(m)); }
+#define IRWLOCK_WRLOCK(m)   { (*(m)) = (*(m)); }
+#define IRWLOCK_WRUNLOCK(m) { (*(m)) = (*(m)); }
+#endif
+
+#endif
+
+
+/*====================================================================*/
+/* IEPOCH - epoch based memory reclamation for lock-free readers      */
+/*                                                                    */
+/* readers access shared nodes between iepoch_enter / iepoch_exit,    */
+/* writers unlink a node first and hand it to iepoch_retire, it is    */
+/* destroyed (ikmem_free by default) once every thread has left the   */
+/* epochs that could still see it. event loops may stay inside for    */
+/* good (QSBR) and call iepoch_quiescent between events instead, that */
+/* costs nothing per read. leave before blocking, or the epoch stalls */
+/* and retired memory grows.                                          */
+/*====================================================================*/
+struct IEPOCHLIMBO
+{
+	iulong tag[3];					/* epoch of each bucket */
+	struct IVECTOR items[3];		/* retired (ptr, dtor), epoch % 3 */
+	ilong count;					/* items in buckets */
+};
+
+struct IEPOCHTHREAD
+{
+	volatile ilong local;			/* epoch * 2 + 1 when inside, or 0 */
+	ilong nesting;					/* enter depth */
+	struct IEPOCH *epoch;
+	struct IEPOCHTHREAD *next;
+	struct IEPOCHLIMBO limbo;
+	ilong threshold;				/* collect when count reaches it */
+	char pad[64];					/* keep local off others' lines */
+};
+
+struct IEPOCH
+{
+	volatile ilong global;			/* current epoch */
+	char pad[64];
+	IMUTEX_TYPE lock;				/* threads list and orphans */
+	struct IEPOCHTHREAD *threads;
+	struct IEPOCHLIMBO orphans;		/* left by unregistered threads */
+};
+
+typedef struct IEPOCH iepoch_t;
+typedef struct IEPOCHTHREAD iepoch_thread_t;
+
+#define IEPOCH_THRESHOLD	64
+
+/* create reclamation domain */
+iepoch_t *iepoch_create(void);
+
+/* delete domain and destroy everything retired: no thread may be 
+ * inside, registered threads are released */
+void iepoch_delete(iepoch_t *ep);
+
+/* register the calling thread, every thread uses its own record */
+iepoch_thread_t *iepoch_register(iepoch_t *ep);
+
+/* unregister: retired nodes not yet safe are passed to the domain */
+void iepoch_unregister(iepoch_thread_t *th);
+
+/* enter critical section (nestable): shared nodes read after this 
+ * stay valid until the matching exit */
+void iepoch_enter(iepoch_thread_t *th);
+
+/* exit critical section */
+void iepoch_exit(iepoch_thread_t *th);
+
+/* quiescent state: the thread holds no shared node now, it stays 
+ * inside (QSBR), call it once per event loop iteration */
+void iepoch_quiescent(iepoch_thread_t *th);
+
+/* defer destroying an unlinked node: dtor(ptr) or ikmem_free(ptr) if
+ * dtor is NULL, may be called inside or outside critical sections.
+ * returns 0 for ok, -1 for no memory (the node is not retired) */
+int iepoch_retire(iepoch_thread_t *th, void *ptr, void (*dtor)(void*));
+
+/* try to advance the epoch and destroy safe nodes, returns how many
+ * nodes are still waiting in this thread */
+ilong iepoch_collect(iepoch_thread_t *th);
+
+
 
 /*====================================================================*/
 /* IVECTOR / IMEMNODE MANAGEMENT                                      */
@@ -21,6 +21,10 @@
 #include <ctype.h>
 #include <assert.h>
 
+#ifdef ICPU_X86
+#include <immintrin.h>
+#endif
+
 /**********************************************************************
  * Dictionary Basic Interface
  **********************************************************************/
@@ -80,12 +84,32 @@ void idict_delete(idict_t *dict)
 	ikmem_free(dict);
 }
 
+/* search pair in the bucket only, reads nothing but the table */
+static inline idictentry_t *_idict_find(const idict_t *dict, 
+	const ivalue_t *key)
+{
+	const struct IDICTBUCKET *bucket;
+	const ilist_head *head, *p;
+	idictentry_t *entry;
+	iulong hash1 = key->hash;
+
+	bucket = &dict->table[hash1 & dict->mask];
+	head = &bucket->head;
+
+	for (p = head->next; p != head; p = p->next) {
+		entry = ilist_entry(p, idictentry_t, queue);
+		if (entry->key.hash != hash1) continue;
+		if (it_cmp(&entry->key, key) == 0) 
+			return entry;
+	}
+
+	return NULL;
+}
+
 /* search pair */
 static inline idictentry_t *_idict_search(idict_t *dict, const ivalue_t *key)
 {
 	idictentry_t *recent, *entry;
-	struct IDICTBUCKET *bucket;
-	ilist_head *head, *p;
 	iulong hash1;
 	iulong hash2;
 
@@ -100,19 +124,10 @@ static inline idictentry_t *_idict_search(idict_t *dict, const ivalue_t *key)
 		}
 	}
 
-	bucket = &dict->table[hash1 & dict->mask];
-	head = &bucket->head;
-
-	for (p = head->next; p != head; p = p->next) {
-		entry = ilist_entry(p, idictentry_t, queue);
-		if (entry->key.hash != hash1) continue;
-		if (it_cmp(&entry->key, key) == 0) {
-			dict->lru[hash2] = entry;
-			return entry;
-		}
-	}
+	entry = _idict_find(dict, key);
+	if (entry) dict->lru[hash2] = entry;
 
-	return NULL;
+	return entry;
 }
 
 /* reference value and recalculate hash */
@@ -625,6 +640,287 @@ int idict_del_i(idict_t *dict, ilong key)
 }
 
 
+/**********************************************************************
+ * ICDICT: thread-safe dictionary, lock striping over idict_t
+ **********************************************************************/
+
+/* create */
+icdict_t *icdict_create(int shift)
+{
+	icdict_t *cd;
+	ilong count, i;
+	char *p;
+	if (shift < 0) shift = 6;
+	if (shift > 16) shift = 16;
+	count = (ilong)1 << shift;
+	cd = (icdict_t*)ikmem_malloc(sizeof(icdict_t));
+	if (cd == NULL) return NULL;
+	cd->buffer = ikmem_malloc(sizeof(struct ICDICTSTRIPE) * count + 
+			ICDICT_CACHELINE);
+	if (cd->buffer == NULL) {
+		ikmem_free(cd);
+		return NULL;
+	}
+	p = (char*)cd->buffer;
+	p += (ICDICT_CACHELINE - ((size_t)p & (ICDICT_CACHELINE - 1))) & 
+		(ICDICT_CACHELINE - 1);
+	cd->stripes = (struct ICDICTSTRIPE*)p;
+	cd->shift = shift;
+	for (i = 0; i < count; i++) {
+		IRWLOCK_INIT(&cd->stripes[i].lock);
+		cd->stripes[i].dict = idict_create();
+		if (cd->stripes[i].dict == NULL) {
+			IRWLOCK_DESTROY(&cd->stripes[i].lock);
+			for (; i > 0; i--) {
+				idict_delete(cd->stripes[i - 1].dict);
+				IRWLOCK_DESTROY(&cd->stripes[i - 1].lock);
+			}
+			ikmem_free(cd->buffer);
+			ikmem_free(cd);
+			return NULL;
+		}
+	}
+	return cd;
+}
+
+/* delete */
+void icdict_delete(icdict_t *cd)
+{
+	ilong count = (ilong)1 << cd->shift, i;
+	assert(cd);
+	for (i = 0; i < count; i++) {
+		idict_delete(cd->stripes[i].dict);
+		IRWLOCK_DESTROY(&cd->stripes[i].lock);
+	}
+	ikmem_free(cd->buffer);
+	ikmem_free(cd);
+}
+
+/* reference key with a mixed hash and return its stripe: the top 
+ * bits of the mixed hash select the stripe and the low bits select 
+ * the bucket inside it, stripe dicts store the mixed hash. with the 
+ * raw hash (int keys hash to themselves) both would be correlated and 
+ * keys of a stripe would crowd into part of its buckets */
+static inline struct ICDICTSTRIPE *_icdict_key(icdict_t *cd, 
+	ivalue_t *dst, const ivalue_t *key)
+{
+	IUINT32 h;
+	_idict_refval(dst, key);
+	h = (IUINT32)(dst->hash ^ ((dst->hash >> 16) >> 16));
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	dst->hash = (iulong)h;
+	if (cd->shift == 0) return cd->stripes;
+	return &cd->stripes[h >> (32 - cd->shift)];
+}
+
+/* search and copy value */
+int icdict_search(icdict_t *cd, const ivalue_t *key, ivalue_t *val)
+{
+	struct ICDICTSTRIPE *stripe;
+	idictentry_t *entry;
+	ivalue_t kk;
+	stripe = _icdict_key(cd, &kk, key);
+	IRWLOCK_RDLOCK(&stripe->lock);
+	entry = _idict_find(stripe->dict, &kk);
+	if (entry && val) {
+		it_cpy(val, &entry->val);
+	}
+	IRWLOCK_RDUNLOCK(&stripe->lock);
+	return (entry == NULL)? -1 : 0;
+}
+
+/* search an int or ptr value: read it under the lock without it_cpy, 
+ * returns 0 for ok, -1 for not found, 1 for another value type */
+static int _icdict_search_scalar(icdict_t *cd, const ivalue_t *key, 
+	int type, ivalue_t *val)
+{
+	struct ICDICTSTRIPE *stripe;
+	idictentry_t *entry;
+	ivalue_t kk;
+	int hr = -1;
+	stripe = _icdict_key(cd, &kk, key);
+	IRWLOCK_RDLOCK(&stripe->lock);
+	entry = _idict_find(stripe->dict, &kk);
+	if (entry) {
+		hr = (it_type(&entry->val) == type)? 0 : 1;
+		if (hr == 0) val[0] = entry->val;
+	}
+	IRWLOCK_RDUNLOCK(&stripe->lock);
+	return hr;
+}
+
+/* add or update (key, val) */
+static int _icdict_update(icdict_t *cd, const ivalue_t *key, 
+	const ivalue_t *val, int isupdate)
+{
+	struct ICDICTSTRIPE *stripe;
+	ivalue_t kk;
+	ilong hr;
+	stripe = _icdict_key(cd, &kk, key);
+	IRWLOCK_WRLOCK(&stripe->lock);
+	hr = _idict_update(stripe->dict, &kk, val, isupdate);
+	IRWLOCK_WRUNLOCK(&stripe->lock);
+	return (hr < 0)? (int)hr : 0;
+}
+
+/* add (key, val) pair */
+int icdict_add(icdict_t *cd, const ivalue_t *key, const ivalue_t *val)
+{
+	return _icdict_update(cd, key, val, 0);
+}
+
+/* add or update (key, val) pair */
+int icdict_update(icdict_t *cd, const ivalue_t *key, const ivalue_t *val)
+{
+	return _icdict_update(cd, key, val, 1);
+}
+
+/* delete pair */
+int icdict_del(icdict_t *cd, const ivalue_t *key)
+{
+	struct ICDICTSTRIPE *stripe;
+	idictentry_t *entry;
+	ivalue_t kk;
+	stripe = _icdict_key(cd, &kk, key);
+	IRWLOCK_WRLOCK(&stripe->lock);
+	entry = _idict_search(stripe->dict, &kk);
+	if (entry) _idict_del(stripe->dict, entry);
+	IRWLOCK_WRUNLOCK(&stripe->lock);
+	return (entry == NULL)? -1 : 0;
+}
+
+/* how many entries */
+ilong icdict_size(icdict_t *cd)
+{
+	ilong count = (ilong)1 << cd->shift, size = 0, i;
+	for (i = 0; i < count; i++) {
+		struct ICDICTSTRIPE *stripe = &cd->stripes[i];
+		IRWLOCK_RDLOCK(&stripe->lock);
+		size += stripe->dict->size;
+		IRWLOCK_RDUNLOCK(&stripe->lock);
+	}
+	return size;
+}
+
+/* clear dictionary */
+void icdict_clear(icdict_t *cd)
+{
+	ilong count = (ilong)1 << cd->shift, i;
+	for (i = 0; i < count; i++) {
+		struct ICDICTSTRIPE *stripe = &cd->stripes[i];
+		IRWLOCK_WRLOCK(&stripe->lock);
+		idict_clear(stripe->dict);
+		IRWLOCK_WRUNLOCK(&stripe->lock);
+	}
+}
+
+/* search: key(str) val(int) */
+int icdict_search_si(icdict_t *cd, const char *key, ilong keysize, 
+	ilong *val)
+{
+	ivalue_t kk, vv;
+	int hr;
+	it_strref(&kk, key, keysize);
+	hr = _icdict_search_scalar(cd, &kk, ITYPE_INT, &vv);
+	if (hr == 0 && val) val[0] = it_int(&vv);
+	return hr;
+}
+
+/* search: key(int) val(int) */
+int icdict_search_ii(icdict_t *cd, ilong key, ilong *val)
+{
+	ivalue_t kk, vv;
+	int hr;
+	it_init_int(&kk, key);
+	hr = _icdict_search_scalar(cd, &kk, ITYPE_INT, &vv);
+	if (hr == 0 && val) val[0] = it_int(&vv);
+	return hr;
+}
+
+/* search: key(str) val(ptr) */
+int icdict_search_sp(icdict_t *cd, const char *key, ilong keysize, 
+	void **ptr)
+{
+	ivalue_t kk, vv;
+	int hr;
+	it_strref(&kk, key, keysize);
+	if (ptr) ptr[0] = NULL;
+	hr = _icdict_search_scalar(cd, &kk, ITYPE_PTR, &vv);
+	if (hr == 0 && ptr) ptr[0] = it_ptr(&vv);
+	return hr;
+}
+
+/* search: key(int) val(ptr) */
+int icdict_search_ip(icdict_t *cd, ilong key, void **ptr)
+{
+	ivalue_t kk, vv;
+	int hr;
+	it_init_int(&kk, key);
+	if (ptr) ptr[0] = NULL;
+	hr = _icdict_search_scalar(cd, &kk, ITYPE_PTR, &vv);
+	if (hr == 0 && ptr) ptr[0] = it_ptr(&vv);
+	return hr;
+}
+
+/* update: key(str) val(int) */
+int icdict_update_si(icdict_t *cd, const char *key, ilong keysize, 
+	ilong val)
+{
+	ivalue_t kk, vv;
+	it_strref(&kk, key, keysize);
+	it_init_int(&vv, val);
+	return icdict_update(cd, &kk, &vv);
+}
+
+/* update: key(int) val(int) */
+int icdict_update_ii(icdict_t *cd, ilong key, ilong val)
+{
+	ivalue_t kk, vv;
+	it_init_int(&kk, key);
+	it_init_int(&vv, val);
+	return icdict_update(cd, &kk, &vv);
+}
+
+/* update: key(str) val(ptr) */
+int icdict_update_sp(icdict_t *cd, const char *key, ilong keysize, 
+	const void *ptr)
+{
+	ivalue_t kk, vv;
+	it_strref(&kk, key, keysize);
+	it_init_ptr(&vv, ptr);
+	return icdict_update(cd, &kk, &vv);
+}
+
+/* update: key(int) val(ptr) */
+int icdict_update_ip(icdict_t *cd, ilong key, const void *ptr)
+{
+	ivalue_t kk, vv;
+	it_init_int(&kk, key);
+	it_init_ptr(&vv, ptr);
+	return icdict_update(cd, &kk, &vv);
+}
+
+/* delete: key(str) */
+int icdict_del_s(icdict_t *cd, const char *key, ilong keysize)
+{
+	ivalue_t kk;
+	it_strref(&kk, key, keysize);
+	return icdict_del(cd, &kk);
+}
+
+/* delete: key(int) */
+int icdict_del_i(icdict_t *cd, ilong key)
+{
+	ivalue_t kk;
+	it_init_int(&kk, key);
+	return icdict_del(cd, &kk);
+}
+
+
 
 /**********************************************************************
  * IRING: Ring FIFO
@@ -864,6 +1160,177 @@ ilong iring_ptr(struct IRING *ring, char **p1, ilong *s1, char **p2,
 
 
 
+/**********************************************************************
+ * ISPSC: lock-free single producer / single consumer ring
+ **********************************************************************/
+
+/* reset positions */
+void ispsc_ctrl_init(struct ISPSC_CTRL *ctrl)
+{
+	memset(ctrl, 0, sizeof(struct ISPSC_CTRL));
+}
+
+/* init with external positions */
+int ispsc_attach(struct ISPSC *ring, struct ISPSC_CTRL *ctrl, 
+	void *buffer, ilong size)
+{
+	if (size <= 0 || (size & (size - 1)) != 0) return -1;
+	ring->ctrl = ctrl;
+	ring->data = (char*)buffer;
+	ring->size = size;
+	ring->mask = size - 1;
+	return 0;
+}
+
+/* init with internal positions */
+int ispsc_init(struct ISPSC *ring, void *buffer, ilong size)
+{
+	ispsc_ctrl_init(&ring->local);
+	return ispsc_attach(ring, &ring->local, buffer, size);
+}
+
+/* producer: free size, re-read tail if less than need is cached */
+static inline ilong ispsc_free(struct ISPSC *ring, ilong need)
+{
+	struct ISPSC_CTRL *ctrl = ring->ctrl;
+	iulong head = (iulong)ctrl->head;
+	ilong size = ring->size - (ilong)(head - (iulong)ctrl->tail_cache);
+	if (size < need) {
+		ctrl->tail_cache = iatomic_get(&ctrl->tail);
+		size = ring->size - (ilong)(head - (iulong)ctrl->tail_cache);
+	}
+	return size;
+}
+
+/* consumer: data size, re-read head if less than need is cached */
+static inline ilong ispsc_used(struct ISPSC *ring, ilong need)
+{
+	struct ISPSC_CTRL *ctrl = ring->ctrl;
+	iulong tail = (iulong)ctrl->tail;
+	ilong size = (ilong)((iulong)ctrl->head_cache - tail);
+	if (size < need) {
+		ctrl->head_cache = iatomic_get(&ctrl->head);
+		size = (ilong)((iulong)ctrl->head_cache - tail);
+	}
+	return size;
+}
+
+/* producer: free size */
+ilong ispsc_fsize(struct ISPSC *ring)
+{
+	return ispsc_free(ring, ring->size);
+}
+
+/* producer: reserve segments */
+ilong ispsc_reserve(struct ISPSC *ring, ilong need, char **p1, ilong *s1,
+	char **p2, ilong *s2)
+{
+	ilong size = ispsc_free(ring, need);
+	ilong pos = ring->ctrl->head & ring->mask;
+	ilong half = ring->size - pos;
+	p1[0] = ring->data + pos;
+	if (size <= half) {
+		s1[0] = size;
+		p2[0] = NULL;
+		s2[0] = 0;
+	}	else {
+		s1[0] = half;
+		p2[0] = ring->data;
+		s2[0] = size - half;
+	}
+	return size;
+}
+
+/* producer: publish */
+void ispsc_commit(struct ISPSC *ring, ilong size)
+{
+	struct ISPSC_CTRL *ctrl = ring->ctrl;
+	iatomic_set(&ctrl->head, (ilong)((iulong)ctrl->head + (iulong)size));
+}
+
+/* producer: write */
+ilong ispsc_write(struct ISPSC *ring, const void *data, ilong size)
+{
+	const char *lptr = (const char*)data;
+	char *p1, *p2;
+	ilong s1, s2, canw;
+	canw = ispsc_reserve(ring, size, &p1, &s1, &p2, &s2);
+	if (canw <= 0) return 0;
+	size = (size < canw)? size : canw;
+	if (size <= s1) {
+		memcpy(p1, lptr, (size_t)size);
+	}	else {
+		memcpy(p1, lptr, (size_t)s1);
+		memcpy(p2, lptr + s1, (size_t)(size - s1));
+	}
+	ispsc_commit(ring, size);
+	return size;
+}
+
+/* consumer: data size */
+ilong ispsc_dsize(struct ISPSC *ring)
+{
+	return ispsc_used(ring, 1);
+}
+
+/* consumer: data segments */
+ilong ispsc_ptr(struct ISPSC *ring, char **p1, ilong *s1, char **p2, 
+	ilong *s2)
+{
+	ilong size = ispsc_used(ring, ring->size);
+	ilong pos = ring->ctrl->tail & ring->mask;
+	ilong half = ring->size - pos;
+	p1[0] = ring->data + pos;
+	if (size <= half) {
+		s1[0] = size;
+		p2[0] = NULL;
+		s2[0] = 0;
+	}	else {
+		s1[0] = half;
+		p2[0] = ring->data;
+		s2[0] = size - half;
+	}
+	return size;
+}
+
+/* consumer: release */
+void ispsc_drop(struct ISPSC *ring, ilong size)
+{
+	struct ISPSC_CTRL *ctrl = ring->ctrl;
+	iatomic_set(&ctrl->tail, (ilong)((iulong)ctrl->tail + (iulong)size));
+}
+
+/* consumer: peek */
+ilong ispsc_peek(struct ISPSC *ring, void *data, ilong size)
+{
+	char *lptr = (char*)data;
+	ilong dsize, pos, half;
+	dsize = ispsc_used(ring, size);
+	if (dsize <= 0) return 0;
+	size = (size < dsize)? size : dsize;
+	pos = ring->ctrl->tail & ring->mask;
+	half = ring->size - pos;
+	if (half >= size) {
+		memcpy(lptr, ring->data + pos, (size_t)size);
+	}	else {
+		memcpy(lptr, ring->data + pos, (size_t)half);
+		memcpy(lptr + half, ring->data, (size_t)(size - half));
+	}
+	return size;
+}
+
+/* consumer: read */
+ilong ispsc_read(struct ISPSC *ring, void *data, ilong size)
+{
+	ilong nsize = ispsc_peek(ring, data, size);
+	if (nsize > 0) {
+		ispsc_drop(ring, nsize);
+	}
+	return nsize;
+}
+
+
+
 /**********************************************************************
  * IMSTREAM: Memory FIFO
  **********************************************************************/
@@ -872,10 +1339,15 @@ struct IMSPAGE
 	struct ILISTHEAD head;
 	iulong size;
 	iulong index;
-	IUINT8 data[2];
+	iulong capacity;
+	IUINT8 *data;
+	struct IMSREF *ref;
+	IUINT8 buffer[2];
 };
 
 #define IMSPAGE_LRU_SIZE	2
+#define IMSPAGE_SMALL		64
+#define IMSPAGE_EXTERN		((iulong)0xfffffffeul)
 
 /* init memory stream */
 void ims_init(struct IMSTREAM *s, ib_memnode *fnode, ilong low, ilong high)
@@ -923,6 +1395,9 @@ static struct IMSPAGE *ims_page_new(struct IMSTREAM *s)
 		page->size = newsize - sizeof(struct IMSPAGE);
 	}
 
+	page->capacity = page->size;
+	page->data = page->buffer;
+	page->ref = NULL;
 	ilist_init(&page->head);
 
 	return page;
@@ -931,7 +1406,11 @@ static struct IMSPAGE *ims_page_new(struct IMSTREAM *s)
 /* free page into kmem-system or IMEMNODE */
 static void ims_page_del(struct IMSTREAM *s, struct IMSPAGE *page)
 {
-	if (s->fixed_pages != NULL) {
+	if (page->index == IMSPAGE_EXTERN) {
+		if (page->ref) ims_ref_dec(page->ref);
+		ikmem_free(page);
+	}
+	else if (s->fixed_pages != NULL) {
 		assert(page->index != (iulong)0xfffffffful);
 		imnode_del(s->fixed_pages, page->index);
 	}	else {
@@ -990,6 +1469,11 @@ static struct IMSPAGE *ims_page_cache_get(struct IMSTREAM *s)
 /* give page back to lru cache */
 static void ims_page_cache_release(struct IMSTREAM *s, struct IMSPAGE *page)
 {
+	if (page->index == IMSPAGE_EXTERN) {
+		ims_page_del(s, page);
+		return;
+	}
+	page->size = page->capacity;
 	ilist_add_tail(&page->head, &s->lru);
 	s->lrusize++;
 	for (; s->lrusize > (IMSPAGE_LRU_SIZE << 1); ) {
@@ -1000,6 +1484,22 @@ static void ims_page_cache_release(struct IMSTREAM *s, struct IMSPAGE *page)
 	}
 }
 
+/* small page for the few bytes written between two referenced pages */
+static struct IMSPAGE *ims_page_small(struct IMSTREAM *s)
+{
+	struct IMSPAGE *page;
+	page = (struct IMSPAGE*)ikmem_malloc(sizeof(struct IMSPAGE) + 
+			IMSPAGE_SMALL);
+	if (page == NULL) return ims_page_cache_get(s);
+	page->index = IMSPAGE_EXTERN;
+	page->size = IMSPAGE_SMALL;
+	page->capacity = IMSPAGE_SMALL;
+	page->data = page->buffer;
+	page->ref = NULL;
+	ilist_init(&page->head);
+	return page;
+}
+
 /* get data size */
 ilong ims_dsize(const struct IMSTREAM *s)
 {
@@ -1027,7 +1527,10 @@ ilong ims_write(struct IMSTREAM *s, const void *ptr, ilong size)
 			canwrite = current->size - s->pos_write;
 		}
 		if (canwrite == 0) {
-			current = ims_page_cache_get(s);
+			if (current && current->ref && size <= IMSPAGE_SMALL) 
+				current = ims_page_small(s);
+			else
+				current = ims_page_cache_get(s);
 			assert(current);
 			ilist_add_tail(&current->head, &s->head);
 			s->pos_write = 0;
@@ -1110,19 +1613,53 @@ ilong ims_drop(struct IMSTREAM *s, ilong size)
 	return ims_read_sub(s, NULL, size, 0);
 }
 
-/* clear stream */
-void ims_clear(struct IMSTREAM *s)
-{
-	assert(s);
-	ims_drop(s, s->size);
-}
-
-/* get flat ptr and size */
-ilong ims_flat(const struct IMSTREAM *s, void **pointer)
+/* overwrite data at offset from the read position */
+ilong ims_poke(struct IMSTREAM *s, ilong pos, const void *ptr, ilong size)
 {
+	const IUINT8 *lptr = (const IUINT8*)ptr;
+	struct ILISTHEAD *head;
 	struct IMSPAGE *current;
-	if (s->size == 0) {
-		if (pointer) pointer[0] = NULL;
+	ilong total, canwrite;
+
+	assert(s && ptr);
+
+	if (pos < 0 || size <= 0 || pos >= (ilong)s->size) return 0;
+	if (size > (ilong)s->size - pos) size = (ilong)s->size - pos;
+
+	pos += s->pos_read;
+	head = s->head.next;
+
+	for (total = 0; size > 0 && head != &s->head; head = head->next) {
+		current = ilist_entry(head, struct IMSPAGE, head);
+		if (pos >= (ilong)current->size) {
+			pos -= current->size;
+			continue;
+		}
+		canwrite = current->size - pos;
+		canwrite = (size <= canwrite)? size : canwrite;
+		memcpy(current->data + pos, lptr, canwrite);
+		lptr += canwrite;
+		size -= canwrite;
+		total += canwrite;
+		pos = 0;
+	}
+
+	return total;
+}
+
+/* clear stream */
+void ims_clear(struct IMSTREAM *s)
+{
+	assert(s);
+	ims_drop(s, s->size);
+}
+
+/* get flat ptr and size */
+ilong ims_flat(const struct IMSTREAM *s, void **pointer)
+{
+	struct IMSPAGE *current;
+	if (s->size == 0) {
+		if (pointer) pointer[0] = NULL;
 		return 0;
 	}
 	current = ilist_entry(s->head.next, struct IMSPAGE, head);
@@ -1134,6 +1671,104 @@ ilong ims_flat(const struct IMSTREAM *s, void **pointer)
 	return s->pos_write - s->pos_read;
 }
 
+/* get ptr and size of up to count pages */
+int ims_iovec(const struct IMSTREAM *s, void *vecptr[], long veclen[],
+	int count)
+{
+	const struct ILISTHEAD *head;
+	struct IMSPAGE *current;
+	iulong pos = s->pos_read;
+	int n = 0;
+	if (s->size == 0) return 0;
+	for (head = s->head.next; head != &s->head && n < count; ) {
+		current = ilist_entry(head, struct IMSPAGE, head);
+		head = head->next;
+		vecptr[n] = current->data + pos;
+		if (head != &s->head) veclen[n] = (long)(current->size - pos);
+		else veclen[n] = (long)(s->pos_write - pos);
+		if (veclen[n] > 0) n++;
+		pos = 0;
+	}
+	return n;
+}
+
+/* append a reference of ref->data[offset, offset + size) */
+ilong ims_write_ref(struct IMSTREAM *s, struct IMSREF *ref, ilong offset,
+	ilong size)
+{
+	struct IMSPAGE *page, *last;
+
+	assert(s && ref);
+
+	if (offset < 0 || offset >= ref->size || size <= 0) return 0;
+	if (size > ref->size - offset) size = ref->size - offset;
+
+	page = (struct IMSPAGE*)ikmem_malloc(sizeof(struct IMSPAGE));
+	if (page == NULL) return -1;
+
+	page->index = IMSPAGE_EXTERN;
+	page->capacity = 0;
+	page->data = (IUINT8*)ref->data + offset;
+	page->size = (iulong)size;
+	page->ref = ref;
+	ims_ref_inc(ref);
+
+	/* an empty stream may still hold its drained tail page */
+	for (; s->size == 0 && !ilist_is_empty(&s->head); ) {
+		last = ilist_entry(s->head.next, struct IMSPAGE, head);
+		ilist_del(&last->head);
+		ims_page_cache_release(s, last);
+		s->pos_read = 0;
+		s->pos_write = 0;
+	}
+
+	/* readers take non-tail pages as full: cut the tail at pos_write */
+	if (!ilist_is_empty(&s->head)) {
+		last = ilist_entry(s->head.prev, struct IMSPAGE, head);
+		last->size = s->pos_write;
+	}
+
+	ilist_add_tail(&page->head, &s->head);
+	s->pos_write = (iulong)size;
+	s->size += size;
+
+	return size;
+}
+
+
+/**********************************************************************
+ * IMSREF
+ **********************************************************************/
+
+/* new buffer with a copy of ptr (if not NULL), refcnt starts at 1 */
+struct IMSREF *ims_ref_new(const void *ptr, ilong size)
+{
+	struct IMSREF *ref;
+	if (size < 0) return NULL;
+	ref = (struct IMSREF*)ikmem_malloc(sizeof(struct IMSREF) + size + 1);
+	if (ref == NULL) return NULL;
+	ref->refcnt = 1;
+	ref->size = size;
+	ref->data = (char*)(ref + 1);
+	if (ptr) memcpy(ref->data, ptr, size);
+	ref->data[size] = 0;
+	return ref;
+}
+
+/* add a reference */
+void ims_ref_inc(struct IMSREF *ref)
+{
+	iatomic_add(&ref->refcnt, 1);
+}
+
+/* release a reference, buffer is freed when the last one goes */
+void ims_ref_dec(struct IMSREF *ref)
+{
+	if (iatomic_add(&ref->refcnt, -1) == 0) {
+		ikmem_free(ref);
+	}
+}
+
 
 /**********************************************************************
  * common string operation
@@ -1142,39 +1777,24 @@ ilong ims_flat(const struct IMSTREAM *s, void **pointer)
 /* strcasestr */
 char* istrcasestr(char* s1, char* s2)  
 {  
-	char* ptr = s1;  
+	ilong pos;
 	if (!s1 || !s2 || !*s2) return s1;  
-	   
-	while (*ptr) {  
-		if (ITOUPPER(*ptr) == ITOUPPER(*s2)) {  
-			char* cur1 = ptr + 1;  
-			char* cur2 = s2 + 1;  
-			while (*cur1 && *cur2 && ITOUPPER(*cur1) == ITOUPPER(*cur2)) {  
-				cur1++;  
-				cur2++;  
-			}  
-			if (!*cur2) return ptr;  
-		}  
-		ptr++;  
-	}  
-	return   NULL;  
+	pos = imem_find(s1, (ilong)strlen(s1), s2, (ilong)strlen(s2), 1, 0);
+	return (pos >= 0)? s1 + pos : NULL;
 }
 
 /* strncasecmp */
 int istrncasecmp(char* s1, char* s2, size_t num)
 {
 	char c1, c2;
+	ilong pos;
 	if(!s1|| !s2 || num == 0) return 0;
 	assert(s1 && s2 && num > 0);
-	while(num > 0){
-		c1 = ITOUPPER(*s1);
-		c2 = ITOUPPER(*s2);
-		if (c1 - c2) return c1 - c2;
-		num--;
-		s1++;
-		s2++;
-	}
-	return 0;
+	pos = imem_casediff(s1, s2, (ilong)num);
+	if (pos >= (ilong)num) return 0;
+	c1 = ITOUPPER(s1[pos]);
+	c2 = ITOUPPER(s2[pos]);
+	return c1 - c2;
 }
 
 /* strsep */
@@ -1207,6 +1827,68 @@ char *istrsep(char **stringp, const char *delim)
 #define IFL_OVERFLOW	4
 #define IFL_UNSIGNED	8
 
+/* 10^0 .. 10^19 */
+static const IUINT64 idec_pow10[20] = {
+	IUINT64_CONST(1), IUINT64_CONST(10), IUINT64_CONST(100),
+	IUINT64_CONST(1000), IUINT64_CONST(10000), IUINT64_CONST(100000),
+	IUINT64_CONST(1000000), IUINT64_CONST(10000000),
+	IUINT64_CONST(100000000), IUINT64_CONST(1000000000),
+	IUINT64_CONST(10000000000), IUINT64_CONST(100000000000),
+	IUINT64_CONST(1000000000000), IUINT64_CONST(10000000000000),
+	IUINT64_CONST(100000000000000), IUINT64_CONST(1000000000000000),
+	IUINT64_CONST(10000000000000000), IUINT64_CONST(100000000000000000),
+	IUINT64_CONST(1000000000000000000), IUINT64_CONST(10000000000000000000),
+};
+
+static const char idec_pairs[201] = 
+	"00010203040506070809101112131415161718192021222324252627282930313233"
+	"34353637383940414243444546474849505152535455565758596061626364656667"
+	"6869707172737475767778798081828384858687888990919293949596979899";
+
+/* number of decimal digits: log10 from the bit length, one compare */
+static inline int idec_count(IUINT64 x)
+{
+	IUINT32 hi = (IUINT32)(x >> 32);
+	int bits = hi? (64 - icpu_clz(hi)) : (32 - icpu_clz((IUINT32)x | 1));
+	int t = (bits * 1233) >> 12;
+	return t + 1 - (t > 0 && x < idec_pow10[t]);
+}
+
+/* write decimal digits of x two at a time, no '\0', returns length */
+static int idec_write(IUINT64 x, char *out)
+{
+	int size = idec_count(x);
+	char *p = out + size;
+	while (x >= 100) {
+		IUINT64 q = x / 100;
+		p -= 2;
+		memcpy(p, idec_pairs + (size_t)(x - q * 100) * 2, 2);
+		x = q;
+	}
+	if (x >= 10) {
+		p -= 2;
+		memcpy(p, idec_pairs + (size_t)x * 2, 2);
+	}	else {
+		*--p = (char)('0' + x);
+	}
+	return size;
+}
+
+/* leading decimal digits of a '\0' terminated string, at most limit
+ * (<= 19, so no overflow check is needed), returns digit count */
+static inline int idec_parse(const char *p, int limit, IUINT64 *value)
+{
+	IUINT64 v = 0;
+	int n = 0;
+	for (; n < limit; n++) {
+		unsigned int d = (unsigned int)((IUINT8)p[n]) - '0';
+		if (d > 9) break;
+		v = v * 10 + d;
+	}
+	*value = v;
+	return n;
+}
+
 /* istrtoxl */
 static unsigned long istrtoxl(const char *nptr, const char **endptr,
 	int ibase, int flags)
@@ -1260,6 +1942,17 @@ static unsigned long istrtoxl(const char *nptr, const char **endptr,
 		}
 	}
 
+	if (ibase == 10) {
+		IUINT64 value;
+		int n = idec_parse(p - 1, (sizeof(unsigned long) > 4)? 19 : 9, &value);
+		if (n > 0) {
+			number = (unsigned long)value;
+			flags |= IFL_READDIGIT;
+			p += n - 1;
+			c = *p++;
+		}
+	}
+
 	maxval = (~0ul) / ibase;
 
 	for (; ; ) {
@@ -1360,6 +2053,15 @@ static IUINT64 istrtoxll(const char *nptr, const char **endptr,
 		if (c == '0' && (*p == 'b' || *p == 'B')) p++, c = *p++;
 	}
 
+	if (ibase == 10) {
+		int n = idec_parse(p - 1, 19, &number);
+		if (n > 0) {
+			flags |= IFL_READDIGIT;
+			p += n - 1;
+			c = *p++;
+		}
+	}
+
 	maxval = (~((IUINT64)0)) / ibase;
 
 	for (; ; ) {
@@ -1417,6 +2119,14 @@ static int ixtoa(IUINT64 val, char *buf, unsigned radix, int is_neg)
 	char temp;
 	int size = 0;
 
+	if (radix == 10) {
+		if (is_neg) val = (IUINT64)(-(IINT64)val);
+		if (buf == NULL) return idec_count(val) + is_neg;
+		if (is_neg) *buf++ = '-';
+		buf[idec_write(val, buf)] = '\0';
+		return 0;
+	}
+
 	p = buf;
 	if (is_neg) {
 		if (buf) *p++ = '-';
@@ -1501,6 +2211,392 @@ int iulltoa(IUINT64 val, char *buf, int radix)
 	return ixtoa(val, buf, (unsigned)radix, 0);
 }
 
+/* fast decimal output, returns length (without the '\0') */
+int iu64toa(IUINT64 val, char *buf)
+{
+	int size = idec_write(val, buf);
+	buf[size] = '\0';
+	return size;
+}
+
+/* fast decimal output, returns length (without the '\0') */
+int ii64toa(IINT64 val, char *buf)
+{
+	if (val < 0) {
+		buf[0] = '-';
+		return iu64toa((IUINT64)0 - (IUINT64)val, buf + 1) + 1;
+	}
+	return iu64toa((IUINT64)val, buf);
+}
+
+
+#if IWORDS_BIG_ENDIAN == 0
+/* number of leading '0'-'9' bytes in 8 bytes, first byte lowest. a
+ * carry from the +6 only reaches bytes after a non-digit */
+static inline int idec_count8(IUINT64 x)
+{
+	const IUINT64 high = IUINT64_CONST(0xF0F0F0F0F0F0F0F0);
+	const IUINT64 seven = IUINT64_CONST(0x7F7F7F7F7F7F7F7F);
+	IUINT64 t = (x & high) | 
+		(((x + IUINT64_CONST(0x0606060606060606)) & high) >> 4);
+	IUINT32 lo, hi;
+	t ^= IUINT64_CONST(0x3333333333333333);
+	t = (((t & seven) + seven) | t) & IUINT64_CONST(0x8080808080808080);
+	lo = (IUINT32)t;
+	hi = (IUINT32)(t >> 32);
+	if (lo) return icpu_ctz(lo) >> 3;
+	return hi? 4 + (icpu_ctz(hi) >> 3) : 8;
+}
+
+/* value of 8 digits already minus '0', first digit in the lowest byte */
+static inline IUINT32 idec_swar8(IUINT64 x)
+{
+	x = (x * 10) + (x >> 8);
+	x = (((x & IUINT64_CONST(0x000000FF000000FF)) * 
+		(100 + (IUINT64_CONST(1000000) << 32))) +
+		(((x >> 16) & IUINT64_CONST(0x000000FF000000FF)) * 
+		(1 + (IUINT64_CONST(10000) << 32)))) >> 32;
+	return (IUINT32)x;
+}
+#endif
+
+/* leading decimal digits of text[0, size): while 8 bytes are left they
+ * are classified and converted at once. returns digits consumed, 0 for
+ * none, -1 if the value does not fit 64 bits */
+ilong iparse_u64(const char *text, ilong size, IUINT64 *value)
+{
+	IUINT64 v = 0;
+	ilong n = 0;
+#if IWORDS_BIG_ENDIAN == 0
+	const IUINT64 zeros = IUINT64_CONST(0x3030303030303030);
+	while (n < 16 && n + 8 <= size) {
+		IUINT64 x;
+		int k;
+		memcpy(&x, text + n, 8);
+		k = idec_count8(x);
+		if (k == 0) break;
+		x -= zeros;
+		if (k < 8) {
+			v = v * idec_pow10[k] + idec_swar8(x << ((8 - k) * 8));
+			*value = v;
+			return n + k;
+		}
+		v = v * 100000000 + idec_swar8(x);
+		n += 8;
+	}
+#endif
+	for (; n < size; n++) {
+		unsigned int d = (unsigned int)((IUINT8)text[n]) - '0';
+		if (d > 9) break;
+		if (n >= 19 && v > (~((IUINT64)0) - d) / 10) return -1;
+		v = v * 10 + d;
+	}
+	*value = v;
+	return n;
+}
+
+/* optional sign and decimal digits, same results as iparse_u64 */
+ilong iparse_i64(const char *text, ilong size, IINT64 *value)
+{
+	const IUINT64 limit = ((IUINT64)1) << 63;
+	IUINT64 v;
+	ilong n, sign = 0;
+	if (size > 0 && (text[0] == '-' || text[0] == '+')) sign = 1;
+	n = iparse_u64(text + sign, size - sign, &v);
+	if (n <= 0) return n;
+	if (sign && text[0] == '-') {
+		if (v > limit) return -1;
+		*value = (IINT64)((IUINT64)0 - v);
+	}	else {
+		if (v >= limit) return -1;
+		*value = (IINT64)v;
+	}
+	return n + sign;
+}
+
+/* shortest round-trip double formatting after Ulf Adams' ryu: 
+ * idtoa_pow5[i] holds the top 125 bits of 5^i, idtoa_inv5[i] holds
+ * floor(2^(pow5bits(i) - 1 + 125) / 5^i) + 1, built on first use */
+#define IDTOA_POW5_BITS		125
+#define IDTOA_POW5_COUNT	326
+#define IDTOA_INV_COUNT		342
+#define IDTOA_LIMBS			36
+
+static IUINT64 idtoa_pow5[IDTOA_POW5_COUNT][2];
+static IUINT64 idtoa_inv5[IDTOA_INV_COUNT][2];
+static volatile int idtoa_ready = 0;
+
+/* bit length of 5^e */
+static inline int idtoa_pow5bits(int e) {
+	return (int)(((IUINT32)e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) */
+static inline int idtoa_log10pow2(int e) {
+	return (int)(((IUINT32)e * 78913) >> 18);
+}
+
+/* floor(log10(5^e)) */
+static inline int idtoa_log10pow5(int e) {
+	return (int)(((IUINT32)e * 732923) >> 20);
+}
+
+/* bits [shift, shift + 128) of a little-endian limb array */
+static void idtoa_extract(const IUINT32 *x, int shift, IUINT64 *out)
+{
+	IUINT32 w[4];
+	int a = shift >> 5, b = shift & 31, k;
+	for (k = 0; k < 4; k++) {
+		IUINT32 lo = (a + k < IDTOA_LIMBS)? x[a + k] : 0;
+		IUINT32 hi = (a + k + 1 < IDTOA_LIMBS)? x[a + k + 1] : 0;
+		w[k] = b? ((lo >> b) | (hi << (32 - b))) : lo;
+	}
+	out[0] = ((IUINT64)w[1] << 32) | w[0];
+	out[1] = ((IUINT64)w[3] << 32) | w[2];
+}
+
+/* build tables with a small bignum: 5^i grows by multiplying, 
+ * 2^1151 / 5^i shrinks by dividing, both truncate exactly */
+static void idtoa_init(void)
+{
+	IUINT32 x[IDTOA_LIMBS], y[IDTOA_LIMBS];
+	int i, k;
+	if (idtoa_ready) return;
+	memset(x, 0, sizeof(x));
+	memset(y, 0, sizeof(y));
+	x[4] = 1;
+	y[IDTOA_LIMBS - 1] = 0x80000000u;
+	for (i = 0; i < IDTOA_POW5_COUNT; i++) {
+		IUINT64 carry = 0;
+		idtoa_extract(x, 128 + idtoa_pow5bits(i) - IDTOA_POW5_BITS,
+			idtoa_pow5[i]);
+		for (k = 0; k < IDTOA_LIMBS; k++) {
+			carry += (IUINT64)x[k] * 5;
+			x[k] = (IUINT32)carry;
+			carry >>= 32;
+		}
+	}
+	for (i = 0; i < IDTOA_INV_COUNT; i++) {
+		int j = idtoa_pow5bits(i) - 1 + IDTOA_POW5_BITS;
+		IUINT64 rem = 0;
+		idtoa_extract(y, 32 * IDTOA_LIMBS - 1 - j, idtoa_inv5[i]);
+		idtoa_inv5[i][0]++;
+		if (idtoa_inv5[i][0] == 0) idtoa_inv5[i][1]++;
+		for (k = IDTOA_LIMBS - 1; k >= 0; k--) {
+			rem = (rem << 32) | y[k];
+			y[k] = (IUINT32)(rem / 5);
+			rem %= 5;
+		}
+	}
+	idtoa_ready = 1;
+}
+
+/* (m * mul) >> j, mul is 128 bits, 64 < j < 128 */
+static inline IUINT64 idtoa_mulshift(IUINT64 m, const IUINT64 *mul, int j)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+	unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+	return (IUINT64)(((b0 >> 64) + b2) >> (j - 64));
+#else
+	IUINT64 m0 = (IUINT32)m, m1 = m >> 32;
+	IUINT64 r[4], t, lo, hi, high0, high1, low1, sum;
+	int s = j - 64;
+	/* high half of m * mul[0] */
+	lo = mul[0] & 0xffffffffu, hi = mul[0] >> 32;
+	r[0] = m0 * lo, r[1] = m0 * hi, r[2] = m1 * lo, r[3] = m1 * hi;
+	t = (r[0] >> 32) + (r[1] & 0xffffffffu) + (r[2] & 0xffffffffu);
+	high0 = r[3] + (r[1] >> 32) + (r[2] >> 32) + (t >> 32);
+	/* full m * mul[1] */
+	lo = mul[1] & 0xffffffffu, hi = mul[1] >> 32;
+	r[0] = m0 * lo, r[1] = m0 * hi, r[2] = m1 * lo, r[3] = m1 * hi;
+	t = (r[0] >> 32) + (r[1] & 0xffffffffu) + (r[2] & 0xffffffffu);
+	low1 = (t << 32) | (r[0] & 0xffffffffu);
+	high1 = r[3] + (r[1] >> 32) + (r[2] >> 32) + (t >> 32);
+	sum = high0 + low1;
+	if (sum < high0) high1++;
+	return (high1 << (64 - s)) | (sum >> s);
+#endif
+}
+
+static inline int idtoa_pow5factor(IUINT64 value)
+{
+	int count = 0;
+	for (; value % 5 == 0; value /= 5) count++;
+	return count;
+}
+
+/* shortest decimal digits of a finite, non-zero double:
+ * result * 10^(*e10) reads back to the same value */
+static IUINT64 idtoa_shortest(IUINT64 mantissa, int exponent, int *e10)
+{
+	IUINT64 m2, mv, vr, vp, vm, output;
+	int e2, q, mmshift, even, removed = 0, last = 0;
+	int vm_zeros = 0, vr_zeros = 0;
+
+	if (exponent == 0) {
+		e2 = 1 - 1023 - 52 - 2;
+		m2 = mantissa;
+	}	else {
+		e2 = exponent - 1023 - 52 - 2;
+		m2 = (IUINT64_CONST(1) << 52) | mantissa;
+	}
+
+	even = (int)((m2 & 1) == 0);
+	mv = 4 * m2;
+	mmshift = (mantissa != 0 || exponent <= 1)? 1 : 0;
+
+	/* the interval [vm, vp] around vr, scaled by a power of ten */
+	if (e2 >= 0) {
+		int k, i;
+		q = idtoa_log10pow2(e2) - (e2 > 3);
+		*e10 = q;
+		k = IDTOA_POW5_BITS + idtoa_pow5bits(q) - 1;
+		i = -e2 + q + k;
+		vr = idtoa_mulshift(4 * m2, idtoa_inv5[q], i);
+		vp = idtoa_mulshift(4 * m2 + 2, idtoa_inv5[q], i);
+		vm = idtoa_mulshift(4 * m2 - 1 - mmshift, idtoa_inv5[q], i);
+		if (q <= 21) {
+			if (mv % 5 == 0) {
+				vr_zeros = idtoa_pow5factor(mv) >= q;
+			}
+			else if (even) {
+				vm_zeros = idtoa_pow5factor(mv - 1 - mmshift) >= q;
+			}
+			else {
+				vp -= idtoa_pow5factor(mv + 2) >= q;
+			}
+		}
+	}	else {
+		int i, k, j;
+		q = idtoa_log10pow5(-e2) - (-e2 > 1);
+		*e10 = q + e2;
+		i = -e2 - q;
+		k = idtoa_pow5bits(i) - IDTOA_POW5_BITS;
+		j = q - k;
+		vr = idtoa_mulshift(4 * m2, idtoa_pow5[i], j);
+		vp = idtoa_mulshift(4 * m2 + 2, idtoa_pow5[i], j);
+		vm = idtoa_mulshift(4 * m2 - 1 - mmshift, idtoa_pow5[i], j);
+		if (q <= 1) {
+			vr_zeros = 1;
+			if (even) vm_zeros = mmshift;
+			else vp--;
+		}
+		else if (q < 63) {
+			vr_zeros = (mv & ((IUINT64_CONST(1) << q) - 1)) == 0;
+		}
+	}
+
+	/* drop digits while the interval still holds one number */
+	if (vm_zeros || vr_zeros) {
+		for (; vp / 10 > vm / 10; removed++) {
+			vm_zeros &= (vm % 10) == 0;
+			vr_zeros &= last == 0;
+			last = (int)(vr % 10);
+			vr /= 10, vp /= 10, vm /= 10;
+		}
+		if (vm_zeros) {
+			for (; vm % 10 == 0; removed++) {
+				vr_zeros &= last == 0;
+				last = (int)(vr % 10);
+				vr /= 10, vp /= 10, vm /= 10;
+			}
+		}
+		if (vr_zeros && last == 5 && vr % 2 == 0) last = 4;
+		output = vr + ((vr == vm && (!even || !vm_zeros)) || last >= 5);
+	}	else {
+		int roundup = 0;
+		if (vp / 100 > vm / 100) {
+			roundup = (vr % 100) >= 50;
+			vr /= 100, vp /= 100, vm /= 100;
+			removed += 2;
+		}
+		for (; vp / 10 > vm / 10; removed++) {
+			roundup = (vr % 10) >= 5;
+			vr /= 10, vp /= 10, vm /= 10;
+		}
+		output = vr + (vr == vm || roundup);
+	}
+
+	*e10 += removed;
+	return output;
+}
+
+/* shortest decimal that reads back as the same double: plain notation
+ * for 1e-5 <= |val| < 1e17, otherwise like "1.5e+300". buf needs 25 
+ * bytes, returns length (without the '\0') */
+int idtoa(double val, char *buf)
+{
+	IUINT64 bits, mantissa, output;
+	int exponent, e10, count, point, size = 0, i;
+	char digits[24];
+
+	memcpy(&bits, &val, sizeof(bits));
+	mantissa = bits & ((IUINT64_CONST(1) << 52) - 1);
+	exponent = (int)((bits >> 52) & 0x7ff);
+
+	if (exponent == 0x7ff && mantissa != 0) {
+		memcpy(buf, "nan", 4);
+		return 3;
+	}
+	if (bits >> 63) buf[size++] = '-';
+	if (exponent == 0x7ff) {
+		memcpy(buf + size, "inf", 4);
+		return size + 3;
+	}
+	if (exponent == 0 && mantissa == 0) {
+		memcpy(buf + size, "0", 2);
+		return size + 1;
+	}
+
+	idtoa_init();
+	output = idtoa_shortest(mantissa, exponent, &e10);
+	count = idec_write(output, digits);
+	point = count + e10;
+
+	if (point > 0 && point <= 17) {
+		if (point >= count) {
+			memcpy(buf + size, digits, count);
+			size += count;
+			for (i = count; i < point; i++) buf[size++] = '0';
+		}	else {
+			memcpy(buf + size, digits, point);
+			size += point;
+			buf[size++] = '.';
+			memcpy(buf + size, digits + point, count - point);
+			size += count - point;
+		}
+	}
+	else if (point <= 0 && point > -5) {
+		buf[size++] = '0';
+		buf[size++] = '.';
+		for (i = point; i < 0; i++) buf[size++] = '0';
+		memcpy(buf + size, digits, count);
+		size += count;
+	}
+	else {
+		int e = point - 1;
+		buf[size++] = digits[0];
+		if (count > 1) {
+			buf[size++] = '.';
+			memcpy(buf + size, digits + 1, count - 1);
+			size += count - 1;
+		}
+		buf[size++] = 'e';
+		buf[size++] = (e < 0)? '-' : '+';
+		if (e < 0) e = -e;
+		if (e >= 100) {
+			buf[size++] = (char)('0' + e / 100);
+			e %= 100;
+		}
+		memcpy(buf + size, idec_pairs + e * 2, 2);
+		size += 2;
+	}
+
+	buf[size] = '\0';
+	return size;
+}
+
 /* istrstrip */
 char *istrstrip(char *ptr, const char *delim)
 {
@@ -1925,8 +3021,8 @@ static ilong it_strfindx(const ivalue_t *src, const ivalue_t *str,
 {
 	const char *p1 = it_str(src);
 	const char *p2 = it_str(str);
-	const char *pend, *p;
-	iulong size, i;
+	iulong size;
+	ilong pos;
 
 	assert(it_type(src) == ITYPE_STR);
 	assert(it_type(str) == ITYPE_STR);
@@ -1938,45 +3034,14 @@ static ilong it_strfindx(const ivalue_t *src, const ivalue_t *str,
 	if (endup > (ilong)it_size(src)) endup = (ilong)it_size(src);
 
 	size = it_size(str);
-	pend = p1 + endup;
 
 	if (start + size > it_size(src) || start >= endup) 
 		return -1;
 
-	if (reverse == 0) {
-		if (incase == 0) {
-			for (p = p1 + start; p + size <= pend; p++) {
-				if (memcmp(p, p2, size) == 0) 
-					return (ilong)(p - p1);
-			}
-		}	else {
-			for (p = p1 + start; p + size <= pend; p++) {
-				for (i = 0; i < size; i++) {
-					if (ITOUPPER(p[i]) != ITOUPPER(p2[i])) break;
-				}
-				if (i >= size) 
-					return (ilong)(p - p1);
-			}
-		}
-	}	
-	else {
-		if (incase == 0) {
-			for (p = pend - size; p >= p1 + start; p--) {
-				if (memcmp(p, p2, size) == 0) 
-					return (ilong)(p - p1);
-			}
-		}	else {
-			for (p = pend - size; p >= p1 + start; p--) {
-				for (i = 0; i < size; i++) {
-					if (ITOUPPER(p[i]) != ITOUPPER(p2[i])) break;
-				}
-				if (i >= size) 
-					return (ilong)(p - p1);
-			}
-		}
-	}
+	pos = imem_find(p1 + start, endup - start, p2, (ilong)size, 
+		incase, reverse);
 
-	return -1;
+	return (pos >= 0)? start + pos : -1;
 }
 
 /* find str in src (s:start, e:endup) */
@@ -2482,20 +3547,939 @@ int istring_list_join(const istring_list_t *strings, const char *str,
 }
 
 
+/**********************************************************************
+ * VARINT ARRAY
+ **********************************************************************/
+
+/* 7 bits groups of a value below 2^56 spread into bytes, and back */
+static inline IUINT64 ivarint_spread(IUINT64 x)
+{
+	x = (x & IUINT64_CONST(0xfffffff)) | 
+		((x & IUINT64_CONST(0xfffffff0000000)) << 4);
+	x = (x & IUINT64_CONST(0x00003fff00003fff)) | 
+		((x & IUINT64_CONST(0x0fffc0000fffc000)) << 2);
+	x = (x & IUINT64_CONST(0x007f007f007f007f)) | 
+		((x & IUINT64_CONST(0x3f803f803f803f80)) << 1);
+	return x;
+}
+
+static inline IUINT64 ivarint_compact(IUINT64 x)
+{
+	x = (x & IUINT64_CONST(0x007f007f007f007f)) | 
+		((x & IUINT64_CONST(0x7f007f007f007f00)) >> 1);
+	x = (x & IUINT64_CONST(0x00003fff00003fff)) | 
+		((x & IUINT64_CONST(0x3fff00003fff0000)) >> 2);
+	x = (x & IUINT64_CONST(0xfffffff)) | 
+		((x & IUINT64_CONST(0xfffffff00000000)) >> 4);
+	return x;
+}
+
+/* bytes needed by iencodeu, v must not be 0 */
+static inline int ivarint_size(IUINT64 v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (64 - __builtin_clzll(v) + 6) / 7;
+#else
+	int size = 1;
+	for (v >>= 7; v > 0; v >>= 7) size++;
+	return size;
+#endif
+}
+
+/* encode array: values below 2^56 are spread and stored as one 8 bytes
+ * word, the bytes beyond the value are overwritten by the next ones. 
+ * near the end, where the following values may take less than those 
+ * bytes, only the value's own bytes are stored */
+char *iencodeu_array(char *ptr, const IUINT64 *values, ilong count)
+{
+	ilong i;
+	for (i = 0; i < count; i++) {
+		IUINT64 v = values[i];
+		if (v < 0x80) {
+			*ptr++ = (char)v;
+			continue;
+		}
+		if (v < 0x4000) {
+			ptr[0] = (char)((v & 0x7f) | 0x80);
+			ptr[1] = (char)(v >> 7);
+			ptr += 2;
+			continue;
+		}
+#if IWORDS_BIG_ENDIAN == 0
+		if (v < (((IUINT64)1) << 56)) {
+			IUINT64 x = ivarint_spread(v);
+			int size = ivarint_size(v);
+			x |= IUINT64_CONST(0x8080808080808080) >> ((9 - size) * 8);
+			if (count - i - 1 >= 8 - size) {
+				memcpy(ptr, &x, 8);
+			}	else {
+				memcpy(ptr, &x, size);
+			}
+			ptr += size;
+			continue;
+		}
+#endif
+		ptr = iencodeu(ptr, v);
+	}
+	return ptr;
+}
+
+/* bounded single value decode */
+static inline const unsigned char *idecodeu_safe(const unsigned char *p,
+	const unsigned char *end, IUINT64 *v)
+{
+	IUINT64 x = 0;
+	int i;
+	if (end - p >= 10) {
+		return (const unsigned char*)idecodeu((const char*)p, v);
+	}
+	for (i = 0; p < end; i++) {
+		unsigned char ch = *p++;
+		x |= ((IUINT64)(ch & 0x7f)) << (i * 7);
+		if ((ch & 0x80) == 0) {
+			v[0] = x;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+/* masked-vbyte style table: for each continuation mask of 8 bytes, a
+ * shuffle moving the leading 1-2 bytes values into 16 bits lanes */
+struct IVARINTSHUF
+{
+	IUINT8 shuffle[16];
+	int count;
+	int size;
+};
+
+static struct IVARINTSHUF ivarint_table[256];
+static volatile int ivarint_table_ready = 0;
+
+static void ivarint_table_init(void)
+{
+	int mask;
+	if (ivarint_table_ready) return;
+	for (mask = 0; mask < 256; mask++) {
+		struct IVARINTSHUF *entry = &ivarint_table[mask];
+		int pos = 0, n = 0;
+		memset(entry->shuffle, 0x80, 16);
+		while (pos < 8) {
+			if ((mask & (1 << pos)) == 0) {
+				entry->shuffle[n * 2] = (IUINT8)pos;
+				pos += 1;
+			}
+			else if (pos < 7 && (mask & (1 << (pos + 1))) == 0) {
+				entry->shuffle[n * 2] = (IUINT8)pos;
+				entry->shuffle[n * 2 + 1] = (IUINT8)(pos + 1);
+				pos += 2;
+			}
+			else {
+				break;
+			}
+			n++;
+		}
+		entry->count = n;
+		entry->size = pos;
+	}
+	ivarint_table_ready = 1;
+}
+
+/* continuation bits of a 16 bytes window are gathered by movemask: a
+ * window of 1 byte or of 2 bytes values is widened directly, leading 
+ * 1-2 bytes values are decoded 4-8 at a time through the shuffle table
+ * (a data dependent step, so the two uniform cases come first), longer
+ * ones are located by ctz and compacted from an 8 bytes load. values longer
+ * than 8 bytes stop the kernel. */
+ICPU_TARGET("ssse3")
+static const unsigned char *idecodeu_ssse3(const unsigned char *p,
+	const unsigned char *end, IUINT64 *values, ilong count, ilong *index)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i low = _mm_set1_epi16(0x7f);
+	__m128i high = _mm_set1_epi16(0x7f00);
+	ilong i = *index;
+	while (end - p >= 24 && count - i >= 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)p);
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(x);
+		const struct IVARINTSHUF *entry = &ivarint_table[mask & 0xff];
+		unsigned int ends, start = 0;
+		if (mask == 0) {
+			__m128i w[2];
+			int j;
+			w[0] = _mm_unpacklo_epi8(x, zero);
+			w[1] = _mm_unpackhi_epi8(x, zero);
+			for (j = 0; j < 2; j++) {
+				__m128i lo = _mm_unpacklo_epi16(w[j], zero);
+				__m128i hi = _mm_unpackhi_epi16(w[j], zero);
+				__m128i *dst = (__m128i*)(values + i + j * 8);
+				_mm_storeu_si128(dst + 0, _mm_unpacklo_epi32(lo, zero));
+				_mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(lo, zero));
+				_mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(hi, zero));
+				_mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(hi, zero));
+			}
+			p += 16;
+			i += 16;
+			continue;
+		}
+		if (mask == 0x5555 || entry->count >= 4) {
+			__m128i *dst = (__m128i*)(values + i);
+			__m128i y = x, lo, hi;
+			if (mask != 0x5555) {
+				y = _mm_shuffle_epi8(x, 
+					_mm_loadu_si128((const __m128i*)entry->shuffle));
+				p += entry->size;
+				i += entry->count;
+			}	else {
+				p += 16;
+				i += 8;
+			}
+			y = _mm_or_si128(_mm_and_si128(y, low), 
+				_mm_srli_epi16(_mm_and_si128(y, high), 1));
+			lo = _mm_unpacklo_epi16(y, zero);
+			hi = _mm_unpackhi_epi16(y, zero);
+			_mm_storeu_si128(dst + 0, _mm_unpacklo_epi32(lo, zero));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(lo, zero));
+			_mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(hi, zero));
+			_mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(hi, zero));
+			continue;
+		}
+		for (ends = ~mask & 0xffff; ends; ends &= ends - 1) {
+			unsigned int stop = (unsigned int)icpu_ctz(ends);
+			unsigned int size = stop - start + 1;
+			IUINT64 v;
+			if (size > 8) break;
+			memcpy(&v, p + start, 8);
+			v = (v << (64 - size * 8)) >> (64 - size * 8);
+			values[i++] = ivarint_compact(v);
+			start = stop + 1;
+		}
+		p += start;
+		if (ends || start == 0) break;
+	}
+	*index = i;
+	return p;
+}
+#endif
+
+/* decode array */
+const char *idecodeu_array(const char *ptr, const char *end, 
+	IUINT64 *values, ilong count)
+{
+	const unsigned char *p = (const unsigned char*)ptr;
+	const unsigned char *e = (const unsigned char*)end;
+	ilong i = 0;
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+	int simd = icpu_features() & ICPU_SSSE3;
+	if (simd) ivarint_table_init();
+#endif
+	while (i < count) {
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+		if (simd) {
+			p = idecodeu_ssse3(p, e, values, count, &i);
+			if (i >= count) break;
+			if (e - p >= 10) {
+				p = (const unsigned char*)idecodeu((const char*)p, 
+						&values[i++]);
+				continue;
+			}
+		}
+#endif
+		for (; i < count && e - p >= 10; i++) {
+			p = (const unsigned char*)idecodeu((const char*)p, &values[i]);
+		}
+		if (i < count) {
+			p = idecodeu_safe(p, e, &values[i++]);
+			if (p == NULL) return NULL;
+		}
+	}
+	return (const char*)p;
+}
+
+/* delta + zigzag encode, in batches through a stack buffer */
+char *iencodei_delta(char *ptr, const IINT64 *values, ilong count, 
+	IINT64 base)
+{
+	IUINT64 buffer[256];
+	IUINT64 prev = (IUINT64)base;
+	ilong i, j, n;
+	for (i = 0; i < count; i += n) {
+		n = (count - i < 256)? (count - i) : 256;
+		for (j = 0; j < n; j++) {
+			IUINT64 x = (IUINT64)values[i + j];
+			IUINT64 y = x - prev;
+			prev = x;
+			if (y & ((IUINT64)1 << 63)) buffer[j] = ((~y) << 1) | 1;
+			else buffer[j] = y << 1;
+		}
+		ptr = iencodeu_array(ptr, buffer, n);
+	}
+	return ptr;
+}
+
+/* delta + zigzag decode, in place */
+const char *idecodei_delta(const char *ptr, const char *end,
+	IINT64 *values, ilong count, IINT64 base)
+{
+	IUINT64 *data = (IUINT64*)values;
+	IUINT64 prev = (IUINT64)base;
+	ilong i;
+	ptr = idecodeu_array(ptr, end, data, count);
+	if (ptr == NULL) return NULL;
+	for (i = 0; i < count; i++) {
+		IUINT64 x = data[i];
+		if ((x & 1) == 0) x = x >> 1;
+		else x = ~(x >> 1);
+		prev += x;
+		values[i] = (IINT64)prev;
+	}
+	return ptr;
+}
+
+
+/**********************************************************************
+ * CSV SCANNER
+ **********************************************************************/
+#ifndef ICSV_SCAN_BATCH
+#define ICSV_SCAN_BATCH 4096
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define icsv_ctz64(x) __builtin_ctzll(x)
+#else
+static inline int icsv_ctz64(IUINT64 x) {
+	IUINT32 lo = (IUINT32)(x & 0xffffffff);
+	if (lo) return icpu_ctz(lo);
+	return 32 + icpu_ctz((IUINT32)(x >> 32));
+}
+#endif
+
+/* bit i set if an odd number of quotes at or before i */
+static inline IUINT64 icsv_prefix_xor(IUINT64 x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+/* separators and newlines outside quotes of a block at 'base' are
+ * appended to the index, quote state is carried to the next block */
+static inline int icsv_block(struct ICSVSCAN *scan, int n, ilong base,
+	IUINT64 quote, IUINT64 sep, IUINT64 lf)
+{
+	IUINT64 inside = icsv_prefix_xor(quote) ^ scan->inside;
+	IUINT64 bits = (sep | lf) & ~inside;
+	ilong *index = scan->index;
+	scan->inside = ((IUINT64)0) - (inside >> 63);
+	for (; bits; bits &= bits - 1) {
+		index[n++] = base + icsv_ctz64(bits);
+	}
+	return n;
+}
+
+#ifdef ICPU_X86
+ICPU_TARGET("sse2")
+static ilong icsv_stage1_sse2(struct ICSVSCAN *scan, ilong pos, int *count)
+{
+	const unsigned char *data = (const unsigned char*)scan->data;
+	__m128i cq = _mm_set1_epi8('"');
+	__m128i cs = _mm_set1_epi8((char)scan->sep);
+	__m128i cn = _mm_set1_epi8('\n');
+	int n = *count;
+	for (; pos + 64 <= scan->size && n + 64 <= scan->capacity; pos += 64) {
+		IUINT64 quote = 0, sep = 0, lf = 0;
+		int i;
+		for (i = 0; i < 4; i++) {
+			__m128i x = _mm_loadu_si128((const __m128i*)(data + pos) + i);
+			int k = i * 16;
+			quote |= ((IUINT64)(unsigned int)
+				_mm_movemask_epi8(_mm_cmpeq_epi8(x, cq))) << k;
+			sep |= ((IUINT64)(unsigned int)
+				_mm_movemask_epi8(_mm_cmpeq_epi8(x, cs))) << k;
+			lf |= ((IUINT64)(unsigned int)
+				_mm_movemask_epi8(_mm_cmpeq_epi8(x, cn))) << k;
+		}
+		n = icsv_block(scan, n, pos, quote, sep, lf);
+	}
+	*count = n;
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static ilong icsv_stage1_avx2(struct ICSVSCAN *scan, ilong pos, int *count)
+{
+	const unsigned char *data = (const unsigned char*)scan->data;
+	__m256i cq = _mm256_set1_epi8('"');
+	__m256i cs = _mm256_set1_epi8((char)scan->sep);
+	__m256i cn = _mm256_set1_epi8('\n');
+	int n = *count;
+	for (; pos + 64 <= scan->size && n + 64 <= scan->capacity; pos += 64) {
+		__m256i x0 = _mm256_loadu_si256((const __m256i*)(data + pos));
+		__m256i x1 = _mm256_loadu_si256((const __m256i*)(data + pos + 32));
+		IUINT64 quote, sep, lf;
+		quote = (IUINT32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0, cq)) |
+			((IUINT64)(IUINT32)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(x1, cq)) << 32);
+		sep = (IUINT32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0, cs)) |
+			((IUINT64)(IUINT32)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(x1, cs)) << 32);
+		lf = (IUINT32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0, cn)) |
+			((IUINT64)(IUINT32)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(x1, cn)) << 32);
+		n = icsv_block(scan, n, pos, quote, sep, lf);
+	}
+	*count = n;
+	return pos;
+}
+#endif
+
+/* classify blocks from scan->scan, the last partial block is padded */
+static void icsv_stage1(struct ICSVSCAN *scan)
+{
+	const unsigned char *data = (const unsigned char*)scan->data;
+	ilong pos = scan->scan;
+	int n = 0;
+#ifdef ICPU_X86
+	int features = icpu_features();
+	if (features & ICPU_AVX2) {
+		pos = icsv_stage1_avx2(scan, pos, &n);
+	}
+	if (features & ICPU_SSE2) {
+		pos = icsv_stage1_sse2(scan, pos, &n);
+	}
+#endif
+	while (pos < scan->size && n + 64 <= scan->capacity) {
+		IUINT64 quote = 0, sep = 0, lf = 0;
+		ilong size = scan->size - pos;
+		int i;
+		if (size > 64) size = 64;
+		for (i = 0; i < (int)size; i++) {
+			int ch = data[pos + i];
+			if (ch == '"') quote |= ((IUINT64)1) << i;
+			else if (ch == scan->sep) sep |= ((IUINT64)1) << i;
+			else if (ch == '\n') lf |= ((IUINT64)1) << i;
+		}
+		n = icsv_block(scan, n, pos, quote, sep, lf);
+		pos += size;
+	}
+	scan->scan = pos;
+	scan->head = 0;
+	scan->tail = n;
+}
+
+/* init scanner */
+int icsv_scan_init(struct ICSVSCAN *scan, const char *data, ilong size,
+	int sep)
+{
+	scan->data = data;
+	scan->size = (size < 0)? (ilong)strlen(data) : size;
+	scan->scan = 0;
+	scan->start = 0;
+	scan->inside = 0;
+	scan->head = 0;
+	scan->tail = 0;
+	scan->capacity = ICSV_SCAN_BATCH;
+	scan->sep = sep & 0xff;
+	scan->count = 0;
+	scan->limit = 16;
+	scan->index = (ilong*)ikmem_malloc(sizeof(ilong) * scan->capacity);
+	scan->fields = (struct ICSVFIELD*)
+		ikmem_malloc(sizeof(struct ICSVFIELD) * scan->limit);
+	if (scan->index == NULL || scan->fields == NULL) {
+		icsv_scan_destroy(scan);
+		return -1;
+	}
+	return 0;
+}
+
+/* free scanner */
+void icsv_scan_destroy(struct ICSVSCAN *scan)
+{
+	if (scan->index) ikmem_free(scan->index);
+	if (scan->fields) ikmem_free(scan->fields);
+	scan->index = NULL;
+	scan->fields = NULL;
+	scan->count = 0;
+	scan->limit = 0;
+	scan->head = 0;
+	scan->tail = 0;
+}
+
+/* read next row */
+int icsv_scan_next(struct ICSVSCAN *scan)
+{
+	const char *data = scan->data;
+	ilong start = scan->start;
+
+	scan->count = 0;
+
+	if (start >= scan->size) 
+		return -1;
+
+	while (1) {
+		struct ICSVFIELD *field;
+		ilong endup;
+		if (scan->head < scan->tail) {
+			endup = scan->index[scan->head++];
+		}
+		else if (scan->scan < scan->size) {
+			icsv_stage1(scan);
+			continue;
+		}
+		else {
+			endup = scan->size;
+		}
+		if (scan->count >= scan->limit) {
+			int limit = scan->limit * 2;
+			struct ICSVFIELD *fields = (struct ICSVFIELD*)
+				ikmem_realloc(scan->fields, sizeof(*fields) * limit);
+			if (fields == NULL) return -2;
+			scan->fields = fields;
+			scan->limit = limit;
+		}
+		field = &scan->fields[scan->count++];
+		field->ptr = data + start;
+		field->size = endup - start;
+		start = endup + 1;
+		if (endup >= scan->size || data[endup] == '\n') {
+			if (field->size > 0 && field->ptr[field->size - 1] == '\r')
+				field->size--;
+			if (scan->count == 1 && field->size == 0)
+				scan->count = 0;
+			break;
+		}
+	}
+
+	scan->start = start;
+	return scan->count;
+}
+
+/* decode a raw field */
+ilong icsv_field_load(const char *ptr, ilong size, char *out)
+{
+	if (out == NULL) {
+		ilong i;
+		for (i = 0; i < size; i++) {
+			if (ptr[i] == '"' || ptr[i] == '\\') return -1;
+		}
+		return size;
+	}
+	if (size > 1 && ptr[0] == '"' && ptr[size - 1] == '"') {
+		ptr++;
+		size -= 2;
+	}
+	return istrload(ptr, size, out);
+}
+
+#ifdef ICPU_X86
+ICPU_TARGET("sse2")
+static ilong icsv_parity_sse2(const unsigned char *data, ilong size, 
+	int *parity)
+{
+	__m128i cq = _mm_set1_epi8('"');
+	__m128i acc = _mm_setzero_si128();
+	ilong pos = 0;
+	unsigned int mask;
+	for (; pos + 16 <= size; pos += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + pos));
+		acc = _mm_xor_si128(acc, _mm_cmpeq_epi8(x, cq));
+	}
+	mask = (unsigned int)_mm_movemask_epi8(acc);
+	for (; mask; mask &= mask - 1) *parity ^= 1;
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static ilong icsv_parity_avx2(const unsigned char *data, ilong size, 
+	int *parity)
+{
+	__m256i cq = _mm256_set1_epi8('"');
+	__m256i acc = _mm256_setzero_si256();
+	ilong pos = 0;
+	unsigned int mask;
+	for (; pos + 32 <= size; pos += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(data + pos));
+		acc = _mm256_xor_si256(acc, _mm256_cmpeq_epi8(x, cq));
+	}
+	mask = (unsigned int)_mm256_movemask_epi8(acc);
+	for (; mask; mask &= mask - 1) *parity ^= 1;
+	return pos;
+}
+#endif
+
+/* parity of quote count in data */
+static int icsv_quote_parity(const char *data, ilong size)
+{
+	const unsigned char *ptr = (const unsigned char*)data;
+	int parity = 0;
+#ifdef ICPU_X86
+	int features = icpu_features();
+	ilong pos = 0;
+	if (features & ICPU_AVX2) {
+		pos = icsv_parity_avx2(ptr, size, &parity);
+	}
+	else if (features & ICPU_SSE2) {
+		pos = icsv_parity_sse2(ptr, size, &parity);
+	}
+	ptr += pos;
+	size -= pos;
+#endif
+	for (; size > 0; ptr++, size--) {
+		if (ptr[0] == '"') parity ^= 1;
+	}
+	return parity;
+}
+
+/* split at row starts: quote parity of everything before a cut point
+ * tells whether it lies inside a quoted field, then the cut moves to
+ * the first newline outside quotes */
+void icsv_split(const char *data, ilong size, ilong *bounds, int count)
+{
+	ilong pos = 0;
+	int inside = 0, i;
+	bounds[0] = 0;
+	for (i = 1; i < count; i++) {
+		ilong target = (ilong)((IINT64)size * i / count);
+		if (pos < target) {
+			inside ^= icsv_quote_parity(data + pos, target - pos);
+			for (pos = target; pos < size; ) {
+				char ch = data[pos++];
+				if (ch == '"') inside ^= 1;
+				else if (ch == '\n' && inside == 0) break;
+			}
+		}
+		bounds[i] = pos;
+	}
+	bounds[count] = size;
+}
+
+
 /**********************************************************************
  * BASE64 / BASE32 / BASE16
  **********************************************************************/
 
+/*-------------------------------------------------------------------*/
+/* vector kernels: only whole blocks of valid input are converted,    */
+/* anything else is left to the scalar loops, so output is identical */
+/*-------------------------------------------------------------------*/
+#ifdef ICPU_X86
+ICPU_TARGET("ssse3")
+static ilong ibase64_encode_ssse3(const IUINT8 *src, ilong pos, ilong size,
+	char *dst, ilong *k)
+{
+	const __m128i shuf = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 
+			7, 6, 8, 7, 10, 9, 11, 10);
+	const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	for (; pos + 16 <= size; pos += 12, *k += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + pos));
+		__m128i t0, t1, index, r;
+		x = _mm_shuffle_epi8(x, shuf);
+		t0 = _mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0fc0fc00)),
+				_mm_set1_epi32(0x04000040));
+		t1 = _mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003f03f0)),
+				_mm_set1_epi32(0x01000010));
+		index = _mm_or_si128(t0, t1);
+		r = _mm_subs_epu8(index, _mm_set1_epi8(51));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_set1_epi8(13),
+				_mm_cmpgt_epi8(_mm_set1_epi8(26), index)));
+		r = _mm_add_epi8(_mm_shuffle_epi8(lut, r), index);
+		_mm_storeu_si128((__m128i*)(dst + *k), r);
+	}
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static ilong ibase64_encode_avx2(const IUINT8 *src, ilong pos, ilong size,
+	char *dst, ilong *k)
+{
+	const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 
+			7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 
+			7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, 
+			'0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	for (; pos + 28 <= size; pos += 24, *k += 32) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(src + pos));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(src + pos + 12));
+		__m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(lo),
+				hi, 1);
+		__m256i t0, t1, index, r;
+		x = _mm256_shuffle_epi8(x, shuf);
+		t0 = _mm256_mulhi_epu16(_mm256_and_si256(x, 
+				_mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		t1 = _mm256_mullo_epi16(_mm256_and_si256(x, 
+				_mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		index = _mm256_or_si256(t0, t1);
+		r = _mm256_subs_epu8(index, _mm256_set1_epi8(51));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_set1_epi8(13),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(26), index)));
+		r = _mm256_add_epi8(_mm256_shuffle_epi8(lut, r), index);
+		_mm256_storeu_si256((__m256i*)(dst + *k), r);
+	}
+	return pos;
+}
+
+/* 16 chars to 12 bytes, returns 0 if any char is not in the alphabet */
+ICPU_TARGET("ssse3")
+static inline int ibase64_decode_block(__m128i x, IUINT8 *dst)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 
+			0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 
+			0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, 
+			-71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 
+			14, 13, 12, -1, -1, -1, -1);
+	__m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i hi = _mm_and_si128(_mm_srli_epi32(x, 4), nibble);
+	__m128i lo = _mm_and_si128(x, nibble);
+	__m128i roll, merge;
+	IUINT32 tail;
+	lo = _mm_shuffle_epi8(lut_lo, lo);
+	roll = _mm_add_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(0x2f)), hi);
+	hi = _mm_shuffle_epi8(lut_hi, hi);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), 
+		_mm_setzero_si128())) != 0xffff) 
+		return 0;
+	x = _mm_add_epi8(x, _mm_shuffle_epi8(lut_roll, roll));
+	merge = _mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140));
+	merge = _mm_madd_epi16(merge, _mm_set1_epi32(0x00011000));
+	merge = _mm_shuffle_epi8(merge, shuf);
+	_mm_storel_epi64((__m128i*)dst, merge);
+	tail = (IUINT32)_mm_cvtsi128_si32(_mm_srli_si128(merge, 8));
+	memcpy(dst + 8, &tail, 4);
+	return 1;
+}
+
+ICPU_TARGET("ssse3")
+static ilong ibase64_decode_ssse3(const IUINT8 *src, ilong pos, ilong size,
+	IUINT8 *dst, ilong *k)
+{
+	for (; pos + 16 <= size; pos += 16, *k += 12) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + pos));
+		if (ibase64_decode_block(x, dst + *k) == 0) break;
+	}
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static ilong ibase64_decode_avx2(const IUINT8 *src, ilong pos, ilong size,
+	IUINT8 *dst, ilong *k)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 
+			0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+			0x15, 0x11, 0x11, 0x11, 0x11, 
+			0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 
+			0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+			0x10, 0x10, 0x01, 0x02, 0x04, 
+			0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, 
+			-71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4, -65, -65, -71, 
+			-71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 
+			14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 
+			14, 13, 12, -1, -1, -1, -1);
+	__m256i nibble = _mm256_set1_epi8(0x0f);
+	for (; pos + 32 <= size; pos += 32, *k += 24) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(src + pos));
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), nibble);
+		__m256i lo = _mm256_and_si256(x, nibble);
+		__m256i roll, merge;
+		__m128i half;
+		IUINT32 tail;
+		lo = _mm256_shuffle_epi8(lut_lo, lo);
+		roll = _mm256_add_epi8(_mm256_cmpeq_epi8(x, 
+				_mm256_set1_epi8(0x2f)), hi);
+		hi = _mm256_shuffle_epi8(lut_hi, hi);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, 
+			hi), _mm256_setzero_si256())) != -1) 
+			break;
+		x = _mm256_add_epi8(x, _mm256_shuffle_epi8(lut_roll, roll));
+		merge = _mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140));
+		merge = _mm256_madd_epi16(merge, _mm256_set1_epi32(0x00011000));
+		merge = _mm256_shuffle_epi8(merge, shuf);
+		half = _mm256_castsi256_si128(merge);
+		_mm_storel_epi64((__m128i*)(dst + *k), half);
+		tail = (IUINT32)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+		memcpy(dst + *k + 8, &tail, 4);
+		half = _mm256_extracti128_si256(merge, 1);
+		_mm_storel_epi64((__m128i*)(dst + *k + 12), half);
+		tail = (IUINT32)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+		memcpy(dst + *k + 20, &tail, 4);
+	}
+	return pos;
+}
+
+ICPU_TARGET("ssse3")
+static ilong ibase16_encode_ssse3(const IUINT8 *src, ilong pos, ilong size,
+	char *dst)
+{
+	const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', 
+			'7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+	__m128i nibble = _mm_set1_epi8(0x0f);
+	for (; pos + 16 <= size; pos += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + pos));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+		__m128i lo = _mm_and_si128(x, nibble);
+		hi = _mm_shuffle_epi8(lut, hi);
+		lo = _mm_shuffle_epi8(lut, lo);
+		_mm_storeu_si128((__m128i*)(dst + pos * 2), 
+				_mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(dst + pos * 2 + 16), 
+				_mm_unpackhi_epi8(hi, lo));
+	}
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static ilong ibase16_encode_avx2(const IUINT8 *src, ilong pos, ilong size,
+	char *dst)
+{
+	const __m256i lut = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+			'7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F', '0', '1', '2', '3', 
+			'4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+	__m256i nibble = _mm256_set1_epi8(0x0f);
+	for (; pos + 32 <= size; pos += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(src + pos));
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+		__m256i lo = _mm256_and_si256(x, nibble);
+		__m256i u0, u1;
+		hi = _mm256_shuffle_epi8(lut, hi);
+		lo = _mm256_shuffle_epi8(lut, lo);
+		u0 = _mm256_unpacklo_epi8(hi, lo);
+		u1 = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i*)(dst + pos * 2), 
+				_mm256_permute2x128_si256(u0, u1, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + pos * 2 + 32), 
+				_mm256_permute2x128_si256(u0, u1, 0x31));
+	}
+	return pos;
+}
+
+/* hex chars to nibble values, lanes of invalid chars are cleared in ok */
+ICPU_TARGET("ssse3")
+static inline __m128i ibase16_nibble(__m128i x, __m128i *ok)
+{
+	__m128i d = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+	__m128i a = _mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)),
+			_mm_set1_epi8('a'));
+	__m128i minus = _mm_set1_epi8(-1);
+	__m128i isd = _mm_and_si128(_mm_cmpgt_epi8(d, minus),
+			_mm_cmpgt_epi8(_mm_set1_epi8(10), d));
+	__m128i isa = _mm_and_si128(_mm_cmpgt_epi8(a, minus),
+			_mm_cmpgt_epi8(_mm_set1_epi8(6), a));
+	*ok = _mm_and_si128(*ok, _mm_or_si128(isd, isa));
+	a = _mm_add_epi8(a, _mm_set1_epi8(10));
+	return _mm_or_si128(_mm_and_si128(isd, d), _mm_and_si128(isa, a));
+}
+
+ICPU_TARGET("ssse3")
+static ilong ibase16_decode_ssse3(const IUINT8 *src, ilong pos, ilong size,
+	IUINT8 *dst, ilong *k)
+{
+	__m128i weight = _mm_set1_epi16(0x0110);
+	for (; pos + 32 <= size; pos += 32, *k += 16) {
+		__m128i ok = _mm_set1_epi8(-1);
+		__m128i x0 = _mm_loadu_si128((const __m128i*)(src + pos));
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(src + pos + 16));
+		x0 = ibase16_nibble(x0, &ok);
+		x1 = ibase16_nibble(x1, &ok);
+		if (_mm_movemask_epi8(ok) != 0xffff) break;
+		x0 = _mm_maddubs_epi16(x0, weight);
+		x1 = _mm_maddubs_epi16(x1, weight);
+		_mm_storeu_si128((__m128i*)(dst + *k), _mm_packus_epi16(x0, x1));
+	}
+	return pos;
+}
+#endif
+
+/* returns non-zero if the vector kernels can be used */
+static inline int ibase_simd(void)
+{
+#ifdef ICPU_X86
+	return icpu_features() & ICPU_SSSE3;
+#else
+	return 0;
+#endif
+}
+
+/* convert leading whole blocks, returns input bytes consumed */
+static ilong ibase64_encode_bulk(const IUINT8 *src, ilong size, char *dst,
+	ilong *k)
+{
+	ilong pos = 0;
+#ifdef ICPU_X86
+	int features = icpu_features();
+	if (features & ICPU_AVX2) {
+		pos = ibase64_encode_avx2(src, pos, size, dst, k);
+	}
+	if (features & ICPU_SSSE3) {
+		pos = ibase64_encode_ssse3(src, pos, size, dst, k);
+	}
+#endif
+	return pos;
+}
+
+static ilong ibase64_decode_bulk(const IUINT8 *src, ilong size, IUINT8 *dst,
+	ilong *k)
+{
+	ilong pos = 0;
+#ifdef ICPU_X86
+	int features = icpu_features();
+	if (features & ICPU_AVX2) {
+		pos = ibase64_decode_avx2(src, pos, size, dst, k);
+	}
+	if (features & ICPU_SSSE3) {
+		pos = ibase64_decode_ssse3(src, pos, size, dst, k);
+	}
+#endif
+	return pos;
+}
+
+/* scalar lookup shared by ibase64_decode and the streaming decoder:
+ * '=' maps to 0, characters out of the alphabet to 88 */
+static iulong ibase64_dtable[256] = { 0xff };
+
+static void ibase64_dinit(void)
+{
+	iulong i;
+	if (ibase64_dtable[0] != 0xff) return;
+	for (i = 1; i < 256; i++) {
+		if (i >= 'A' && i <= 'Z') ibase64_dtable[i] = i - 'A';
+		else if (i >= 'a' && i <= 'z') ibase64_dtable[i] = i - 'a' + 26;
+		else if (i >= '0' && i <= '9') ibase64_dtable[i] = i - '0' + 52;
+		else if (i == '+') ibase64_dtable[i] = 62;
+		else if (i == '/') ibase64_dtable[i] = 63;
+		else if (i == '=') ibase64_dtable[i] = 0;
+		else ibase64_dtable[i] = 88;
+	}
+	ibase64_dtable[0] = 88;
+}
+
+static const char ibase64_etable[] = 
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
 /* encode data as a base64 string, returns string size,
    if dst == 0, returns how many bytes needed for encode (>=real) */
 ilong ibase64_encode(const void *src, ilong size, char *dst)
 {
 	const IUINT8 *s = (const IUINT8*)src;
-	static const char encode[] = 
-	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const char *encode = ibase64_etable;
 	iulong c;
 	char *d = dst;
-	int i;
+	ilong i, k = 0;
 
 	if (size == 0) return 0;
 
@@ -2507,7 +4491,10 @@ ilong ibase64_encode(const void *src, ilong size, char *dst)
 		return result;
 	}
 
-	for (i = 0; i < size; ) {
+	i = ibase64_encode_bulk(s, size, dst, &k);
+	d += k;
+
+	for (; i < size; ) {
 		c = s[i]; 
 		c <<= 8;
 		i++;
@@ -2529,10 +4516,10 @@ ilong ibase64_encode(const void *src, ilong size, char *dst)
 /* decode a base64 string into data, returns data size */
 ilong ibase64_decode(const char *src, ilong size, void *dst)
 {
-	static iulong decode[256] = { 0xff };
+	const iulong *decode = ibase64_dtable;
 	const IUINT8 *s = (const IUINT8*)src;
 	IUINT8 *d = (IUINT8*)dst;
-	iulong mark, i, j, c, k;
+	iulong mark, i, j, c, k, retry;
 	char b[3];
 
 	if (size == 0) return 0;
@@ -2544,18 +4531,8 @@ ilong ibase64_decode(const char *src, ilong size, void *dst)
 		return nbytes;
 	}
 
-	if (decode[0] == 0xff) {
-		for (i = 1; i < 256; i++) {
-			if (i >= 'A' && i <= 'Z') decode[i] = i - 'A';
-			else if (i >= 'a' && i <= 'z') decode[i] = i - 'a' + 26;
-			else if (i >= '0' && i <= '9') decode[i] = i - '0' + 52;
-			else if (i == '+') decode[i] = 62;
-			else if (i == '/') decode[i] = 63;
-			else if (i == '=') decode[i] = 0;
-			else decode[i] = 88;
-		}
-		decode[0] = 88;
-	}
+	ibase64_dinit();
+	retry = ibase_simd()? 0 : (iulong)size;
 
 	#define ibase64_skip(s, i, size) {					\
 			for (; i < size; i++) {						\
@@ -2565,6 +4542,16 @@ ilong ibase64_decode(const char *src, ilong size, void *dst)
 		}
 	
 	for (i = 0, j = 0, k = 0; i < (iulong)size; ) {
+		/* vector path from group boundaries, retried after each
+		 * block that contains separators or padding */
+		if (i >= retry && (iulong)size - i >= 16) {
+			ilong n = (ilong)k;
+			i += (iulong)ibase64_decode_bulk(s + i, size - i, d, &n);
+			k = (iulong)n;
+			retry = i + 16;
+			if (i >= (iulong)size) break;
+		}
+
 		mark = 0;
 		c = 0;
 
@@ -2603,6 +4590,113 @@ ilong ibase64_decode(const char *src, ilong size, void *dst)
 	return (ilong)k;
 }
 
+/* reset streaming state */
+void ibase64_state_init(struct IBASE64STATE *state)
+{
+	state->bits = 0;
+	state->count = 0;
+	state->done = 0;
+}
+
+/* encode a chunk, 0-2 trailing bytes are kept in state */
+ilong ibase64_encode_update(struct IBASE64STATE *state, const void *src,
+	ilong size, char *dst)
+{
+	const IUINT8 *s = (const IUINT8*)src;
+	const char *encode = ibase64_etable;
+	ilong i = 0, k = 0;
+	IUINT32 c;
+
+	for (; state->count > 0 && state->count < 3 && i < size; i++) {
+		state->bits = (state->bits << 8) | s[i];
+		state->count++;
+	}
+
+	if (state->count == 3) {
+		c = state->bits;
+		dst[k++] = encode[(c >> 18) & 0x3f];
+		dst[k++] = encode[(c >> 12) & 0x3f];
+		dst[k++] = encode[(c >> 6) & 0x3f];
+		dst[k++] = encode[(c >> 0) & 0x3f];
+		state->bits = 0;
+		state->count = 0;
+	}
+
+	if (state->count == 0) {
+		i += ibase64_encode_bulk(s + i, size - i, dst, &k);
+		for (; i + 3 <= size; i += 3) {
+			c = ((IUINT32)s[i] << 16) | ((IUINT32)s[i + 1] << 8) | s[i + 2];
+			dst[k++] = encode[(c >> 18) & 0x3f];
+			dst[k++] = encode[(c >> 12) & 0x3f];
+			dst[k++] = encode[(c >> 6) & 0x3f];
+			dst[k++] = encode[(c >> 0) & 0x3f];
+		}
+		for (; i < size; i++) {
+			state->bits = (state->bits << 8) | s[i];
+			state->count++;
+		}
+	}
+
+	return k;
+}
+
+/* encode the kept bytes with padding */
+ilong ibase64_encode_final(struct IBASE64STATE *state, char *dst)
+{
+	const char *encode = ibase64_etable;
+	IUINT32 c;
+	if (state->count == 0) return 0;
+	c = state->bits << (8 * (3 - state->count));
+	dst[0] = encode[(c >> 18) & 0x3f];
+	dst[1] = encode[(c >> 12) & 0x3f];
+	dst[2] = (state->count == 2)? encode[(c >> 6) & 0x3f] : '=';
+	dst[3] = '=';
+	ibase64_state_init(state);
+	return 4;
+}
+
+/* decode a chunk, an incomplete group is kept in state */
+ilong ibase64_decode_update(struct IBASE64STATE *state, const char *src,
+	ilong size, void *dst)
+{
+	const IUINT8 *s = (const IUINT8*)src;
+	IUINT8 *d = (IUINT8*)dst;
+	ilong i = 0, k = 0, retry;
+
+	if (size < 0) size = (ilong)strlen(src);
+
+	ibase64_dinit();
+	retry = ibase_simd()? 0 : size;
+
+	for (; i < size && state->done == 0; i++) {
+		iulong v;
+		if (state->count == 0 && i >= retry && size - i >= 16) {
+			i += ibase64_decode_bulk(s + i, size - i, d, &k);
+			retry = i + 16;
+			if (i >= size) break;
+		}
+		v = ibase64_dtable[s[i]];
+		if (v > 64) continue;
+		if (state->count >= 2 && s[i] == '=') {
+			IUINT32 c = state->bits << (6 * (4 - state->count));
+			d[k++] = (IUINT8)((c >> 16) & 0xff);
+			if (state->count == 3) d[k++] = (IUINT8)((c >> 8) & 0xff);
+			state->done = 1;
+			break;
+		}
+		state->bits = (state->bits << 6) | (IUINT32)v;
+		if (++state->count == 4) {
+			d[k++] = (IUINT8)((state->bits >> 16) & 0xff);
+			d[k++] = (IUINT8)((state->bits >> 8) & 0xff);
+			d[k++] = (IUINT8)((state->bits >> 0) & 0xff);
+			state->bits = 0;
+			state->count = 0;
+		}
+	}
+
+	return k;
+}
+
 /* encode data as a base32 string, returns string size */
 ilong ibase32_encode(const void *src, ilong size, char *dst)
 {
@@ -2621,7 +4715,22 @@ ilong ibase32_encode(const void *src, ilong size, char *dst)
 		return result;
 	}
 
-	for (i = 0, index = 0; i < size; ) {
+	/* whole 5 bytes groups, 8 chars each */
+	for (i = 0; i + 5 <= size; i += 5, dst += 8) {
+		IUINT64 x = ((IUINT64)buffer[i] << 32) | 
+			((IUINT64)buffer[i + 1] << 24) | ((IUINT32)buffer[i + 2] << 16) |
+			((IUINT32)buffer[i + 3] << 8) | buffer[i + 4];
+		dst[0] = encode[(x >> 35) & 31];
+		dst[1] = encode[(x >> 30) & 31];
+		dst[2] = encode[(x >> 25) & 31];
+		dst[3] = encode[(x >> 20) & 31];
+		dst[4] = encode[(x >> 15) & 31];
+		dst[5] = encode[(x >> 10) & 31];
+		dst[6] = encode[(x >> 5) & 31];
+		dst[7] = encode[(x >> 0) & 31];
+	}
+
+	for (index = 0; i < size; ) {
 		if (index > 3) {
 			word = (buffer[i] & (0xFF >> index));
 			index = (index + 5) % 8;
@@ -2647,6 +4756,22 @@ ilong ibase32_encode(const void *src, ilong size, char *dst)
 	return (ilong)(dst - ptr);
 }
 
+/* 5 bits values of the base32 alphabet, 0x20 for other chars */
+static IUINT8 ibase32_dtable[256] = { 0xff };
+
+static void ibase32_dinit(void)
+{
+	int i;
+	if (ibase32_dtable[0] != 0xff) return;
+	for (i = 1; i < 256; i++) {
+		if (i >= '2' && i <= '7') ibase32_dtable[i] = (IUINT8)(i - '2' + 26);
+		else if (i >= 'A' && i <= 'Z') ibase32_dtable[i] = (IUINT8)(i - 'A');
+		else if (i >= 'a' && i <= 'z') ibase32_dtable[i] = (IUINT8)(i - 'a');
+		else ibase32_dtable[i] = 0x20;
+	}
+	ibase32_dtable[0] = 0x20;
+}
+
 /* decode a base32 string into data, returns data size */
 ilong ibase32_decode(const char *src, ilong size, void *dst)
 {
@@ -2664,7 +4789,26 @@ ilong ibase32_decode(const char *src, ilong size, void *dst)
 		return need;
 	}
 
-	for(i = 0, index = 0, offset = 0, last = -1; i < size; i++) {
+	ibase32_dinit();
+
+	/* leading groups of 8 valid chars, 5 bytes each */
+	for (i = 0, offset = 0; i + 8 <= size; i += 8, offset += 5) {
+		const IUINT8 *p = lptr + i;
+		IUINT32 a = ibase32_dtable[p[0]], b = ibase32_dtable[p[1]];
+		IUINT32 c = ibase32_dtable[p[2]], d = ibase32_dtable[p[3]];
+		IUINT32 e = ibase32_dtable[p[4]], f = ibase32_dtable[p[5]];
+		IUINT32 g = ibase32_dtable[p[6]], h = ibase32_dtable[p[7]];
+		IUINT32 hi = (a << 15) | (b << 10) | (c << 5) | d;
+		IUINT32 lo = (e << 15) | (f << 10) | (g << 5) | h;
+		if ((a | b | c | d | e | f | g | h) & 0x20) break;
+		buffer[offset + 0] = (IUINT8)(hi >> 12);
+		buffer[offset + 1] = (IUINT8)(hi >> 4);
+		buffer[offset + 2] = (IUINT8)((hi << 4) | (lo >> 16));
+		buffer[offset + 3] = (IUINT8)(lo >> 8);
+		buffer[offset + 4] = (IUINT8)(lo >> 0);
+	}
+
+	for(index = 0, last = offset - 1; i < size; i++) {
 		IUINT8 ch = lptr[i];
 
 		if (ch >= '2' && ch <= '7') word = ch - '2' + 26;
@@ -2703,6 +4847,21 @@ ilong ibase16_encode(const void *src, ilong size, char *dst)
 	char *output = dst;
 	if (src == NULL || dst == NULL) 
 		return 2 * size;
+#ifdef ICPU_X86
+	if (size >= 16) {
+		int features = icpu_features();
+		ilong pos = 0;
+		if (features & ICPU_AVX2) {
+			pos = ibase16_encode_avx2(ptr, pos, size, dst);
+		}
+		if (features & ICPU_SSSE3) {
+			pos = ibase16_encode_ssse3(ptr, pos, size, dst);
+		}
+		ptr += pos;
+		output += pos * 2;
+		size -= pos;
+	}
+#endif
 	for (; size > 0; output += 2, ptr++, size--) {
 		output[0] = encode[ptr[0] >> 4];
 		output[1] = encode[ptr[0] & 15];
@@ -2716,6 +4875,10 @@ ilong ibase16_decode(const char *src, ilong size, void *dst)
 	const IUINT8 *in = (const IUINT8*)src;
 	IUINT8 *out = (IUINT8*)dst, word = 0, decode = 0;
 	int index = 0;
+#ifdef ICPU_X86
+	int simd = ibase_simd();
+	const IUINT8 *retry = in;
+#endif
 
 	if (size == 0) return 0;
 	if (size < 0) size = strlen(src);
@@ -2724,7 +4887,18 @@ ilong ibase16_decode(const char *src, ilong size, void *dst)
 		return size >> 1;
 	
 	for (; size > 0; size--) {
-		IUINT8 ch = *in++;
+		IUINT8 ch;
+#ifdef ICPU_X86
+		if (simd && index == 0 && in >= retry && size >= 32) {
+			ilong n = 0, pos = ibase16_decode_ssse3(in, 0, size, out, &n);
+			in += pos;
+			out += n;
+			size -= pos;
+			retry = in + 32;
+			if (size == 0) break;
+		}
+#endif
+		ch = *in++;
 		if (ch >= '0' && ch <= '9') word = ch - '0';
 		else if (ch >= 'A' && ch <= 'F') word = ch - 'A' + 10;
 		else if (ch >= 'a' && ch <= 'f') word = ch - 'a' + 10;
@@ -2791,3 +4965,280 @@ void icrypt_rc4_crypt(unsigned char *box, int *x, int *y,
 }
 
 
+/**********************************************************************
+ * CHACHA20
+ **********************************************************************/
+#define ICHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define ICHACHA_QR(a, b, c, d) do { \
+		a += b; d ^= a; d = ICHACHA_ROTL(d, 16); \
+		c += d; b ^= c; b = ICHACHA_ROTL(b, 12); \
+		a += b; d ^= a; d = ICHACHA_ROTL(d, 8); \
+		c += d; b ^= c; b = ICHACHA_ROTL(b, 7); \
+	}	while (0)
+
+/* chacha20 init */
+int icrypt_chacha20_init(struct ICHACHA20 *ctx, const unsigned char *key,
+	int keylen, const unsigned char *nonce)
+{
+	static const char *sigma = "expand 32-byte k";
+	static const char *tau = "expand 16-byte k";
+	const char *constants = (keylen == 32)? sigma : tau;
+	int i;
+	if (keylen != 16 && keylen != 32) return -1;
+	for (i = 0; i < 4; i++) {
+		idecode32u_lsb(constants + i * 4, &ctx->state[i]);
+		idecode32u_lsb((const char*)key + i * 4, &ctx->state[4 + i]);
+		idecode32u_lsb((const char*)key + (keylen - 16) + i * 4,
+			&ctx->state[8 + i]);
+	}
+	ctx->state[12] = 0;
+	ctx->state[13] = 0;
+	ctx->state[14] = 0;
+	ctx->state[15] = 0;
+	if (nonce) {
+		idecode32u_lsb((const char*)nonce, &ctx->state[14]);
+		idecode32u_lsb((const char*)nonce + 4, &ctx->state[15]);
+	}
+	ctx->offset = 64;
+	return 0;
+}
+
+/* advance 64-bit block counter */
+static inline void icrypt_chacha20_next(IUINT32 *state, IUINT32 blocks)
+{
+	IUINT32 counter = state[12];
+	state[12] = counter + blocks;
+	if (state[12] < counter) state[13]++;
+}
+
+/* one keystream block */
+static void icrypt_chacha20_block(IUINT32 *state, unsigned char *out)
+{
+	IUINT32 x[16];
+	int i;
+	for (i = 0; i < 16; i++) x[i] = state[i];
+	for (i = 0; i < 10; i++) {
+		ICHACHA_QR(x[0], x[4], x[8], x[12]);
+		ICHACHA_QR(x[1], x[5], x[9], x[13]);
+		ICHACHA_QR(x[2], x[6], x[10], x[14]);
+		ICHACHA_QR(x[3], x[7], x[11], x[15]);
+		ICHACHA_QR(x[0], x[5], x[10], x[15]);
+		ICHACHA_QR(x[1], x[6], x[11], x[12]);
+		ICHACHA_QR(x[2], x[7], x[8], x[13]);
+		ICHACHA_QR(x[3], x[4], x[9], x[14]);
+	}
+	for (i = 0; i < 16; i++) {
+		iencode32u_lsb((char*)out + i * 4, x[i] + state[i]);
+	}
+	icrypt_chacha20_next(state, 1);
+}
+
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+
+/* the 4 lanes of x[0..15] hold words of blocks counter + 0..3 */
+#define ICHACHA_ROTL_SSE2(v, n) \
+	_mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define ICHACHA_QR_SSE2(a, b, c, d) do { \
+		a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+		d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, 0xb1), 0xb1); \
+		c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+		b = ICHACHA_ROTL_SSE2(b, 12); \
+		a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+		d = ICHACHA_ROTL_SSE2(d, 8); \
+		c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+		b = ICHACHA_ROTL_SSE2(b, 7); \
+	}	while (0)
+
+/* xor blocks (multiple of 4) with keystream */
+ICPU_TARGET("sse2")
+static void icrypt_chacha20_sse2(IUINT32 *state, const unsigned char *src,
+	unsigned char *dst, ilong blocks)
+{
+	for (; blocks >= 4; blocks -= 4, src += 256, dst += 256) {
+		__m128i x[16], o[16];
+		IUINT32 lo = state[12], hi = state[13];
+		int i, k;
+		for (i = 0; i < 16; i++) o[i] = _mm_set1_epi32((int)state[i]);
+		o[12] = _mm_setr_epi32((int)lo, (int)(lo + 1), (int)(lo + 2), 
+			(int)(lo + 3));
+		o[13] = _mm_setr_epi32((int)hi, (int)(hi + (lo + 1 < lo)),
+			(int)(hi + (lo + 2 < lo)), (int)(hi + (lo + 3 < lo)));
+		for (i = 0; i < 16; i++) x[i] = o[i];
+		for (i = 0; i < 10; i++) {
+			ICHACHA_QR_SSE2(x[0], x[4], x[8], x[12]);
+			ICHACHA_QR_SSE2(x[1], x[5], x[9], x[13]);
+			ICHACHA_QR_SSE2(x[2], x[6], x[10], x[14]);
+			ICHACHA_QR_SSE2(x[3], x[7], x[11], x[15]);
+			ICHACHA_QR_SSE2(x[0], x[5], x[10], x[15]);
+			ICHACHA_QR_SSE2(x[1], x[6], x[11], x[12]);
+			ICHACHA_QR_SSE2(x[2], x[7], x[8], x[13]);
+			ICHACHA_QR_SSE2(x[3], x[4], x[9], x[14]);
+		}
+		for (i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], o[i]);
+		/* transpose words 4k..4k+3 of the 4 blocks */
+		for (k = 0; k < 4; k++) {
+			__m128i t0 = _mm_unpacklo_epi32(x[k * 4], x[k * 4 + 1]);
+			__m128i t1 = _mm_unpacklo_epi32(x[k * 4 + 2], x[k * 4 + 3]);
+			__m128i t2 = _mm_unpackhi_epi32(x[k * 4], x[k * 4 + 1]);
+			__m128i t3 = _mm_unpackhi_epi32(x[k * 4 + 2], x[k * 4 + 3]);
+			__m128i r[4];
+			r[0] = _mm_unpacklo_epi64(t0, t1);
+			r[1] = _mm_unpackhi_epi64(t0, t1);
+			r[2] = _mm_unpacklo_epi64(t2, t3);
+			r[3] = _mm_unpackhi_epi64(t2, t3);
+			for (i = 0; i < 4; i++) {
+				const __m128i *s = (const __m128i*)(src + i * 64 + k * 16);
+				__m128i *d = (__m128i*)(dst + i * 64 + k * 16);
+				_mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(s), r[i]));
+			}
+		}
+		icrypt_chacha20_next(state, 4);
+	}
+}
+
+/* the 8 lanes of x[0..15] hold words of blocks counter + 0..7 */
+#define ICHACHA_ROTL_AVX2(v, n) \
+	_mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+#define ICHACHA_QR_AVX2(a, b, c, d) do { \
+		a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); \
+		d = _mm256_shuffle_epi8(d, r16); \
+		c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); \
+		b = ICHACHA_ROTL_AVX2(b, 12); \
+		a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); \
+		d = _mm256_shuffle_epi8(d, r8); \
+		c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); \
+		b = ICHACHA_ROTL_AVX2(b, 7); \
+	}	while (0)
+
+/* xor blocks (multiple of 8) with keystream */
+ICPU_TARGET("avx2")
+static void icrypt_chacha20_avx2(IUINT32 *state, const unsigned char *src,
+	unsigned char *dst, ilong blocks)
+{
+	const __m256i r16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 
+		10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 
+		10, 11, 8, 9, 14, 15, 12, 13);
+	const __m256i r8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 
+		11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 
+		11, 8, 9, 10, 15, 12, 13, 14);
+	for (; blocks >= 8; blocks -= 8, src += 512, dst += 512) {
+		__m256i x[16], o[16];
+		IUINT32 lo = state[12], hi = state[13], c[8];
+		int i, k;
+		for (i = 0; i < 16; i++) o[i] = _mm256_set1_epi32((int)state[i]);
+		for (i = 0; i < 8; i++) c[i] = hi + ((IUINT32)(lo + i) < lo);
+		o[12] = _mm256_add_epi32(o[12], _mm256_setr_epi32(0, 1, 2, 3, 
+			4, 5, 6, 7));
+		o[13] = _mm256_loadu_si256((const __m256i*)c);
+		for (i = 0; i < 16; i++) x[i] = o[i];
+		for (i = 0; i < 10; i++) {
+			ICHACHA_QR_AVX2(x[0], x[4], x[8], x[12]);
+			ICHACHA_QR_AVX2(x[1], x[5], x[9], x[13]);
+			ICHACHA_QR_AVX2(x[2], x[6], x[10], x[14]);
+			ICHACHA_QR_AVX2(x[3], x[7], x[11], x[15]);
+			ICHACHA_QR_AVX2(x[0], x[5], x[10], x[15]);
+			ICHACHA_QR_AVX2(x[1], x[6], x[11], x[12]);
+			ICHACHA_QR_AVX2(x[2], x[7], x[8], x[13]);
+			ICHACHA_QR_AVX2(x[3], x[4], x[9], x[14]);
+		}
+		for (i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], o[i]);
+		/* transpose in 128-bit lanes: r[k][i] has words 4k..4k+3 of
+		 * block i in the low lane and of block i + 4 in the high one */
+		for (k = 0; k < 4; k++) {
+			__m256i t0 = _mm256_unpacklo_epi32(x[k * 4], x[k * 4 + 1]);
+			__m256i t1 = _mm256_unpacklo_epi32(x[k * 4 + 2], x[k * 4 + 3]);
+			__m256i t2 = _mm256_unpackhi_epi32(x[k * 4], x[k * 4 + 1]);
+			__m256i t3 = _mm256_unpackhi_epi32(x[k * 4 + 2], x[k * 4 + 3]);
+			x[k * 4 + 0] = _mm256_unpacklo_epi64(t0, t1);
+			x[k * 4 + 1] = _mm256_unpackhi_epi64(t0, t1);
+			x[k * 4 + 2] = _mm256_unpacklo_epi64(t2, t3);
+			x[k * 4 + 3] = _mm256_unpackhi_epi64(t2, t3);
+		}
+		for (i = 0; i < 4; i++) {
+			__m256i b[4];
+			b[0] = _mm256_permute2x128_si256(x[i], x[4 + i], 0x20);
+			b[1] = _mm256_permute2x128_si256(x[8 + i], x[12 + i], 0x20);
+			b[2] = _mm256_permute2x128_si256(x[i], x[4 + i], 0x31);
+			b[3] = _mm256_permute2x128_si256(x[8 + i], x[12 + i], 0x31);
+			for (k = 0; k < 4; k++) {
+				ilong pos = (k < 2)? (i * 64 + k * 32) : 
+					((i + 4) * 64 + (k - 2) * 32);
+				const __m256i *s = (const __m256i*)(src + pos);
+				__m256i *d = (__m256i*)(dst + pos);
+				_mm256_storeu_si256(d, 
+					_mm256_xor_si256(_mm256_loadu_si256(s), b[k]));
+			}
+		}
+		icrypt_chacha20_next(state, 8);
+	}
+}
+
+#endif
+
+/* chacha20 crypt */
+void icrypt_chacha20_crypt(struct ICHACHA20 *ctx, const unsigned char *src,
+	unsigned char *dst, ilong size)
+{
+	ilong i;
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+	int cpu;
+#endif
+	for (; ctx->offset < 64 && size > 0; size--) {
+		*dst++ = *src++ ^ ctx->stream[ctx->offset++];
+	}
+	if (size <= 0) return;
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+	cpu = icpu_features();
+	if ((cpu & ICPU_AVX2) && size >= 512) {
+		ilong n = size & ~((ilong)511);
+		icrypt_chacha20_avx2(ctx->state, src, dst, n >> 6);
+		src += n;
+		dst += n;
+		size -= n;
+	}
+	if ((cpu & ICPU_SSE2) && size >= 256) {
+		ilong n = size & ~((ilong)255);
+		icrypt_chacha20_sse2(ctx->state, src, dst, n >> 6);
+		src += n;
+		dst += n;
+		size -= n;
+	}
+#endif
+	for (; size >= 64; size -= 64, src += 64, dst += 64) {
+		icrypt_chacha20_block(ctx->state, ctx->stream);
+		for (i = 0; i < 64; i++) dst[i] = src[i] ^ ctx->stream[i];
+	}
+	if (size > 0) {
+		icrypt_chacha20_block(ctx->state, ctx->stream);
+		for (i = 0; i < size; i++) dst[i] = src[i] ^ ctx->stream[i];
+		ctx->offset = (int)size;
+	}
+}
+
+/* skip keystream */
+void icrypt_chacha20_skip(struct ICHACHA20 *ctx, IINT64 size)
+{
+	IINT64 blocks;
+	if (size <= 0) return;
+	if (ctx->offset < 64) {
+		int canskip = 64 - ctx->offset;
+		if (size <= canskip) {
+			ctx->offset += (int)size;
+			return;
+		}
+		ctx->offset = 64;
+		size -= canskip;
+	}
+	blocks = size >> 6;
+	ctx->state[13] += (IUINT32)(blocks >> 32);
+	icrypt_chacha20_next(ctx->state, (IUINT32)(blocks & 0xffffffff));
+	if (size & 63) {
+		icrypt_chacha20_block(ctx->state, ctx->stream);
+		ctx->offset = (int)(size & 63);
+	}
+}
+
+
@@ -781,6 +781,96 @@ int idict_del_s(idict_t *dict, const char *key, ilong keysize);
 int idict_del_i(idict_t *dict, ilong key);
 
 
+/*-------------------------------------------------------------------*/
+/* ICDICT - thread-safe dictionary for read-mostly workloads         */
+/*                                                                   */
+/* keys are spread over 2^shift stripes by hash, every stripe is an  */
+/* idict_t guarded by its own IRWLOCK. searches take the read lock   */
+/* and never touch the lru cache, so readers only share the lock of  */
+/* their stripe. values are copied out, as entries may be changed  */
+/* by other threads once the lock is released.                       */
+/*-------------------------------------------------------------------*/
+#define ICDICT_CACHELINE	64
+
+struct ICDICTSTRIPE
+{
+	IRWLOCK_TYPE lock;
+	idict_t *dict;
+	char pad[ICDICT_CACHELINE - (sizeof(IRWLOCK_TYPE) + sizeof(void*)) % 
+		ICDICT_CACHELINE];
+};
+
+struct ICDICT
+{
+	struct ICDICTSTRIPE *stripes;	/* cache line aligned */
+	void *buffer;					/* stripes memory */
+	int shift;						/* 2^shift stripes */
+};
+
+typedef struct ICDICT icdict_t;
+
+/* create with 2^shift stripes, shift < 0 for default (64 stripes) */
+icdict_t *icdict_create(int shift);
+
+/* delete concurrent dictionary */
+void icdict_delete(icdict_t *cd);
+
+/* search and copy value into val (initialized by the caller, eg. by 
+ * it_init(val, ITYPE_NONE), destroy it after use), returns 0 for ok, 
+ * -1 for not found */
+int icdict_search(icdict_t *cd, const ivalue_t *key, ivalue_t *val);
+
+/* add (key, val) pair, returns 0 for ok, -1/-2 for key exists, 
+ * -3 for no memory */
+int icdict_add(icdict_t *cd, const ivalue_t *key, const ivalue_t *val);
+
+/* add or update (key, val) pair, returns 0 for ok, -3 for no memory */
+int icdict_update(icdict_t *cd, const ivalue_t *key, const ivalue_t *val);
+
+/* delete pair, returns 0 for ok, -1 for not found */
+int icdict_del(icdict_t *cd, const ivalue_t *key);
+
+/* how many entries (a snapshot while others are writing) */
+ilong icdict_size(icdict_t *cd);
+
+/* clear dictionary */
+void icdict_clear(icdict_t *cd);
+
+/* search: key(str) val(int) */
+int icdict_search_si(icdict_t *cd, const char *key, ilong keysize, 
+	ilong *val);
+
+/* search: key(int) val(int) */
+int icdict_search_ii(icdict_t *cd, ilong key, ilong *val);
+
+/* search: key(str) val(ptr) */
+int icdict_search_sp(icdict_t *cd, const char *key, ilong keysize, 
+	void **ptr);
+
+/* search: key(int) val(ptr) */
+int icdict_search_ip(icdict_t *cd, ilong key, void **ptr);
+
+/* update: key(str) val(int) */
+int icdict_update_si(icdict_t *cd, const char *key, ilong keysize, 
+	ilong val);
+
+/* update: key(int) val(int) */
+int icdict_update_ii(icdict_t *cd, ilong key, ilong val);
+
+/* update: key(str) val(ptr) */
+int icdict_update_sp(icdict_t *cd, const char *key, ilong keysize, 
+	const void *ptr);
+
+/* update: key(int) val(ptr) */
+int icdict_update_ip(icdict_t *cd, ilong key, const void *ptr);
+
+/* delete: key(str) */
+int icdict_del_s(icdict_t *cd, const char *key, ilong keysize);
+
+/* delete: key(int) */
+int icdict_del_i(icdict_t *cd, ilong key);
+
+
 
 
 /**********************************************************************
@@ -1260,6 +1350,25 @@ static inline const char *idecodei(const char *p, IINT64 *value)
 	return p;
 }
 
+/* encode count integers in iencodeu format, returns the end pointer,
+ * ptr needs (count * 10) bytes at most, nothing beyond the returned 
+ * end is written */
+char *iencodeu_array(char *ptr, const IUINT64 *values, ilong count);
+
+/* decode count integers in iencodeu format, never reads beyond 'end',
+ * returns the end pointer or NULL if input ends before count values */
+const char *idecodeu_array(const char *ptr, const char *end, 
+	IUINT64 *values, ilong count);
+
+/* delta + zigzag (iencodei) coding of a sequence: each value is stored
+ * as the difference to its predecessor, values[-1] is taken as 'base' */
+char *iencodei_delta(char *ptr, const IINT64 *values, ilong count, 
+	IINT64 base);
+
+/* decode a delta + zigzag sequence, returns NULL on error */
+const char *idecodei_delta(const char *ptr, const char *end,
+	IINT64 *values, ilong count, IINT64 base);
+
 /* swap byte order of int16 */
 static inline unsigned short iexbyte16(unsigned short word)
 {
@@ -1345,6 +1454,100 @@ ilong iring_ptr(struct IRING *ring, char **p1, ilong *s1, char **p2,
 	ilong *s2);
 
 
+/**********************************************************************
+ * ISPSC: lock-free IRING for one producer and one consumer thread
+ * (or process), positions only grow and are masked by size (power of
+ * 2), each side keeps its own position and a cached copy of the other
+ * one in its own cache line, the other side's position is re-read 
+ * (acquire) only when the cached one is not enough.
+ **********************************************************************/
+#define ISPSC_CACHELINE		64
+
+struct ISPSC_CTRL		/* positions, can be placed in shared memory */
+{
+	volatile ilong head;		/* write position, stored by producer */
+	ilong tail_cache;			/* producer's copy of tail */
+	char pad1[ISPSC_CACHELINE - sizeof(ilong) * 2];
+	volatile ilong tail;		/* read position, stored by consumer */
+	ilong head_cache;			/* consumer's copy of head */
+	char pad2[ISPSC_CACHELINE - sizeof(ilong) * 2];
+};
+
+struct ISPSC
+{
+	struct ISPSC_CTRL *ctrl;	/* positions: &local or external */
+	char *data;					/* memory address */
+	ilong size;					/* total mem-size (power of 2) */
+	ilong mask;					/* size - 1 */
+	char pad[ISPSC_CACHELINE];
+	struct ISPSC_CTRL local;
+};
+
+typedef struct ISPSC ispsc_t;
+
+
+/* init with internal positions: returns 0 or -1 if size is not 2^n */
+int ispsc_init(struct ISPSC *ring, void *buffer, ilong size);
+
+/* init with external positions (eg. shared memory), ctrl is kept */
+int ispsc_attach(struct ISPSC *ring, struct ISPSC_CTRL *ctrl, 
+	void *buffer, ilong size);
+
+/* reset positions, neither side may be using it */
+void ispsc_ctrl_init(struct ISPSC_CTRL *ctrl);
+
+/* producer: get free space size */
+ilong ispsc_fsize(struct ISPSC *ring);
+
+/* producer: write data, returns bytes written (less if full) */
+ilong ispsc_write(struct ISPSC *ring, const void *data, ilong size);
+
+/* producer: free space as two segments for writing in place, the 
+ * other side is re-read only if less than need is cached, returns 
+ * free size */
+ilong ispsc_reserve(struct ISPSC *ring, ilong need, char **p1, ilong *s1,
+	char **p2, ilong *s2);
+
+/* producer: publish size bytes written into reserved space */
+void ispsc_commit(struct ISPSC *ring, ilong size);
+
+/* consumer: get data size */
+ilong ispsc_dsize(struct ISPSC *ring);
+
+/* consumer: peek data (no drop), returns bytes copied */
+ilong ispsc_peek(struct ISPSC *ring, void *data, ilong size);
+
+/* consumer: read data and drop them, returns bytes read */
+ilong ispsc_read(struct ISPSC *ring, void *data, ilong size);
+
+/* consumer: data as two segments (like iring_ptr), returns data size */
+ilong ispsc_ptr(struct ISPSC *ring, char **p1, ilong *s1, char **p2, 
+	ilong *s2);
+
+/* consumer: release size bytes to the producer */
+void ispsc_drop(struct ISPSC *ring, ilong size);
+
+
+/**********************************************************************
+ * IMSREF: refcounted read-only buffer, can be referenced by streams
+ **********************************************************************/
+struct IMSREF
+{
+	volatile ilong refcnt;
+	ilong size;
+	char *data;
+};
+
+/* new buffer with a copy of ptr (if not NULL), refcnt starts at 1 */
+struct IMSREF *ims_ref_new(const void *ptr, ilong size);
+
+/* add a reference */
+void ims_ref_inc(struct IMSREF *ref);
+
+/* release a reference, buffer is freed when the last one goes */
+void ims_ref_dec(struct IMSREF *ref);
+
+
 /**********************************************************************
  * IMSTREAM: The struct definition of the memory stream descriptor
  **********************************************************************/
@@ -1382,12 +1585,25 @@ ilong ims_peek(const struct IMSTREAM *s, void *ptr, ilong size);
 /* drop data from memory stream */
 ilong ims_drop(struct IMSTREAM *s, ilong size);
 
+/* overwrite data at offset from the read position, size is unchanged */
+ilong ims_poke(struct IMSTREAM *s, ilong pos, const void *ptr, ilong size);
+
 /* clear stream */
 void ims_clear(struct IMSTREAM *s);
 
 /* get flat ptr and size */
 ilong ims_flat(const struct IMSTREAM *s, void **pointer);
 
+/* get ptr and size of up to count pages, returns pages filled */
+int ims_iovec(const struct IMSTREAM *s, void *vecptr[], long veclen[],
+	int count);
+
+/* append size bytes of ref at offset without copying, the stream holds
+ * a reference until the data is dropped. referenced bytes are read-only
+ * and must not be changed by ims_poke */
+ilong ims_write_ref(struct IMSTREAM *s, struct IMSREF *ref, ilong offset,
+	ilong size);
+
 
 
 /**********************************************************************
@@ -1477,6 +1693,23 @@ int illtoa(IINT64 val, char *buf, int radix);
 /* iultoa implementation */
 int iulltoa(IUINT64 val, char *buf, int radix);
 
+/* decimal only, buf needs 21 bytes, returns length */
+int iu64toa(IUINT64 val, char *buf);
+
+/* decimal only, buf needs 21 bytes, returns length */
+int ii64toa(IINT64 val, char *buf);
+
+/* leading decimal digits of text[0, size) without reading past it,
+ * returns digits consumed, 0 if none, -1 if it overflows 64 bits */
+ilong iparse_u64(const char *text, ilong size, IUINT64 *value);
+
+/* like iparse_u64 with an optional '+' or '-' */
+ilong iparse_i64(const char *text, ilong size, IINT64 *value);
+
+/* shortest string that reads back to the same double (ryu),
+ * buf needs 25 bytes, returns length */
+int idtoa(double val, char *buf);
+
 /* istrstrip implementation */
 char *istrstrip(char *ptr, const char *delim);
 
@@ -1654,6 +1887,61 @@ int istring_list_join(const istring_list_t *strings, const char *str,
 	ilong size, ivalue_t *output);
 
 
+/**********************************************************************
+ * CSV SCANNER: zero-copy csv parser over a memory buffer, quotes, 
+ * separators and newlines are classified 64 bytes a time as bitmasks
+ * (sse2/avx2 when available), fields are slices into the buffer.
+ **********************************************************************/
+struct ICSVFIELD
+{
+	const char *ptr;		/* raw field text, quotes not removed */
+	ilong size;
+};
+
+struct ICSVSCAN
+{
+	const char *data;		/* buffer, must be valid while scanning */
+	ilong size;
+	ilong scan;				/* bytes classified */
+	ilong start;			/* start of the next field */
+	IUINT64 inside;			/* all ones if scan stopped inside quotes */
+	ilong *index;			/* offsets of separators and newlines */
+	int head;
+	int tail;
+	int capacity;
+	int sep;
+	struct ICSVFIELD *fields;	/* fields of the current row */
+	int count;
+	int limit;
+};
+
+typedef struct ICSVSCAN icsv_scan_t;
+typedef struct ICSVFIELD icsv_field_t;
+
+/* init scanner over data, sep is the field separator (usually ',') */
+int icsv_scan_init(struct ICSVSCAN *scan, const char *data, ilong size,
+	int sep);
+
+/* free index and field arrays */
+void icsv_scan_destroy(struct ICSVSCAN *scan);
+
+/* read next row into scan->fields, returns field count, an empty line
+ * returns 0, and -1 for end of data. newlines inside quotes belong to
+ * the field, '\r' before the newline is removed. */
+int icsv_scan_next(struct ICSVSCAN *scan);
+
+/* decode a raw field the same way as istring_list_csv_decode: strip the
+ * surrounding quotes and un-escape, out needs (size + 1) bytes, returns
+ * decoded size. if out is NULL, returns -1 when the slice needs decoding
+ * and its size when it can be used as it is. */
+ilong icsv_field_load(const char *ptr, ilong size, char *out);
+
+/* split data into 'count' chunks at row starts outside quotes for 
+ * parallel scanning, chunk i is [bounds[i], bounds[i + 1]), bounds
+ * must have (count + 1) entries. chunks can be empty for short data. */
+void icsv_split(const char *data, ilong size, ilong *bounds, int count);
+
+
 /**********************************************************************
  * BASE64 / BASE32 / BASE16
  **********************************************************************/
@@ -1666,6 +1954,33 @@ ilong ibase64_encode(const void *src, ilong size, char *dst);
    if dst == NULL, returns how many bytes needed for decode (>=real) */
 ilong ibase64_decode(const char *src, ilong size, void *dst);
 
+/* streaming base64 for chunked input: output of all updates (plus final
+   for encoding) is the same as one ibase64_encode/ibase64_decode call */
+struct IBASE64STATE
+{
+	IUINT32 bits;
+	int count;
+	int done;
+};
+
+typedef struct IBASE64STATE ibase64_state_t;
+
+/* reset streaming state */
+void ibase64_state_init(struct IBASE64STATE *state);
+
+/* encode a chunk, returns chars written, dst needs ((size + 2) / 3) * 4
+   bytes, '\0' isn't appended */
+ilong ibase64_encode_update(struct IBASE64STATE *state, const void *src,
+	ilong size, char *dst);
+
+/* encode remaining 1-2 bytes with '=' padding, dst needs 4 bytes */
+ilong ibase64_encode_final(struct IBASE64STATE *state, char *dst);
+
+/* decode a chunk, returns bytes written, dst needs ((size + 3) / 4) * 3
+   bytes. data after padding is ignored */
+ilong ibase64_decode_update(struct IBASE64STATE *state, const char *src,
+	ilong size, void *dst);
+
 /* encode data as a base32 string, returns string size,
    if dst == NULL, returns how many bytes needed for encode (>=real) */
 ilong ibase32_encode(const void *src, ilong size, char *dst);
@@ -1697,6 +2012,30 @@ void icrypt_rc4_crypt(unsigned char *box, int *x, int *y,
 	const unsigned char *src, unsigned char *dst, ilong size);
 
 
+/**********************************************************************
+ * CHACHA20: 64-bit block counter and 64-bit nonce (original variant),
+ * several blocks are generated at once with sse2 / avx2 when present
+ **********************************************************************/
+struct ICHACHA20
+{
+	IUINT32 state[16];			/* constants, key, counter, nonce */
+	unsigned char stream[64];	/* keystream of the current block */
+	int offset;					/* used bytes of stream, 64 for none */
+};
+
+/* chacha20 init: key is 16 or 32 bytes, nonce is 8 bytes (NULL for 
+ * zero), returns 0 for success, -1 for bad key size */
+int icrypt_chacha20_init(struct ICHACHA20 *ctx, const unsigned char *key,
+	int keylen, const unsigned char *nonce);
+
+/* chacha20 crypt: xor keystream, src and dst can be the same */
+void icrypt_chacha20_crypt(struct ICHACHA20 *ctx, const unsigned char *src,
+	unsigned char *dst, ilong size);
+
+/* skip size bytes of keystream without generating it */
+void icrypt_chacha20_skip(struct ICHACHA20 *ctx, IINT64 size);
+
+
 /**********************************************************************
  * XOR crypt
  **********************************************************************/
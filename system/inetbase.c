@@ -28,6 +28,14 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <sys/select.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__DragonFly__)
+#include <sys/socket.h>
+#define IHAVE_BSD_SENDFILE
+#endif
 
 #ifndef __AVM3__
 #include <poll.h>
@@ -45,6 +53,7 @@
 #include <mswsock.h>
 #include <process.h>
 #include <stddef.h>
+#include <io.h>
 #ifdef _MSC_VER
 #pragma comment(lib, "winmm.lib")
 #pragma comment(lib, "ws2_32.lib")
@@ -562,6 +571,122 @@ long irecv(int sock, void *buf, long size, int mode)
 	return (long)recv(sock, (char*)buf, size, mode);
 }
 
+#ifndef ISENDV_MAX
+#define ISENDV_MAX 64
+#endif
+
+/* send vector in one system call */
+long isendv(int sock, const void * const vecptr[], const long veclen[],
+	int count, int mode)
+{
+#if defined(__unix) && !defined(__AVM2__)
+	struct iovec iov[ISENDV_MAX];
+	struct msghdr msg;
+	int i;
+	if (count > ISENDV_MAX) count = ISENDV_MAX;
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = (void*)vecptr[i];
+		iov[i].iov_len = (size_t)veclen[i];
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return (long)sendmsg(sock, &msg, mode);
+#elif defined(_WIN32) && !defined(_XBOX)
+	WSABUF bufs[ISENDV_MAX];
+	DWORD sent = 0;
+	int i;
+	if (count > ISENDV_MAX) count = ISENDV_MAX;
+	for (i = 0; i < count; i++) {
+		bufs[i].buf = (char*)vecptr[i];
+		bufs[i].len = (ULONG)veclen[i];
+	}
+	if (WSASend((SOCKET)sock, bufs, (DWORD)count, &sent, (DWORD)mode,
+		NULL, NULL) != 0) 
+		return -1;
+	return (long)sent;
+#else
+	if (count <= 0) return 0;
+	return isend(sock, vecptr[0], veclen[0], mode);
+#endif
+}
+
+/* send file data by sendfile */
+long isendfile(int sock, int fd, IINT64 *offset, long size)
+{
+#if defined(__linux__)
+	off_t pos = (off_t)offset[0];
+	ssize_t hr;
+	if ((IINT64)pos != offset[0]) return -2;
+	hr = sendfile(sock, fd, &pos, (size_t)size);
+	if (hr < 0) {
+		if (errno == EINVAL || errno == ENOSYS) return -2;
+		return -1;
+	}
+	offset[0] = (IINT64)pos;
+	return (long)hr;
+#elif defined(IHAVE_BSD_SENDFILE)
+	off_t sent = 0;
+	int hr;
+	#if defined(__APPLE__)
+	sent = (off_t)size;
+	hr = sendfile(fd, sock, (off_t)offset[0], &sent, NULL, 0);
+	#else
+	hr = sendfile(fd, sock, (off_t)offset[0], (size_t)size, NULL, &sent, 0);
+	#endif
+	if (hr < 0 && sent <= 0) {
+		if (errno == EINVAL || errno == ENOTSUP || errno == ENOTSOCK) 
+			return -2;
+		return -1;
+	}
+	offset[0] += (IINT64)sent;
+	return (long)sent;
+#else
+	return -2;
+#endif
+}
+
+/* read file data at offset */
+long ipread(int fd, IINT64 offset, void *buf, long size)
+{
+#if defined(__unix) && !defined(__AVM2__)
+	return (long)pread(fd, buf, (size_t)size, (off_t)offset);
+#elif defined(_WIN32) && !defined(_XBOX)
+	if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+	return (long)_read(fd, buf, (unsigned int)size);
+#else
+	return -1;
+#endif
+}
+
+/* duplicate a file descriptor */
+int idupfd(int fd)
+{
+#if defined(__unix)
+	int newfd = dup(fd);
+	#ifdef FD_CLOEXEC
+	if (newfd >= 0) fcntl(newfd, F_SETFD, FD_CLOEXEC);
+	#endif
+	return newfd;
+#elif defined(_WIN32) && !defined(_XBOX)
+	return _dup(fd);
+#else
+	return -1;
+#endif
+}
+
+/* close a file descriptor */
+int iclosefd(int fd)
+{
+#if defined(__unix)
+	return close(fd);
+#elif defined(_WIN32) && !defined(_XBOX)
+	return _close(fd);
+#else
+	return -1;
+#endif
+}
+
 /* send to remote */
 long isendto(int sock, const void *buf, long size, int mode, 
 			const struct sockaddr *addr, int addrlen)
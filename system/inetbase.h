@@ -551,6 +551,21 @@ long isend(int sock, const void *buf, long size, int mode);
 /* receive */
 long irecv(int sock, void *buf, long size, int mode);
 
+/* send vector in one system call (sendmsg / WSASend) */
+long isendv(int sock, const void * const vecptr[], const long veclen[],
+	int count, int mode);
+
+/* send file data from offset (advanced) by sendfile, returns bytes sent,
+ * -1 for socket error (see ierrno), -2 if fd or platform can't do it */
+long isendfile(int sock, int fd, IINT64 *offset, long size);
+
+/* read file data at offset, returns bytes read, 0 for eof, -1 for error */
+long ipread(int fd, IINT64 offset, void *buf, long size);
+
+/* duplicate / close a file descriptor */
+int idupfd(int fd);
+int iclosefd(int fd);
+
 /* sendto */
 long isendto(int sock, const void *buf, long size, int mode, 
 	const struct sockaddr *addr, int addrlen);
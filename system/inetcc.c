@@ -0,0 +1,574 @@
+//=====================================================================
+//
+// inetcc.c - pluggable congestion control for kcp and itcp
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+#include "inetcc.h"
+
+#include <stddef.h>
+#include <string.h>
+
+
+//=====================================================================
+// COMMON
+//=====================================================================
+
+//---------------------------------------------------------------------
+// initialize state with given algorithm and segment size
+//---------------------------------------------------------------------
+void icc_init(struct ICCSTATE *cc, const struct ICCOPS *ops, IUINT32 mss)
+{
+	assert(cc && ops);
+	memset(cc, 0, sizeof(struct ICCSTATE));
+	cc->ops = ops;
+	cc->mss = (mss > 0)? mss : 1;
+	cc->cwnd = ICC_INIT_CWND * cc->mss;
+	cc->ssthresh = ICC_INFINITE;
+	cc->pace_burst = 10;
+	if (ops->init) {
+		ops->init(cc);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// change segment size
+//---------------------------------------------------------------------
+void icc_set_mss(struct ICCSTATE *cc, IUINT32 mss)
+{
+	cc->mss = (mss > 0)? mss : 1;
+	if (cc->cwnd < 2 * cc->mss) {
+		cc->cwnd = 2 * cc->mss;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// feed an ack sample
+//---------------------------------------------------------------------
+void icc_on_ack(struct ICCSTATE *cc, const struct ICCSAMPLE *sample)
+{
+	if (sample->rtt >= 0) {
+		IUINT32 rtt = (sample->rtt > 0)? (IUINT32)sample->rtt : 1;
+		if (cc->srtt == 0) cc->srtt = rtt;
+		else cc->srtt = (7 * cc->srtt + rtt) / 8;
+		if (cc->min_rtt == 0 || rtt < cc->min_rtt) {
+			cc->min_rtt = rtt;
+		}
+	}
+	cc->delivered += sample->acked;
+	if (cc->ops->on_ack) {
+		cc->ops->on_ack(cc, sample);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// report a loss event
+//---------------------------------------------------------------------
+void icc_on_loss(struct ICCSTATE *cc, IUINT32 now, IUINT32 inflight,
+		int timeout)
+{
+	// losses of the same window only reduce once, further timeouts
+	// in that window collapse cwnd but keep ssthresh
+	if (cc->loss_valid) {
+		if (itimediff(now, cc->loss_ts) < (long)_imax(cc->srtt, 1)) {
+			if (timeout) cc->cwnd = cc->mss;
+			return;
+		}
+	}
+	cc->loss_ts = now;
+	cc->loss_valid = 1;
+	if (cc->ops->on_loss) {
+		cc->ops->on_loss(cc, now, inflight, timeout);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// congestion window in bytes
+//---------------------------------------------------------------------
+IUINT32 icc_cwnd(const struct ICCSTATE *cc)
+{
+	IUINT32 cwnd = (cc->ops->cwnd)? cc->ops->cwnd(cc) : cc->cwnd;
+	return _imax(cwnd, cc->mss);
+}
+
+
+//---------------------------------------------------------------------
+// pacing rate in bytes per second
+//---------------------------------------------------------------------
+IUINT32 icc_pacing_rate(const struct ICCSTATE *cc)
+{
+	if (cc->ops->pacing_rate == NULL) return 0;
+	return cc->ops->pacing_rate(cc);
+}
+
+
+//---------------------------------------------------------------------
+// refill pacing credit
+//---------------------------------------------------------------------
+static void icc_pacing_refill(struct ICCSTATE *cc, IUINT32 now,
+		IUINT32 rate)
+{
+	long elapsed = itimediff(now, cc->pace_ts);
+	IINT64 credit, limit;
+	if (elapsed <= 0) return;
+	credit = (IINT64)cc->pace_credit + (IINT64)rate * elapsed / 1000;
+	limit = (IINT64)rate * cc->pace_burst / 1000;
+	if (limit < (IINT64)(2 * cc->mss)) limit = 2 * cc->mss;
+	cc->pace_credit = (IINT32)((credit < limit)? credit : limit);
+	cc->pace_ts = now;
+}
+
+
+//---------------------------------------------------------------------
+// consume pacing credit, returns 1 if the packet can be sent now
+//---------------------------------------------------------------------
+int icc_pacing_send(struct ICCSTATE *cc, IUINT32 now, IUINT32 size)
+{
+	IUINT32 rate = icc_pacing_rate(cc);
+	if (rate == 0) return 1;
+	icc_pacing_refill(cc, now, rate);
+	if (cc->pace_credit < 0) return 0;
+	cc->pace_credit -= (IINT32)size;
+	return 1;
+}
+
+
+//---------------------------------------------------------------------
+// millisec to wait until next packet can be sent
+//---------------------------------------------------------------------
+IUINT32 icc_pacing_delay(const struct ICCSTATE *cc, IUINT32 now)
+{
+	IUINT32 rate = icc_pacing_rate(cc);
+	long elapsed = itimediff(now, cc->pace_ts);
+	IINT64 credit = cc->pace_credit;
+	if (rate == 0) return 0;
+	if (elapsed > 0) credit += (IINT64)rate * elapsed / 1000;
+	if (credit >= 0) return 0;
+	return (IUINT32)(((IUINT64)(-credit) * 1000 + rate - 1) / rate);
+}
+
+
+//---------------------------------------------------------------------
+// default pacing: cwnd/srtt, doubled in slow start (as linux does)
+//---------------------------------------------------------------------
+static IUINT32 icc_pacing_default(const struct ICCSTATE *cc)
+{
+	IUINT64 rate;
+	if (cc->srtt == 0) return 0;
+	rate = (IUINT64)cc->cwnd * 1000 / cc->srtt;
+	rate = (cc->cwnd < cc->ssthresh)? rate * 2 : rate * 6 / 5;
+	return (rate > ICC_INFINITE)? ICC_INFINITE : (IUINT32)rate;
+}
+
+
+//---------------------------------------------------------------------
+// slow start shared by loss based algorithms (abc with L=2)
+//---------------------------------------------------------------------
+static void icc_slow_start(struct ICCSTATE *cc, IUINT32 acked)
+{
+	cc->cwnd += _imin(acked, 2 * cc->mss);
+}
+
+
+//=====================================================================
+// NEWRENO
+//=====================================================================
+static void icc_reno_init(struct ICCSTATE *cc)
+{
+	cc->u.reno.acc = 0;
+}
+
+static void icc_reno_on_ack(struct ICCSTATE *cc, const struct ICCSAMPLE *s)
+{
+	struct ICCRENO *reno = &cc->u.reno;
+	if (s->recovery) return;
+	if (cc->cwnd < cc->ssthresh) {
+		icc_slow_start(cc, s->acked);
+		return;
+	}
+	reno->acc += s->acked;
+	if (reno->acc >= cc->cwnd) {
+		reno->acc -= cc->cwnd;
+		cc->cwnd += cc->mss;
+	}
+}
+
+static void icc_reno_on_loss(struct ICCSTATE *cc, IUINT32 now,
+		IUINT32 inflight, int timeout)
+{
+	cc->ssthresh = _imax(inflight / 2, 2 * cc->mss);
+	cc->cwnd = (timeout)? cc->mss : cc->ssthresh;
+	cc->u.reno.acc = 0;
+}
+
+const struct ICCOPS icc_newreno = {
+	"newreno",
+	icc_reno_init,
+	icc_reno_on_ack,
+	icc_reno_on_loss,
+	NULL,
+	icc_pacing_default,
+};
+
+
+//=====================================================================
+// CUBIC: W(t) = C * (t - K)^3 + Wmax, C = 0.4, beta = 0.7
+//=====================================================================
+#define ICC_CUBIC_BETA		717		// beta * 1024
+
+//---------------------------------------------------------------------
+// integer cube root (hacker's delight)
+//---------------------------------------------------------------------
+static IUINT32 icc_cbrt(IUINT64 x)
+{
+	IUINT64 y = 0, b;
+	int s;
+	for (s = 63; s >= 0; s -= 3) {
+		y = 2 * y;
+		b = 3 * y * (y + 1) + 1;
+		if ((x >> s) >= b) {
+			x -= b << s;
+			y++;
+		}
+	}
+	return (IUINT32)y;
+}
+
+static void icc_cubic_init(struct ICCSTATE *cc)
+{
+	memset(&cc->u.cubic, 0, sizeof(struct ICCCUBIC));
+}
+
+static void icc_cubic_on_ack(struct ICCSTATE *cc, const struct ICCSAMPLE *s)
+{
+	struct ICCCUBIC *cubic = &cc->u.cubic;
+	IUINT32 mss = cc->mss;
+	IINT64 t, offs, target;
+	IUINT32 inc;
+
+	if (s->recovery) return;
+
+	if (cc->cwnd < cc->ssthresh) {
+		icc_slow_start(cc, s->acked);
+		return;
+	}
+
+	if (cubic->epoch == 0) {
+		cubic->epoch = s->now? s->now : 1;
+		if (cc->cwnd < cubic->wmax) {
+			// K = cbrt((Wmax - cwnd) / C) seconds, in millisec
+			IUINT64 x = (IUINT64)(cubic->wmax - cc->cwnd) * 2500000000UL;
+			cubic->k = icc_cbrt(x / mss);
+			cubic->origin = cubic->wmax;
+		}	else {
+			cubic->k = 0;
+			cubic->origin = cc->cwnd;
+		}
+		cubic->west = cc->cwnd;
+		cubic->acc = 0;
+	}
+
+	// target window one min_rtt ahead
+	t = (IINT64)itimediff(s->now, cubic->epoch) + cc->min_rtt;
+	offs = t - (IINT64)cubic->k;
+	if (offs > 60000) offs = 60000;
+	if (offs < -60000) offs = -60000;
+	target = (IINT64)cubic->origin +
+		(offs * offs * offs / 1000) * mss * 4 / 10000000;
+	if (target < (IINT64)mss) target = mss;
+
+	// reno friendly region: 3 * (1 - beta) / (1 + beta) ~= 0.53
+	cubic->acc += s->acked;
+	if (cubic->acc >= mss) {
+		IUINT64 delta = (IUINT64)cubic->acc * mss * 542 / 1024;
+		cubic->west += (IUINT32)(delta / cc->cwnd);
+		cubic->acc = 0;
+	}
+	if ((IINT64)cubic->west > target) {
+		target = cubic->west;
+	}
+
+	if (target > (IINT64)cc->cwnd) {
+		IUINT64 delta = (IUINT64)(target - cc->cwnd) * s->acked / cc->cwnd;
+		inc = (IUINT32)_imin((IUINT32)delta, s->acked / 2 + 1);
+	}	else {
+		inc = (IUINT32)((IUINT64)s->acked * mss / (100 * (IUINT64)cc->cwnd));
+	}
+	cc->cwnd += inc;
+}
+
+static void icc_cubic_on_loss(struct ICCSTATE *cc, IUINT32 now,
+		IUINT32 inflight, int timeout)
+{
+	struct ICCCUBIC *cubic = &cc->u.cubic;
+	cubic->epoch = 0;
+	// fast convergence: release bandwidth for new flows
+	if (cc->cwnd < cubic->last_wmax) {
+		cubic->wmax = (IUINT32)((IUINT64)cc->cwnd *
+				(1024 + ICC_CUBIC_BETA) / 2048);
+	}	else {
+		cubic->wmax = cc->cwnd;
+	}
+	cubic->last_wmax = cc->cwnd;
+	cc->ssthresh = (IUINT32)((IUINT64)cc->cwnd * ICC_CUBIC_BETA / 1024);
+	cc->ssthresh = _imax(cc->ssthresh, 2 * cc->mss);
+	cc->cwnd = (timeout)? cc->mss : cc->ssthresh;
+}
+
+const struct ICCOPS icc_cubic = {
+	"cubic",
+	icc_cubic_init,
+	icc_cubic_on_ack,
+	icc_cubic_on_loss,
+	NULL,
+	icc_pacing_default,
+};
+
+
+//=====================================================================
+// BBR v1: model based, paces at max bandwidth and bounds inflight
+// to a multiple of bandwidth-delay product
+//=====================================================================
+#define ICC_BBR_HIGH_GAIN	739		// 2/ln(2) ~= 2.885
+#define ICC_BBR_DRAIN_GAIN	88		// 1/2.885
+#define ICC_BBR_CWND_GAIN	512		// 2.0 in probe bw
+#define ICC_BBR_CYCLE_LEN	8
+#define ICC_BBR_RTT_EXPIRE	10000	// min rtt filter window (ms)
+#define ICC_BBR_PROBE_TIME	200		// time to hold probe rtt (ms)
+#define ICC_BBR_MIN_CWND	4		// in segments
+
+static const IUINT32 icc_bbr_cycle_gain[ICC_BBR_CYCLE_LEN] = {
+	320, 192, 256, 256, 256, 256, 256, 256,
+};
+
+static IUINT32 icc_bbr_max_bw(const struct ICCSTATE *cc)
+{
+	const struct ICCBBR *bbr = &cc->u.bbr;
+	IUINT32 bw = 0;
+	int i;
+	for (i = 0; i < ICC_BBR_BW_ROUNDS; i++) {
+		if (bbr->bw[i] > bw) bw = bbr->bw[i];
+	}
+	return bw;
+}
+
+// bandwidth-delay product scaled by gain, in bytes
+static IUINT32 icc_bbr_bdp(const struct ICCSTATE *cc, IUINT32 gain)
+{
+	IUINT32 bw = icc_bbr_max_bw(cc);
+	IUINT64 bdp;
+	if (bw == 0 || cc->min_rtt == 0) {
+		return ICC_INIT_CWND * cc->mss;
+	}
+	bdp = (IUINT64)bw * cc->min_rtt / 1000;
+	bdp = bdp * gain / ICC_BBR_UNIT;
+	return (bdp > ICC_INFINITE)? ICC_INFINITE : (IUINT32)bdp;
+}
+
+static void icc_bbr_set_mode(struct ICCSTATE *cc, int mode, IUINT32 now)
+{
+	struct ICCBBR *bbr = &cc->u.bbr;
+	bbr->mode = mode;
+	switch (mode) {
+	case ICC_BBR_STARTUP:
+		bbr->pacing_gain = ICC_BBR_HIGH_GAIN;
+		bbr->cwnd_gain = ICC_BBR_HIGH_GAIN;
+		break;
+	case ICC_BBR_DRAIN:
+		bbr->pacing_gain = ICC_BBR_DRAIN_GAIN;
+		bbr->cwnd_gain = ICC_BBR_HIGH_GAIN;
+		break;
+	case ICC_BBR_PROBE_BW:
+		// start at a random-ish phase other than the draining one
+		bbr->cycle = 2 + (int)(bbr->round % (ICC_BBR_CYCLE_LEN - 2));
+		bbr->cycle_ts = now;
+		bbr->pacing_gain = icc_bbr_cycle_gain[bbr->cycle];
+		bbr->cwnd_gain = ICC_BBR_CWND_GAIN;
+		break;
+	case ICC_BBR_PROBE_RTT:
+		bbr->pacing_gain = ICC_BBR_UNIT;
+		bbr->cwnd_gain = ICC_BBR_UNIT;
+		bbr->prior_cwnd = _imax(bbr->prior_cwnd, cc->cwnd);
+		bbr->probe_rtt_done = 0;
+		break;
+	}
+}
+
+static IUINT32 icc_bbr_pacing_rate(const struct ICCSTATE *cc);
+
+static void icc_bbr_init(struct ICCSTATE *cc)
+{
+	memset(&cc->u.bbr, 0, sizeof(struct ICCBBR));
+	icc_bbr_set_mode(cc, ICC_BBR_STARTUP, 0);
+}
+
+static void icc_bbr_on_ack(struct ICCSTATE *cc, const struct ICCSAMPLE *s)
+{
+	struct ICCBBR *bbr = &cc->u.bbr;
+	IUINT32 now = s->now;
+	IUINT32 mincwnd = ICC_BBR_MIN_CWND * cc->mss;
+	IUINT32 target;
+	int round_start = 0;
+	int expired;
+	long elapsed;
+
+	if (bbr->round == 0 && bbr->round_ts == 0) {
+		bbr->round_ts = now;
+		bbr->round_delivered = cc->delivered - s->acked;
+		bbr->min_rtt_ts = now;
+	}
+
+	// windowed min rtt, expired filter triggers probe rtt
+	expired = (itimediff(now, bbr->min_rtt_ts) > ICC_BBR_RTT_EXPIRE);
+	if (s->rtt >= 0 && ((IUINT32)s->rtt <= cc->min_rtt || expired)) {
+		cc->min_rtt = (s->rtt > 0)? (IUINT32)s->rtt : 1;
+		bbr->min_rtt_ts = now;
+	}
+	if (expired && bbr->mode != ICC_BBR_PROBE_RTT) {
+		icc_bbr_set_mode(cc, ICC_BBR_PROBE_RTT, now);
+	}
+
+	// one delivery rate sample per round trip, it can not exceed the
+	// sending rate: larger values come from acks released in a burst
+	elapsed = itimediff(now, bbr->round_ts);
+	if (elapsed >= (long)_imax(cc->min_rtt, 1)) {
+		IUINT64 rate = (IUINT64)(cc->delivered - bbr->round_delivered);
+		IUINT32 limit = icc_bbr_pacing_rate(cc);
+		rate = rate * 1000 / (IUINT64)elapsed;
+		if (icc_bbr_max_bw(cc) > 0 && rate > limit) rate = limit;
+		bbr->round++;
+		bbr->bw[bbr->round % ICC_BBR_BW_ROUNDS] =
+			(rate > ICC_INFINITE)? ICC_INFINITE : (IUINT32)rate;
+		bbr->round_ts = now;
+		bbr->round_delivered = cc->delivered;
+		round_start = 1;
+	}
+
+	// pipe is full when bandwidth stops growing 25% for 3 rounds
+	if (round_start && bbr->filled == 0) {
+		IUINT32 bw = icc_bbr_max_bw(cc);
+		if ((IUINT64)bw * 4 >= (IUINT64)bbr->full_bw * 5) {
+			bbr->full_bw = bw;
+			bbr->full_cnt = 0;
+		}
+		else if (++bbr->full_cnt >= 3) {
+			bbr->filled = 1;
+		}
+	}
+
+	switch (bbr->mode) {
+	case ICC_BBR_STARTUP:
+		if (bbr->filled) {
+			icc_bbr_set_mode(cc, ICC_BBR_DRAIN, now);
+		}
+		break;
+	case ICC_BBR_DRAIN:
+		if (s->inflight <= icc_bbr_bdp(cc, ICC_BBR_UNIT)) {
+			icc_bbr_set_mode(cc, ICC_BBR_PROBE_BW, now);
+		}
+		break;
+	case ICC_BBR_PROBE_BW:
+		{
+			int full = (itimediff(now, bbr->cycle_ts) > (long)cc->min_rtt);
+			int next = 0;
+			if (bbr->pacing_gain == ICC_BBR_UNIT) {
+				next = full;
+			}
+			else if (bbr->pacing_gain > ICC_BBR_UNIT) {
+				next = full &&
+					(s->inflight >= icc_bbr_bdp(cc, bbr->pacing_gain));
+			}
+			else {
+				next = full ||
+					(s->inflight <= icc_bbr_bdp(cc, ICC_BBR_UNIT));
+			}
+			if (next) {
+				bbr->cycle = (bbr->cycle + 1) % ICC_BBR_CYCLE_LEN;
+				bbr->cycle_ts = now;
+				bbr->pacing_gain = icc_bbr_cycle_gain[bbr->cycle];
+			}
+		}
+		break;
+	case ICC_BBR_PROBE_RTT:
+		if (bbr->probe_rtt_done == 0) {
+			if (s->inflight <= mincwnd) {
+				bbr->probe_rtt_done = now + ICC_BBR_PROBE_TIME;
+				if (bbr->probe_rtt_done == 0) bbr->probe_rtt_done = 1;
+			}
+		}
+		else if (itimediff(now, bbr->probe_rtt_done) >= 0) {
+			bbr->min_rtt_ts = now;
+			cc->cwnd = _imax(cc->cwnd, bbr->prior_cwnd);
+			bbr->prior_cwnd = 0;
+			icc_bbr_set_mode(cc, bbr->filled?
+					ICC_BBR_PROBE_BW : ICC_BBR_STARTUP, now);
+		}
+		break;
+	}
+
+	// grow towards cwnd_gain * bdp
+	target = icc_bbr_bdp(cc, bbr->cwnd_gain) + 3 * cc->mss;
+	if (bbr->filled) {
+		cc->cwnd = _imin(cc->cwnd + s->acked, target);
+	}
+	else if (cc->cwnd < target || cc->delivered < ICC_INIT_CWND * cc->mss) {
+		cc->cwnd += s->acked;
+	}
+	if (cc->cwnd < mincwnd) {
+		cc->cwnd = mincwnd;
+	}
+}
+
+static void icc_bbr_on_loss(struct ICCSTATE *cc, IUINT32 now,
+		IUINT32 inflight, int timeout)
+{
+	// bbr does not treat fast retransmit loss as congestion signal
+	if (timeout) {
+		cc->u.bbr.prior_cwnd = _imax(cc->u.bbr.prior_cwnd, cc->cwnd);
+		cc->cwnd = cc->mss;
+	}
+}
+
+static IUINT32 icc_bbr_cwnd(const struct ICCSTATE *cc)
+{
+	IUINT32 mincwnd = ICC_BBR_MIN_CWND * cc->mss;
+	if (cc->u.bbr.mode == ICC_BBR_PROBE_RTT) {
+		return _imin(cc->cwnd, mincwnd);
+	}
+	return cc->cwnd;
+}
+
+static IUINT32 icc_bbr_pacing_rate(const struct ICCSTATE *cc)
+{
+	const struct ICCBBR *bbr = &cc->u.bbr;
+	IUINT32 bw = icc_bbr_max_bw(cc);
+	IUINT64 rate;
+	if (bw == 0) {
+		// no sample yet: pace initial window over srtt with high gain
+		if (cc->srtt == 0) return 0;
+		rate = (IUINT64)cc->cwnd * 1000 / cc->srtt;
+	}	else {
+		rate = bw;
+	}
+	// 1% below the estimation to drain queues
+	rate = rate * bbr->pacing_gain / ICC_BBR_UNIT * 99 / 100;
+	if (rate < cc->mss) rate = cc->mss;
+	return (rate > ICC_INFINITE)? ICC_INFINITE : (IUINT32)rate;
+}
+
+const struct ICCOPS icc_bbr = {
+	"bbr",
+	icc_bbr_init,
+	icc_bbr_on_ack,
+	icc_bbr_on_loss,
+	icc_bbr_cwnd,
+	icc_bbr_pacing_rate,
+};
+
+
@@ -0,0 +1,177 @@
+//=====================================================================
+//
+// inetcc.h - pluggable congestion control for kcp and itcp
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+#ifndef __INETCC_H__
+#define __INETCC_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "imemdata.h"
+
+
+//=====================================================================
+// GLOBAL DEFINITION
+//=====================================================================
+#define ICC_INFINITE		0x7fffffff
+#define ICC_INIT_CWND		4			// initial window in segments
+#define ICC_BBR_UNIT		256			// fixed point unit of bbr gains
+#define ICC_BBR_BW_ROUNDS	10			// max bandwidth filter length
+
+#define ICC_BBR_STARTUP		0
+#define ICC_BBR_DRAIN		1
+#define ICC_BBR_PROBE_BW	2
+#define ICC_BBR_PROBE_RTT	3
+
+
+//---------------------------------------------------------------------
+// ack sample: filled by the protocol for each valuable ack
+//---------------------------------------------------------------------
+struct ICCSAMPLE
+{
+	IUINT32 now;			// current clock in millisec
+	IUINT32 acked;			// bytes newly acknowledged
+	IUINT32 inflight;		// bytes still in flight after this ack
+	IINT32 rtt;				// rtt sample in millisec, -1 for none
+	int recovery;			// protocol is in loss recovery
+};
+
+
+//---------------------------------------------------------------------
+// algorithm private states
+//---------------------------------------------------------------------
+struct ICCRENO
+{
+	IUINT32 acc;			// bytes acked since last increment
+};
+
+struct ICCCUBIC
+{
+	IUINT32 wmax;			// window before last reduction (bytes)
+	IUINT32 last_wmax;		// previous wmax for fast convergence
+	IUINT32 epoch;			// start of current epoch, 0 for none
+	IUINT32 origin;			// window at the plateau (bytes)
+	IUINT32 k;				// time to reach origin (millisec)
+	IUINT32 west;			// reno friendly window estimation (bytes)
+	IUINT32 acc;			// bytes acked since last increment
+};
+
+struct ICCBBR
+{
+	int mode;				// ICC_BBR_STARTUP, ...
+	IUINT32 bw[ICC_BBR_BW_ROUNDS];	// per round max delivery rate (B/s)
+	IUINT32 round;			// round trip counter
+	IUINT32 round_ts;		// start time of current round
+	IUINT32 round_delivered;	// delivered bytes at round start
+	IUINT32 full_bw;		// bandwidth when pipe was last growing
+	int full_cnt;			// rounds without 25% bandwidth growth
+	int filled;				// pipe is filled
+	IUINT32 pacing_gain;	// in ICC_BBR_UNIT
+	IUINT32 cwnd_gain;		// in ICC_BBR_UNIT
+	int cycle;				// probe bw gain cycle index
+	IUINT32 cycle_ts;		// start time of current cycle phase
+	IUINT32 min_rtt_ts;		// when min_rtt was last refreshed
+	IUINT32 probe_rtt_done;	// probe rtt exit time, 0 for not started
+	IUINT32 prior_cwnd;		// cwnd saved before probe rtt / timeout
+};
+
+
+//---------------------------------------------------------------------
+// congestion control state
+//---------------------------------------------------------------------
+struct ICCSTATE
+{
+	const struct ICCOPS *ops;
+	IUINT32 mss;			// max segment size in bytes
+	IUINT32 cwnd;			// congestion window in bytes
+	IUINT32 ssthresh;		// slow start threshold in bytes
+	IUINT32 srtt;			// smoothed rtt in millisec, 0 for unknown
+	IUINT32 min_rtt;		// minimal rtt in millisec, 0 for unknown
+	IUINT32 delivered;		// total bytes delivered
+	IUINT32 loss_ts;		// time of last window reduction
+	int loss_valid;			// loss_ts is valid
+	IUINT32 pace_ts;		// last time the pacing credit was refilled
+	IINT32 pace_credit;		// pacing credit in bytes (can be negative)
+	IUINT32 pace_burst;		// max credit accumulated in millisec
+	union {
+		struct ICCRENO reno;
+		struct ICCCUBIC cubic;
+		struct ICCBBR bbr;
+	}	u;
+};
+
+
+//---------------------------------------------------------------------
+// congestion control operations
+//---------------------------------------------------------------------
+struct ICCOPS
+{
+	const char *name;
+	void (*init)(struct ICCSTATE *cc);
+	void (*on_ack)(struct ICCSTATE *cc, const struct ICCSAMPLE *sample);
+	void (*on_loss)(struct ICCSTATE *cc, IUINT32 now, IUINT32 inflight,
+			int timeout);
+	IUINT32 (*cwnd)(const struct ICCSTATE *cc);
+	IUINT32 (*pacing_rate)(const struct ICCSTATE *cc);
+};
+
+typedef struct ICCSTATE icc_state;
+typedef struct ICCOPS icc_ops;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// built-in algorithms
+//---------------------------------------------------------------------
+extern const struct ICCOPS icc_newreno;
+extern const struct ICCOPS icc_cubic;
+extern const struct ICCOPS icc_bbr;
+
+
+//---------------------------------------------------------------------
+// interface
+//---------------------------------------------------------------------
+
+// initialize state with given algorithm and segment size
+void icc_init(struct ICCSTATE *cc, const struct ICCOPS *ops, IUINT32 mss);
+
+// change segment size (window is kept at least 2 segments)
+void icc_set_mss(struct ICCSTATE *cc, IUINT32 mss);
+
+// feed an ack sample, updates srtt/min_rtt before calling the algorithm
+void icc_on_ack(struct ICCSTATE *cc, const struct ICCSAMPLE *sample);
+
+// report a loss event, losses within one srtt reduce the window once
+void icc_on_loss(struct ICCSTATE *cc, IUINT32 now, IUINT32 inflight,
+		int timeout);
+
+// congestion window in bytes
+IUINT32 icc_cwnd(const struct ICCSTATE *cc);
+
+// pacing rate in bytes per second, zero for unpaced
+IUINT32 icc_pacing_rate(const struct ICCSTATE *cc);
+
+// consume pacing credit for a packet of 'size' bytes, returns 1 if it
+// can be sent now, 0 if it should wait for icc_pacing_delay millisec
+int icc_pacing_send(struct ICCSTATE *cc, IUINT32 now, IUINT32 size);
+
+// millisec to wait until next packet can be sent, 0 for now
+IUINT32 icc_pacing_delay(const struct ICCSTATE *cc, IUINT32 now);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
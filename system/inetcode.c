@@ -38,6 +38,10 @@
 
 #include <assert.h>
 
+#ifdef ICPU_X86
+#include <immintrin.h>
+#endif
+
 
 /*===================================================================*/
 /* Network Information                                               */
@@ -120,6 +124,42 @@ int isocket_update_address(int resolvname)
 #define ASYNC_SOCK_MAXSIZE 0x800000
 #endif
 
+/* drop cipher states, the cipher choice is kept */
+static void async_sock_crypt_reset(CAsyncSock *asyncsock)
+{
+	asyncsock->rc4_send_x = -1;
+	asyncsock->rc4_send_y = -1;
+	asyncsock->rc4_recv_x = -1;
+	asyncsock->rc4_recv_y = -1;
+	if (asyncsock->chacha_send) {
+		ikmem_free(asyncsock->chacha_send);
+		asyncsock->chacha_send = NULL;
+	}
+	if (asyncsock->chacha_recv) {
+		ikmem_free(asyncsock->chacha_recv);
+		asyncsock->chacha_recv = NULL;
+	}
+}
+
+/* plain when neither rc4 nor chacha20 is set for sending */
+static inline int async_sock_send_plain(const CAsyncSock *asyncsock)
+{
+	return (asyncsock->rc4_send_x < 0 || asyncsock->rc4_send_y < 0) && 
+		asyncsock->chacha_send == NULL;
+}
+
+/* encrypt outgoing bytes, src and dst can be the same */
+static void async_sock_send_crypt(CAsyncSock *asyncsock, 
+	const unsigned char *src, unsigned char *dst, long size)
+{
+	if (asyncsock->chacha_send) {
+		icrypt_chacha20_crypt(asyncsock->chacha_send, src, dst, size);
+	}	else {
+		icrypt_rc4_crypt(asyncsock->rc4_send_box, &asyncsock->rc4_send_x,
+			&asyncsock->rc4_send_y, src, dst, size);
+	}
+}
+
 /* create a new asyncsock */
 void async_sock_init(CAsyncSock *asyncsock, struct IMEMNODE *nodes)
 {
@@ -137,6 +177,9 @@ void async_sock_init(CAsyncSock *asyncsock, struct IMEMNODE *nodes)
 	asyncsock->rc4_send_y = -1;
 	asyncsock->rc4_recv_x = -1;
 	asyncsock->rc4_recv_y = -1;
+	asyncsock->cipher = ASYNC_SOCK_CIPHER_RC4;
+	asyncsock->chacha_send = NULL;
+	asyncsock->chacha_recv = NULL;
 	asyncsock->external = NULL;
 	asyncsock->bufsize = 0;
 	asyncsock->maxsize = ASYNC_SOCK_MAXSIZE;
@@ -151,7 +194,11 @@ void async_sock_init(CAsyncSock *asyncsock, struct IMEMNODE *nodes)
 	asyncsock->closing = 0;
 	ilist_init(&asyncsock->node);
 	ilist_init(&asyncsock->pending);
-	ims_init(&asyncsock->linemsg, nodes, 0, 0);
+	ilist_init(&asyncsock->files);
+	asyncsock->linesize = -1;
+	asyncsock->codec = NULL;
+	asyncsock->codec_state[0] = 0;
+	asyncsock->codec_state[1] = 0;
 	ims_init(&asyncsock->sendmsg, nodes, 0, 0);
 	ims_init(&asyncsock->recvmsg, nodes, 0, 0);
 }
@@ -182,13 +229,12 @@ void async_sock_destroy(CAsyncSock *asyncsock)
 	asyncsock->filter = NULL;
 	asyncsock->object = NULL;
 	asyncsock->state = ASYNC_SOCK_STATE_CLOSED;
-	ims_destroy(&asyncsock->linemsg);
+	asyncsock->linesize = -1;
+	asyncsock->codec = NULL;
 	ims_destroy(&asyncsock->sendmsg);
 	ims_destroy(&asyncsock->recvmsg);
-	asyncsock->rc4_send_x = -1;
-	asyncsock->rc4_send_y = -1;
-	asyncsock->rc4_recv_x = -1;
-	asyncsock->rc4_recv_y = -1;
+	async_file_clear(&asyncsock->files);
+	async_sock_crypt_reset(asyncsock);
 }
 
 
@@ -203,9 +249,12 @@ int async_sock_connect(CAsyncSock *asyncsock, const struct sockaddr *remote,
 	asyncsock->header = (header < 0 || header > ITMH_LINESPLIT)? 0 : header;
 	asyncsock->error = 0;
 
-	ims_clear(&asyncsock->linemsg);
+	asyncsock->linesize = -1;
+	asyncsock->codec_state[0] = 0;
+	asyncsock->codec_state[1] = 0;
 	ims_clear(&asyncsock->sendmsg);
 	ims_clear(&asyncsock->recvmsg);
+	async_file_clear(&asyncsock->files);
 
 	if (asyncsock->buffer == NULL) {
 		if (asyncsock->external == NULL) {
@@ -217,10 +266,7 @@ int async_sock_connect(CAsyncSock *asyncsock, const struct sockaddr *remote,
 		}
 	}
 
-	asyncsock->rc4_send_x = -1;
-	asyncsock->rc4_send_y = -1;
-	asyncsock->rc4_recv_x = -1;
-	asyncsock->rc4_recv_y = -1;
+	async_sock_crypt_reset(asyncsock);
 	
 	if (addrlen <= 20) {
 		asyncsock->fd = isocket(AF_INET, SOCK_STREAM, 0);
@@ -283,14 +329,14 @@ int async_sock_assign(CAsyncSock *asyncsock, int sock, int header)
 		}
 	}
 
-	asyncsock->rc4_send_x = -1;
-	asyncsock->rc4_send_y = -1;
-	asyncsock->rc4_recv_x = -1;
-	asyncsock->rc4_recv_y = -1;
+	async_sock_crypt_reset(asyncsock);
 
-	ims_clear(&asyncsock->linemsg);
+	asyncsock->linesize = -1;
+	asyncsock->codec_state[0] = 0;
+	asyncsock->codec_state[1] = 0;
 	ims_clear(&asyncsock->sendmsg);
 	ims_clear(&asyncsock->recvmsg);
+	async_file_clear(&asyncsock->files);
 
 	asyncsock->fd = sock;
 	asyncsock->error = 0;
@@ -310,10 +356,7 @@ void async_sock_close(CAsyncSock *asyncsock)
 	if (asyncsock->fd >= 0) iclose(asyncsock->fd);
 	asyncsock->fd = -1;
 	asyncsock->state = ASYNC_SOCK_STATE_CLOSED;
-	asyncsock->rc4_send_x = -1;
-	asyncsock->rc4_send_y = -1;
-	asyncsock->rc4_recv_x = -1;
-	asyncsock->rc4_recv_y = -1;
+	async_sock_crypt_reset(asyncsock);
 }
 
 /* try connect */
@@ -337,33 +380,394 @@ static int async_sock_try_connect(CAsyncSock *asyncsock)
 	return 0;
 }
 
-/* try send */
-static int async_sock_try_send(CAsyncSock *asyncsock)
+#ifndef ASYNC_SOCK_IOVMAX
+#define ASYNC_SOCK_IOVMAX 64
+#endif
+
+/*-------------------------------------------------------------------*/
+/* file segments: queued behind 'before' bytes of the send stream,   */
+/* sent by sendfile, or read through a bounded staging buffer when   */
+/* the data must be encrypted or sendfile is not available           */
+/*-------------------------------------------------------------------*/
+#ifndef ASYNC_FILE_CHUNK
+#define ASYNC_FILE_CHUNK	0x10000		/* read-through buffer size */
+#endif
+
+#define ASYNC_FILE_SENDMAX	0x40000000	/* max bytes per sendfile */
+
+struct CAsyncFile
+{
+	struct ILISTHEAD head;
+	int fd;							/* duplicated fd */
+	IINT64 offset;					/* next byte to send or read */
+	IINT64 remain;					/* bytes not sent yet */
+	iulong before;					/* stream bytes to send first */
+	char *stage;					/* read-through buffer, NULL direct */
+	long stage_pos;
+	long stage_len;
+	int rc4_x;						/* rc4 state, -1 for plain */
+	int rc4_y;
+	struct ICHACHA20 *chacha;		/* chacha20 state or NULL */
+	unsigned char rc4_box[256];
+};
+
+/* allocate a file segment, chacha20 state is reserved when needed */
+static struct CAsyncFile *async_file_new(int fd, int chacha, int *error)
 {
-	void *ptr;
-	char *flat;
-	long size;
-	ilong retval;
+	struct CAsyncFile *file;
 
-	if (asyncsock->state != ASYNC_SOCK_STATE_ESTAB) return 0;
+	file = (struct CAsyncFile*)ikmem_malloc(sizeof(struct CAsyncFile));
+	if (file == NULL) {
+		error[0] = -2;
+		return NULL;
+	}
+
+	file->chacha = NULL;
+
+	if (chacha) {
+		size_t size = sizeof(struct ICHACHA20);
+		file->chacha = (struct ICHACHA20*)ikmem_malloc(size);
+		if (file->chacha == NULL) {
+			ikmem_free(file);
+			error[0] = -2;
+			return NULL;
+		}
+	}
+
+	file->fd = idupfd(fd);
+	if (file->fd < 0) {
+		if (file->chacha) ikmem_free(file->chacha);
+		ikmem_free(file);
+		error[0] = -1;
+		return NULL;
+	}
+
+	return file;
+}
+
+/* append an allocated segment behind stream, can't fail */
+static void async_file_attach(struct ILISTHEAD *files, 
+	const struct IMSTREAM *stream, struct CAsyncFile *file,
+	IINT64 offset, IINT64 length, const unsigned char *box,
+	int x, int y, const struct ICHACHA20 *chacha)
+{
+	struct ILISTHEAD *it;
+	iulong before = stream->size;
+
+	for (it = files->next; it != files; it = it->next) {
+		before -= ilist_entry(it, struct CAsyncFile, head)->before;
+	}
+
+	file->offset = offset;
+	file->remain = length;
+	file->before = before;
+	file->stage = NULL;
+	file->stage_pos = 0;
+	file->stage_len = 0;
+	file->rc4_x = -1;
+	file->rc4_y = -1;
+
+	if (chacha != NULL) {
+		memcpy(file->chacha, chacha, sizeof(struct ICHACHA20));
+	}
+	else if (box != NULL && x >= 0 && y >= 0) {
+		memcpy(file->rc4_box, box, 256);
+		file->rc4_x = x;
+		file->rc4_y = y;
+	}
+
+	ilist_add_tail(&file->head, files);
+}
+
+/* queue a file segment behind the data already in stream */
+int async_file_queue(struct ILISTHEAD *files, const struct IMSTREAM *stream,
+	int fd, IINT64 offset, IINT64 length, const unsigned char *box,
+	int x, int y, const struct ICHACHA20 *chacha)
+{
+	struct CAsyncFile *file;
+	int error = 0;
+
+	if (length <= 0) return 0;
+
+	file = async_file_new(fd, (chacha != NULL), &error);
+	if (file == NULL) return error;
+
+	async_file_attach(files, stream, file, offset, length, box, x, y, 
+		chacha);
+
+	return 0;
+}
+
+/* delete a file segment */
+static void async_file_delete(struct CAsyncFile *file)
+{
+	ilist_del(&file->head);
+	iclosefd(file->fd);
+	if (file->stage) ikmem_free(file->stage);
+	if (file->chacha) ikmem_free(file->chacha);
+	ikmem_free(file);
+}
+
+/* drop all queued file segments */
+void async_file_clear(struct ILISTHEAD *files)
+{
+	while (!ilist_is_empty(files)) {
+		async_file_delete(ilist_entry(files->next, struct CAsyncFile, head));
+	}
+}
+
+/* bytes of queued file segments */
+IINT64 async_file_remain(const struct ILISTHEAD *files)
+{
+	const struct ILISTHEAD *it;
+	IINT64 size = 0;
+	for (it = files->next; it != files; it = it->next) {
+		size += ilist_entry(it, const struct CAsyncFile, head)->remain;
+	}
+	return size;
+}
+
+/* send once from the head file segment, -3 for a truncated file */
+static long async_file_send(int sock, struct CAsyncFile *file, long *size)
+{
+	long retval;
+
+	if (file->stage == NULL && file->rc4_x < 0 && file->chacha == NULL) {
+		size[0] = (file->remain > ASYNC_FILE_SENDMAX)? 
+			ASYNC_FILE_SENDMAX : (long)file->remain;
+		retval = isendfile(sock, file->fd, &file->offset, size[0]);
+		if (retval == 0) return -3;
+		if (retval != -2) {
+			if (retval > 0) file->remain -= retval;
+			return retval;
+		}
+	}
+
+	if (file->stage == NULL) {
+		file->stage = (char*)ikmem_malloc(ASYNC_FILE_CHUNK);
+		if (file->stage == NULL) return -3;
+	}
+
+	if (file->stage_pos >= file->stage_len) {
+		long canread = (file->remain > ASYNC_FILE_CHUNK)? 
+			ASYNC_FILE_CHUNK : (long)file->remain;
+		retval = ipread(file->fd, file->offset, file->stage, canread);
+		if (retval <= 0) return -3;
+		if (file->chacha) {
+			icrypt_chacha20_crypt(file->chacha, 
+				(unsigned char*)file->stage, 
+				(unsigned char*)file->stage, retval);
+		}
+		else if (file->rc4_x >= 0) {
+			icrypt_rc4_crypt(file->rc4_box, &file->rc4_x, &file->rc4_y, 
+				(unsigned char*)file->stage, 
+				(unsigned char*)file->stage, retval);
+		}
+		file->offset += retval;
+		file->stage_pos = 0;
+		file->stage_len = retval;
+	}
+
+	size[0] = file->stage_len - file->stage_pos;
+	retval = isend(sock, file->stage + file->stage_pos, size[0], 0);
+
+	if (retval > 0) {
+		file->stage_pos += retval;
+		file->remain -= retval;
+	}
+
+	return retval;
+}
+
+/* send stream and queued file segments in order */
+int async_file_flush(int sock, struct IMSTREAM *stream, 
+	struct ILISTHEAD *files, int *error)
+{
+	void *vecptr[ASYNC_SOCK_IOVMAX];
+	long veclen[ASYNC_SOCK_IOVMAX];
 
 	while (1) {
-		size = (long)ims_flat(&asyncsock->sendmsg, &ptr);
-		if (size <= 0) break;
-		flat = (char*)ptr;
-		retval = isend(asyncsock->fd, flat, size, 0);
+		struct CAsyncFile *file = NULL;
+		iulong limit = stream->size;
+		long size, retval;
+		int count, i;
+
+		if (!ilist_is_empty(files)) {
+			file = ilist_entry(files->next, struct CAsyncFile, head);
+			limit = file->before;
+		}
+
+		if (limit > 0) {
+			count = ims_iovec(stream, vecptr, veclen, ASYNC_SOCK_IOVMAX);
+			for (size = 0, i = 0; i < count; i++) {
+				if ((iulong)(size + veclen[i]) >= limit) {
+					veclen[i] = (long)(limit - (iulong)size);
+					count = i + 1;
+				}
+				size += veclen[i];
+			}
+			retval = isendv(sock, (const void**)vecptr, veclen, count, 0);
+		}
+		else if (file != NULL) {
+			retval = async_file_send(sock, file, &size);
+			if (retval == -3) {
+				if (error) error[0] = -1;
+				return -1;
+			}
+		}
+		else {
+			break;
+		}
+
 		if (retval == 0) break;
 		else if (retval < 0) {
 			retval = ierrno();
 			if (retval == IEAGAIN || retval == 0) break;
+			if (error) error[0] = (int)retval;
+			return -1;
+		}
+
+		if (limit > 0) {
+			ims_drop(stream, retval);
+			if (file) file->before -= retval;
+		}
+		else if (file->remain == 0) {
+			async_file_delete(file);
+		}
+
+		if (retval < size) break;
+	}
+
+	return 0;
+}
+
+/* try send: sendmsg and file segments are flushed in order */
+static int async_sock_try_send(CAsyncSock *asyncsock)
+{
+	if (asyncsock->state != ASYNC_SOCK_STATE_ESTAB) return 0;
+	return async_file_flush(asyncsock->fd, &asyncsock->sendmsg, 
+		&asyncsock->files, &asyncsock->error);
+}
+
+/*-------------------------------------------------------------------*/
+/* line split: offsets of '\n' are collected in batches, vector scan  */
+/* stops 32 entries before 'limit' and the rest is finished by memchr */
+/*-------------------------------------------------------------------*/
+#ifndef ASYNC_SOCK_EOLBATCH
+#define ASYNC_SOCK_EOLBATCH 256
+#endif
+
+#ifdef ICPU_X86
+ICPU_TARGET("sse2")
+static long async_sock_eol_sse2(const unsigned char *buf, long pos,
+	long size, long *eol, int *count, int limit)
+{
+	__m128i lf = _mm_set1_epi8('\n');
+	int n = *count;
+	for (; pos + 16 <= size && n + 16 <= limit; pos += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(buf + pos));
+		unsigned int mask = (unsigned int)
+			_mm_movemask_epi8(_mm_cmpeq_epi8(x, lf));
+		for (; mask; mask &= mask - 1) {
+			eol[n++] = pos + icpu_ctz(mask);
+		}
+	}
+	*count = n;
+	return pos;
+}
+
+ICPU_TARGET("avx2")
+static long async_sock_eol_avx2(const unsigned char *buf, long pos,
+	long size, long *eol, int *count, int limit)
+{
+	__m256i lf = _mm256_set1_epi8('\n');
+	int n = *count;
+	for (; pos + 32 <= size && n + 32 <= limit; pos += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(buf + pos));
+		unsigned int mask = (unsigned int)
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, lf));
+		for (; mask; mask &= mask - 1) {
+			eol[n++] = pos + icpu_ctz(mask);
+		}
+	}
+	*count = n;
+	return pos;
+}
+#endif
+
+/* collect up to 'limit' offsets of '\n' from buf[pos] to buf[size],
+ * returns where scanning stopped */
+static long async_sock_eol_scan(const unsigned char *buf, long pos,
+	long size, long *eol, int *count, int limit)
+{
+#ifdef ICPU_X86
+	int features = icpu_features();
+	if (features & ICPU_AVX2) {
+		pos = async_sock_eol_avx2(buf, pos, size, eol, count, limit);
+	}
+	if (features & ICPU_SSE2) {
+		pos = async_sock_eol_sse2(buf, pos, size, eol, count, limit);
+	}
+#endif
+	while (pos < size && *count < limit) {
+		const unsigned char *p = (const unsigned char*)
+			memchr(buf + pos, '\n', size - pos);
+		if (p == NULL) return size;
+		pos = (long)(p - buf);
+		eol[(*count)++] = pos++;
+	}
+	return pos;
+}
+
+/* split received data into 4 bytes lsb length prefixed lines. the
+ * header of a line is built in place over the tail of the previous one
+ * (already written out), so each line costs one write. an unterminated
+ * line is appended to recvmsg behind a zero header, which readers take
+ * as incomplete, and the header is patched once the line ends. */
+static void async_sock_split_line(CAsyncSock *asyncsock, 
+	unsigned char *buffer, long size)
+{
+	struct IMSTREAM *recvmsg = &asyncsock->recvmsg;
+	long eol[ASYNC_SOCK_EOLBATCH];
+	long start = 0, pos = 0;
+	char head[4];
+	int count, i;
+
+	while (pos < size) {
+		count = 0;
+		pos = async_sock_eol_scan(buffer, pos, size, eol, &count,
+				ASYNC_SOCK_EOLBATCH);
+		for (i = 0; i < count; i++) {
+			long x = eol[i] - start + 1;
+			if (asyncsock->linesize >= 0) {
+				long y = asyncsock->linesize + x;
+				ims_write(recvmsg, &buffer[start], x);
+				iencode32u_lsb(head, y + 4);
+				ims_poke(recvmsg, (ilong)recvmsg->size - y - 4, head, 4);
+				asyncsock->linesize = -1;
+			}
+			else if (start >= 4) {
+				iencode32u_lsb((char*)&buffer[start - 4], x + 4);
+				ims_write(recvmsg, &buffer[start - 4], x + 4);
+			}
 			else {
-				asyncsock->error = (int)retval;
-				return -1;
+				iencode32u_lsb(head, x + 4);
+				ims_write(recvmsg, head, 4);
+				ims_write(recvmsg, &buffer[start], x);
 			}
+			start = eol[i] + 1;
 		}
-		ims_drop(&asyncsock->sendmsg, retval);
 	}
-	return 0;
+
+	if (start < size) {
+		if (asyncsock->linesize < 0) {
+			iencode32u_lsb(head, 0);
+			ims_write(recvmsg, head, 4);
+			asyncsock->linesize = 0;
+		}
+		ims_write(recvmsg, &buffer[start], size - start);
+		asyncsock->linesize += size - start;
+	}
 }
 
 /* try receive */
@@ -387,35 +791,18 @@ static int async_sock_try_recv(CAsyncSock *asyncsock)
 			asyncsock->error = 0;
 			return -1;
 		}
-		if (asyncsock->rc4_recv_x >= 0 && asyncsock->rc4_recv_y >= 0) {
+		if (asyncsock->chacha_recv) {
+			icrypt_chacha20_crypt(asyncsock->chacha_recv, 
+				(unsigned char*)buffer, (unsigned char*)buffer, retval);
+		}
+		else if (asyncsock->rc4_recv_x >= 0 && asyncsock->rc4_recv_y >= 0) {
 			icrypt_rc4_crypt(asyncsock->rc4_recv_box, &asyncsock->rc4_recv_x,
 				&asyncsock->rc4_recv_y, buffer, buffer, retval);
 		}
 		if (asyncsock->header != ITMH_LINESPLIT) {
 			ims_write(&asyncsock->recvmsg, buffer, retval);
 		}	else {
-			long start = 0, pos = 0;
-			char head[4];
-			for (start = 0, pos = 0; pos < retval; pos++) {
-				if (buffer[pos] == '\n') {
-					long x = pos - start + 1;
-					long y = (long)(asyncsock->linemsg.size);
-					iencode32u_lsb(head, x + y + 4);
-					ims_write(&asyncsock->recvmsg, head, 4);
-					while (asyncsock->linemsg.size > 0) {
-						ilong csize;
-						void *ptr;
-						csize = ims_flat(&asyncsock->linemsg, &ptr);
-						ims_write(&asyncsock->recvmsg, ptr, csize);
-						ims_drop(&asyncsock->linemsg, csize);
-					}
-					ims_write(&asyncsock->recvmsg, &buffer[start], x);
-					start = pos + 1;
-				}
-			}
-			if (pos > start) {
-				ims_write(&asyncsock->linemsg, &buffer[start], pos - start);
-			}
+			async_sock_split_line(asyncsock, buffer, retval);
 		}
 		if (retval < bufsize) break;
 	}
@@ -476,10 +863,15 @@ int async_sock_fd(const CAsyncSock *asyncsock)
 	return asyncsock->fd;
 }
 
-/* get how many bytes remain in the send buffer */
+/* get how many bytes remain in the send buffer (and file segments) */
 long async_sock_remain(const CAsyncSock *asyncsock)
 {
-	return (long)asyncsock->sendmsg.size;
+	IINT64 size = (IINT64)asyncsock->sendmsg.size;
+	if (!ilist_is_empty(&asyncsock->files)) {
+		size += async_file_remain(&asyncsock->files);
+		if (size > 0x7fffffff) size = 0x7fffffff;
+	}
+	return (long)size;
 }
 
 
@@ -614,31 +1006,85 @@ async_sock_write_size(const CAsyncSock *asyncsock, long size,
 	return hdrlen;
 }
 
+/* recv vector with a framing codec */
+static long async_sock_recv_codec(CAsyncSock *asyncsock, 
+	void* const vecptr[], const long veclen[], int count)
+{
+	const CAsyncCodec *codec = asyncsock->codec;
+	long size = 0, hdrlen = 0, frame, len, pos;
+	int i;
+
+	for (i = 0; i < count; i++) size += veclen[i];
+
+	frame = codec->peek(asyncsock, &asyncsock->recvmsg, &hdrlen);
+	if (frame == 0) return -1;
+	if (frame < 0 || hdrlen < 0 || hdrlen > frame) return -3;
+	if (frame > asyncsock->maxsize) return -4;
+	if ((long)asyncsock->recvmsg.size < frame) return -1;
+
+	len = frame - hdrlen;
+	if (vecptr == NULL) return len;
+	if (len > size) return -2;
+
+	ims_drop(&asyncsock->recvmsg, hdrlen);
+
+	for (i = 0, pos = 0; i < count && pos < len; i++) {
+		long canread = len - pos;
+		if (canread > veclen[i]) canread = veclen[i];
+		ims_read(&asyncsock->recvmsg, vecptr[i], canread);
+		if (codec->decode) {
+			codec->decode(asyncsock, (char*)vecptr[i], canread, pos);
+		}
+		pos += canread;
+	}
+
+	asyncsock->codec_state[0] = 0;
+	asyncsock->codec_state[1] = 0;
+
+	return len;
+}
+
+/* write (encrypted) header of a size bytes message into sendmsg */
+static void async_sock_send_head(CAsyncSock *asyncsock, long size, int mask)
+{
+	unsigned char head[ASYNC_CODEC_HEAD];
+	int hdrlen;
+
+	if (asyncsock->codec == NULL) {
+		hdrlen = async_sock_write_size(asyncsock, size, mask, (char*)head);
+	}
+	else if (asyncsock->codec->encode) {
+		hdrlen = asyncsock->codec->encode(asyncsock, (char*)head, 
+				size, mask);
+	}
+	else {
+		hdrlen = 0;
+	}
+
+	if (!async_sock_send_plain(asyncsock) && hdrlen) {
+		async_sock_send_crypt(asyncsock, head, head, hdrlen);
+	}
+
+	ims_write(&asyncsock->sendmsg, head, hdrlen);
+}
+
 /* send vector */
 long async_sock_send_vector(CAsyncSock *asyncsock, 
 	const void * const vecptr[],
 	const long veclen[], int count, int mask)
 {
-	unsigned char head[4];
 	long size = 0;
-	int hdrlen;
 	int i;
 
 	assert(asyncsock);
 	if (asyncsock == NULL) return -1;
 
 	for (i = 0; i < count; i++) size += veclen[i];
-	hdrlen = async_sock_write_size(asyncsock, size, mask, (char*)head);
 
-	if (asyncsock->rc4_send_x >= 0 && asyncsock->rc4_send_y >= 0 && hdrlen) {
-		icrypt_rc4_crypt(asyncsock->rc4_send_box, &asyncsock->rc4_send_x,
-			&asyncsock->rc4_send_y, head, head, hdrlen);
-	}
-
-	ims_write(&asyncsock->sendmsg, head, hdrlen);
+	async_sock_send_head(asyncsock, size, mask);
 
 	for (i = 0; i < count; i++) {
-		if (asyncsock->rc4_send_x < 0 || asyncsock->rc4_send_y < 0) {
+		if (async_sock_send_plain(asyncsock)) {
 			ims_write(&asyncsock->sendmsg, vecptr[i], veclen[i]);
 		}	else {
 			unsigned char *buffer = (unsigned char*)asyncsock->buffer;
@@ -646,11 +1092,8 @@ long async_sock_send_vector(CAsyncSock *asyncsock,
 			long remain = veclen[i];
 			long bufsize = asyncsock->bufsize;
 			for (; remain > 0; ) {
-				long canread = (size > bufsize)? bufsize : remain;
-				icrypt_rc4_crypt(asyncsock->rc4_send_box, 
-					&asyncsock->rc4_send_x, 
-					&asyncsock->rc4_send_y, 
-					lptr, buffer, canread);
+				long canread = (remain > bufsize)? bufsize : remain;
+				async_sock_send_crypt(asyncsock, lptr, buffer, canread);
 				ims_write(&asyncsock->sendmsg, buffer, canread);
 				remain -= canread;
 				lptr += canread;
@@ -661,6 +1104,89 @@ long async_sock_send_vector(CAsyncSock *asyncsock,
 	return size;
 }
 
+/* send a shared buffer, the payload is referenced instead of copied */
+long async_sock_send_shared(CAsyncSock *asyncsock, struct IMSREF *ref,
+	int mask)
+{
+	assert(asyncsock && ref);
+	if (asyncsock == NULL) return -1;
+
+	/* ciphers encrypt per connection, small ones are cheaper to copy */
+	if (!async_sock_send_plain(asyncsock) || 
+		ref->size < ASYNC_SOCK_SHARED_MIN) {
+		const void *vecptr[1];
+		long veclen[1];
+		vecptr[0] = ref->data;
+		veclen[0] = (long)ref->size;
+		return async_sock_send_vector(asyncsock, vecptr, veclen, 1, mask);
+	}
+
+	async_sock_send_head(asyncsock, (long)ref->size, mask);
+
+	if (ims_write_ref(&asyncsock->sendmsg, ref, 0, ref->size) < 0) {
+		ims_write(&asyncsock->sendmsg, ref->data, ref->size);
+	}
+
+	return (long)ref->size;
+}
+
+/* send a file segment as the payload of one message */
+long async_sock_send_file(CAsyncSock *asyncsock, int fd, IINT64 offset,
+	IINT64 length, int mask)
+{
+	int plain = async_sock_send_plain(asyncsock);
+	struct CAsyncFile *file = NULL;
+	int hr = 0;
+
+	assert(asyncsock);
+	if (asyncsock == NULL || fd < 0 || offset < 0) return -1;
+	if (length < 0) return -1;
+
+	if (length > 0x7fffffff) {
+		if (asyncsock->codec == NULL) {
+			if (asyncsock->header < ITMH_RAWDATA) return -2;
+		}
+		else if (asyncsock->codec->encode) {
+			return -2;
+		}
+	}
+
+	/* everything that can fail goes before the header: once written, 
+	   the header has advanced the cipher and the payload must follow */
+	if (length > 0) {
+		file = async_file_new(fd, (asyncsock->chacha_send != NULL), &hr);
+		if (file == NULL) return -1;
+	}
+
+	async_sock_send_head(asyncsock, (long)length, mask);
+
+	if (length == 0) return 0;
+
+	async_file_attach(&asyncsock->files, &asyncsock->sendmsg, file,
+		offset, length, asyncsock->rc4_send_box, 
+		asyncsock->rc4_send_x, asyncsock->rc4_send_y, 
+		asyncsock->chacha_send);
+
+	/* the segment took a copy of the cipher state, skip its keystream */
+	if (asyncsock->chacha_send) {
+		icrypt_chacha20_skip(asyncsock->chacha_send, length);
+	}
+	else if (!plain) {
+		unsigned char *buffer = (unsigned char*)asyncsock->buffer;
+		long bufsize = asyncsock->bufsize;
+		IINT64 remain = length;
+		for (; remain > 0; ) {
+			long canskip = (remain > bufsize)? bufsize : (long)remain;
+			icrypt_rc4_crypt(asyncsock->rc4_send_box, 
+				&asyncsock->rc4_send_x, &asyncsock->rc4_send_y,
+				buffer, buffer, canskip);
+			remain -= canskip;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * recv vector: returns packet size, -1 for not enough data, -2 for 
  * buffer size too small, -3 for packet size error, -4 for size over limit,
@@ -676,6 +1202,10 @@ long async_sock_recv_vector(CAsyncSock *asyncsock, void* const vecptr[],
 	assert(asyncsock);
 	if (asyncsock == 0) return 0;
 
+	if (asyncsock->codec) {
+		return async_sock_recv_codec(asyncsock, vecptr, veclen, count);
+	}
+
 	hdrlen = async_sock_head_len[asyncsock->header];
 	for (i = 0; i < count; i++) size += veclen[i];
 
@@ -735,22 +1265,53 @@ long async_sock_recv(CAsyncSock *asyncsock, void *ptr, int size)
 	return async_sock_recv_vector(asyncsock, vecptr, veclen, 1);
 }
 
+/* set key of one direction for asyncsock->cipher */
+static int async_sock_set_key(CAsyncSock *asyncsock, unsigned char *box,
+	int *x, int *y, struct ICHACHA20 **chacha, 
+	const unsigned char *key, int keylen)
+{
+	struct ICHACHA20 *state;
+	if (asyncsock->cipher != ASYNC_SOCK_CIPHER_CHACHA20 || 
+		key == NULL || keylen <= 0) {
+		if (chacha[0]) {
+			ikmem_free(chacha[0]);
+			chacha[0] = NULL;
+		}
+		icrypt_rc4_init(box, x, y, key, keylen);
+		return 0;
+	}
+	/* a failed call keeps the current cipher */
+	if (keylen != 16 && keylen != 24 && keylen != 32 && keylen != 40) {
+		return -1;
+	}
+	state = (struct ICHACHA20*)ikmem_malloc(sizeof(struct ICHACHA20));
+	if (state == NULL) return -1;
+	/* 24 and 40 bytes keys end with an 8 bytes nonce */
+	icrypt_chacha20_init(state, key, keylen & ~8, 
+		(keylen & 8)? key + (keylen & ~8) : NULL);
+	if (chacha[0]) ikmem_free(chacha[0]);
+	chacha[0] = state;
+	x[0] = -1;
+	y[0] = -1;
+	return 0;
+}
+
 /* set send cryption key */
-void async_sock_rc4_set_skey(CAsyncSock *asyncsock, 
+int async_sock_rc4_set_skey(CAsyncSock *asyncsock, 
 	const unsigned char *key, int keylen)
 {
-	icrypt_rc4_init(asyncsock->rc4_send_box, 
-			&asyncsock->rc4_send_x,
-			&asyncsock->rc4_send_y, key, keylen);
+	return async_sock_set_key(asyncsock, asyncsock->rc4_send_box,
+			&asyncsock->rc4_send_x, &asyncsock->rc4_send_y, 
+			&asyncsock->chacha_send, key, keylen);
 }
 
 /* set recv cryption key */
-void async_sock_rc4_set_rkey(CAsyncSock *asyncsock, 
+int async_sock_rc4_set_rkey(CAsyncSock *asyncsock, 
 	const unsigned char *key, int keylen)
 {
-	icrypt_rc4_init(asyncsock->rc4_recv_box, 
-			&asyncsock->rc4_recv_x,
-			&asyncsock->rc4_recv_y, key, keylen);
+	return async_sock_set_key(asyncsock, asyncsock->rc4_recv_box,
+			&asyncsock->rc4_recv_x, &asyncsock->rc4_recv_y, 
+			&asyncsock->chacha_recv, key, keylen);
 }
 
 /* set nodelay */
@@ -782,6 +1343,248 @@ int async_sock_keepalive(CAsyncSock *asyncsock, int keepcnt, int keepidle,
 
 
 
+/*===================================================================*/
+/* CAsyncCodec                                                       */
+/*===================================================================*/
+#ifndef ASYNC_CODEC_HTTP_HEAD
+#define ASYNC_CODEC_HTTP_HEAD 8192
+#endif
+
+/* set framing codec */
+void async_sock_codec(CAsyncSock *asyncsock, const CAsyncCodec *codec)
+{
+	asyncsock->codec = codec;
+	asyncsock->codec_state[0] = 0;
+	asyncsock->codec_state[1] = 0;
+}
+
+
+/*-------------------------------------------------------------------*/
+/* varint: iencodeu(size) + payload                                  */
+/*-------------------------------------------------------------------*/
+static long async_codec_varint_peek(CAsyncSock *sock, 
+	const struct IMSTREAM *stream, long *hdrlen)
+{
+	unsigned char head[10];
+	long size, i;
+	IUINT64 len;
+	size = (long)ims_peek(stream, head, 10);
+	for (i = 0; i < size; i++) {
+		if ((head[i] & 0x80) == 0) break;
+	}
+	if (i >= 10) return -1;
+	if (i >= size) return 0;
+	idecodeu((const char*)head, &len);
+	if (len >= 0x7fffffff - 10) return 0x7fffffff;
+	hdrlen[0] = i + 1;
+	return (long)len + i + 1;
+}
+
+static int async_codec_varint_encode(CAsyncSock *sock, char *head,
+	long size, int mask)
+{
+	return (int)(iencodeu(head, (IUINT64)size) - head);
+}
+
+const CAsyncCodec async_codec_varint = {
+	"varint",
+	async_codec_varint_peek,
+	NULL,
+	async_codec_varint_encode,
+};
+
+
+/*-------------------------------------------------------------------*/
+/* http/1.1 request: codec_state[0] is the scanned head size,        */
+/* codec_state[1] caches the frame size once the head is complete    */
+/*-------------------------------------------------------------------*/
+static long async_codec_http_field(const char *line, long size, 
+	const char *name)
+{
+	long n = (long)strlen(name);
+	if (size <= n) return -1;
+	if (istrncasecmp((char*)line, (char*)name, n) != 0) return -1;
+	for (; n < size && (line[n] == ' ' || line[n] == '\t'); n++);
+	return n;
+}
+
+static long async_codec_http_peek(CAsyncSock *sock, 
+	const struct IMSTREAM *stream, long *hdrlen)
+{
+	char head[ASYNC_CODEC_HTTP_HEAD];
+	long size, pos, end = -1, body = 0, line, next;
+
+	hdrlen[0] = 0;
+	if (sock->codec_state[1] > 0) return sock->codec_state[1];
+
+	size = (long)stream->size;
+	if (size > ASYNC_CODEC_HTTP_HEAD) size = ASYNC_CODEC_HTTP_HEAD;
+	if (size <= sock->codec_state[0]) return 0;
+
+	size = (long)ims_peek(stream, head, size);
+	pos = sock->codec_state[0];
+
+	while (pos < size) {
+		const char *p = (const char*)memchr(head + pos, '\n', size - pos);
+		if (p == NULL) break;
+		pos = (long)(p - head) + 1;
+		if (pos >= 2 && head[pos - 2] == '\n') end = pos;
+		else if (pos >= 3 && head[pos - 2] == '\r' && head[pos - 3] == '\n')
+			end = pos;
+		if (end >= 0) break;
+	}
+
+	if (end < 0) {
+		if (size >= ASYNC_CODEC_HTTP_HEAD) return -1;
+		sock->codec_state[0] = (size > 3)? size - 3 : 0;
+		return 0;
+	}
+
+	for (line = 0; line < end; line = next) {
+		const char *p = (const char*)memchr(head + line, '\n', end - line);
+		long n, x;
+		next = (long)(p - head) + 1;
+		n = next - line;
+		x = async_codec_http_field(head + line, n, "content-length:");
+		if (x >= 0) {
+			for (body = 0; x < n && head[line + x] >= '0' &&
+				head[line + x] <= '9'; x++) {
+				body = body * 10 + (head[line + x] - '0');
+				if (body >= 0x7fffffff - ASYNC_CODEC_HTTP_HEAD) 
+					return 0x7fffffff;
+			}
+		}
+		x = async_codec_http_field(head + line, n, "transfer-encoding:");
+		if (x >= 0 && n - x >= 7) {
+			if (istrncasecmp(head + line + x, (char*)"chunked", 7) == 0)
+				return -1;
+		}
+	}
+
+	sock->codec_state[1] = end + body;
+
+	return end + body;
+}
+
+const CAsyncCodec async_codec_http = {
+	"http",
+	async_codec_http_peek,
+	NULL,
+	NULL,
+};
+
+
+/*-------------------------------------------------------------------*/
+/* websocket: codec_state[0] is the masking key, codec_state[1] is   */
+/* the first header byte with 0x100 set for masked frames            */
+/*-------------------------------------------------------------------*/
+static long async_codec_ws_peek(CAsyncSock *sock, 
+	const struct IMSTREAM *stream, long *hdrlen)
+{
+	unsigned char head[14];
+	long size, need = 2, i;
+	IUINT64 len;
+	IUINT32 key = 0;
+
+	size = (long)ims_peek(stream, head, 14);
+	if (size < 2) return 0;
+
+	len = head[1] & 0x7f;
+	if (len == 126) need += 2;
+	else if (len == 127) need += 8;
+	if (head[1] & 0x80) need += 4;
+	if (size < need) return 0;
+
+	if (len == 126) {
+		len = (((IUINT64)head[2]) << 8) | head[3];
+	}
+	else if (len == 127) {
+		for (len = 0, i = 2; i < 10; i++) len = (len << 8) | head[i];
+	}
+
+	if (head[1] & 0x80) {
+		idecode32u_lsb((const char*)head + need - 4, &key);
+	}
+
+	sock->codec_state[0] = (long)key;
+	sock->codec_state[1] = head[0] | ((head[1] & 0x80) << 1);
+
+	if (len >= 0x7fffffff - 14) return 0x7fffffff;
+
+	/* keep the last header byte, decode puts the opcode there */
+	hdrlen[0] = need - 1;
+
+	return (long)len + need;
+}
+
+static void async_codec_ws_decode(CAsyncSock *sock, char *data, 
+	long size, long pos)
+{
+	unsigned char *p = (unsigned char*)data;
+	unsigned char key[8];
+	IUINT32 k;
+	long i = 0, j;
+
+	if (pos == 0 && size > 0) {
+		p[0] = (unsigned char)(sock->codec_state[1] & 0xff);
+		i = 1;
+	}
+
+	if ((sock->codec_state[1] & 0x100) == 0) return;
+
+	k = (IUINT32)sock->codec_state[0];
+
+	/* payload byte at data[i] is (pos + i - 1) of the frame payload */
+	for (j = 0; j < 8; j++) {
+		key[j] = (unsigned char)(k >> (((pos + i - 1 + j) & 3) * 8));
+	}
+
+	for (; i + 8 <= size; i += 8) {
+		IUINT64 x, y;
+		memcpy(&x, p + i, 8);
+		memcpy(&y, key, 8);
+		x ^= y;
+		memcpy(p + i, &x, 8);
+	}
+
+	for (j = 0; i < size; i++, j++) {
+		p[i] ^= key[j];
+	}
+}
+
+static int async_codec_ws_encode(CAsyncSock *sock, char *head, 
+	long size, int mask)
+{
+	unsigned char *p = (unsigned char*)head;
+	int opcode = (mask & 0x0f)? (mask & 0x0f) : 2;
+	int i;
+	p[0] = (unsigned char)(0x80 | opcode);
+	if (size < 126) {
+		p[1] = (unsigned char)size;
+		return 2;
+	}
+	else if (size < 0x10000) {
+		p[1] = 126;
+		p[2] = (unsigned char)(size >> 8);
+		p[3] = (unsigned char)(size & 0xff);
+		return 4;
+	}
+	p[1] = 127;
+	for (i = 0; i < 8; i++) {
+		p[2 + i] = (unsigned char)(((IUINT64)size) >> ((7 - i) * 8));
+	}
+	return 10;
+}
+
+const CAsyncCodec async_codec_websocket = {
+	"websocket",
+	async_codec_ws_peek,
+	async_codec_ws_decode,
+	async_codec_ws_encode,
+};
+
+
+
 /*===================================================================*/
 /* CAsyncCore                                                        */
 /*===================================================================*/
@@ -814,6 +1617,26 @@ struct CAsyncCore
 	IUINT32 timeout;
 	struct ILISTHEAD pending;
 	CAsyncValidator validator;
+	void * volatile cmdq;
+	volatile ilong cmdwake;
+};
+
+
+/*-------------------------------------------------------------------*/
+/* command submitted from other threads                              */
+/*-------------------------------------------------------------------*/
+#define ASYNC_CORE_CMD_SEND         0
+#define ASYNC_CORE_CMD_CLOSE        1
+#define ASYNC_CORE_CMD_OPTION       2
+
+struct CAsyncCommand
+{
+	struct CAsyncCommand *next;
+	int cmd;
+	int arg;
+	long hid;
+	long value;
+	char data[1];
 };
 
 
@@ -842,6 +1665,10 @@ static unsigned int async_core_monitor = 0;
 
 #define ASYNC_CORE_FILTER(s) ((CAsyncFilter)((s)->filter))
 
+/* data or file segments waiting to be sent */
+#define ASYNC_CORE_PENDING(s) \
+	((s)->sendmsg.size > 0 || !ilist_is_empty(&((s)->files)))
+
 static long _async_core_node_head(const CAsyncCore *core);
 static long _async_core_node_next(const CAsyncCore *core, long hid);
 static long _async_core_node_prev(const CAsyncCore *core, long hid);
@@ -914,6 +1741,8 @@ CAsyncCore* async_core_new(int flags)
 	core->limited = 0;
 	core->flags = 0;
 	core->dispatch = 0;
+	core->cmdq = NULL;
+	core->cmdwake = 0;
 
 	core->xfd[0] = -1;
 	core->xfd[1] = -1;
@@ -971,8 +1800,15 @@ static long async_core_node_delete(CAsyncCore *core, long hid);
 
 void async_core_delete(CAsyncCore *core)
 {
+	struct CAsyncCommand *cmd;
 	if (core == NULL) return;
 	ASYNC_CORE_CRITICAL_BEGIN(core);
+	cmd = (struct CAsyncCommand*)iatomic_ptr_xchg(&core->cmdq, NULL);
+	while (cmd) {
+		struct CAsyncCommand *next = cmd->next;
+		ikmem_free(cmd);
+		cmd = next;
+	}
 	while (1) {
 		long hid = _async_core_node_head(core);
 		if (hid < 0) break;
@@ -1370,6 +2206,7 @@ static long async_core_accept(CAsyncCore *core, long listen_hid)
 	struct sockaddr_in6 remote6;
 #endif
 	struct sockaddr *remote;
+	const CAsyncCodec *codec;
 	long hid, limited, maxsize;
 	int fd = -1;
 	int addrlen = 0;
@@ -1421,6 +2258,7 @@ static long async_core_accept(CAsyncCore *core, long listen_hid)
 	head = sock->header;
 	limited = sock->limited;
 	maxsize = sock->maxsize;
+	codec = sock->codec;
 
 	sock = async_core_node_get(core, hid);
 
@@ -1438,6 +2276,7 @@ static long async_core_accept(CAsyncCore *core, long listen_hid)
 
 	sock->limited = limited;
 	sock->maxsize = maxsize;
+	sock->codec = codec;
 	
 	hr = ipoll_add(core->pfd, fd, IPOLL_IN | IPOLL_ERR, sock);
 	if (hr != 0) {
@@ -1817,7 +2656,7 @@ static void async_core_event_close(CAsyncCore *core,
 		sock->filter = NULL;
 		sock->object = NULL;
 	}
-	if (sock->sendmsg.size > 0) {
+	if (ASYNC_CORE_PENDING(sock)) {
 		if (sock->fd >= 0) {
 			async_sock_update(sock, 2);
 		}
@@ -1838,6 +2677,8 @@ static void async_core_event_close(CAsyncCore *core,
 /* wait for events for millisec ms. and process events,              */
 /* if millisec equals zero, no wait.                                 */
 /*-------------------------------------------------------------------*/
+static void async_core_command_drain(CAsyncCore *core);
+
 static void async_core_process_events(CAsyncCore *core, IUINT32 millisec)
 {
 	int fd, event, x, count, xf, code = 2010;
@@ -1846,6 +2687,9 @@ static void async_core_process_events(CAsyncCore *core, IUINT32 millisec)
 	IUINT64 ts;
 	IUINT32 now;
 
+	/* commands from other threads */
+	async_core_command_drain(core);
+
 	/* process pending close */
 	while (!ilist_is_empty(&core->pending)) {
 		CAsyncSock *sock;
@@ -1863,6 +2707,8 @@ static void async_core_process_events(CAsyncCore *core, IUINT32 millisec)
 	/* waiting events */
 	count = ipoll_wait(core->pfd, (pending == 0)? millisec : 0);
 
+	async_core_command_drain(core);
+
 	ts = iclock64();
 	core->current = (IUINT32)(ts & 0xfffffffful);
 	now = (IUINT32)((ts / 1000) & 0xfffffffful);
@@ -1985,13 +2831,13 @@ static void async_core_process_events(CAsyncCore *core, IUINT32 millisec)
 					}
 				}
 			}
-			if (sock->sendmsg.size > 0 && needclose == 0) {
+			if (ASYNC_CORE_PENDING(sock) && needclose == 0) {
 				if (async_sock_update(sock, 2) != 0) {
 					needclose = 1;
 					code = 2005;
 				}
 			}
-			if (sock->sendmsg.size == 0 && sock->fd >= 0 && !needclose) {
+			if (!ASYNC_CORE_PENDING(sock) && sock->fd >= 0 && !needclose) {
 				if (sock->mask & IPOLL_OUT) {
 					async_core_node_mask(core, sock, 0, IPOLL_OUT);
 					if (sock->flags & ASYNC_CORE_FLAG_PROGRESS) {
@@ -2002,7 +2848,7 @@ static void async_core_process_events(CAsyncCore *core, IUINT32 millisec)
 			}
 		}
 		if (sock->flags & ASYNC_CORE_FLAG_SHUTDOWN) {
-			if (sock->sendmsg.size == 0 && needclose == 0) {
+			if (!ASYNC_CORE_PENDING(sock) && needclose == 0) {
 				needclose = 1;
 				code = 2006;
 			}
@@ -2034,7 +2880,7 @@ static int _async_core_close(CAsyncCore *core, long hid, int code)
 	CAsyncSock *sock;
 	sock = async_core_node_get(core, hid);
 	if (sock == NULL) return -1;
-	if (sock->sendmsg.size > 0) {
+	if (ASYNC_CORE_PENDING(sock)) {
 		if (sock->fd >= 0) {
 			async_sock_update(sock, 2);
 		}
@@ -2065,14 +2911,10 @@ int async_core_close(CAsyncCore *core, long hid, int code)
 
 
 /*-------------------------------------------------------------------*/
-/* send vector                                                       */
+/* check send limit before sending, returns zero if can send         */
 /*-------------------------------------------------------------------*/
-static long _async_core_send_vector(CAsyncCore *core, long hid,
-	const void * const vecptr[],
-	const long veclen[], int count, int mask)
+static long _async_core_send_check(CAsyncCore *core, CAsyncSock *sock)
 {
-	CAsyncSock *sock = async_core_node_get(core, hid);
-	long hr;
 	if (sock == NULL) return -100;
 	if (sock->closing) return -110;
 	if (sock->limited > 0 && sock->sendmsg.size > (iulong)sock->limited) {
@@ -2082,17 +2924,52 @@ static long _async_core_send_vector(CAsyncCore *core, long hid,
 			}
 		}
 		if (sock->sendmsg.size > (iulong)sock->limited) {
-			_async_core_close(core, hid, 2008);
+			_async_core_close(core, sock->hid, 2008);
 			return -200;
 		}
 	}
-	hr = async_sock_send_vector(sock, vecptr, veclen, count, mask);
-	if (sock->sendmsg.size > 0 && sock->fd >= 0) {
+	return 0;
+}
+
+/*-------------------------------------------------------------------*/
+/* watch IPOLL_OUT after sending                                     */
+/*-------------------------------------------------------------------*/
+static void _async_core_send_mask(CAsyncCore *core, CAsyncSock *sock)
+{
+	if (ASYNC_CORE_PENDING(sock) && sock->fd >= 0) {
 		if ((sock->mask & IPOLL_OUT) == 0) {
 			async_core_node_mask(core, sock, 
 				IPOLL_OUT, 0);
 		}
 	}
+}
+
+/*-------------------------------------------------------------------*/
+/* send vector                                                       */
+/*-------------------------------------------------------------------*/
+static long _async_core_send_vector(CAsyncCore *core, long hid,
+	const void * const vecptr[],
+	const long veclen[], int count, int mask)
+{
+	CAsyncSock *sock = async_core_node_get(core, hid);
+	long hr = _async_core_send_check(core, sock);
+	if (hr != 0) return hr;
+	hr = async_sock_send_vector(sock, vecptr, veclen, count, mask);
+	_async_core_send_mask(core, sock);
+	return hr;
+}
+
+/*-------------------------------------------------------------------*/
+/* send shared buffer                                                */
+/*-------------------------------------------------------------------*/
+static long _async_core_send_shared(CAsyncCore *core, long hid,
+	struct IMSREF *ref)
+{
+	CAsyncSock *sock = async_core_node_get(core, hid);
+	long hr = _async_core_send_check(core, sock);
+	if (hr != 0) return hr;
+	hr = async_sock_send_shared(sock, ref, 0);
+	_async_core_send_mask(core, sock);
 	return hr;
 }
 
@@ -2172,6 +3049,75 @@ long async_core_send(CAsyncCore *core, long hid, const void *ptr, long len)
 }
 
 
+/*-------------------------------------------------------------------*/
+/* send file segment                                                 */
+/*-------------------------------------------------------------------*/
+long async_core_send_file(CAsyncCore *core, long hid, int fd, 
+	IINT64 offset, IINT64 length, int mask)
+{
+	CAsyncSock *sock;
+	long hr;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	sock = async_core_node_get(core, hid);
+	hr = _async_core_send_check(core, sock);
+	if (hr == 0 && sock->filter != NULL) {
+		hr = -300;
+	}
+	if (hr == 0) {
+		hr = async_sock_send_file(sock, fd, offset, length, mask);
+		_async_core_send_mask(core, sock);
+	}
+	ASYNC_CORE_CRITICAL_END(core);
+	return hr;
+}
+
+
+/*-------------------------------------------------------------------*/
+/* send the same data to many hids                                   */
+/*-------------------------------------------------------------------*/
+long async_core_broadcast(CAsyncCore *core, const long hids[], int count,
+	const void *ptr, long len)
+{
+	struct IMSREF *ref = NULL;
+	long sent = 0;
+	int i;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	for (i = 0; i < count; i++) {
+		CAsyncSock *sock = async_core_node_get(core, hids[i]);
+		long hr;
+		if (sock == NULL) continue;
+		if (sock->filter != NULL) {
+			CAsyncFilter filter = ASYNC_CORE_FILTER(sock);
+			core->dispatch = 1;
+			hr = filter(core, sock->object, hids[i], 
+					ASYNC_CORE_FILTER_WRITE, ptr, len);
+			core->dispatch = 0;
+		}
+		else {
+			if (ref == NULL) {
+				ref = ims_ref_new(ptr, len);
+			}
+			if (ref != NULL) {
+				hr = _async_core_send_shared(core, hids[i], ref);
+			}	else {
+				const void *vecptr[1];
+				long veclen[1];
+				vecptr[0] = ptr;
+				veclen[0] = len;
+				hr = _async_core_send_vector(core, hids[i], vecptr, 
+						veclen, 1, 0);
+			}
+		}
+		if (hr >= 0) sent++;
+	}
+	if (ref != NULL) {
+		ims_ref_dec(ref);
+	}
+	ASYNC_CORE_CRITICAL_END(core);
+	return sent;
+}
+
+
 /*-------------------------------------------------------------------*/
 /* wait for events for millisec ms. and process events,              */
 /* if millisec equals zero, no wait.                                 */
@@ -2312,7 +3258,7 @@ long async_core_remain(const CAsyncCore *core, long hid)
 	long size = -1;
 	ASYNC_CORE_CRITICAL_BEGIN(core);
 	sock = async_core_node_get_const(core, hid);
-	if (sock != NULL) size = (long)sock->sendmsg.size;
+	if (sock != NULL) size = async_sock_remain(sock);
 	ASYNC_CORE_CRITICAL_END(core);
 	return size;
 }
@@ -2490,12 +3436,12 @@ static int _async_core_option(CAsyncCore *core, long hid,
 		if (sock->mode != ASYNC_CORE_NODE_LISTEN4 && 
 			sock->mode != ASYNC_CORE_NODE_LISTEN6 && 
 			sock->mode != ASYNC_CORE_NODE_DGRAM) {
-			if (sock->sendmsg.size > 0) {
+			if (ASYNC_CORE_PENDING(sock)) {
 				if (sock->fd >= 0) {
 					async_sock_update(sock, 2);
 				}
 			}
-			if (sock->sendmsg.size == 0) {
+			if (!ASYNC_CORE_PENDING(sock)) {
 				_async_core_close(core, sock->hid, (int)value);
 			}	else {
 				sock->flags |= ASYNC_CORE_FLAG_SHUTDOWN;
@@ -2505,6 +3451,15 @@ static int _async_core_option(CAsyncCore *core, long hid,
 	case ASYNC_CORE_OPTION_GETHEADER:
 		hr = sock->header;
 		break;
+	case ASYNC_CORE_OPTION_CIPHER:
+		if (value == ASYNC_SOCK_CIPHER_RC4 || 
+			value == ASYNC_SOCK_CIPHER_CHACHA20) {
+			sock->cipher = (int)value;
+			hr = 0;
+		}	else {
+			hr = -1;
+		}
+		break;
 	}
 	return hr;
 }
@@ -2554,6 +3509,146 @@ long async_core_status(CAsyncCore *core, long hid, int opt)
 	return hr;
 }
 
+
+/*-------------------------------------------------------------------*/
+/* run commands submitted by other threads, in submission order      */
+/*-------------------------------------------------------------------*/
+static void async_core_command_drain(CAsyncCore *core)
+{
+	struct CAsyncCommand *cmd, *next, *list = NULL;
+
+	if (iatomic_ptr_get(&core->cmdq) == NULL) return;
+
+	/* clear first, producers after this point will wake us again */
+	iatomic_xchg(&core->cmdwake, 0);
+	cmd = (struct CAsyncCommand*)iatomic_ptr_xchg(&core->cmdq, NULL);
+
+	for (; cmd; cmd = next) {
+		next = cmd->next;
+		cmd->next = list;
+		list = cmd;
+	}
+
+	for (cmd = list; cmd; cmd = next) {
+		CAsyncSock *sock = async_core_node_get(core, cmd->hid);
+		next = cmd->next;
+		if (sock != NULL) {
+			switch (cmd->cmd) {
+			case ASYNC_CORE_CMD_SEND:
+				if (sock->filter == NULL) {
+					const void *vecptr[1];
+					long veclen[1];
+					vecptr[0] = cmd->data;
+					veclen[0] = cmd->value;
+					_async_core_send_vector(core, cmd->hid, vecptr, 
+						veclen, 1, cmd->arg);
+				}	else {
+					CAsyncFilter filter = ASYNC_CORE_FILTER(sock);
+					core->dispatch = 1;
+					filter(core, sock->object, cmd->hid,
+						ASYNC_CORE_FILTER_WRITE, cmd->data, cmd->value);
+					core->dispatch = 0;
+				}
+				break;
+			case ASYNC_CORE_CMD_CLOSE:
+				_async_core_close(core, cmd->hid, (int)cmd->value);
+				break;
+			case ASYNC_CORE_CMD_OPTION:
+				_async_core_option(core, cmd->hid, cmd->arg, cmd->value);
+				break;
+			}
+		}
+		ikmem_free(cmd);
+	}
+}
+
+
+/*-------------------------------------------------------------------*/
+/* queue a command without taking core->lock                         */
+/*-------------------------------------------------------------------*/
+static int async_core_command_push(CAsyncCore *core, 
+	struct CAsyncCommand *cmd)
+{
+	void *head;
+	do {
+		head = iatomic_ptr_get(&core->cmdq);
+		cmd->next = (struct CAsyncCommand*)head;
+	}	while (iatomic_ptr_cas(&core->cmdq, head, cmd) != head);
+	if (iatomic_xchg(&core->cmdwake, 1) == 0) {
+		async_core_notify(core);
+	}
+	return 0;
+}
+
+static struct CAsyncCommand *async_core_command_new(int command, 
+	long hid, int arg, long value, long size)
+{
+	struct CAsyncCommand *cmd;
+	size = (size < 0)? 0 : size;
+	cmd = (struct CAsyncCommand*)ikmem_malloc(
+		sizeof(struct CAsyncCommand) + size);
+	if (cmd == NULL) return NULL;
+	cmd->next = NULL;
+	cmd->cmd = command;
+	cmd->arg = arg;
+	cmd->hid = hid;
+	cmd->value = value;
+	return cmd;
+}
+
+/* queue vector send from any thread, never waits for the poll loop */
+long async_core_submit_vector(CAsyncCore *core, long hid, 
+	const void * const vecptr[],
+	const long veclen[], int count, int mask)
+{
+	struct CAsyncCommand *cmd;
+	long size = 0;
+	char *ptr;
+	int i;
+	for (i = 0; i < count; i++) size += veclen[i];
+	cmd = async_core_command_new(ASYNC_CORE_CMD_SEND, hid, mask, 
+			size, size);
+	if (cmd == NULL) return -1;
+	for (ptr = cmd->data, i = 0; i < count; i++) {
+		if (vecptr[i]) {
+			memcpy(ptr, vecptr[i], veclen[i]);
+		}
+		ptr += veclen[i];
+	}
+	async_core_command_push(core, cmd);
+	return size;
+}
+
+/* queue send from any thread */
+long async_core_submit(CAsyncCore *core, long hid, const void *ptr, 
+	long len)
+{
+	const void *vecptr[1];
+	long veclen[1];
+	vecptr[0] = ptr;
+	veclen[0] = len;
+	return async_core_submit_vector(core, hid, vecptr, veclen, 1, 0);
+}
+
+/* queue close from any thread */
+int async_core_submit_close(CAsyncCore *core, long hid, int code)
+{
+	struct CAsyncCommand *cmd;
+	cmd = async_core_command_new(ASYNC_CORE_CMD_CLOSE, hid, 0, code, 0);
+	if (cmd == NULL) return -1;
+	return async_core_command_push(core, cmd);
+}
+
+/* queue option from any thread, the result is discarded */
+int async_core_submit_option(CAsyncCore *core, long hid, int opt, 
+	long value)
+{
+	struct CAsyncCommand *cmd;
+	cmd = async_core_command_new(ASYNC_CORE_CMD_OPTION, hid, opt, value, 0);
+	if (cmd == NULL) return -1;
+	return async_core_command_push(core, cmd);
+}
+
 /* set connection rc4 send key */
 int async_core_rc4_set_skey(CAsyncCore *core, long hid, 
 	const unsigned char *key, int keylen)
@@ -2563,8 +3658,7 @@ int async_core_rc4_set_skey(CAsyncCore *core, long hid,
 	ASYNC_CORE_CRITICAL_BEGIN(core);
 	sock = async_core_node_get(core, hid);
 	if (sock != NULL) {
-		async_sock_rc4_set_skey(sock, key, keylen);
-		hr = 0;
+		hr = async_sock_rc4_set_skey(sock, key, keylen)? -2 : 0;
 	}
 	ASYNC_CORE_CRITICAL_END(core);
 	return hr;
@@ -2579,8 +3673,7 @@ int async_core_rc4_set_rkey(CAsyncCore *core, long hid,
 	ASYNC_CORE_CRITICAL_BEGIN(core);
 	sock = async_core_node_get(core, hid);
 	if (sock != NULL) {
-		async_sock_rc4_set_rkey(sock, key, keylen);
-		hr = 0;
+		hr = async_sock_rc4_set_rkey(sock, key, keylen)? -2 : 0;
 	}
 	ASYNC_CORE_CRITICAL_END(core);
 	return hr;
@@ -2626,6 +3719,21 @@ void async_core_firewall(CAsyncCore *core, CAsyncValidator v, void *user)
 	ASYNC_CORE_CRITICAL_END(core);
 }
 
+/* set framing codec */
+int async_core_codec(CAsyncCore *core, long hid, const CAsyncCodec *codec)
+{
+	CAsyncSock *sock;
+	int hr = -1;
+	ASYNC_CORE_CRITICAL_BEGIN(core);
+	sock = async_core_node_get(core, hid);
+	if (sock != NULL) {
+		async_sock_codec(sock, codec);
+		hr = 0;
+	}
+	ASYNC_CORE_CRITICAL_END(core);
+	return hr;
+}
+
 /* set timeout */
 void async_core_timeout(CAsyncCore *core, long seconds)
 {
@@ -51,6 +51,8 @@ int isocket_update_address(int resolvname);
 /*===================================================================*/
 /* CAsyncSock                                                        */
 /*===================================================================*/
+struct CAsyncCodec;
+
 struct CAsyncSock
 {
 	IUINT32 time;					/* timeout */
@@ -73,13 +75,19 @@ struct CAsyncSock
 	int rc4_send_y;					/* rc4 encryption variable */
 	int rc4_recv_x;					/* rc4 encryption variable */
 	int rc4_recv_y;					/* rc4 encryption variable */
+	int cipher;						/* cipher of new keys */
+	struct ICHACHA20 *chacha_send;	/* chacha20 send state or NULL */
+	struct ICHACHA20 *chacha_recv;	/* chacha20 recv state or NULL */
 	void *filter;					/* filter function */
 	void *object;					/* filter object */
 	int closing;					/* pending close */
 	int exitcode;					/* exit code */
 	struct ILISTHEAD node;			/* list node */
 	struct ILISTHEAD pending;		/* waiting close */
-	struct IMSTREAM linemsg;		/* line buffer */
+	long linesize;					/* unterminated line in recvmsg, -1 none */
+	const struct CAsyncCodec *codec;	/* framing codec, NULL for header */
+	long codec_state[2];			/* codec private, reset for each frame */
+	struct ILISTHEAD files;			/* queued file segments */
 	struct IMSTREAM sendmsg;		/* send buffer */
 	struct IMSTREAM recvmsg;		/* recv buffer */
 	unsigned char rc4_send_box[256];	
@@ -109,6 +117,13 @@ struct CAsyncSock
 #define ASYNC_SOCK_STATE_CONNECTING     1
 #define ASYNC_SOCK_STATE_ESTAB          2
 
+#define ASYNC_SOCK_CIPHER_RC4           0	/* key: 1-256 bytes */
+#define ASYNC_SOCK_CIPHER_CHACHA20      1	/* key: 16/32 (+8 nonce) bytes */
+
+#ifndef ASYNC_SOCK_SHARED_MIN
+#define ASYNC_SOCK_SHARED_MIN         256   /* copy shared ones below */
+#endif
+
 typedef struct CAsyncSock CAsyncSock;
 
 
@@ -157,6 +172,26 @@ long async_sock_send_vector(CAsyncSock *asyncsock,
 	const void * const vecptr[],
 	const long veclen[], int count, int mask);
 
+/**
+ * send a refcounted buffer: sendmsg keeps a reference to ref instead of
+ * a copy, unless a cipher is set or ref is below ASYNC_SOCK_SHARED_MIN
+ */
+long async_sock_send_shared(CAsyncSock *asyncsock, struct IMSREF *ref,
+	int mask);
+
+/**
+ * send length bytes of file fd from offset as the payload of one message,
+ * after the data already queued. it goes by sendfile, or is read through 
+ * a bounded buffer when a cipher is set. fd is duplicated and can be 
+ * closed right away. returns 0 for success, -1 for error, -2 if length 
+ * doesn't fit the header (above 2GB needs ITMH_RAWDATA). nothing is 
+ * written on failure. with rc4 the call itself is O(length): the send 
+ * keystream has no seek and is advanced by running rc4 over length 
+ * bytes, chacha20 skips in O(1).
+ */
+long async_sock_send_file(CAsyncSock *asyncsock, int fd, IINT64 offset,
+	IINT64 length, int mask);
+
 /**
  * recv vector: returns packet size, -1 for not enough data, -2 for 
  * buffer size too small, -3 for packet size error, -4 for size over limit,
@@ -173,12 +208,14 @@ int async_sock_update(CAsyncSock *asyncsock, int what);
 void async_sock_process(CAsyncSock *asyncsock);
 
 
-/* set send cryption key */
-void async_sock_rc4_set_skey(CAsyncSock *asyncsock, 
+/* set send cryption key of asyncsock->cipher (NULL to disable),
+   returns 0 for success, -1 for bad key size (current key is kept) */
+int async_sock_rc4_set_skey(CAsyncSock *asyncsock, 
 	const unsigned char *key, int keylen);
 
-/* set recv cryption key */
-void async_sock_rc4_set_rkey(CAsyncSock *asyncsock, 
+/* set recv cryption key of asyncsock->cipher (NULL to disable),
+   returns 0 for success, -1 for bad key size (current key is kept) */
+int async_sock_rc4_set_rkey(CAsyncSock *asyncsock, 
 	const unsigned char *key, int keylen);
 
 /* set nodelay */
@@ -193,6 +230,77 @@ int async_sock_keepalive(CAsyncSock *asyncsock, int keepcnt, int keepidle,
 
 
 
+/*===================================================================*/
+/* CAsyncCodec: framing beyond ITMH_* headers                        */
+/*===================================================================*/
+#define ASYNC_CODEC_HEAD        16      /* max header size of encode */
+
+struct CAsyncCodec
+{
+	const char *name;
+	/**
+	 * size of the frame at the head of stream (header included), 0 for
+	 * not enough data, -1 for malformed. *hdrlen leading bytes of the
+	 * frame are dropped, the rest is delivered.
+	 */
+	long (*peek)(CAsyncSock *sock, const struct IMSTREAM *stream, 
+		long *hdrlen);
+	/* optional: decode delivered data in place, pos is its offset */
+	void (*decode)(CAsyncSock *sock, char *data, long size, long pos);
+	/* optional: write header for a payload of size into head */
+	int (*encode)(CAsyncSock *sock, char *head, long size, int mask);
+};
+
+typedef struct CAsyncCodec CAsyncCodec;
+
+/* length in iencodeu format (header excluded) followed by payload */
+extern const CAsyncCodec async_codec_varint;
+
+/* http/1.1 request with optional Content-Length body, delivered whole */
+extern const CAsyncCodec async_codec_http;
+
+/**
+ * websocket (rfc 6455) server side: delivers the first header byte 
+ * (FIN and opcode) followed by unmasked payload, sends unmasked frames
+ * with mask as opcode (0 for binary)
+ */
+extern const CAsyncCodec async_codec_websocket;
+
+/* set framing codec, NULL to use the header mode again */
+void async_sock_codec(CAsyncSock *asyncsock, const CAsyncCodec *codec);
+
+
+
+/*===================================================================*/
+/* file segments: send queue entries of (fd, offset, length)         */
+/*===================================================================*/
+
+/**
+ * queue a file segment behind the data already in stream, fd is 
+ * duplicated. box/x/y is the rc4 state for its first byte, NULL for 
+ * plain, chacha (copied) is the chacha20 one instead when not NULL.
+ * returns 0 for success, -1 for bad fd, -2 for out of memory.
+ */
+int async_file_queue(struct ILISTHEAD *files, const struct IMSTREAM *stream,
+	int fd, IINT64 offset, IINT64 length, const unsigned char *box,
+	int x, int y, const struct ICHACHA20 *chacha);
+
+/**
+ * send stream and queued file segments in order until the socket would 
+ * block, returns 0 for ok, -1 for error (errno or -1 for a truncated 
+ * file in *error).
+ */
+int async_file_flush(int sock, struct IMSTREAM *stream, 
+	struct ILISTHEAD *files, int *error);
+
+/* drop all queued file segments */
+void async_file_clear(struct ILISTHEAD *files);
+
+/* bytes of queued file segments */
+IINT64 async_file_remain(const struct ILISTHEAD *files);
+
+
+
 /*===================================================================*/
 /* CAsyncCore                                                        */
 /*===================================================================*/
@@ -272,6 +380,35 @@ long async_core_send_vector(CAsyncCore *core, long hid,
 	const void * const vecptr[],
 	const long veclen[], int count, int mask);
 
+/**
+ * send the same data to many hids: the payload is stored once in a
+ * refcounted buffer shared by their send queues (copied only for the
+ * ones with a cipher), returns how many hids accepted it.
+ */
+long async_core_broadcast(CAsyncCore *core, const long hids[], int count,
+	const void *ptr, long len);
+
+
+/**
+ * submit from other threads: commands are queued without core->lock
+ * and run by async_core_wait in order, one wake-up is sent for a batch.
+ * hid is checked when the command runs, returns -1 for out of memory.
+ */
+long async_core_submit(CAsyncCore *core, long hid, const void *ptr, 
+	long len);
+
+/* queue vector send, returns size */
+long async_core_submit_vector(CAsyncCore *core, long hid, 
+	const void * const vecptr[],
+	const long veclen[], int count, int mask);
+
+/* queue close */
+int async_core_submit_close(CAsyncCore *core, long hid, int code);
+
+/* queue async_core_option, its return value is discarded */
+int async_core_submit_option(CAsyncCore *core, long hid, int opt, 
+	long value);
+
 
 /* new connection to the target address, returns hid */
 long async_core_new_connect(CAsyncCore *core, const struct sockaddr *addr,
@@ -344,6 +481,7 @@ long async_core_node_prev(const CAsyncCore *core, long hid);
 #define ASYNC_CORE_OPTION_MASKDEL       16
 #define ASYNC_CORE_OPTION_SHUTDOWN      17
 #define ASYNC_CORE_OPTION_GETHEADER     18
+#define ASYNC_CORE_OPTION_CIPHER        19	/* ASYNC_SOCK_CIPHER_* */
 
 /* set connection socket option */
 int async_core_option(CAsyncCore *core, long hid, int opt, long value);
@@ -355,17 +493,30 @@ int async_core_option(CAsyncCore *core, long hid, int opt, long value);
 /* get connection socket status */
 long async_core_status(CAsyncCore *core, long hid, int opt);
 
-/* set connection rc4 send key */
+/* set connection send key of the cipher chosen by ASYNC_CORE_OPTION_CIPHER
+   (rc4 by default), returns 0, -1 for bad hid, -2 for bad key size */
 int async_core_rc4_set_skey(CAsyncCore *core, long hid, 
 	const unsigned char *key, int keylen);
 
-/* set connection rc4 recv key */
+/* set connection recv key, see async_core_rc4_set_skey */
 int async_core_rc4_set_rkey(CAsyncCore *core, long hid,
 	const unsigned char *key, int keylen);
 
 /* set remote ip validator */
 void async_core_firewall(CAsyncCore *core, CAsyncValidator v, void *user);
 
+/* set framing codec (inherited by accepted nodes of a listener) */
+int async_core_codec(CAsyncCore *core, long hid, const CAsyncCodec *codec);
+
+/**
+ * send length bytes of file fd from offset as one message, see 
+ * async_sock_send_file. ASYNC_CORE_EVT_PROGRESS (when enabled) comes
+ * once all of it has been sent. returns 0 for success, -100 for bad hid,
+ * -110 for closing, -200 for over limit, -300 for hids with a filter.
+ */
+long async_core_send_file(CAsyncCore *core, long hid, int fd, 
+	IINT64 offset, IINT64 length, int mask);
+
 
 #define ASYNC_CORE_FILTER_INIT          0     /* called after install */
 #define ASYNC_CORE_FILTER_RELEASE       1     /* called before delete */
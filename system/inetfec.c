@@ -0,0 +1,844 @@
+//=====================================================================
+//
+// inetfec.c - forward error correction for datagram protocols
+//
+// NOTE:
+// for more information, please see the readme file
+//
+//=====================================================================
+#include "inetfec.h"
+#include "inetkcp.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ICPU_X86
+#include <immintrin.h>
+#endif
+
+
+//=====================================================================
+// GF(2^8) with polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d)
+//=====================================================================
+static unsigned char ifec_gf_exp[512];
+static unsigned char ifec_gf_log[256];
+static unsigned char ifec_gf_table[256][256];
+static volatile ilong ifec_gf_inited = 0;	// 0: no, 1: building, 2: ready
+
+// built once by the first caller, concurrent ones wait for it
+static void ifec_gf_init(void)
+{
+	int i, j, x = 1;
+	if (iatomic_get(&ifec_gf_inited) == 2) return;
+	if (iatomic_cas(&ifec_gf_inited, 0, 1) != 0) {
+		while (iatomic_get(&ifec_gf_inited) != 2);
+		return;
+	}
+	for (i = 0; i < 255; i++) {
+		ifec_gf_exp[i] = (unsigned char)x;
+		ifec_gf_exp[i + 255] = (unsigned char)x;
+		ifec_gf_log[x] = (unsigned char)i;
+		x <<= 1;
+		if (x & 0x100) x ^= 0x11d;
+	}
+	ifec_gf_exp[510] = ifec_gf_exp[0];
+	ifec_gf_exp[511] = ifec_gf_exp[1];
+	ifec_gf_log[0] = 0;
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 256; j++) {
+			if (i == 0 || j == 0) {
+				ifec_gf_table[i][j] = 0;
+			}	else {
+				int k = ifec_gf_log[i] + ifec_gf_log[j];
+				ifec_gf_table[i][j] = ifec_gf_exp[k];
+			}
+		}
+	}
+	iatomic_set(&ifec_gf_inited, 2);
+}
+
+int ifec_gf_mul(int a, int b)
+{
+	ifec_gf_init();
+	return ifec_gf_table[a & 0xff][b & 0xff];
+}
+
+int ifec_gf_div(int a, int b)
+{
+	ifec_gf_init();
+	assert((b & 0xff) != 0);
+	if ((a & 0xff) == 0) return 0;
+	return ifec_gf_exp[ifec_gf_log[a & 0xff] + 255 - ifec_gf_log[b & 0xff]];
+}
+
+// low and high nibble products: c * x == lo[x & 15] ^ hi[x >> 4]
+static void ifec_gf_nibbles(unsigned char *table, int c)
+{
+	int i;
+	for (i = 0; i < 16; i++) {
+		table[i] = ifec_gf_table[c][i];
+		table[i + 16] = ifec_gf_table[c][i << 4];
+	}
+}
+
+
+//---------------------------------------------------------------------
+// region multiply-accumulate kernels
+//---------------------------------------------------------------------
+static void ifec_muladd_scalar(unsigned char *dst, const unsigned char *src,
+		const unsigned char *row, size_t size)
+{
+	size_t i = 0;
+	for (; i + 4 <= size; i += 4) {
+		dst[i + 0] ^= row[src[i + 0]];
+		dst[i + 1] ^= row[src[i + 1]];
+		dst[i + 2] ^= row[src[i + 2]];
+		dst[i + 3] ^= row[src[i + 3]];
+	}
+	for (; i < size; i++) {
+		dst[i] ^= row[src[i]];
+	}
+}
+
+#ifdef ICPU_X86
+ICPU_TARGET("ssse3")
+static size_t ifec_muladd_ssse3(unsigned char *dst, const unsigned char *src,
+		const unsigned char *table, size_t size)
+{
+	__m128i lo = _mm_loadu_si128((const __m128i*)table);
+	__m128i hi = _mm_loadu_si128((const __m128i*)(table + 16));
+	__m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i l = _mm_and_si128(x, mask);
+		__m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+		l = _mm_shuffle_epi8(lo, l);
+		h = _mm_shuffle_epi8(hi, h);
+		d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+		_mm_storeu_si128((__m128i*)(dst + i), d);
+	}
+	return i;
+}
+
+ICPU_TARGET("avx2")
+static size_t ifec_muladd_avx2(unsigned char *dst, const unsigned char *src,
+		const unsigned char *table, size_t size)
+{
+	__m256i lo = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)table));
+	__m256i hi = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)(table + 16)));
+	__m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 64 <= size; i += 64) {
+		__m256i x0 = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i x1 = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+		__m256i d0 = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i d1 = _mm256_loadu_si256((const __m256i*)(dst + i + 32));
+		__m256i l0 = _mm256_shuffle_epi8(lo, _mm256_and_si256(x0, mask));
+		__m256i l1 = _mm256_shuffle_epi8(lo, _mm256_and_si256(x1, mask));
+		__m256i h0 = _mm256_shuffle_epi8(hi,
+				_mm256_and_si256(_mm256_srli_epi64(x0, 4), mask));
+		__m256i h1 = _mm256_shuffle_epi8(hi,
+				_mm256_and_si256(_mm256_srli_epi64(x1, 4), mask));
+		d0 = _mm256_xor_si256(d0, _mm256_xor_si256(l0, h0));
+		d1 = _mm256_xor_si256(d1, _mm256_xor_si256(l1, h1));
+		_mm256_storeu_si256((__m256i*)(dst + i), d0);
+		_mm256_storeu_si256((__m256i*)(dst + i + 32), d1);
+	}
+	for (; i + 32 <= size; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+		__m256i h = _mm256_shuffle_epi8(hi,
+				_mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+		d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+		_mm256_storeu_si256((__m256i*)(dst + i), d);
+	}
+	return i;
+}
+#endif
+
+// table: 32 bytes nibble table of c
+static void ifec_muladd_table(unsigned char *dst, const unsigned char *src,
+		int c, const unsigned char *table, size_t size)
+{
+	size_t done = 0;
+	if (c == 0) return;
+	if (c == 1) {
+		size_t i;
+		for (i = 0; i < size; i++) dst[i] ^= src[i];
+		return;
+	}
+#ifdef ICPU_X86
+	if (size >= 16) {
+		int features = icpu_features();
+		if (features & ICPU_AVX2) {
+			done = ifec_muladd_avx2(dst, src, table, size);
+		}
+		if (features & ICPU_SSSE3) {
+			done += ifec_muladd_ssse3(dst + done, src + done,
+					table, size - done);
+		}
+	}
+#endif
+	if (done < size) {
+		ifec_muladd_scalar(dst + done, src + done, ifec_gf_table[c],
+				size - done);
+	}
+}
+
+void ifec_gf_muladd(unsigned char *dst, const unsigned char *src,
+		int c, size_t size)
+{
+	unsigned char table[32];
+	ifec_gf_init();
+	c &= 0xff;
+	ifec_gf_nibbles(table, c);
+	ifec_muladd_table(dst, src, c, table, size);
+}
+
+
+//=====================================================================
+// REED-SOLOMON
+//=====================================================================
+
+//---------------------------------------------------------------------
+// create codec: parity row i, column j is 1 / (x_i + y_j) with
+// x_i = data + i and y_j = j, every square submatrix is invertible
+//---------------------------------------------------------------------
+ifec_rs* ifec_rs_new(int data, int parity)
+{
+	ifec_rs *rs;
+	int i, j;
+
+	if (data <= 0 || parity < 0 || data + parity > IFEC_MAX_SHARDS) {
+		return NULL;
+	}
+
+	ifec_gf_init();
+
+	rs = (ifec_rs*)ikmem_malloc(sizeof(ifec_rs));
+	if (rs == NULL) return NULL;
+
+	rs->data = data;
+	rs->parity = parity;
+	rs->matrix = (unsigned char*)ikmem_malloc(data * parity + 1);
+	rs->tables = (unsigned char*)ikmem_malloc(data * parity * 32 + 1);
+
+	if (rs->matrix == NULL || rs->tables == NULL) {
+		ifec_rs_delete(rs);
+		return NULL;
+	}
+
+	for (i = 0; i < parity; i++) {
+		for (j = 0; j < data; j++) {
+			int c = ifec_gf_div(1, (data + i) ^ j);
+			rs->matrix[i * data + j] = (unsigned char)c;
+			ifec_gf_nibbles(rs->tables + (i * data + j) * 32, c);
+		}
+	}
+
+	return rs;
+}
+
+
+//---------------------------------------------------------------------
+// delete codec
+//---------------------------------------------------------------------
+void ifec_rs_delete(ifec_rs *rs)
+{
+	if (rs == NULL) return;
+	if (rs->matrix) ikmem_free(rs->matrix);
+	if (rs->tables) ikmem_free(rs->tables);
+	rs->matrix = NULL;
+	rs->tables = NULL;
+	ikmem_free(rs);
+}
+
+
+//---------------------------------------------------------------------
+// encode: parity_i = sum(m[i][j] * data_j)
+//---------------------------------------------------------------------
+void ifec_rs_encode(const ifec_rs *rs, const unsigned char * const *data,
+		int ndata, unsigned char **parity, size_t size)
+{
+	int i, j;
+	assert(ndata > 0 && ndata <= rs->data);
+	for (i = 0; i < rs->parity; i++) {
+		const unsigned char *row = rs->matrix + i * rs->data;
+		const unsigned char *tab = rs->tables + i * rs->data * 32;
+		memset(parity[i], 0, size);
+		for (j = 0; j < ndata; j++) {
+			ifec_muladd_table(parity[i], data[j], row[j], tab + j * 32,
+					size);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// invert n x n matrix in place (gauss-jordan), returns -1 if singular
+//---------------------------------------------------------------------
+static int ifec_gf_invert(unsigned char *m, unsigned char *inv, int n)
+{
+	int i, j, k;
+	memset(inv, 0, n * n);
+	for (i = 0; i < n; i++) inv[i * n + i] = 1;
+	for (i = 0; i < n; i++) {
+		int pivot = -1, c;
+		for (k = i; k < n; k++) {
+			if (m[k * n + i] != 0) { pivot = k; break; }
+		}
+		if (pivot < 0) return -1;
+		if (pivot != i) {
+			for (j = 0; j < n; j++) {
+				unsigned char t;
+				t = m[i * n + j]; m[i * n + j] = m[pivot * n + j];
+				m[pivot * n + j] = t;
+				t = inv[i * n + j]; inv[i * n + j] = inv[pivot * n + j];
+				inv[pivot * n + j] = t;
+			}
+		}
+		c = ifec_gf_div(1, m[i * n + i]);
+		for (j = 0; j < n; j++) {
+			m[i * n + j] = ifec_gf_table[c][m[i * n + j]];
+			inv[i * n + j] = ifec_gf_table[c][inv[i * n + j]];
+		}
+		for (k = 0; k < n; k++) {
+			int f = m[k * n + i];
+			if (k == i || f == 0) continue;
+			for (j = 0; j < n; j++) {
+				m[k * n + j] ^= ifec_gf_table[f][m[i * n + j]];
+				inv[k * n + j] ^= ifec_gf_table[f][inv[i * n + j]];
+			}
+		}
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// decode: subtract known data from e parity shards, then solve the
+// e x e cauchy system of missing data shards
+//---------------------------------------------------------------------
+int ifec_rs_decode(const ifec_rs *rs, unsigned char **shards,
+		const unsigned char *present, int ndata, size_t size)
+{
+	unsigned char missing[IFEC_MAX_SHARDS], rows[IFEC_MAX_SHARDS];
+	unsigned char *sub, *inv;
+	unsigned char table[32];
+	int nmiss = 0, nrows = 0;
+	int i, j;
+
+	assert(ndata > 0 && ndata <= rs->data);
+
+	for (i = 0; i < ndata; i++) {
+		if (present[i] == 0) missing[nmiss++] = (unsigned char)i;
+	}
+	if (nmiss == 0) return 0;
+
+	for (i = 0; i < rs->parity && nrows < nmiss; i++) {
+		if (present[ndata + i]) rows[nrows++] = (unsigned char)i;
+	}
+	if (nrows < nmiss) return -1;
+
+	sub = (unsigned char*)ikmem_malloc(nmiss * nmiss * 2);
+	if (sub == NULL) return -1;
+	inv = sub + nmiss * nmiss;
+
+	// syndromes: parity_r - sum(m[r][j] * data_j) for known j
+	for (i = 0; i < nrows; i++) {
+		int r = rows[i];
+		const unsigned char *row = rs->matrix + r * rs->data;
+		const unsigned char *tab = rs->tables + r * rs->data * 32;
+		unsigned char *syn = shards[ndata + r];
+		for (j = 0; j < ndata; j++) {
+			if (present[j]) {
+				ifec_muladd_table(syn, shards[j], row[j], tab + j * 32,
+						size);
+			}
+		}
+		for (j = 0; j < nmiss; j++) {
+			sub[i * nmiss + j] = row[missing[j]];
+		}
+	}
+
+	if (ifec_gf_invert(sub, inv, nmiss) != 0) {
+		ikmem_free(sub);
+		return -1;
+	}
+
+	for (i = 0; i < nmiss; i++) {
+		unsigned char *out = shards[missing[i]];
+		memset(out, 0, size);
+		for (j = 0; j < nrows; j++) {
+			int c = inv[i * nmiss + j];
+			ifec_gf_nibbles(table, c);
+			ifec_muladd_table(out, shards[ndata + rows[j]], c, table, size);
+		}
+	}
+
+	ikmem_free(sub);
+
+	return nmiss;
+}
+
+
+//=====================================================================
+// ENCODER
+//=====================================================================
+
+//---------------------------------------------------------------------
+// create encoder
+//---------------------------------------------------------------------
+ifec_encoder* ifec_encoder_new(int data, int parity, int mtu, void *user)
+{
+	ifec_encoder *enc;
+	int i, n = data + parity;
+
+	if (mtu <= 0 || mtu > 0xffff) return NULL;
+
+	enc = (ifec_encoder*)ikmem_malloc(sizeof(ifec_encoder));
+	if (enc == NULL) return NULL;
+
+	memset(enc, 0, sizeof(ifec_encoder));
+	enc->rs = ifec_rs_new(data, parity);
+	enc->shards = (unsigned char**)ikmem_malloc(sizeof(void*) * (n + 1));
+
+	if (enc->rs == NULL || enc->shards == NULL) {
+		ifec_encoder_delete(enc);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		enc->shards[i] = (unsigned char*)ikmem_malloc(IFEC_OVERHEAD + mtu);
+		if (enc->shards[i] == NULL) {
+			ifec_encoder_delete(enc);
+			return NULL;
+		}
+	}
+
+	enc->data = data;
+	enc->parity = parity;
+	enc->mtu = mtu;
+	enc->group = 0;
+	enc->count = 0;
+	enc->maxsize = 0;
+	enc->ts_first = 0;
+	enc->timeout = 0;
+	enc->user = user;
+	enc->output = NULL;
+
+	return enc;
+}
+
+
+//---------------------------------------------------------------------
+// delete encoder
+//---------------------------------------------------------------------
+void ifec_encoder_delete(ifec_encoder *enc)
+{
+	if (enc == NULL) return;
+	if (enc->shards) {
+		int i;
+		for (i = 0; i < enc->data + enc->parity; i++) {
+			if (enc->shards[i]) ikmem_free(enc->shards[i]);
+		}
+		ikmem_free(enc->shards);
+	}
+	if (enc->rs) ifec_rs_delete(enc->rs);
+	ikmem_free(enc);
+}
+
+
+//---------------------------------------------------------------------
+// write shard header
+//---------------------------------------------------------------------
+static void ifec_encode_header(ifec_encoder *enc, unsigned char *p,
+		int index, int ndata, int flag)
+{
+	char *ptr = (char*)p;
+	ptr = iencode32u_lsb(ptr, enc->group);
+	ptr = iencode8u(ptr, (unsigned char)index);
+	ptr = iencode8u(ptr, (unsigned char)ndata);
+	ptr = iencode8u(ptr, (unsigned char)enc->parity);
+	ptr = iencode8u(ptr, (unsigned char)flag);
+}
+
+
+//---------------------------------------------------------------------
+// send a packet
+//---------------------------------------------------------------------
+int ifec_encoder_send(ifec_encoder *enc, const void *data, int size)
+{
+	unsigned char *shard;
+
+	if (size < 0 || size > enc->mtu) return -1;
+
+	shard = enc->shards[enc->count];
+	ifec_encode_header(enc, shard, enc->count, enc->data, IFEC_FLAG_DATA);
+	iencode16u_lsb((char*)shard + IFEC_HEADER, (unsigned short)size);
+	memcpy(shard + IFEC_OVERHEAD, data, size);
+
+	if (enc->output) {
+		enc->output((const char*)shard, IFEC_OVERHEAD + size, enc->user);
+	}
+
+	if (enc->count == 0) {
+		enc->maxsize = 0;
+	}
+
+	enc->count++;
+	enc->cnt_data++;
+
+	if (size + 2 > enc->maxsize) {
+		enc->maxsize = size + 2;
+	}
+
+	if (enc->count >= enc->data) {
+		ifec_encoder_flush(enc);
+	}
+
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// send parity of current group and start a new one
+//---------------------------------------------------------------------
+void ifec_encoder_flush(ifec_encoder *enc)
+{
+	const unsigned char *src[IFEC_MAX_SHARDS];
+	unsigned char *dst[IFEC_MAX_SHARDS];
+	int i, size;
+
+	if (enc->count == 0) return;
+
+	size = enc->maxsize;
+
+	for (i = 0; i < enc->count; i++) {
+		unsigned char *shard = enc->shards[i];
+		unsigned short length;
+		idecode16u_lsb((const char*)shard + IFEC_HEADER, &length);
+		// zero padding up to the longest shard
+		if (length + 2 < size) {
+			memset(shard + IFEC_OVERHEAD + length, 0, size - length - 2);
+		}
+		src[i] = shard + IFEC_HEADER;
+	}
+
+	for (i = 0; i < enc->parity; i++) {
+		dst[i] = enc->shards[enc->data + i] + IFEC_HEADER;
+	}
+
+	ifec_rs_encode(enc->rs, src, enc->count, dst, size);
+
+	for (i = 0; i < enc->parity; i++) {
+		unsigned char *shard = enc->shards[enc->data + i];
+		ifec_encode_header(enc, shard, i, enc->count, IFEC_FLAG_PARITY);
+		if (enc->output) {
+			enc->output((const char*)shard, IFEC_HEADER + size, enc->user);
+		}
+		enc->cnt_parity++;
+	}
+
+	enc->group++;
+	enc->count = 0;
+	enc->maxsize = 0;
+}
+
+
+//---------------------------------------------------------------------
+// flush a partial group older than timeout
+//---------------------------------------------------------------------
+void ifec_encoder_update(ifec_encoder *enc, IUINT32 current)
+{
+	if (enc->count == 0) {
+		enc->ts_first = current;
+		return;
+	}
+	if (enc->timeout > 0) {
+		if (itimediff(current, enc->ts_first) >= (long)enc->timeout) {
+			ifec_encoder_flush(enc);
+			enc->ts_first = current;
+		}
+	}
+}
+
+
+//=====================================================================
+// DECODER
+//=====================================================================
+
+//---------------------------------------------------------------------
+// create decoder
+//---------------------------------------------------------------------
+ifec_decoder* ifec_decoder_new(int data, int parity, int mtu, int window,
+		void *user)
+{
+	ifec_decoder *dec;
+	int n = data + parity;
+	int i, j;
+
+	if (mtu <= 0 || mtu > 0xffff) return NULL;
+	if (window <= 0) window = 8;
+
+	dec = (ifec_decoder*)ikmem_malloc(sizeof(ifec_decoder));
+	if (dec == NULL) return NULL;
+
+	memset(dec, 0, sizeof(ifec_decoder));
+	dec->window = window;
+	dec->rs = ifec_rs_new(data, parity);
+	dec->groups = (struct IFECGROUP*)
+		ikmem_malloc(sizeof(struct IFECGROUP) * window);
+
+	if (dec->rs == NULL || dec->groups == NULL) {
+		ifec_decoder_delete(dec);
+		return NULL;
+	}
+
+	memset(dec->groups, 0, sizeof(struct IFECGROUP) * window);
+
+	for (i = 0; i < window; i++) {
+		struct IFECGROUP *g = &dec->groups[i];
+		g->present = (unsigned char*)ikmem_malloc(n);
+		g->length = (short*)ikmem_malloc(sizeof(short) * data);
+		g->shards = (unsigned char**)ikmem_malloc(sizeof(void*) * n);
+		if (g->present == NULL || g->length == NULL || g->shards == NULL) {
+			ifec_decoder_delete(dec);
+			return NULL;
+		}
+		memset(g->shards, 0, sizeof(void*) * n);
+		for (j = 0; j < n; j++) {
+			g->shards[j] = (unsigned char*)ikmem_malloc(mtu + 2);
+			if (g->shards[j] == NULL) {
+				ifec_decoder_delete(dec);
+				return NULL;
+			}
+		}
+	}
+
+	dec->data = data;
+	dec->parity = parity;
+	dec->mtu = mtu;
+	dec->newest = 0;
+	dec->inited = 0;
+	dec->user = user;
+	dec->output = NULL;
+
+	return dec;
+}
+
+
+//---------------------------------------------------------------------
+// delete decoder
+//---------------------------------------------------------------------
+void ifec_decoder_delete(ifec_decoder *dec)
+{
+	if (dec == NULL) return;
+	if (dec->groups) {
+		int i, j;
+		for (i = 0; i < dec->window; i++) {
+			struct IFECGROUP *g = &dec->groups[i];
+			if (g->shards) {
+				for (j = 0; j < dec->data + dec->parity; j++) {
+					if (g->shards[j]) ikmem_free(g->shards[j]);
+				}
+				ikmem_free(g->shards);
+			}
+			if (g->present) ikmem_free(g->present);
+			if (g->length) ikmem_free(g->length);
+		}
+		ikmem_free(dec->groups);
+	}
+	if (dec->rs) ifec_rs_delete(dec->rs);
+	ikmem_free(dec);
+}
+
+
+//---------------------------------------------------------------------
+// find or recycle the slot of a group, NULL for stale group
+//---------------------------------------------------------------------
+static struct IFECGROUP *ifec_decoder_group(ifec_decoder *dec,
+		IUINT32 group)
+{
+	struct IFECGROUP *g = &dec->groups[group % (IUINT32)dec->window];
+	if (dec->inited == 0) {
+		dec->newest = group;
+		dec->inited = 1;
+	}
+	else if (itimediff(group, dec->newest) > 0) {
+		dec->newest = group;
+	}
+	else if (itimediff(dec->newest, group) >= dec->window) {
+		return NULL;
+	}
+	if (g->used && g->group == group) {
+		return g;
+	}
+	if (g->used && itimediff(g->group, group) > 0) {
+		return NULL;
+	}
+	g->group = group;
+	g->used = 1;
+	g->done = 0;
+	g->data = 0;
+	g->width = 0;
+	g->parity = 0;
+	g->ndata = 0;
+	g->nparity = 0;
+	g->size = 0;
+	memset(g->present, 0, dec->data + dec->parity);
+	return g;
+}
+
+
+//---------------------------------------------------------------------
+// try to rebuild missing data shards of a group
+//---------------------------------------------------------------------
+static void ifec_decoder_recover(ifec_decoder *dec, struct IFECGROUP *g)
+{
+	unsigned char *shards[IFEC_MAX_SHARDS];
+	unsigned char present[IFEC_MAX_SHARDS];
+	int i, n = g->data;
+
+	if (g->done || n == 0) return;
+	if (g->ndata >= n) {
+		g->done = 1;
+		return;
+	}
+	if (g->ndata + g->nparity < n) return;
+
+	for (i = 0; i < n; i++) {
+		shards[i] = g->shards[i];
+		present[i] = g->present[i];
+		if (present[i] && g->length[i] + 2 < g->size) {
+			// shorter data shards are zero padded by the encoder
+			memset(shards[i] + g->length[i] + 2, 0,
+				g->size - g->length[i] - 2);
+		}
+	}
+	for (i = 0; i < dec->parity; i++) {
+		shards[n + i] = g->shards[dec->data + i];
+		present[n + i] = g->present[dec->data + i];
+	}
+
+	g->done = 1;
+
+	if (ifec_rs_decode(dec->rs, shards, present, n, g->size) < 0) {
+		dec->cnt_failed++;
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		unsigned short length;
+		if (present[i]) continue;
+		idecode16u_lsb((const char*)shards[i], &length);
+		if ((int)length + 2 > g->size) {
+			dec->cnt_failed++;
+			continue;
+		}
+		dec->cnt_recovered++;
+		if (dec->output) {
+			dec->output((const char*)shards[i] + 2, length, dec->user);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// input datagram
+//---------------------------------------------------------------------
+int ifec_decoder_input(ifec_decoder *dec, const void *data, long size)
+{
+	const char *ptr = (const char*)data;
+	struct IFECGROUP *g;
+	IUINT32 group;
+	unsigned char index, ndata, nparity, flag;
+
+	if (size < IFEC_HEADER) return -1;
+
+	ptr = idecode32u_lsb(ptr, &group);
+	ptr = idecode8u(ptr, &index);
+	ptr = idecode8u(ptr, &ndata);
+	ptr = idecode8u(ptr, &nparity);
+	ptr = idecode8u(ptr, &flag);
+	size -= IFEC_HEADER;
+
+	if (nparity != dec->parity || ndata == 0 || ndata > dec->data) {
+		return -1;
+	}
+
+	if (flag == IFEC_FLAG_DATA) {
+		unsigned short length;
+		if (size < 2 || index >= ndata) return -1;
+		idecode16u_lsb(ptr, &length);
+		if ((long)length + 2 > size || (int)length > dec->mtu) return -1;
+		g = ifec_decoder_group(dec, group);
+		// data shards carry the encoder's group width, parity shards 
+		// the real count, a shard must agree with both
+		if (g != NULL) {
+			if (g->width != 0 && g->width != ndata) return -1;
+			if (g->data != 0 && index >= g->data) return -1;
+		}
+		if (dec->output) {
+			dec->output(ptr + 2, length, dec->user);
+		}
+		if (g == NULL || g->done || g->present[index]) return 0;
+		memcpy(g->shards[index], ptr, length + 2);
+		g->present[index] = 1;
+		g->length[index] = (short)length;
+		g->width = ndata;
+		g->ndata++;
+	}
+	else if (flag == IFEC_FLAG_PARITY) {
+		if (index >= nparity || size > dec->mtu + 2) return -1;
+		g = ifec_decoder_group(dec, group);
+		if (g == NULL || g->done || g->present[dec->data + index]) {
+			return 0;
+		}
+		if (g->data != 0) {
+			if (g->data != ndata || g->size != size) return -1;
+		}
+		else {
+			int i;
+			if (g->width != 0 && ndata > g->width) return -1;
+			for (i = ndata; i < dec->data; i++) {
+				if (g->present[i]) return -1;
+			}
+		}
+		memcpy(g->shards[dec->data + index], ptr, size);
+		g->present[dec->data + index] = 1;
+		g->data = ndata;
+		g->parity = nparity;
+		g->size = (int)size;
+		g->nparity++;
+	}
+	else {
+		return -1;
+	}
+
+	ifec_decoder_recover(dec, g);
+
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// deliver decoded packets to kcp
+//---------------------------------------------------------------------
+static int ifec_kcp_output(const char *buf, int len, void *user)
+{
+	return ikcp_input((ikcpcb*)user, buf, len);
+}
+
+void ifec_decoder_kcp(ifec_decoder *dec, struct IKCPCB *kcp)
+{
+	dec->user = kcp;
+	dec->output = ifec_kcp_output;
+}
+
+
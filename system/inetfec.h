@@ -0,0 +1,187 @@
+//=====================================================================
+//
+// inetfec.h - forward error correction for datagram protocols
+//
+// NOTE:
+// Reed-Solomon erasure code over GF(2^8) with a Cauchy matrix, any
+// 'data' shards out of 'data + parity' recover the group. Designed to
+// sit between kcp output and the udp socket.
+// for more information, please see the readme file
+//
+//=====================================================================
+#ifndef __INETFEC_H__
+#define __INETFEC_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "imemdata.h"
+
+
+//=====================================================================
+// GLOBAL DEFINITION
+//=====================================================================
+#define IFEC_MAX_SHARDS		255		// data + parity
+#define IFEC_HEADER			8		// group(4) index(1) data(1) parity(1) flag(1)
+#define IFEC_OVERHEAD		10		// header + length(2) of a data shard
+
+#define IFEC_FLAG_DATA		0
+#define IFEC_FLAG_PARITY	1
+
+
+//---------------------------------------------------------------------
+// Reed-Solomon codec
+//---------------------------------------------------------------------
+struct IFECRS
+{
+	int data;					// max data shards
+	int parity;					// parity shards
+	unsigned char *matrix;		// parity x data cauchy coefficients
+	unsigned char *tables;		// 32 bytes nibble table per coefficient
+};
+
+typedef struct IFECRS ifec_rs;
+
+
+//---------------------------------------------------------------------
+// encoder: packets are forwarded at once with a data header, parity
+// shards are sent when a group is full or flushed
+//---------------------------------------------------------------------
+struct IFECENCODER
+{
+	ifec_rs *rs;
+	int data, parity, mtu;
+	IUINT32 group;				// current group id
+	int count;					// data shards in current group
+	int maxsize;				// longest shard in current group
+	IUINT32 ts_first;			// when current group started
+	IUINT32 timeout;			// flush a partial group after, 0 for never
+	unsigned char **shards;		// data + parity buffers (header + shard)
+	long cnt_data, cnt_parity;
+	void *user;
+	int (*output)(const char *buf, int len, void *user);
+};
+
+typedef struct IFECENCODER ifec_encoder;
+
+
+//---------------------------------------------------------------------
+// decoder: originals are passed through, missing ones are rebuilt
+// once enough shards of the group arrived
+//---------------------------------------------------------------------
+struct IFECGROUP
+{
+	IUINT32 group;
+	int used;					// slot holds a group
+	int done;					// nothing left to recover
+	int data;					// data shards in group, 0 for unknown
+	int width;					// data count of data shard headers
+	int parity;					// parity shards in group
+	int ndata, nparity;			// shards received
+	int size;					// parity shard size
+	unsigned char *present;		// data + parity flags
+	short *length;				// received length of each data shard
+	unsigned char **shards;		// data + parity buffers (shard only)
+};
+
+struct IFECDECODER
+{
+	ifec_rs *rs;
+	int data, parity, mtu;
+	int window;					// groups being tracked
+	struct IFECGROUP *groups;
+	IUINT32 newest;				// newest group seen
+	int inited;
+	long cnt_recovered, cnt_failed;
+	void *user;
+	int (*output)(const char *buf, int len, void *user);
+};
+
+typedef struct IFECDECODER ifec_decoder;
+
+struct IKCPCB;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// GF(256) region operations (SSSE3/AVX2 when available)
+//---------------------------------------------------------------------
+
+// dst[i] ^= c * src[i]
+void ifec_gf_muladd(unsigned char *dst, const unsigned char *src,
+		int c, size_t size);
+
+// c = a * b, c = a / b (b != 0)
+int ifec_gf_mul(int a, int b);
+int ifec_gf_div(int a, int b);
+
+
+//---------------------------------------------------------------------
+// Reed-Solomon codec
+//---------------------------------------------------------------------
+
+// create codec, data + parity must not exceed IFEC_MAX_SHARDS
+ifec_rs* ifec_rs_new(int data, int parity);
+
+void ifec_rs_delete(ifec_rs *rs);
+
+// compute parity shards from first 'ndata' (<= rs->data) shards
+void ifec_rs_encode(const ifec_rs *rs, const unsigned char * const *data,
+		int ndata, unsigned char **parity, size_t size);
+
+// rebuild missing data shards in place: shards[0..ndata) are data,
+// shards[ndata..ndata+rs->parity) are parity, present[i] != 0 marks
+// valid ones. parity buffers may be used as scratch. returns number of
+// shards rebuilt, -1 for not enough shards
+int ifec_rs_decode(const ifec_rs *rs, unsigned char **shards,
+		const unsigned char *present, int ndata, size_t size);
+
+
+//---------------------------------------------------------------------
+// encoder
+//---------------------------------------------------------------------
+
+// mtu is the max packet size given to ifec_encoder_send
+ifec_encoder* ifec_encoder_new(int data, int parity, int mtu, void *user);
+
+void ifec_encoder_delete(ifec_encoder *enc);
+
+// send a packet (size <= mtu), returns 0 for success
+int ifec_encoder_send(ifec_encoder *enc, const void *data, int size);
+
+// send parity of current partial group now
+void ifec_encoder_flush(ifec_encoder *enc);
+
+// flush a partial group older than enc->timeout
+void ifec_encoder_update(ifec_encoder *enc, IUINT32 current);
+
+
+//---------------------------------------------------------------------
+// decoder
+//---------------------------------------------------------------------
+
+// window is how many groups can be recovered concurrently
+ifec_decoder* ifec_decoder_new(int data, int parity, int mtu, int window,
+		void *user);
+
+void ifec_decoder_delete(ifec_decoder *dec);
+
+// input a datagram from the encoder: originals and recovered packets
+// are passed to dec->output. returns 0 for ok, -1 for malformed
+int ifec_decoder_input(ifec_decoder *dec, const void *data, long size);
+
+// deliver decoded packets to ikcp_input of given kcp
+void ifec_decoder_kcp(ifec_decoder *dec, struct IKCPCB *kcp);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
@@ -168,6 +168,7 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
     kcp->dead_link = IKCP_DEADLINK;
 	kcp->output = NULL;
 	kcp->writelog = NULL;
+	kcp->cc = NULL;
 
 	return kcp;
 }
@@ -207,6 +208,9 @@ void ikcp_release(ikcpcb *kcp)
 		if (kcp->acklist) {
 			iv_delete(kcp->acklist);
 		}
+		if (kcp->cc) {
+			ikmem_free(kcp->cc);
+		}
 
 		kcp->nrcv_buf = 0;
 		kcp->nsnd_buf = 0;
@@ -215,6 +219,7 @@ void ikcp_release(ikcpcb *kcp)
 		kcp->ackcount = 0;
 		kcp->buffer = NULL;
 		kcp->acklist = NULL;
+		kcp->cc = NULL;
 		ikmem_free(kcp);
 	}
 }
@@ -422,7 +427,9 @@ static void ikcp_update_ack(ikcpcb *kcp, IINT32 rtt)
 		kcp->rx_srtt = (7 * kcp->rx_srtt + rtt) / 8;
 		if (kcp->rx_srtt < 1) kcp->rx_srtt = 1;
 	}
-	rto = kcp->rx_srtt + _imax(1, 4 * kcp->rx_rttval);
+	// acks are flushed once per interval: with a congestion controller
+	// keep that much slack so ack quantization won't trigger a timeout
+	rto = kcp->rx_srtt + _imax(kcp->cc? kcp->interval : 1, 4 * kcp->rx_rttval);
 	kcp->rx_rto = _ibound(kcp->rx_minrto, rto, IKCP_RTO_MAX);
 	kcp->rx_rtt = (IUINT32)rtt;
 }
@@ -569,12 +576,26 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 }
 
 
+//---------------------------------------------------------------------
+// sync window from congestion control (in segments)
+//---------------------------------------------------------------------
+static void ikcp_cc_update(ikcpcb *kcp)
+{
+	IUINT32 mss = (kcp->mss > 0)? kcp->mss : 1;
+	kcp->cwnd = _imax(icc_cwnd(kcp->cc) / mss, 1);
+	kcp->ssthresh = kcp->cc->ssthresh / mss;
+	kcp->incr = kcp->cwnd * mss;
+}
+
+
 //---------------------------------------------------------------------
 // input data
 //---------------------------------------------------------------------
 int ikcp_input(ikcpcb *kcp, const char *data, long size)
 {
 	IUINT32 prev_una = kcp->snd_una;
+	IUINT32 prev_buf = kcp->nsnd_buf;
+	IINT32 rtt = -1;
 
 	if (ikcp_canlog(kcp, IKCP_LOG_INPUT)) {
 		ikcp_log(kcp, IKCP_LOG_INPUT, "[RI] %d bytes", size);
@@ -615,7 +636,8 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 
 		if (cmd == IKCP_CMD_ACK) {
 			if (itimediff(kcp->current, ts) >= 0) {
-				ikcp_update_ack(kcp, itimediff(kcp->current, ts));
+				rtt = itimediff(kcp->current, ts);
+				ikcp_update_ack(kcp, rtt);
 			}
 			ikcp_parse_ack(kcp, sn);
 			ikcp_shrink_buf(kcp);
@@ -675,7 +697,19 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		size -= len;
 	}
 
-	if (itimediff(kcp->snd_una, prev_una) > 0) {
+	if (kcp->cc) {
+		if (kcp->nsnd_buf < prev_buf) {
+			struct ICCSAMPLE sample;
+			sample.now = kcp->current;
+			sample.acked = (prev_buf - kcp->nsnd_buf) * kcp->mss;
+			sample.inflight = kcp->nsnd_buf * kcp->mss;
+			sample.rtt = rtt;
+			sample.recovery = 0;
+			icc_on_ack(kcp->cc, &sample);
+			ikcp_cc_update(kcp);
+		}
+	}
+	else if (itimediff(kcp->snd_una, prev_una) > 0) {
 		if (kcp->cwnd < kcp->rmt_wnd) {
 			IUINT32 mss = kcp->mss;
 			if (kcp->cwnd < kcp->ssthresh) {
@@ -827,6 +861,12 @@ void ikcp_flush(ikcpcb *kcp)
 
 		newseg = ilist_entry(kcp->snd_queue.next, IKCPSEG, node);
 
+		// pace new data across interval when controller has a rate
+		if (kcp->cc != NULL && kcp->nocwnd == 0) {
+			IUINT32 need = newseg->len + IKCP_OVERHEAD;
+			if (icc_pacing_send(kcp->cc, current, need) == 0) break;
+		}
+
 		ilist_del(&newseg->node);
 		ilist_add_tail(&newseg->node, &kcp->snd_buf);
 		kcp->nsnd_que--;
@@ -916,6 +956,14 @@ void ikcp_flush(ikcpcb *kcp)
 		ikcp_output(kcp, buffer, size);
 	}
 
+	if (kcp->cc) {
+		IUINT32 inflight = kcp->nsnd_buf * kcp->mss;
+		if (change) icc_on_loss(kcp->cc, current, inflight, 0);
+		if (lost) icc_on_loss(kcp->cc, current, inflight, 1);
+		ikcp_cc_update(kcp);
+		return;
+	}
+
 	// update ssthresh
 	if (change) {
 		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
@@ -941,6 +989,23 @@ void ikcp_flush(ikcpcb *kcp)
 }
 
 
+//---------------------------------------------------------------------
+// millisec until paced new data can be sent between two intervals,
+// returns -1 if nothing is waiting for pacing
+//---------------------------------------------------------------------
+static IINT32 ikcp_pacing_wait(const ikcpcb *kcp, IUINT32 current)
+{
+	IUINT32 cwnd;
+	if (kcp->cc == NULL || kcp->nocwnd != 0) return -1;
+	if (ilist_is_empty(&kcp->snd_queue)) return -1;
+	if (icc_pacing_rate(kcp->cc) == 0) return -1;
+	cwnd = _imin(kcp->snd_wnd, kcp->rmt_wnd);
+	cwnd = _imin(kcp->cwnd, cwnd);
+	if (itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) >= 0) return -1;
+	return (IINT32)icc_pacing_delay(kcp->cc, current);
+}
+
+
 //---------------------------------------------------------------------
 // update state (call it repeatedly, every 10ms-100ms), or you can ask 
 // ikcp_check when to call it again (without ikcp_input/_send calling).
@@ -971,6 +1036,9 @@ void ikcp_update(ikcpcb *kcp, IUINT32 current)
 		}
 		ikcp_flush(kcp);
 	}
+	else if (ikcp_pacing_wait(kcp, current) == 0) {
+		ikcp_flush(kcp);
+	}
 }
 
 
@@ -1006,6 +1074,12 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current)
 
 	tm_flush = itimediff(ts_flush, current);
 
+	if (kcp->cc) {
+		IINT32 wait = ikcp_pacing_wait(kcp, current);
+		if (wait == 0) return current;
+		if (wait > 0 && wait < tm_flush) tm_flush = wait;
+	}
+
 	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
 		const IKCPSEG *seg = ilist_entry(p, const IKCPSEG, node);
 		IINT32 diff = itimediff(seg->resendts, current);
@@ -1037,6 +1111,10 @@ int ikcp_setmtu(ikcpcb *kcp, int mtu)
 	kcp->mss = kcp->mtu - IKCP_OVERHEAD;
 	ikmem_free(kcp->buffer);
 	kcp->buffer = buffer;
+	if (kcp->cc) {
+		icc_set_mss(kcp->cc, kcp->mss);
+		ikcp_cc_update(kcp);
+	}
 	return 0;
 }
 
@@ -1045,6 +1123,7 @@ int ikcp_interval(ikcpcb *kcp, int interval)
 	if (interval > 5000) interval = 5000;
 	else if (interval < 10) interval = 10;
 	kcp->interval = interval;
+	if (kcp->cc) kcp->cc->pace_burst = interval;
 	return 0;
 }
 
@@ -1063,6 +1142,7 @@ int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc)
 		if (interval > 5000) interval = 5000;
 		else if (interval < 10) interval = 10;
 		kcp->interval = interval;
+		if (kcp->cc) kcp->cc->pace_burst = interval;
 	}
 	if (resend >= 0) {
 		kcp->fastresend = resend;
@@ -1074,6 +1154,29 @@ int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc)
 }
 
 
+int ikcp_setcc(ikcpcb *kcp, const struct ICCOPS *ops)
+{
+	if (ops == NULL) {
+		if (kcp->cc) {
+			ikmem_free(kcp->cc);
+			kcp->cc = NULL;
+		}
+		kcp->cwnd = 1;
+		kcp->incr = kcp->mss;
+		kcp->ssthresh = IKCP_THRESH_INIT;
+		return 0;
+	}
+	if (kcp->cc == NULL) {
+		kcp->cc = (struct ICCSTATE*)ikmem_malloc(sizeof(struct ICCSTATE));
+		if (kcp->cc == NULL) return -1;
+	}
+	icc_init(kcp->cc, ops, kcp->mss);
+	kcp->cc->pace_burst = kcp->interval;
+	ikcp_cc_update(kcp);
+	return 0;
+}
+
+
 int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd)
 {
 	if (kcp) {
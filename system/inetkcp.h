@@ -16,6 +16,7 @@
 #include <assert.h>
 
 #include "imemdata.h"
+#include "inetcc.h"
 
 
 
@@ -69,6 +70,7 @@ struct IKCPCB
 	int fastlimit;
 	int nocwnd, stream;
 	int logmask;
+	struct ICCSTATE *cc;
 	int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
 	void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
 };
@@ -148,6 +150,10 @@ int ikcp_waitsnd(const ikcpcb *kcp);
 int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc);
 
 
+// congestion control: NULL for the built-in one, or &icc_newreno,
+// &icc_cubic, &icc_bbr (new data is paced across interval)
+int ikcp_setcc(ikcpcb *kcp, const struct ICCOPS *ops);
+
 void ikcp_log(ikcpcb *kcp, int mask, const char *fmt, ...);
 
 
@@ -8,10 +8,19 @@
 //=====================================================================
 #include "inetcode.h"
 #include "inetnot.h"
+#include "itimer.h"
 
 #include <time.h>
 #include <stdarg.h>
 
+#if defined(__linux__) && !defined(ASYNC_NOTIFY_NO_SHM)
+#define ASYNC_NOTIFY_SHM_ENABLE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 //=====================================================================
 // CAsyncNotify
@@ -31,6 +40,11 @@ struct CAsyncConfig
 	int buffer_limit;
 	int sign_timeout;
 	int retry_seconds;
+	int links;
+	int link_policy;
+	long batch_limit;
+	long batch_delay;
+	long shm_size;
 };
 
 
@@ -41,13 +55,63 @@ struct CAsyncNode
 {
 	struct ILISTHEAD node_ping;
 	struct ILISTHEAD node_idle;
+	struct ILISTHEAD node_batch;
 	long hid;		// AsyncCore connection id
 	int mode;		// ASYNC_CORE_NODE_LISTEN4/LISTEN6/IN/OUT
 	int state;		// 0: unlogin 1: logined
 	int sid;		// server id
+	int link;		// link index within the sid
 	int rtt;
 	long ts_ping;
 	long ts_idle;
+	char *batch;	// pending batch: header + (size, cmd, data) list
+	long batch_size;	// bytes used in batch (0 for empty)
+	long batch_capacity;
+	IINT64 batch_ts;	// usec when the first message was batched
+	struct ILISTHEAD calls;	// pending calls sent over this node
+	struct CAsyncShm *shm;	// shared memory transport
+};
+
+
+//---------------------------------------------------------------------
+// CAsyncShm: local view of a shared memory ring pair
+//---------------------------------------------------------------------
+struct CAsyncShm
+{
+	struct ILISTHEAD node;			// notify->shms
+	struct CAsyncNode *owner;		// node using it
+	struct CAsyncShmCtrl *tx;		// flags of the ring we write
+	struct CAsyncShmCtrl *rx;		// flags of the ring we read
+	struct ISPSC txring;			// we are the producer
+	struct ISPSC rxring;			// we are the consumer
+	char *base;						// mapped address
+	long total;						// mapped size
+	ilong capacity;					// ring size (power of 2)
+	int creator;					// created by us (out link)
+	int tx_active;					// send over rings
+	int rx_active;					// read from rings
+	char *pending;					// queued (size32, msg) when full
+	long pending_head;
+	long pending_size;
+	long pending_capacity;
+	long pending_offset;			// bytes of first msg already written
+	char *frag;						// reassembly of split messages
+	long frag_size;
+	long frag_capacity;
+	long ts_offer;					// when the offer was sent
+	char name[48];					// shm name until unlinked
+};
+
+
+//---------------------------------------------------------------------
+// CAsyncCall
+//---------------------------------------------------------------------
+struct CAsyncCall
+{
+	struct ILISTHEAD node;	// node->calls, or dead list after expired
+	itimer_evt evt;			// deadline
+	IUINT32 id;				// call id
+	long hid;				// connection which carries the call
 };
 
 
@@ -59,10 +123,12 @@ struct CAsyncNotify
 	struct IMEMNODE *cache;		// cache for msg stream buffer
 	struct ILISTHEAD ping;		// ping queue
 	struct ILISTHEAD idle;		// idle queue
+	struct ILISTHEAD batch;		// nodes with pending batches, oldest first
 	struct IVECTOR *vector;		// buffer for data
 	struct CAsyncNode *nodes;	// hid -> nodes look-up table
 	idict_t *sid2hid_in;		// sid -> hid look-up table
 	idict_t *sid2hid_out;		// out sid -> hid
+	idict_t *sid2link;			// (mode, link, sid) -> hid for link > 0
 	idict_t *sid2addr;			// sid -> addr
 	idict_t *allowip;			// ip white list
 	idict_t *sidblack;			// black list 
@@ -79,6 +145,12 @@ struct CAsyncNotify
 	int evtmask;				// event mask
 	int logmask;				// logmask
 	int sid;					// self server id
+	IUINT32 link_round;			// round-robin cursor for links
+	IUINT32 call_serial;		// last call id
+	struct ib_hash_map calls;	// call id -> CAsyncCall
+	struct ILISTHEAD dead;		// expired calls to be freed
+	struct ILISTHEAD shms;		// shared memory transports
+	itimer_mgr timer;			// call deadlines
 	struct IMSTREAM msgs;		// msg stream
 	char *data;					// local data buffer
 	void *user;					// log user data
@@ -92,11 +164,25 @@ struct CAsyncNotify
 
 // message: msgid(16bits), cmd(16bits), data
 #define ASYNC_NOTIFY_MSG_LOGIN		0x6801	// (selfid, remoteid, ts, sign)
-#define ASYNC_NOTIFY_MSG_LOGINACK	0x6802	// (selfid, remoteid, ts, sign)
+#define ASYNC_NOTIFY_MSG_LOGINACK	0x6802	// cmd=error, (caps32) when ok
 #define ASYNC_NOTIFY_MSG_DATA		0x6803	// (data)
 #define ASYNC_NOTIFY_MSG_PING		0x6804	// (millisec)
 #define ASYNC_NOTIFY_MSG_PACK		0x6805	// (millisec)
 #define ASYNC_NOTIFY_MSG_ERROR		0x6806
+#define ASYNC_NOTIFY_MSG_BATCH		0x6807	// (size32, cmd16, data) ...
+#define ASYNC_NOTIFY_MSG_CALL		0x6808	// (callid, data)
+#define ASYNC_NOTIFY_MSG_REPLY		0x6809	// (callid, data)
+#define ASYNC_NOTIFY_MSG_SHM		0x680a	// (name) cmd=SHM_*
+
+#define ASYNC_NOTIFY_SHM_OFFER		0
+#define ASYNC_NOTIFY_SHM_ACCEPT		1
+#define ASYNC_NOTIFY_SHM_REJECT		2
+#define ASYNC_NOTIFY_SHM_SWITCH		3
+#define ASYNC_NOTIFY_SHM_WAKE		4
+
+#define ASYNC_NOTIFY_CAP_SHM		1		// accepts shm offers
+
+#define ASYNC_NOTIFY_SHM_TIMEOUT	5		// seconds to answer an offer
 
 #define ASYNC_NOTIFY_STATE_CONNECTING	0
 #define ASYNC_NOTIFY_STATE_ESTAB		1
@@ -105,6 +191,10 @@ struct CAsyncNotify
 
 typedef struct CAsyncNode CAsyncNode;
 typedef struct CAsyncConfig CAsyncConfig;
+typedef struct CAsyncCall CAsyncCall;
+typedef struct CAsyncShm CAsyncShm;
+typedef struct CAsyncShmCtrl CAsyncShmCtrl;
+typedef struct CAsyncShmHead CAsyncShmHead;
 
 //---------------------------------------------------------------------
 // declare functions
@@ -128,9 +218,18 @@ static int async_notify_firewall(const struct sockaddr *remote, int len,
 	CAsyncCore *core, long listenhid, void *user);
 
 static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node);
-static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node);
+static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node,
+	long length);
 static void async_notify_cmd_data(CAsyncNotify *notify, CAsyncNode *node,
 	char *data, long length);
+static void async_notify_cmd_call(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length);
+static void async_notify_cmd_reply(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length);
+
+static void async_notify_call_done(CAsyncNotify *notify, CAsyncCall *call,
+	long code, const void *data, long size);
+static void async_notify_call_expire(void *data, void *user);
 
 void async_notify_hash(const void *in, size_t len, char *out);
 
@@ -159,9 +258,16 @@ static CAsyncNode *async_notify_node_new(CAsyncNotify *notify, long hid)
 	node->mode = -1;
 	node->state = 0;
 	node->sid = -1;
+	node->link = 0;
 	node->rtt = -1;
 	ilist_init(&node->node_ping);
 	ilist_init(&node->node_idle);
+	ilist_init(&node->node_batch);
+	ilist_init(&node->calls);
+	node->shm = NULL;
+	node->batch = NULL;
+	node->batch_size = 0;
+	node->batch_capacity = 0;
 	node->ts_ping = notify->seconds;
 	node->ts_idle = notify->seconds;
 	notify->count_node++;
@@ -182,6 +288,15 @@ static int async_notify_node_del(CAsyncNotify *notify, long hid)
 	if (!ilist_is_empty(&node->node_idle)) {
 		ilist_del_init(&node->node_idle);
 	}
+	if (!ilist_is_empty(&node->node_batch)) {
+		ilist_del_init(&node->node_batch);
+	}
+	if (node->batch) {
+		ikmem_free(node->batch);
+		node->batch = NULL;
+	}
+	node->batch_size = 0;
+	node->batch_capacity = 0;
 	notify->count_node--;
 	return 0;
 }
@@ -289,6 +404,46 @@ static void async_notify_set(CAsyncNotify *self, int mode, int sid, long hid)
 	}
 }
 
+// key for links above 0: mode, link, sid
+static void async_notify_link_key(char *key, int mode, int sid, int link)
+{
+	key[0] = (char)mode;
+	key[1] = (char)link;
+	iencode32u_lsb(key + 2, (IUINT32)sid);
+}
+
+// get hid by sid and link, link 0 lives in the sid2hid tables
+static long async_notify_link_get(CAsyncNotify *self, int mode, int sid,
+	int link)
+{
+	ilong value = -1;
+	char key[6];
+	if (link == 0) return async_notify_get(self, mode, sid);
+	if (sid < 0) return -1;
+	async_notify_link_key(key, mode, sid, link);
+	if (idict_search_si(self->sid2link, key, 6, &value) == 0) {
+		return (long)value;
+	}
+	return -1;
+}
+
+// set hid of sid and link: -1 to delete
+static void async_notify_link_set(CAsyncNotify *self, int mode, int sid,
+	int link, long hid)
+{
+	char key[6];
+	if (link == 0) {
+		async_notify_set(self, mode, sid, hid);
+		return;
+	}
+	async_notify_link_key(key, mode, sid, link);
+	if (hid < 0) {
+		idict_del_s(self->sid2link, key, 6);
+	}	else {
+		idict_update_si(self->sid2link, key, 6, hid);
+	}
+}
+
 // set into sid blacklist
 static void async_notify_black_set(CAsyncNotify *notify, int sid, int mode)
 {
@@ -359,6 +514,703 @@ static inline void async_notify_decode_64(const char *ptr, IINT64 *x)
 	if (x) x[0] = y;
 }
 
+//---------------------------------------------------------------------
+// shared memory transport: a logined out link to a loopback address
+// offers a named shm with two SPSC rings (out->in, in->out), then both
+// sides move their messages from tcp to the rings:
+//   out: OFFER(name) ->                  (keep sending over tcp)
+//   in:  open, unlink  <- ACCEPT         (in writes rings from now)
+//   out: SWITCH ->                       (out reads & writes rings)
+//   in:  (reads rings after SWITCH, so tcp data before is handled)
+// a reader blocking in async_notify_wait sets its sleep flag, writers
+// send a WAKE over tcp only then, the same for writers waiting space.
+// records: (size32, data) aligned to 8 bytes, never wrap around the
+// end (PAD skips the tail), messages larger than free space are split
+// with the MORE bit and queued locally when the ring is full.
+//---------------------------------------------------------------------
+#define ASYNC_NOTIFY_SHM_MAGIC		0x4d48534e	// "NSHM"
+#define ASYNC_NOTIFY_SHM_PAD		0xffffffff
+#define ASYNC_NOTIFY_SHM_MORE		0x80000000
+
+// shared ring control, one per direction
+struct CAsyncShmCtrl
+{
+	struct ISPSC_CTRL ring;		// positions of the spsc ring
+	volatile ilong sleep;		// reader is blocking in wait
+	volatile ilong wait;		// writer is waiting for free space
+	char pad3[64 - sizeof(ilong) * 2];
+};
+
+// shared memory header, followed by two rings of capacity bytes
+struct CAsyncShmHead
+{
+	IUINT32 magic;
+	IUINT32 capacity;
+	char pad[56];
+	struct CAsyncShmCtrl ctrl[2];
+};
+
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+
+// unmap and release
+static void async_notify_shm_free(CAsyncNotify *notify, CAsyncShm *shm)
+{
+	if (shm->creator && shm->name[0]) {
+		shm_unlink(shm->name);
+	}
+	if (shm->base) {
+		munmap(shm->base, shm->total);
+	}
+	if (shm->pending) {
+		ikmem_free(shm->pending);
+	}
+	if (shm->frag) {
+		ikmem_free(shm->frag);
+	}
+	ilist_del(&shm->node);
+	ikmem_free(shm);
+}
+
+static int async_notify_sid_get(CAsyncNotify *notify, int sid,
+	struct sockaddr *remote, int size);
+
+// map shared memory and set up ring views
+static CAsyncShm *async_notify_shm_map(CAsyncNotify *notify, int fd, 
+	long total, int creator)
+{
+	CAsyncShmHead *head;
+	CAsyncShm *shm;
+	char *base;
+	base = (char*)mmap(NULL, total, PROT_READ | PROT_WRITE, 
+		MAP_SHARED, fd, 0);
+	if (base == (char*)MAP_FAILED) return NULL;
+	shm = (CAsyncShm*)ikmem_malloc(sizeof(CAsyncShm));
+	if (shm == NULL) {
+		munmap(base, total);
+		return NULL;
+	}
+	head = (CAsyncShmHead*)base;
+	if (creator) {
+		head->magic = ASYNC_NOTIFY_SHM_MAGIC;
+		head->capacity = (IUINT32)(total - sizeof(CAsyncShmHead)) / 2;
+	}
+	shm->base = base;
+	shm->total = total;
+	shm->creator = creator;
+	shm->capacity = (ilong)head->capacity;
+	shm->tx = &head->ctrl[creator? 0 : 1];
+	shm->rx = &head->ctrl[creator? 1 : 0];
+	// capacity of an accepted offer is checked before the rings are used
+	ispsc_attach(&shm->txring, &shm->tx->ring, base + 
+		sizeof(CAsyncShmHead) + (creator? 0 : shm->capacity), 
+		shm->capacity);
+	ispsc_attach(&shm->rxring, &shm->rx->ring, base + 
+		sizeof(CAsyncShmHead) + (creator? shm->capacity : 0), 
+		shm->capacity);
+	shm->tx_active = 0;
+	shm->rx_active = 0;
+	shm->pending = NULL;
+	shm->pending_head = 0;
+	shm->pending_size = 0;
+	shm->pending_capacity = 0;
+	shm->pending_offset = 0;
+	shm->frag = NULL;
+	shm->frag_size = 0;
+	shm->frag_capacity = 0;
+	shm->ts_offer = notify->seconds;
+	shm->name[0] = 0;
+	ilist_init(&shm->node);
+	ilist_add_tail(&shm->node, &notify->shms);
+	return shm;
+}
+
+// returns 1 for a loopback address
+static int async_notify_shm_loopback(const struct sockaddr *addr)
+{
+	if (addr->sa_family == AF_INET) {
+		const struct sockaddr_in *in4 = (const struct sockaddr_in*)addr;
+		const unsigned char *ip = (const unsigned char*)&in4->sin_addr;
+		return (ip[0] == 127)? 1 : 0;
+	}
+#ifdef AF_INET6
+	else if (addr->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *in6 = (const struct sockaddr_in6*)addr;
+		static const unsigned char lo[16] = { 
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+		return (memcmp(&in6->sin6_addr, lo, 16) == 0)? 1 : 0;
+	}
+#endif
+	return 0;
+}
+
+// out link: create shared memory and send OFFER
+static void async_notify_shm_offer(CAsyncNotify *notify, CAsyncNode *node)
+{
+	// names must be unique in the process, not just in one notify
+	static volatile ilong serial = 0;
+	long total;
+	char name[48];
+	char remote[128];
+	struct sockaddr *rmt = (struct sockaddr*)remote;
+	CAsyncShm *shm;
+	int fd;
+
+	if (notify->cfg.shm_size <= 0) return;
+	if (async_notify_sid_get(notify, node->sid, rmt, 128) <= 0) return;
+
+	// only for loopback addresses
+	if (async_notify_shm_loopback(rmt) == 0) return;
+
+	sprintf(name, "/inetnot.%d.%lx.%u", (int)getpid(), node->hid, 
+		(unsigned)iatomic_add(&serial, 1));
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return;
+
+	total = (long)sizeof(CAsyncShmHead) + notify->cfg.shm_size * 2;
+	shm = NULL;
+
+	if (ftruncate(fd, total) == 0) {
+		shm = async_notify_shm_map(notify, fd, total, 1);
+	}
+
+	close(fd);
+
+	if (shm == NULL) {
+		shm_unlink(name);
+		return;
+	}
+
+	strcpy(shm->name, name);
+	shm->owner = node;
+	node->shm = shm;
+
+	async_notify_header_write(notify->data, ASYNC_NOTIFY_MSG_SHM, 
+		ASYNC_NOTIFY_SHM_OFFER);
+	memcpy(notify->data + 4, name, strlen(name));
+	async_core_send(notify->core, node->hid, notify->data, 
+		4 + (long)strlen(name));
+}
+
+// in link: open the offered shared memory
+static int async_notify_shm_accept(CAsyncNotify *notify, CAsyncNode *node,
+	const char *data, long length)
+{
+	CAsyncShmHead *head;
+	struct stat st;
+	char name[48];
+	CAsyncShm *shm;
+	ilong capacity;
+	int fd;
+
+	if (node->shm != NULL || length < 10 || length >= 48) return -1;
+	memcpy(name, data, length);
+	name[length] = 0;
+
+	if (memcmp(name, "/inetnot.", 9) != 0) return -1;
+	if (strchr(name + 1, '/') != NULL) return -1;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) return -2;
+
+	shm_unlink(name);
+	shm = NULL;
+
+	if (fstat(fd, &st) == 0 && 
+		st.st_size > (off_t)sizeof(CAsyncShmHead)) {
+		shm = async_notify_shm_map(notify, fd, (long)st.st_size, 0);
+	}
+
+	close(fd);
+
+	if (shm == NULL) return -3;
+
+	head = (CAsyncShmHead*)shm->base;
+	capacity = shm->capacity;
+
+	if (head->magic != ASYNC_NOTIFY_SHM_MAGIC || capacity < 64 ||
+		(capacity & (capacity - 1)) != 0 ||
+		shm->total != (long)sizeof(CAsyncShmHead) + capacity * 2) {
+		async_notify_shm_free(notify, shm);
+		return -4;
+	}
+
+	node->shm = shm;
+	return 0;
+}
+
+// write fragments of message (h, d) from *offset into tx ring, 
+// returns 1 if it is complete, 0 for ring full
+static int async_notify_shm_put(CAsyncShm *shm, const char *h, long hs,
+	const char *d, long ds, long *offset)
+{
+	struct ISPSC *ring = &shm->txring;
+	long total = hs + ds;
+	long pos = *offset;
+	int complete = 0;
+
+	while (1) {
+		long remain = total - pos;
+		ilong need = (4 + remain + 7) & ~((ilong)7);
+		ilong avail, edge, s1, s2;
+		char *p1, *p2;
+		long n, x, k;
+		if (need < 16) need = 16;
+		if (need > ring->size) need = ring->size;
+		avail = ispsc_reserve(ring, need, &p1, &s1, &p2, &s2);
+		edge = ring->size - (ilong)(p1 - ring->data);
+		// keep a record contiguous when it fits after the tail edge
+		if (edge < 16 || (edge < 4 + remain && avail - edge >= 4 + remain)) {
+			if (avail < edge) {
+				avail = ispsc_reserve(ring, edge, &p1, &s1, &p2, &s2);
+				if (avail < edge) break;
+			}
+			*(IUINT32*)p1 = ASYNC_NOTIFY_SHM_PAD;
+			ispsc_commit(ring, edge);
+			continue;
+		}
+		if (avail < 16) break;
+		n = (long)(s1 - 4);
+		if (n > remain) n = remain;
+		for (x = pos, k = 0; k < n; ) {
+			long size;
+			if (x < hs) {
+				size = (hs - x < n - k)? hs - x : n - k;
+				memcpy(p1 + 4 + k, h + x, size);
+			}	else {
+				size = n - k;
+				memcpy(p1 + 4 + k, d + (x - hs), size);
+			}
+			x += size;
+			k += size;
+		}
+		pos += n;
+		*(IUINT32*)p1 = (IUINT32)n | 
+			((pos < total)? ASYNC_NOTIFY_SHM_MORE : 0);
+		ispsc_commit(ring, (4 + n + 7) & ~((ilong)7));
+		if (pos >= total) {
+			complete = 1;
+			break;
+		}
+	}
+
+	*offset = pos;
+	return complete;
+}
+
+// ring the peer over tcp
+static void async_notify_shm_wake(CAsyncNotify *notify, long hid)
+{
+	char head[4];
+	async_notify_header_write(head, ASYNC_NOTIFY_MSG_SHM, 
+		ASYNC_NOTIFY_SHM_WAKE);
+	async_core_send(notify->core, hid, head, 4);
+}
+
+// move queued messages into tx ring, returns 1 if queue is empty
+static int async_notify_shm_flush(CAsyncNotify *notify, CAsyncNode *node)
+{
+	CAsyncShm *shm = node->shm;
+	int written = 0, hr = 1;
+	while (shm->pending_head < shm->pending_size) {
+		char *ptr = shm->pending + shm->pending_head;
+		IUINT32 size;
+		idecode32u_lsb(ptr, &size);
+		if (!async_notify_shm_put(shm, ptr + 4, (long)size, NULL, 0, 
+			&shm->pending_offset)) {
+			if (shm->pending_offset > 0) written = 1;
+			hr = 0;
+			break;
+		}
+		written = 1;
+		shm->pending_head += 4 + (long)size;
+		shm->pending_offset = 0;
+	}
+	if (hr) {
+		shm->pending_head = 0;
+		shm->pending_size = 0;
+	}
+	if (written && iatomic_xchg(&shm->tx->sleep, 0)) {
+		async_notify_shm_wake(notify, node->hid);
+	}
+	return hr;
+}
+
+// send a message over shared memory
+static long async_notify_shm_send(CAsyncNotify *notify, CAsyncNode *node,
+	const char *h, long hs, const char *d, long ds)
+{
+	CAsyncShm *shm = node->shm;
+	long offset = 0;
+	long need, size;
+	if (shm->pending_size == 0) {
+		int hr = async_notify_shm_put(shm, h, hs, d, ds, &offset);
+		if (offset > 0 && iatomic_xchg(&shm->tx->sleep, 0)) {
+			async_notify_shm_wake(notify, node->hid);
+		}
+		if (hr) return 0;
+	}
+	// ring full: queue the rest (the whole message if nothing written)
+	size = hs + ds;
+	need = shm->pending_size + 4 + size;
+	if (need > shm->pending_capacity) {
+		long newsize = (need < 0x10000)? 0x10000 : need;
+		char *ptr;
+		if (shm->pending_head > 0) {
+			shm->pending_size -= shm->pending_head;
+			memmove(shm->pending, shm->pending + shm->pending_head, 
+				shm->pending_size);
+			shm->pending_head = 0;
+			need = shm->pending_size + 4 + size;
+		}
+		if (need > shm->pending_capacity) {
+			while (newsize < need) newsize *= 2;
+			ptr = (char*)ikmem_realloc(shm->pending, newsize);
+			if (ptr == NULL) return -1;
+			shm->pending = ptr;
+			shm->pending_capacity = newsize;
+		}
+	}
+	if (shm->pending_size == 0) {
+		shm->pending_offset = offset;
+	}
+	iencode32u_lsb(shm->pending + shm->pending_size, (IUINT32)size);
+	memcpy(shm->pending + shm->pending_size + 4, h, hs);
+	if (ds > 0) {
+		memcpy(shm->pending + shm->pending_size + 4 + hs, d, ds);
+	}
+	shm->pending_size += 4 + size;
+	return 0;
+}
+
+// read messages from rx ring and dispatch them like tcp data
+static void async_notify_shm_drain(CAsyncNotify *notify, CAsyncNode *node)
+{
+	CAsyncShm *shm = node->shm;
+	struct ISPSC *ring = &shm->rxring;
+	ilong total, s1, s2;
+	char *p1, *p2;
+	long hid = node->hid;
+	int error = 0;
+
+	total = ispsc_ptr(ring, &p1, &s1, &p2, &s2);
+
+	if (total == 0) return;
+
+	while (total > 0) {
+		IUINT32 word;
+		ilong step;
+		long n;
+		if (s1 == 0) {
+			p1 = p2;
+			s1 = s2;
+			s2 = 0;
+		}
+		word = *(IUINT32*)p1;
+		if (word == ASYNC_NOTIFY_SHM_PAD) {
+			step = ring->size - (ilong)(p1 - ring->data);
+			if (step > s1) {
+				error = 1;
+				break;
+			}
+			p1 += step;
+			s1 -= step;
+			total -= step;
+			ispsc_drop(ring, step);
+			continue;
+		}
+		n = (long)(word & ~ASYNC_NOTIFY_SHM_MORE);
+		step = (4 + n + 7) & ~((ilong)7);
+		if ((ilong)n > s1 - 4 || step > s1) {
+			error = 1;
+			break;
+		}
+		if ((word & ASYNC_NOTIFY_SHM_MORE) || shm->frag_size > 0) {
+			long need = shm->frag_size + n;
+			if (need > shm->frag_capacity) {
+				long newsize = (need < 0x10000)? 0x10000 : need;
+				char *frag;
+				while (newsize < need) newsize *= 2;
+				frag = (char*)ikmem_realloc(shm->frag, newsize);
+				if (frag == NULL) {
+					error = 2;
+					break;
+				}
+				shm->frag = frag;
+				shm->frag_capacity = newsize;
+			}
+			memcpy(shm->frag + shm->frag_size, p1 + 4, n);
+			shm->frag_size += n;
+			if ((word & ASYNC_NOTIFY_SHM_MORE) == 0) {
+				long size = shm->frag_size;
+				shm->frag_size = 0;
+				if (size >= 4) {
+					async_notify_on_data(notify, hid, 0, shm->frag, size);
+				}	else {
+					error = 1;
+				}
+			}
+		}
+		else if (n >= 4) {
+			async_notify_on_data(notify, hid, 0, p1 + 4, n);
+		}
+		else {
+			error = 1;
+		}
+		if (error) break;
+		p1 += step;
+		s1 -= step;
+		total -= step;
+		ispsc_drop(ring, step);
+		if (node->hid != hid || node->shm != shm) return;
+	}
+
+	// writer is waiting for free space
+	if (iatomic_xchg(&shm->rx->wait, 0)) {
+		async_notify_shm_wake(notify, hid);
+	}
+
+	if (error) {
+		shm->rx_active = 0;
+		async_core_close(notify->core, hid, 8202);
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING, 
+			"[WARNING] bad shared memory record from hid=%lx sid=%d",
+			hid, node->sid);
+	}
+}
+
+// before waiting: flush queues and set sleep flags if it will block,
+// returns 0 if it must not block since data has arrived.
+static int async_notify_shm_sleep(CAsyncNotify *notify, int block)
+{
+	struct ILISTHEAD *it;
+	for (it = notify->shms.next; it != &notify->shms; it = it->next) {
+		CAsyncShm *shm = ilist_entry(it, CAsyncShm, node);
+		CAsyncNode *node = shm->owner;
+		if (shm->rx_active && block) {
+			iatomic_xchg(&shm->rx->sleep, 1);
+			if (iatomic_add(&shm->rx->ring.head, 0) != shm->rx->ring.tail) {
+				block = 0;
+			}
+		}
+		if (shm->tx_active && shm->pending_size > 0) {
+			if (async_notify_shm_flush(notify, node) == 0 && block) {
+				iatomic_xchg(&shm->tx->wait, 1);
+				if (async_notify_shm_flush(notify, node)) {
+					iatomic_set(&shm->tx->wait, 0);
+				}
+			}
+		}
+	}
+	return block;
+}
+
+// after waked up: clear sleep flags, drain rx rings, flush queues
+static void async_notify_shm_poll(CAsyncNotify *notify)
+{
+	struct ILISTHEAD *it, *next;
+	for (it = notify->shms.next; it != &notify->shms; it = next) {
+		CAsyncShm *shm = ilist_entry(it, CAsyncShm, node);
+		CAsyncNode *node = shm->owner;
+		next = it->next;
+		if (shm->rx_active) {
+			if (shm->rx->sleep) {
+				iatomic_set(&shm->rx->sleep, 0);
+			}
+			async_notify_shm_drain(notify, node);
+		}
+		if (shm->tx_active && shm->pending_size > 0) {
+			async_notify_shm_flush(notify, node);
+		}
+	}
+}
+
+// handle ASYNC_NOTIFY_MSG_SHM
+static void async_notify_cmd_shm(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length)
+{
+	int mid, cmd, hr;
+	async_notify_header_read(data, &mid, &cmd);
+	if (node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+		return;
+	}
+	switch (cmd) {
+	case ASYNC_NOTIFY_SHM_OFFER:
+		if (node->mode != ASYNC_CORE_NODE_IN) break;
+		hr = (notify->cfg.shm_size > 0)? 0 : -5;
+		if (hr == 0) {
+			// only from loopback peers, as offers are only sent to them
+			char remote[128];
+			int size = sizeof(remote);
+			struct sockaddr *rmt = (struct sockaddr*)remote;
+			if (async_core_peername(notify->core, node->hid, rmt, &size) 
+				!= 0 || async_notify_shm_loopback(rmt) == 0) {
+				hr = -6;
+			}
+		}
+		if (hr == 0) {
+			hr = async_notify_shm_accept(notify, node, data + 4, length - 4);
+		}
+		if (hr == 0) {
+			node->shm->owner = node;
+			cmd = ASYNC_NOTIFY_SHM_ACCEPT;
+		}	else {
+			cmd = ASYNC_NOTIFY_SHM_REJECT;
+		}
+		async_notify_header_write(data, ASYNC_NOTIFY_MSG_SHM, cmd);
+		async_core_send(notify->core, node->hid, data, 4);
+		if (hr == 0) {
+			// tcp only carries wake-ups now: don't let nagle hold them
+			async_core_option(notify->core, node->hid, 
+				ASYNC_CORE_OPTION_NODELAY, 1);
+			node->shm->tx_active = 1;
+		}
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
+			"shared memory %s: hid=%lx sid=%d error=%d", 
+			(hr == 0)? "accepted" : "rejected", node->hid, node->sid, hr);
+		break;
+	case ASYNC_NOTIFY_SHM_ACCEPT:
+		if (node->mode != ASYNC_CORE_NODE_OUT) break;
+		if (node->shm == NULL) {
+			// the offer expired, peer already writes into the rings
+			async_core_close(notify->core, node->hid, 8204);
+			break;
+		}
+		shm_unlink(node->shm->name);
+		node->shm->name[0] = 0;
+		async_notify_header_write(data, ASYNC_NOTIFY_MSG_SHM, 
+			ASYNC_NOTIFY_SHM_SWITCH);
+		async_core_send(notify->core, node->hid, data, 4);
+		async_core_option(notify->core, node->hid, 
+			ASYNC_CORE_OPTION_NODELAY, 1);
+		node->shm->tx_active = 1;
+		node->shm->rx_active = 1;
+		break;
+	case ASYNC_NOTIFY_SHM_REJECT:
+		if (node->mode != ASYNC_CORE_NODE_OUT || node->shm == NULL) break;
+		async_notify_shm_free(notify, node->shm);
+		node->shm = NULL;
+		break;
+	case ASYNC_NOTIFY_SHM_SWITCH:
+		if (node->mode != ASYNC_CORE_NODE_IN || node->shm == NULL) break;
+		node->shm->rx_active = 1;
+		break;
+	}
+}
+
+// drop offers left unanswered, so their names don't stay in /dev/shm
+static void async_notify_shm_expire(CAsyncNotify *notify)
+{
+	struct ILISTHEAD *it, *next;
+	for (it = notify->shms.next; it != &notify->shms; it = next) {
+		CAsyncShm *shm = ilist_entry(it, CAsyncShm, node);
+		next = it->next;
+		if (shm->creator == 0 || shm->tx_active) continue;
+		if (notify->seconds - shm->ts_offer < ASYNC_NOTIFY_SHM_TIMEOUT) {
+			continue;
+		}
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
+			"shared memory offer expired: hid=%lx sid=%d", 
+			shm->owner->hid, shm->owner->sid);
+		shm->owner->shm = NULL;
+		async_notify_shm_free(notify, shm);
+	}
+}
+
+#endif
+
+
+//---------------------------------------------------------------------
+// send a message to a node: over shared memory once it is switched
+//---------------------------------------------------------------------
+static long async_notify_node_send(CAsyncNotify *notify, CAsyncNode *node,
+	const void *head, long hs, const void *data, long ds)
+{
+	const void *vecptr[2];
+	long veclen[2];
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (node->shm && node->shm->tx_active) {
+		return async_notify_shm_send(notify, node, (const char*)head, hs,
+				(const char*)data, ds);
+	}
+#endif
+	vecptr[0] = head;
+	vecptr[1] = data;
+	veclen[0] = hs;
+	veclen[1] = ds;
+	return async_core_send_vector(notify->core, node->hid, 
+			vecptr, veclen, 2, 0);
+}
+
+// send the pending batch of a node
+static void async_notify_batch_flush(CAsyncNotify *notify, CAsyncNode *node)
+{
+	if (node->batch_size > 4) {
+		async_notify_header_write(node->batch, ASYNC_NOTIFY_MSG_BATCH, 0);
+		async_notify_node_send(notify, node, node->batch, 
+			node->batch_size, NULL, 0);
+	}
+	node->batch_size = 0;
+	if (!ilist_is_empty(&node->node_batch)) {
+		ilist_del_init(&node->node_batch);
+	}
+}
+
+// append a message to the batch of a node, returns 0 for batched and
+// -1 if it must be sent alone (pending messages are flushed first).
+static int async_notify_batch_push(CAsyncNotify *notify, CAsyncNode *node,
+	int cmd, const void *data, long size)
+{
+	long limit = notify->cfg.batch_limit;
+	long need = 6 + size;
+	char *ptr;
+	if (4 + need > limit) {
+		async_notify_batch_flush(notify, node);
+		return -1;
+	}
+	if (node->batch_size + need > limit) {
+		async_notify_batch_flush(notify, node);
+	}
+	if (node->batch_capacity < limit) {
+		ptr = (char*)ikmem_realloc(node->batch, limit);
+		if (ptr == NULL) {
+			async_notify_batch_flush(notify, node);
+			return -1;
+		}
+		node->batch = ptr;
+		node->batch_capacity = limit;
+	}
+	if (node->batch_size == 0) {
+		node->batch_size = 4;
+		node->batch_ts = iclockrt();
+		ilist_add_tail(&node->node_batch, &notify->batch);
+	}
+	ptr = node->batch + node->batch_size;
+	iencode32u_lsb(ptr, (IUINT32)size);
+	iencode16u_lsb(ptr + 4, (unsigned short)cmd);
+	if (size > 0) {
+		memcpy(ptr + 6, data, size);
+	}
+	node->batch_size += need;
+	if (node->batch_size >= limit) {
+		async_notify_batch_flush(notify, node);
+	}
+	return 0;
+}
+
+// flush batches older than batch_delay, returns usec until the next
+// deadline or -1 if nothing is pending.
+static IINT64 async_notify_batch_expire(CAsyncNotify *notify, IINT64 now)
+{
+	while (!ilist_is_empty(&notify->batch)) {
+		CAsyncNode *node = ilist_entry(notify->batch.next, 
+				CAsyncNode, node_batch);
+		IINT64 remain = node->batch_ts + notify->cfg.batch_delay - now;
+		if (remain > 0) return remain;
+		async_notify_batch_flush(notify, node);
+	}
+	return -1;
+}
+
 
 //---------------------------------------------------------------------
 // create async notify
@@ -404,17 +1256,26 @@ CAsyncNotify* async_notify_new(int serverid)
 	notify->evtmask = 0;
 	notify->lastsec = -1;
 	notify->sid = serverid;
+	notify->link_round = 0;
+	notify->call_serial = 0;
 	notify->nodes = (CAsyncNode*)ikmem_malloc(sizeof(CAsyncNode) * 0x10000);
 	notify->core = async_core_new(0);
 	
 	ilist_init(&notify->ping);
 	ilist_init(&notify->idle);
+	ilist_init(&notify->batch);
+	ilist_init(&notify->dead);
+	ilist_init(&notify->shms);
 	it_init(&notify->token, ITYPE_STR);
 
+	ib_map_init(&notify->calls, ib_hash_func_uint, ib_hash_compare_uint);
+	itimer_mgr_init(&notify->timer, notify->current, 1);
+
 	IMUTEX_INIT(&notify->lock);
 
 	notify->sid2hid_in = idict_create();
 	notify->sid2hid_out = idict_create();
+	notify->sid2link = idict_create();
 	notify->sid2addr = idict_create();
 	notify->allowip = idict_create();
 	notify->sidblack = idict_create();
@@ -422,6 +1283,7 @@ CAsyncNotify* async_notify_new(int serverid)
 	
 	if (notify->sid2hid_in == NULL || 
 		notify->sid2hid_out == NULL ||
+		notify->sid2link == NULL ||
 		notify->sid2addr == NULL ||
 		notify->allowip == NULL ||
 		notify->sidblack == NULL ||
@@ -435,6 +1297,7 @@ CAsyncNotify* async_notify_new(int serverid)
 	for (i = 0; i < 0x10000; i++) {
 		notify->nodes[i].hid = -1;
 		notify->nodes[i].mode = -1;
+		notify->nodes[i].batch = NULL;
 		notify->sid2hid[i] = -1;
 	}
 
@@ -450,6 +1313,15 @@ CAsyncNotify* async_notify_new(int serverid)
 	notify->cfg.buffer_limit = -1;
 	notify->cfg.sign_timeout = -1;
 	notify->cfg.retry_seconds = -1;
+	notify->cfg.links = 1;
+	notify->cfg.link_policy = ASYNC_NOTIFY_LINK_ROUND;
+	notify->cfg.batch_limit = 0;
+	notify->cfg.batch_delay = 0;
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	notify->cfg.shm_size = ASYNC_NOTIFY_SHM_DEFAULT;
+#else
+	notify->cfg.shm_size = 0;
+#endif
 
 	async_core_firewall(notify->core, async_notify_firewall, notify);
 	async_core_limit(notify->core, 0x400000, 0x200000);
@@ -471,12 +1343,45 @@ void async_notify_delete(CAsyncNotify *notify)
 
 	it_destroy(&notify->token);
 
+	while (1) {
+		struct ib_hash_entry *entry = ib_map_first(&notify->calls);
+		CAsyncCall *call;
+		if (entry == NULL) break;
+		call = (CAsyncCall*)ib_hash_value(entry);
+		ib_map_erase(&notify->calls, entry);
+		itimer_evt_destroy(&call->evt);
+		ilist_del(&call->node);
+		ikmem_free(call);
+	}
+
+	while (!ilist_is_empty(&notify->dead)) {
+		CAsyncCall *call = ilist_entry(notify->dead.next, CAsyncCall, node);
+		ilist_del(&call->node);
+		ikmem_free(call);
+	}
+
+	ib_map_destroy(&notify->calls);
+	itimer_mgr_destroy(&notify->timer);
+
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	while (!ilist_is_empty(&notify->shms)) {
+		CAsyncShm *shm = ilist_entry(notify->shms.next, CAsyncShm, node);
+		async_notify_shm_free(notify, shm);
+	}
+#endif
+
 	if (notify->core) {
 		async_core_delete(notify->core);
 		notify->core = NULL;
 	}
 	
 	if (notify->nodes) {
+		int i;
+		for (i = 0; i < 0x10000; i++) {
+			if (notify->nodes[i].batch) {
+				ikmem_free(notify->nodes[i].batch);
+			}
+		}
 		ikmem_free(notify->nodes);
 		notify->nodes = NULL;
 	}
@@ -506,6 +1411,11 @@ void async_notify_delete(CAsyncNotify *notify)
 		notify->sid2hid_out = NULL;
 	}
 
+	if (notify->sid2link) {
+		idict_delete(notify->sid2link);
+		notify->sid2link = NULL;
+	}
+
 	if (notify->sid2hid) {
 		ikmem_free(notify->sid2hid);
 		notify->sid2hid = NULL;
@@ -775,6 +1685,23 @@ void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec)
 
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
 
+	// flush expired batches and wake up in time for the next one
+	if (!ilist_is_empty(&notify->batch)) {
+		IINT64 remain = async_notify_batch_expire(notify, iclockrt());
+		if (remain >= 0) {
+			IUINT32 limit = (IUINT32)((remain + 999) / 1000);
+			if (limit < millisec) millisec = limit;
+		}
+	}
+
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (!ilist_is_empty(&notify->shms)) {
+		if (async_notify_shm_sleep(notify, millisec > 0) == 0) {
+			millisec = 0;
+		}
+	}
+#endif
+
 	async_core_wait(notify->core, millisec);
 
 	itimeofday(&seconds, NULL);
@@ -820,11 +1747,30 @@ void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec)
 		}
 	}
 
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (!ilist_is_empty(&notify->shms)) {
+		async_notify_shm_poll(notify);
+	}
+#endif
+
 	if (notify->seconds != notify->lastsec) {
 		notify->lastsec = notify->seconds;
 		async_notify_on_timer(notify);
 	}
 
+	if (!ilist_is_empty(&notify->batch)) {
+		async_notify_batch_expire(notify, iclockrt());
+	}
+
+	// expire calls, which can not be freed inside the timer callback
+	itimer_mgr_run(&notify->timer, notify->current);
+
+	while (!ilist_is_empty(&notify->dead)) {
+		CAsyncCall *call = ilist_entry(notify->dead.next, CAsyncCall, node);
+		ilist_del(&call->node);
+		ikmem_free(call);
+	}
+
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 }
 
@@ -1003,7 +1949,11 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 
 	if (node->mode == ASYNC_CORE_NODE_OUT) {
 		if (node->sid >= 0) {
-			async_notify_set(notify, ASYNC_CORE_NODE_OUT, node->sid, -1);
+			if (async_notify_link_get(notify, ASYNC_CORE_NODE_OUT, 
+				node->sid, node->link) == hid) {
+				async_notify_link_set(notify, ASYNC_CORE_NODE_OUT,
+					node->sid, node->link, -1);
+			}
 		}
 		if (node->state != ASYNC_NOTIFY_STATE_LOGINED) {
 			async_notify_black_set(notify, node->sid, 1);
@@ -1013,6 +1963,12 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 					sid, notify->cfg.retry_seconds);
 			}
 		}
+		while (!ilist_is_empty(&node->calls)) {
+			CAsyncCall *call = ilist_entry(node->calls.next, 
+					CAsyncCall, node);
+			async_notify_call_done(notify, call, 
+				ASYNC_NOTIFY_CALL_CLOSED, NULL, 0);
+		}
 		name = "connection-out";
 		notify->count_out--;
 		if (notify->evtmask & ASYNC_NOTIFY_EVT_CLOSED_OUT) {
@@ -1024,7 +1980,11 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 	}
 	else if (node->mode == ASYNC_CORE_NODE_IN) {
 		if (node->sid >= 0) {
-			async_notify_set(notify, ASYNC_CORE_NODE_IN, node->sid, -1);
+			if (async_notify_link_get(notify, ASYNC_CORE_NODE_IN, 
+				node->sid, node->link) == hid) {
+				async_notify_link_set(notify, ASYNC_CORE_NODE_IN,
+					node->sid, node->link, -1);
+			}
 		}
 		name = "connection-in";
 		notify->count_in--;
@@ -1042,6 +2002,13 @@ static void async_notify_on_leave(CAsyncNotify *notify, long hid, long tag,
 		name = "listener";
 	}
 
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (node->shm) {
+		async_notify_shm_free(notify, node->shm);
+		node->shm = NULL;
+	}
+#endif
+
 	async_notify_node_del(notify, hid);
 
 	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO, 
@@ -1098,13 +2065,28 @@ static void async_notify_on_data(CAsyncNotify *notify, long hid, long tag,
 		break;
 
 	case ASYNC_NOTIFY_MSG_LOGINACK: 
-		async_notify_cmd_logack(notify, node);
+		async_notify_cmd_logack(notify, node, length);
 		break;
 
 	case ASYNC_NOTIFY_MSG_DATA:	
+	case ASYNC_NOTIFY_MSG_BATCH:
 		async_notify_cmd_data(notify, node, data, length);
 		break;
 
+	case ASYNC_NOTIFY_MSG_CALL:
+		async_notify_cmd_call(notify, node, data, length);
+		break;
+
+	case ASYNC_NOTIFY_MSG_REPLY:
+		async_notify_cmd_reply(notify, node, data, length);
+		break;
+
+	case ASYNC_NOTIFY_MSG_SHM:
+	#ifdef ASYNC_NOTIFY_SHM_ENABLE
+		async_notify_cmd_shm(notify, node, data, length);
+	#endif
+		break;
+
 	case ASYNC_NOTIFY_MSG_PING:
 		async_notify_header_write(data, ASYNC_NOTIFY_MSG_PACK, 0);
 		async_core_send(notify->core, hid, data, 8);
@@ -1138,8 +2120,10 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 	long seconds;
 	long hid = node->hid;
 	long hid2 = -1;
-	int size;
+	int size, link;
 
+	// link index travels in the cmd field of the header
+	async_notify_header_read(data, NULL, &link);
 	idecode32u_lsb(data + 4, &sid1);
 	idecode32u_lsb(data + 8, &sid2);
 	async_notify_decode_64(data + 12, &ts);
@@ -1170,6 +2154,15 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 			"[WARNING] error login for hid=%lx: state error", hid);
 		return;
 	}
+	if (link >= ASYNC_NOTIFY_LINK_MAX) {
+		async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 6);
+		async_core_send(notify->core, hid, data, 4);
+		async_core_close(notify->core, hid, 8006);
+		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
+			"[WARNING] error login for hid=%lx: link %d out of range",
+			hid, link);
+		return;
+	}
 	if ((int)sid2 != notify->sid) {
 		async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 3);
 		async_core_send(notify->core, hid, data, 4);
@@ -1205,7 +2198,7 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 		}
 	}
 
-	hid2 = async_notify_get(notify, ASYNC_CORE_NODE_IN, sid1);
+	hid2 = async_notify_link_get(notify, ASYNC_CORE_NODE_IN, sid1, link);
 
 	// already an existent connection for remote server
 	if (hid2 >= 0) {
@@ -1216,19 +2209,26 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 		async_core_close(notify->core, hid2, 8010);
 		node2->sid = -1;
 		node2->state = ASYNC_NOTIFY_STATE_ERROR;
-		async_notify_set(notify, ASYNC_CORE_NODE_IN, sid1, -1);
+		async_notify_link_set(notify, ASYNC_CORE_NODE_IN, sid1, link, -1);
 		async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING,
-			"[WARNING] login conflict: hid=%lx to hid=%lx sid=%d", 
-			hid, hid2, sid1);
+			"[WARNING] login conflict: hid=%lx to hid=%lx sid=%d link=%d", 
+			hid, hid2, sid1, link);
 	}
 
 	node->sid = sid1;
+	node->link = link;
 	node->state = ASYNC_NOTIFY_STATE_LOGINED;
-	async_notify_set(notify, ASYNC_CORE_NODE_IN, sid1, hid);
+	async_notify_link_set(notify, ASYNC_CORE_NODE_IN, sid1, link, hid);
 
-	// send back login ack
+	// send back login ack with what we support
 	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGINACK, 0);
-	async_core_send(notify->core, hid, data, 4);
+	iencode32u_lsb(data + 4, 0);
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (notify->cfg.shm_size > 0) {
+		iencode32u_lsb(data + 4, ASYNC_NOTIFY_CAP_SHM);
+	}
+#endif
+	async_core_send(notify->core, hid, data, 8);
 
 	if (notify->evtmask & ASYNC_NOTIFY_EVT_NEW_IN) {
 		async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_NEW_IN,
@@ -1236,12 +2236,15 @@ static void async_notify_cmd_login(CAsyncNotify *notify, CAsyncNode *node)
 	}
 
 	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
-		"login from remote successful: hid=%lx sid=%d", hid, sid1);
+		"login from remote successful: hid=%lx sid=%d link=%d", 
+		hid, sid1, link);
 }
 
-static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node)
+static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node,
+	long length)
 {
 	char *data = notify->data;
+	IUINT32 caps = 0;
 	int mid, cmd;
 	async_notify_header_read(data, &mid, &cmd);
 	if (cmd != 0) {
@@ -1266,6 +2269,17 @@ static void async_notify_cmd_logack(CAsyncNotify *notify, CAsyncNode *node)
 
 	async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
 		"login to remote successful: hid=%lx sid=%d", node->hid, node->sid);
+
+	// older peers send no caps and would never answer an offer
+	if (length >= 8) {
+		idecode32u_lsb(data + 4, &caps);
+	}
+
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (caps & ASYNC_NOTIFY_CAP_SHM) {
+		async_notify_shm_offer(notify, node);
+	}
+#endif
 }
 
 static void async_notify_cmd_data(CAsyncNotify *notify, CAsyncNode *node,
@@ -1284,11 +2298,93 @@ static void async_notify_cmd_data(CAsyncNotify *notify, CAsyncNode *node,
 		return;
 	}
 
+	if (mid == ASYNC_NOTIFY_MSG_BATCH) {
+		long pos = 4;
+		// unpack batch: (size32, cmd16, data) ...
+		while (pos < length) {
+			IUINT32 size;
+			unsigned short cc;
+			if (length - pos < 6) break;
+			idecode32u_lsb(data + pos, &size);
+			idecode16u_lsb(data + pos + 4, &cc);
+			if (size > (IUINT32)(length - pos - 6)) break;
+			async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_DATA, node->sid,
+				cc, data + pos + 6, (long)size);
+			pos += 6 + (long)size;
+		}
+		if (pos != length) {
+			async_core_close(notify->core, node->hid, 8201);
+			async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING, 
+				"[WARNING] bad batch from hid=%lx sid=%d",
+				node->hid, node->sid);
+		}
+		return;
+	}
+
 	// push message
 	async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_DATA, node->sid,
 		cmd, data + 4, length - 4);
 }
 
+// invoked when received a call: push (token, data) for async_notify_reply
+static void async_notify_cmd_call(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length)
+{
+	IUINT32 id;
+	int mid, cmd;
+
+	async_notify_header_read(data, &mid, &cmd);
+	if (node->state != ASYNC_NOTIFY_STATE_LOGINED || length < 8) {
+		async_core_close(notify->core, node->hid, 8200);
+		if (notify->logmask & ASYNC_NOTIFY_LOG_WARNING) {
+			async_notify_log(notify, ASYNC_NOTIFY_LOG_WARNING, 
+			"[WARNING] can not receive call for hid=%lx sid=%d cmd=%d",
+			node->hid, node->sid, cmd);
+		}
+		return;
+	}
+
+	// replace (header, callid) with the token: (callid, hid)
+	idecode32u_lsb(data + 4, &id);
+	iencode32u_lsb(data + 0, id);
+	iencode32u_lsb(data + 4, (IUINT32)node->hid);
+
+	async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_CALL, node->sid,
+		cmd, data, length);
+}
+
+// invoked when received a reply of our call
+static void async_notify_cmd_reply(CAsyncNotify *notify, CAsyncNode *node,
+	char *data, long length)
+{
+	struct ib_hash_entry *entry;
+	CAsyncCall *call;
+	IUINT32 id;
+	int mid, code;
+
+	async_notify_header_read(data, &mid, &code);
+	if (node->state != ASYNC_NOTIFY_STATE_LOGINED || length < 8) {
+		async_core_close(notify->core, node->hid, 8200);
+		return;
+	}
+
+	idecode32u_lsb(data + 4, &id);
+	entry = ib_map_find_uint(&notify->calls, id);
+
+	// late reply of an expired call
+	if (entry == NULL) return;
+
+	call = (CAsyncCall*)ib_hash_value(entry);
+
+	// only the link which carries the call may complete it
+	if (call->hid != node->hid) {
+		async_core_close(notify->core, node->hid, 8203);
+		return;
+	}
+
+	async_notify_call_done(notify, call, code, data + 8, length - 8);
+}
+
 
 //---------------------------------------------------------------------
 // new listen: return id(-1 error, -2 port conflict), flags&1(reuse)
@@ -1421,9 +2517,9 @@ int async_notify_get_port(CAsyncNotify *notify, long listenid)
 
 
 //---------------------------------------------------------------------
-// send message to server
+// get or open one link to server
 //---------------------------------------------------------------------
-static long async_notify_get_connection(CAsyncNotify *notify, int sid)
+static long async_notify_link_open(CAsyncNotify *notify, int sid, int link)
 {
 	CAsyncNode *node;
 	char *data;
@@ -1434,7 +2530,7 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	int keysize;
 
 	// get connection
-	hid = async_notify_get(notify, ASYNC_CORE_NODE_OUT, sid);
+	hid = async_notify_link_get(notify, ASYNC_CORE_NODE_OUT, sid, link);
 	// check if there is an existent connection
 	if (hid >= 0) return hid;
 
@@ -1481,6 +2577,7 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	async_notify_hid_init(notify, hid);
 
 	node->sid = sid;
+	node->link = link;
 	node->mode = ASYNC_CORE_NODE_OUT;
 	node->state = ASYNC_NOTIFY_STATE_CONNECTING;
 
@@ -1491,11 +2588,11 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 	node->ts_ping = notify->seconds;
 
 	// add sid2hid map
-	async_notify_set(notify, ASYNC_CORE_NODE_OUT, sid, hid);
+	async_notify_link_set(notify, ASYNC_CORE_NODE_OUT, sid, link, hid);
 	
 	// build login message: (selfid, remoteid, ts, sign)
 	data = notify->data;
-	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGIN, 0);
+	async_notify_header_write(data, ASYNC_NOTIFY_MSG_LOGIN, link);
 
 	iencode32u_lsb(data + 4, (IUINT32)notify->sid);
 	iencode32u_lsb(data + 8, (IUINT32)sid);
@@ -1521,12 +2618,74 @@ static long async_notify_get_connection(CAsyncNotify *notify, int sid)
 
 	if (notify->logmask & ASYNC_NOTIFY_LOG_INFO) {
 		async_notify_log(notify, ASYNC_NOTIFY_LOG_INFO,
-			"create new connection hid=%lx to sid=%d", hid, sid);
+			"create new connection hid=%lx to sid=%d link=%d", 
+			hid, sid, link);
 	}
 
 	return hid;
 }
 
+//---------------------------------------------------------------------
+// choose a link to server: the policy gives the first candidate and
+// missing links are opened. round-robin and least-queued skip links 
+// that are not logined yet while another one is, affinity keeps the 
+// link of cmd (data waits for the login) and moves on only if it 
+// cannot be opened.
+//---------------------------------------------------------------------
+static long async_notify_get_connection(CAsyncNotify *notify, int sid,
+	int cmd)
+{
+	int links = notify->cfg.links;
+	int policy = notify->cfg.link_policy;
+	long first = -1, best = -1, remain = 0, error = -3;
+	int start, i;
+
+	if (links <= 1) {
+		return async_notify_link_open(notify, sid, 0);
+	}
+
+	if (policy == ASYNC_NOTIFY_LINK_AFFINITY) {
+		start = (cmd & 0xffff) % links;
+	}
+	else if (policy == ASYNC_NOTIFY_LINK_LEAST) {
+		start = 0;
+	}
+	else {
+		start = (int)(notify->link_round++ % (IUINT32)links);
+	}
+
+	for (i = 0; i < links; i++) {
+		int link = (start + i) % links;
+		long hid = async_notify_link_open(notify, sid, link);
+		CAsyncNode *node;
+		if (hid < 0) {
+			// sid unknown: no link can help
+			if (hid == -1) return -1;
+			error = hid;
+			continue;
+		}
+		if (first < 0) first = hid;
+		if (policy == ASYNC_NOTIFY_LINK_AFFINITY) break;
+		node = async_notify_node_get(notify, hid);
+		if (node == NULL || node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+			continue;
+		}
+		if (policy != ASYNC_NOTIFY_LINK_LEAST) {
+			return hid;
+		}	else {
+			long size = async_core_remain(notify->core, hid);
+			if (best < 0 || size < remain) {
+				best = hid;
+				remain = size;
+			}
+		}
+	}
+
+	if (best >= 0) return best;
+
+	return (first >= 0)? first : error;
+}
+
 //---------------------------------------------------------------------
 // send message to server
 //---------------------------------------------------------------------
@@ -1542,20 +2701,22 @@ int async_notify_send(CAsyncNotify *notify, int sid, short cmd,
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
 	
 	// get or create an connection 
-	hid = async_notify_get_connection(notify, sid);
+	hid = async_notify_get_connection(notify, sid, cmd);
 
 	// check if connection for remote server exists
 	if (hid >= 0) {	
-		const void *vecptr[2];
-		long veclen[2];
-		char *head = notify->data;
-		vecptr[0] = head;
-		vecptr[1] = data;
-		veclen[0] = 4;
-		veclen[1] = size;
-		async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
-		x = async_core_send_vector(notify->core, hid, vecptr, veclen, 2, 0);
-		if (x < 0) hr = -1000 + x;
+		CAsyncNode *node = NULL;
+		if (notify->cfg.batch_limit > 0) {
+			node = async_notify_node_get(notify, hid);
+		}
+		if (node == NULL || 
+			async_notify_batch_push(notify, node, cmd, data, size) != 0) {
+			char *head = notify->data;
+			async_notify_header_write(head, ASYNC_NOTIFY_MSG_DATA, cmd);
+			node = async_notify_node_get(notify, hid);
+			x = async_notify_node_send(notify, node, head, 4, data, size);
+			if (x < 0) hr = -1000 + x;
+		}
 		// update idle time
 		async_notify_node_active(notify, hid, 1);
 	}	else {
@@ -1572,16 +2733,191 @@ int async_notify_send(CAsyncNotify *notify, int sid, short cmd,
 	return hr;
 }
 
+//---------------------------------------------------------------------
+// flush batched messages of sid (all sids if sid < 0)
+//---------------------------------------------------------------------
+int async_notify_flush(CAsyncNotify *notify, int sid)
+{
+	int count = 0;
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+	if (sid < 0) {
+		while (!ilist_is_empty(&notify->batch)) {
+			CAsyncNode *node = ilist_entry(notify->batch.next,
+					CAsyncNode, node_batch);
+			async_notify_batch_flush(notify, node);
+			count++;
+		}
+	}	else {
+		int link;
+		for (link = 0; link < notify->cfg.links; link++) {
+			long hid = async_notify_link_get(notify, ASYNC_CORE_NODE_OUT,
+					sid, link);
+			CAsyncNode *node;
+			if (hid < 0) continue;
+			node = async_notify_node_get(notify, hid);
+			if (node && node->batch_size > 0) {
+				async_notify_batch_flush(notify, node);
+				count++;
+			}
+		}
+	}
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+	return count;
+}
+
+
+//---------------------------------------------------------------------
+// finish a call: push result and release it
+//---------------------------------------------------------------------
+static void async_notify_call_done(CAsyncNotify *notify, CAsyncCall *call,
+	long code, const void *data, long size)
+{
+	async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_RESULT, 
+		(long)call->id, code, data, size);
+	ib_map_remove(&notify->calls, (void*)((size_t)call->id));
+	itimer_evt_destroy(&call->evt);
+	ilist_del(&call->node);
+	ikmem_free(call);
+}
+
+// call deadline: the timer still touches the event after callback, 
+// so the call is moved to the dead list and freed by async_notify_wait
+static void async_notify_call_expire(void *data, void *user)
+{
+	CAsyncNotify *notify = (CAsyncNotify*)user;
+	CAsyncCall *call = (CAsyncCall*)data;
+	async_notify_msg_push(notify, ASYNC_NOTIFY_EVT_RESULT, 
+		(long)call->id, ASYNC_NOTIFY_CALL_TIMEOUT, "", 0);
+	ib_map_remove(&notify->calls, (void*)((size_t)call->id));
+	ilist_del(&call->node);
+	ilist_add_tail(&call->node, &notify->dead);
+}
+
+
+//---------------------------------------------------------------------
+// call server: returns call id (> 0) or error (< 0)
+//---------------------------------------------------------------------
+long async_notify_call(CAsyncNotify *notify, int sid, short cmd, 
+	const void *data, long size, IUINT32 timeout)
+{
+	CAsyncCall *call;
+	CAsyncNode *node;
+	long hid, x, hr;
+	char *head;
+	IUINT32 id;
+
+	if (cmd < 0) return -5;
+	if (sid == notify->sid) return -6;
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+
+	hid = async_notify_get_connection(notify, sid, cmd);
+	node = (hid >= 0)? async_notify_node_get(notify, hid) : NULL;
+
+	if (node == NULL) {
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		return (hid < 0)? hid : -1;
+	}
+
+	call = (CAsyncCall*)ikmem_malloc(sizeof(CAsyncCall));
+
+	if (call == NULL) {
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		return -7;
+	}
+
+	// ids wrap at 0x7fffffff to stay positive in a 32-bit long, 
+	// skip 0 and ids still pending after wrap around
+	while (1) {
+		id = notify->call_serial = (notify->call_serial + 1) & 0x7fffffff;
+		if (id == 0) continue;
+		if (ib_map_find_uint(&notify->calls, id) == NULL) break;
+	}
+
+	// keep order with messages batched before
+	if (node->batch_size > 0) {
+		async_notify_batch_flush(notify, node);
+	}
+
+	head = notify->data;
+	async_notify_header_write(head, ASYNC_NOTIFY_MSG_CALL, cmd);
+	iencode32u_lsb(head + 4, id);
+	x = async_notify_node_send(notify, node, head, 8, data, size);
+	async_notify_node_active(notify, hid, 1);
+
+	if (x < 0) {
+		ikmem_free(call);
+		ASYNC_NOTIFY_CRITICAL_END(notify);
+		return -1000 + x;
+	}
+
+	call->id = id;
+	call->hid = hid;
+	itimer_evt_init(&call->evt, async_notify_call_expire, call, notify);
+	ib_map_add(&notify->calls, (void*)((size_t)id), call, NULL);
+	ilist_add_tail(&call->node, &node->calls);
+
+	if (timeout > 0) {
+		itimer_evt_start(&notify->timer, &call->evt, timeout, 1);
+	}
+
+	hr = (long)id;
+
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+
+	return hr;
+}
+
+
+//---------------------------------------------------------------------
+// reply a call by the token from ASYNC_NOTIFY_EVT_CALL
+//---------------------------------------------------------------------
+int async_notify_reply(CAsyncNotify *notify, const void *token, short code,
+	const void *data, long size)
+{
+	CAsyncNode *node;
+	IUINT32 id, hid;
+	int hr = 0;
+
+	if (code < 0) return -5;
+
+	idecode32u_lsb((const char*)token + 0, &id);
+	idecode32u_lsb((const char*)token + 4, &hid);
+
+	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
+
+	node = async_notify_node_get(notify, (long)hid);
+
+	if (node == NULL || node->state != ASYNC_NOTIFY_STATE_LOGINED) {
+		hr = -1;
+	}	else {
+		char *head = notify->data;
+		long x;
+		async_notify_header_write(head, ASYNC_NOTIFY_MSG_REPLY, code);
+		iencode32u_lsb(head + 4, id);
+		x = async_notify_node_send(notify, node, head, 8, data, size);
+		if (x < 0) hr = -1000 + x;
+	}
+
+	ASYNC_NOTIFY_CRITICAL_END(notify);
+
+	return hr;
+}
+
+
 //---------------------------------------------------------------------
 // close server connection
 //---------------------------------------------------------------------
 int async_notify_close(CAsyncNotify *notify, int sid, int mode, int code)
 {
 	long hid = -1;
+	int link;
 	ASYNC_NOTIFY_CRITICAL_BEGIN(notify);
-	hid = async_notify_get(notify, mode, sid);
-	if (hid >= 0) {
-		async_core_close(notify->core, hid, code);
+	for (link = 0; link < ASYNC_NOTIFY_LINK_MAX; link++) {
+		hid = async_notify_link_get(notify, mode, sid, link);
+		if (hid >= 0) {
+			async_core_close(notify->core, hid, code);
+		}
 	}
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 	return 0;
@@ -1628,6 +2964,11 @@ static void async_notify_on_timer(CAsyncNotify *notify)
 				node->hid, x);
 		}
 	}
+#ifdef ASYNC_NOTIFY_SHM_ENABLE
+	if (!ilist_is_empty(&notify->shms)) {
+		async_notify_shm_expire(notify);
+	}
+#endif
 }
 
 
@@ -1721,6 +3062,54 @@ int async_notify_option(CAsyncNotify *notify, int type, long value)
 	case ASYNC_NOTIFY_OPT_GET_IN_COUNT:
 		hr = notify->count_in;
 		break;
+
+	case ASYNC_NOTIFY_OPT_LINK_COUNT:
+		if (value < 1) value = 1;
+		if (value > ASYNC_NOTIFY_LINK_MAX) value = ASYNC_NOTIFY_LINK_MAX;
+		notify->cfg.links = (int)value;
+		hr = 0;
+		break;
+
+	case ASYNC_NOTIFY_OPT_LINK_POLICY:
+		if (value >= ASYNC_NOTIFY_LINK_ROUND && 
+			value <= ASYNC_NOTIFY_LINK_AFFINITY) {
+			notify->cfg.link_policy = (int)value;
+			hr = 0;
+		}
+		break;
+
+	case ASYNC_NOTIFY_OPT_BATCH_LIMIT:
+		if (value < 0) value = 0;
+		if (value > ASYNC_NOTIFY_BATCH_MAX) value = ASYNC_NOTIFY_BATCH_MAX;
+		notify->cfg.batch_limit = value;
+		if (value == 0) {
+			while (!ilist_is_empty(&notify->batch)) {
+				node = ilist_entry(notify->batch.next, 
+						CAsyncNode, node_batch);
+				async_notify_batch_flush(notify, node);
+			}
+		}
+		hr = 0;
+		break;
+
+	case ASYNC_NOTIFY_OPT_BATCH_DELAY:
+		notify->cfg.batch_delay = (value < 0)? 0 : value;
+		hr = 0;
+		break;
+
+	case ASYNC_NOTIFY_OPT_SHM_SIZE:
+		if (value > 0) {
+			long size = ASYNC_NOTIFY_SHM_MIN;
+			while (size < value && size < ASYNC_NOTIFY_SHM_MAX) size *= 2;
+			value = size;
+		}
+	#ifdef ASYNC_NOTIFY_SHM_ENABLE
+		notify->cfg.shm_size = (value < 0)? 0 : value;
+		hr = 0;
+	#else
+		hr = (value > 0)? -1 : 0;
+	#endif
+		break;
 	}
 	ASYNC_NOTIFY_CRITICAL_END(notify);
 	return hr;
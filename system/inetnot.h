@@ -44,6 +44,8 @@ void async_notify_delete(CAsyncNotify *notify);
 #define ASYNC_NOTIFY_EVT_CLOSED_OUT		16	//  (wp=sid, lp=hid)
 #define ASYNC_NOTIFY_EVT_ERROR			32	//  (wp=sid, lp=why)
 #define ASYNC_NOTIFY_EVT_CORE			64
+#define ASYNC_NOTIFY_EVT_CALL			128	//  (wp=sid, lp=cmd)
+#define ASYNC_NOTIFY_EVT_RESULT			256	//  (wp=callid, lp=code)
 
 // wait events
 void async_notify_wait(CAsyncNotify *notify, IUINT32 millisec);
@@ -73,6 +75,26 @@ void async_notify_change(CAsyncNotify *notify, int new_server_id);
 int async_notify_send(CAsyncNotify *notify, int sid, short cmd, 
 	const void *data, long size);
 
+// flush batched messages for sid (all if sid < 0), returns batch count
+int async_notify_flush(CAsyncNotify *notify, int sid);
+
+// call server: returns call id (> 0) or error (< 0), the result comes
+// as ASYNC_NOTIFY_EVT_RESULT (wp=callid, lp=code): code is the reply 
+// code (>= 0), CALL_TIMEOUT when no reply within timeout millisecs
+// (0 for no deadline), or CALL_CLOSED when the connection is lost.
+long async_notify_call(CAsyncNotify *notify, int sid, short cmd, 
+	const void *data, long size, IUINT32 timeout);
+
+// reply a call: the data of ASYNC_NOTIFY_EVT_CALL starts with an 
+// ASYNC_NOTIFY_TOKEN_SIZE bytes token, followed by the request data.
+int async_notify_reply(CAsyncNotify *notify, const void *token, short code,
+	const void *data, long size);
+
+#define ASYNC_NOTIFY_TOKEN_SIZE		8
+
+#define ASYNC_NOTIFY_CALL_TIMEOUT	-1
+#define ASYNC_NOTIFY_CALL_CLOSED	-2
+
 // close server connection
 int async_notify_close(CAsyncNotify *notify, int sid, int mode, int code);
 
@@ -122,6 +144,39 @@ void async_notify_sid_clear(CAsyncNotify *notify);
 #define ASYNC_NOTIFY_OPT_GET_PING			12
 #define ASYNC_NOTIFY_OPT_GET_OUT_COUNT		13
 #define ASYNC_NOTIFY_OPT_GET_IN_COUNT		14
+#define ASYNC_NOTIFY_OPT_LINK_COUNT			15
+#define ASYNC_NOTIFY_OPT_LINK_POLICY		16
+#define ASYNC_NOTIFY_OPT_BATCH_LIMIT		17
+#define ASYNC_NOTIFY_OPT_BATCH_DELAY		18
+#define ASYNC_NOTIFY_OPT_SHM_SIZE			19
+
+// links per sid (OPT_LINK_COUNT, default 1): every peer must support 
+// links before it is raised. the policy picks the link for a message:
+// round-robin and least-queued (by async_core_remain) may reorder 
+// messages and use other links while one reconnects. affinity maps 
+// cmd to a fixed link and keeps per-cmd order, it moves to the next
+// link only when its own one can not be opened.
+#define ASYNC_NOTIFY_LINK_MAX		32
+#define ASYNC_NOTIFY_LINK_ROUND		0
+#define ASYNC_NOTIFY_LINK_LEAST		1
+#define ASYNC_NOTIFY_LINK_AFFINITY	2
+
+// batching (OPT_BATCH_LIMIT > 0, default 0): messages to the same link
+// are packed into one frame of at most BATCH_LIMIT bytes, which is 
+// sent when full, by async_notify_flush, or by async_notify_wait once
+// it is older than OPT_BATCH_DELAY microseconds (0: next wait). every
+// peer must support batching before it is enabled. 
+#define ASYNC_NOTIFY_BATCH_MAX		0x100000
+
+// shared memory (OPT_SHM_SIZE, linux only): out links to loopback 
+// addresses offer a ring pair of SHM_SIZE bytes per direction after
+// login, messages go through the rings once the peer accepts, and tcp
+// only carries pings and wake-ups. 0 disables it. offers only go to
+// peers advertising shm at login, one unanswered for a few seconds is
+// dropped and the link keeps using tcp.
+#define ASYNC_NOTIFY_SHM_DEFAULT	0x100000
+#define ASYNC_NOTIFY_SHM_MIN		0x10000
+#define ASYNC_NOTIFY_SHM_MAX		0x4000000
 
 #define ASYNC_NOTIFY_LOG_INFO		1
 #define ASYNC_NOTIFY_LOG_REJECT		2
@@ -36,6 +36,12 @@ void isim_transfer_init(iSimTransfer *trans, long rtt, long lost, long amb,
 	trans->cnt_send = 0;
 	trans->cnt_drop = 0;
 	trans->mode = mode;
+	trans->bandwidth = 0;
+	trans->queue = 0;
+	trans->busy = 0;
+	trans->remain = 0;
+	trans->random = NULL;
+	trans->user = NULL;
 	ilist_init(&trans->head);
 }
 
@@ -77,6 +83,10 @@ long isim_transfer_random(iSimTransfer *trans, long range)
 
 	if (range <= 0) return 0;
 
+	if (trans->random) {
+		return trans->random(trans->user, range);
+	}
+
 	seed = trans->seed;
 	value = (((seed = seed * 214013L + 2531011L) >> 16) & 0xffff);
 	trans->seed = seed;
@@ -110,6 +120,20 @@ long isim_transfer_send(iSimTransfer *trans, const void *data, long size)
 		}
 	}
 
+	// 瓶颈排队：队列超过最大排队时间则尾部丢弃
+	if (trans->bandwidth > 0) {
+		unsigned long start = trans->busy;
+		unsigned long cost;
+		if ((long)(start - trans->current) < 0) start = trans->current;
+		if ((long)(start - trans->current) > trans->queue) {
+			trans->cnt_drop++;
+			return -3;
+		}
+		cost = (unsigned long)size * 1000 + trans->remain;
+		trans->remain = cost % (unsigned long)trans->bandwidth;
+		trans->busy = start + cost / (unsigned long)trans->bandwidth;
+	}
+
 	// 分配新数据包
 	packet = (iSimPacket*)malloc(sizeof(iSimPacket) + size);
 	assert(packet);
@@ -127,6 +151,10 @@ long isim_transfer_send(iSimTransfer *trans, const void *data, long size)
 	if (wave < 0) feature = trans->current;
 	else feature = trans->current + wave;
 
+	if (trans->bandwidth > 0) {
+		feature = trans->busy + ((wave < 0)? 0 : wave);
+	}
+
 	packet->timestamp = feature;
 
 	// 按到达时间先后插入时间链表
@@ -186,6 +214,29 @@ long isim_transfer_recv(iSimTransfer *trans, void *data, long maxsize)
 }
 
 
+//---------------------------------------------------------------------
+// 单向链路：设置瓶颈带宽和最大排队时间
+//---------------------------------------------------------------------
+void isim_transfer_bandwidth(iSimTransfer *trans, long bandwidth, long queue)
+{
+	assert(trans);
+	trans->bandwidth = (bandwidth > 0)? bandwidth : 0;
+	trans->queue = (queue > 0)? queue : 0;
+	trans->busy = trans->current;
+	trans->remain = 0;
+}
+
+//---------------------------------------------------------------------
+// 单向链路：设置随机数源
+//---------------------------------------------------------------------
+void isim_transfer_source(iSimTransfer *trans, iSimRandom random, void *user)
+{
+	assert(trans);
+	trans->random = random;
+	trans->user = (random)? user : NULL;
+}
+
+
 //---------------------------------------------------------------------
 // isim_init:
 // 初始化网络模拟器
@@ -239,6 +290,16 @@ void isim_settime(iSimNet *simnet, unsigned long current)
 	isim_transfer_settime(&simnet->t2, current);
 }
 
+//---------------------------------------------------------------------
+// 设置双向瓶颈带宽和最大排队时间
+//---------------------------------------------------------------------
+void isim_bandwidth(iSimNet *simnet, long bandwidth, long queue)
+{
+	assert(simnet);
+	isim_transfer_bandwidth(&simnet->t1, bandwidth, queue);
+	isim_transfer_bandwidth(&simnet->t2, bandwidth, queue);
+}
+
 //---------------------------------------------------------------------
 // 发送数据
 //---------------------------------------------------------------------
@@ -276,3 +337,14 @@ void isim_seed(iSimNet *simnet, unsigned long seed1, unsigned long seed2)
 	simnet->t2.seed = seed2;
 }
 
+//---------------------------------------------------------------------
+// 设置随机数源
+//---------------------------------------------------------------------
+void isim_random(iSimNet *simnet, iSimRandom random, void *user1, 
+		void *user2)
+{
+	assert(simnet);
+	isim_transfer_source(&simnet->t1, random, user1);
+	isim_transfer_source(&simnet->t2, random, user2);
+}
+
@@ -107,6 +107,9 @@ struct ISIMPACKET
 
 typedef struct ISIMPACKET iSimPacket;
 
+// 随机数源：返回 0 <= x < range，如 isecure.h 中的 random_pcg_source
+typedef long (*iSimRandom)(void *user, long range);
+
 // 单向链路
 struct ISIMTRANSFER
 {
@@ -121,8 +124,13 @@ struct ISIMTRANSFER
 	int mode;						// 模式0(会前后到达)1(顺序到达)
 	long cnt_send;					// 发送了多少个包
 	long cnt_drop;					// 丢失了多少个包
+	long bandwidth;					// 瓶颈带宽(字节/秒，0为不限)
+	long queue;						// 瓶颈最大排队时间(毫秒)
+	unsigned long busy;				// 瓶颈空闲时间
+	unsigned long remain;			// 发送时间余数(字节*1000)
+	iSimRandom random;				// 随机数源(NULL为内置LCG)
+	void *user;						// 随机数源参数
 };
-
 typedef struct ISIMTRANSFER iSimTransfer;
 
 // 网络端点
@@ -173,6 +181,12 @@ long isim_transfer_send(iSimTransfer *trans, const void *data, long size);
 // 单向链路：接收数据
 long isim_transfer_recv(iSimTransfer *trans, void *data, long maxsize);
 
+// 单向链路：设置瓶颈带宽(字节/秒，0为不限)和最大排队时间(毫秒)
+void isim_transfer_bandwidth(iSimTransfer *trans, long bandwidth, long queue);
+
+// 单向链路：设置随机数源(NULL恢复内置LCG)
+void isim_transfer_source(iSimTransfer *trans, iSimRandom random, void *user);
+
 
 
 // isim_init:
@@ -195,6 +209,9 @@ void isim_destroy(iSimNet *simnet);
 // 设置时间
 void isim_settime(iSimNet *simnet, unsigned long current);
 
+// 设置双向瓶颈带宽(字节/秒，0为不限)和最大排队时间(毫秒)
+void isim_bandwidth(iSimNet *simnet, long bandwidth, long queue);
+
 
 // 发送数据
 long isim_send(iSimPeer *peer, const void *data, long size);
@@ -208,6 +225,11 @@ iSimPeer *isim_peer(iSimNet *simnet, int peerno);
 // 设置随机数种子
 void isim_seed(iSimNet *simnet, unsigned long seed1, unsigned long seed2);
 
+// 设置随机数源：两条链路各用一个生成器(user1, user2)，生成器状态
+// 由调用者维护，相同种子的生成器可以重现同样的模拟过程
+void isim_random(iSimNet *simnet, iSimRandom random, void *user1, 
+		void *user2);
+
 
 
 #ifdef __cplusplus
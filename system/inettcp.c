@@ -42,10 +42,13 @@ const IUINT32 ITCP_BLOCKING_RETRY = 250;
 const IUINT8 ITCP_FLAG_CTL = 0x02;
 const IUINT8 ITCP_FLAG_RST = 0x04;
 const IUINT8 ITCP_FLAG_ECR = 0x08;
+const IUINT8 ITCP_FLAG_SACK = 0x10;
 
 const IUINT8 ITCP_CTL_CONNECT = 0;
 const IUINT8 ITCP_CTL_EXTRA = 255;
 
+const IUINT8 ITCP_CAP_SACK = 0x01;
+
 const IUINT32 ITCP_DEF_TIMEOUT = 0x4000;
 const IUINT32 ITCP_CLOSED_TIMEOUT = 60 * 1000;
 
@@ -174,7 +177,7 @@ itcpcb *itcp_create(IUINT32 conv, const void *user)
 	tcp->rlen = 0;
 	tcp->snd_una = 0;
 	tcp->snd_nxt = 0;
-	tcp->snd_wnd = 1;
+	tcp->snd_wnd = 2;			// room for the connect control
 	tcp->slen = 0;
 	tcp->be_readable = 1;
 	tcp->be_writeable = 0;
@@ -198,6 +201,8 @@ itcpcb *itcp_create(IUINT32 conv, const void *user)
 
 	tcp->dup_acks = 0;
 	tcp->recover = 0;
+	tcp->sack = 1;
+	tcp->sack_ok = 0;
 	tcp->ts_recent = 0;
 	tcp->ts_lastack = 0;
 	tcp->ts_acklocal = 0;
@@ -214,6 +219,8 @@ itcpcb *itcp_create(IUINT32 conv, const void *user)
 
 	tcp->logmask = 0;
 	tcp->id = 0;
+	tcp->cc = NULL;
+	tcp->pace_timer = 0;
 
 	ilist_init(&tcp->slist);
 	ilist_init(&tcp->rlist);
@@ -285,6 +292,10 @@ void itcp_release(itcpcb *tcp)
 		itcp_free(tcp->errmsg);
 		tcp->errmsg = NULL;
 	}
+	if (tcp->cc != NULL) {
+		itcp_free(tcp->cc);
+		tcp->cc = NULL;
+	}
 	memset(tcp, 0, sizeof(itcpcb));
 	itcp_free(tcp);
 }
@@ -317,6 +328,12 @@ int itcp_check(itcpcb *tcp)
 		ntimeout = _imin(ntimeout,
 			itimediff(tcp->last_send + tcp->rx_rto, now));
 	}
+	if (tcp->rack_timer) {
+		ntimeout = _imin(ntimeout, itimediff(tcp->rack_timer, now));
+	}
+	if (tcp->pace_timer) {
+		ntimeout = _imin(ntimeout, itimediff(tcp->pace_timer, now));
+	}
 	if (tcp->keepalive && tcp->state == ITCP_ESTAB) {
 		IUINT32 timeout = tcp->be_outgoing ? 
 			ITCP_IDLE_PING * 3 / 2 : ITCP_IDLE_PING;
@@ -408,6 +425,32 @@ void itcp_log_segout(itcpcb *tcp, ISEGOUT *seg)
 // TCP CORE: OUTPUT
 //=====================================================================
 
+//---------------------------------------------------------------------
+// build sack blocks from out-of-order list, returns block count
+//---------------------------------------------------------------------
+static int itcp_sack_build(itcpcb *tcp, IUINT32 *sack, int limit)
+{
+	ilist_head *it;
+	int nsack = 0;
+	for (it = tcp->rlist.next; it != &tcp->rlist && nsack < limit; ) {
+		ISEGIN *segin = ilist_entry(it, ISEGIN, head);
+		IUINT32 left = segin->seq;
+		IUINT32 right = segin->seq + segin->len;
+		for (it = it->next; it != &tcp->rlist; it = it->next) {
+			segin = ilist_entry(it, ISEGIN, head);
+			if (segin->seq > right) break;
+			if (segin->seq + segin->len > right) 
+				right = segin->seq + segin->len;
+		}
+		if (right <= tcp->rcv_nxt) continue;
+		sack[nsack * 2 + 0] = _imax(left, tcp->rcv_nxt);
+		sack[nsack * 2 + 1] = right;
+		nsack++;
+	}
+	return nsack;
+}
+
+
 //---------------------------------------------------------------------
 // make up PDU(protocol data unit) and output to lower level protocol
 //---------------------------------------------------------------------
@@ -418,6 +461,7 @@ static int itcp_output(itcpcb *tcp, IUINT32 seq, IUINT32 flags,
 	IUINT32 current = tcp->current;
 	IUINT32 wnd, ack;
 	int retval = IOUTPUT_FAILED;
+	int size;
 
 	wnd = tcp->rcv_wnd;
 	ack = tcp->rcv_nxt;
@@ -446,8 +490,27 @@ static int itcp_output(itcpcb *tcp, IUINT32 seq, IUINT32 flags,
 		}
 	}
 
+	size = IHEADER_SIZE + len;
+
+	// append sack blocks as trailer: [blocks n*8][n]
+	if (tcp->sack_ok && !ilist_is_empty(&tcp->rlist)) {
+		IUINT32 sack[ITCP_SACK_MAX * 2];
+		int room = ((int)tcp->mtu - size - 1) / 8;
+		int nsack = itcp_sack_build(tcp, sack, _imin(room, ITCP_SACK_MAX));
+		if (nsack > 0) {
+			char *ptr = buffer + size;
+			int i;
+			for (i = 0; i < nsack * 2; i++, ptr += 4) {
+				iencode32u_msb(ptr, sack[i]);
+			}
+			ptr[0] = (char)nsack;
+			size += nsack * 8 + 1;
+			buffer[13] = (unsigned char)(flags | ITCP_FLAG_SACK);
+		}
+	}
+
 	if (tcp->output) {
-		retval = tcp->output(buffer, IHEADER_SIZE + len, tcp, tcp->user);
+		retval = tcp->output(buffer, size, tcp, tcp->user);
 	}
 
 	if (retval != IOUTPUT_OK) {
@@ -499,6 +562,9 @@ static long itcp_send_queue(itcpcb *tcp, const char *data, int len, int ctl)
 		node->len = len;
 		node->bctl = (unsigned short)ctl;
 		node->xmit = 0;
+		node->ts = 0;
+		node->sacked = 0;
+		node->lost = 0;
 		ilist_add_tail(&node->head, &tcp->slist);
 	}
 	if (len > 0) {
@@ -515,6 +581,18 @@ static long itcp_send_queue(itcpcb *tcp, const char *data, int len, int ctl)
 }
 
 
+//---------------------------------------------------------------------
+// queue connect control with capabilities
+//---------------------------------------------------------------------
+static void itcp_send_connect(itcpcb *tcp)
+{
+	char buffer[2];
+	buffer[0] = ITCP_CTL_CONNECT;
+	buffer[1] = (char)(tcp->sack ? ITCP_CAP_SACK : 0);
+	itcp_send_queue(tcp, buffer, 2, 1);
+}
+
+
 //---------------------------------------------------------------------
 // send a given segment
 //---------------------------------------------------------------------
@@ -583,6 +661,7 @@ static int itcp_send_seg(itcpcb *tcp, ISEGOUT *seg)
 			}
 			tcp->mss = tcp->mtu - IPACKET_OVERHEAD;
 			tcp->cwnd = tcp->mss * 2;
+			if (tcp->cc) icc_set_mss(tcp->cc, tcp->mss);
 
 			if (tcp->mss < ntransmit) {
 				ntransmit = tcp->mss;
@@ -607,6 +686,9 @@ static int itcp_send_seg(itcpcb *tcp, ISEGOUT *seg)
 		subseg->len = seg->len - ntransmit;
 		subseg->bctl = seg->bctl;
 		subseg->xmit = seg->xmit;
+		subseg->ts = seg->ts;
+		subseg->sacked = seg->sacked;
+		subseg->lost = seg->lost;
 		seg->len = ntransmit;
 		ilist_add(&subseg->head, &seg->head);
 	}
@@ -614,9 +696,17 @@ static int itcp_send_seg(itcpcb *tcp, ISEGOUT *seg)
 	if (seg->xmit == 0) {
 		//ASSERT(tcp->snd_nxt == seg->seq);
 		tcp->snd_nxt += seg->len;
+	}	else {
+		tcp->cnt_retrans++;
+	}
+
+	if (seg->lost) {
+		tcp->lost_bytes -= seg->len;
+		seg->lost = 0;
 	}
 
 	seg->xmit += 1;
+	seg->ts = tcp->current;
 	if (tcp->rto_base == 0) {
 		tcp->rto_base = tcp->current;
 	}
@@ -625,6 +715,45 @@ static int itcp_send_seg(itcpcb *tcp, ISEGOUT *seg)
 }
 
 
+//---------------------------------------------------------------------
+// bytes still in the network: inflight minus sacked and lost
+//---------------------------------------------------------------------
+static IUINT32 itcp_sack_pipe(const itcpcb *tcp)
+{
+	IUINT32 inflight = tcp->snd_nxt - tcp->snd_una;
+	IUINT32 gone = tcp->sack_bytes + tcp->lost_bytes;
+	return (inflight > gone)? (inflight - gone) : 0;
+}
+
+
+//---------------------------------------------------------------------
+// retransmit segments marked lost while pipe allows
+//---------------------------------------------------------------------
+static int itcp_sack_retrans(itcpcb *tcp)
+{
+	ilist_head *it;
+	for (it = tcp->slist.next; it != &tcp->slist; ) {
+		ISEGOUT *seg = ilist_entry(it, ISEGOUT, head);
+		int retval;
+		if (seg->xmit == 0) break;
+		if (seg->lost == 0 || seg->sacked) {
+			it = it->next;
+			continue;
+		}
+		if (itcp_sack_pipe(tcp) >= tcp->cwnd) break;
+		retval = itcp_send_seg(tcp, seg);
+		if (retval == ITR_FAILED) return -1;
+		if (retval == ITR_WAIT) break;
+		if (tcp->logmask & ILOG_ACK) {
+			itcp_log(tcp, ILOG_ACK, "[%d] sack retrans seq=%u len=%u",
+				tcp->id, seg->seq, seg->len);
+		}
+		it = seg->head.next;
+	}
+	return 0;
+}
+
+
 //---------------------------------------------------------------------
 // send new data
 //---------------------------------------------------------------------
@@ -634,14 +763,21 @@ static void itcp_send_newdata(itcpcb *tcp, int sflag)
 	int retval = 0;
 
 	if (itimediff(current, tcp->last_send) > (long)tcp->rx_rto) {
-		tcp->cwnd = tcp->mss * 1;
+		if (tcp->cc == NULL) tcp->cwnd = tcp->mss * 1;
 	}
 
+	tcp->pace_timer = 0;
+
 	if (tcp->logmask & ILOG_DEBUG) {
 		itcp_log(tcp, ILOG_DEBUG, 
 			"-------------------------- BEGIN --------------------------");
 	}
 
+	// retransmit segments marked lost by sack/rack first
+	if (tcp->sack_ok && tcp->lost_bytes > 0) {
+		itcp_sack_retrans(tcp);
+	}
+
 	while (1) {
 		IUINT32 cwnd, nwin, ninflight, nuseable, navailiable;
 		ilist_head *node;
@@ -654,6 +790,12 @@ static void itcp_send_newdata(itcpcb *tcp, int sflag)
 		nwin = _imin(cwnd, tcp->snd_wnd);
 		ninflight = tcp->snd_nxt - tcp->snd_una;
 		nuseable = (ninflight < nwin) ? (nwin - ninflight) : 0;
+		if (tcp->sack_ok) {
+			IUINT32 npipe = itcp_sack_pipe(tcp);
+			nuseable = (npipe < cwnd) ? (cwnd - npipe) : 0;
+			if (ninflight >= tcp->snd_wnd) nuseable = 0;
+			else nuseable = _imin(nuseable, tcp->snd_wnd - ninflight);
+		}
 		navailiable = _imin(tcp->slen - ninflight, tcp->mss);
 
 		if (navailiable > nuseable) {
@@ -664,6 +806,15 @@ static void itcp_send_newdata(itcpcb *tcp, int sflag)
 			}
 		}
 
+		if (navailiable > 0 && tcp->cc != NULL) {
+			IUINT32 need = navailiable + IPACKET_OVERHEAD;
+			if (icc_pacing_send(tcp->cc, current, need) == 0) {
+				IUINT32 delay = icc_pacing_delay(tcp->cc, current);
+				tcp->pace_timer = current + _imax(delay, 1);
+				navailiable = 0;
+			}
+		}
+
 		if ((tcp->logmask & ILOG_WINDOW) && (tcp->logmask & ILOG_PACKET)) {
 			itcp_log(tcp, ILOG_WINDOW, 
 			"[%d] [cwnd:%u nwin:%d fly:%d avai:%d que:%d free:%d ssth:%d]",
@@ -704,6 +855,9 @@ static void itcp_send_newdata(itcpcb *tcp, int sflag)
 			subseg->len = seg->len - navailiable;
 			subseg->bctl = seg->bctl;
 			subseg->xmit = 0;
+			subseg->ts = 0;
+			subseg->sacked = 0;
+			subseg->lost = 0;
 			seg->len = navailiable;
 			ilist_add(&subseg->head, node);
 		}
@@ -745,6 +899,27 @@ static void itcp_adjust_mtu(itcpcb *tcp)
 	tcp->mss = tcp->mtu - IPACKET_OVERHEAD;
 	tcp->ssthresh = _imax(tcp->ssthresh, 8 * tcp->mss);
 	tcp->cwnd = _imax(tcp->cwnd, tcp->mss);
+	if (tcp->cc) {
+		icc_set_mss(tcp->cc, tcp->mss);
+		tcp->cwnd = icc_cwnd(tcp->cc);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// window reduction on loss (timeout: rto instead of fast retransmit)
+//---------------------------------------------------------------------
+static void itcp_cc_loss(itcpcb *tcp, int timeout)
+{
+	IUINT32 inflight = tcp->snd_nxt - tcp->snd_una;
+	if (tcp->cc) {
+		icc_on_loss(tcp->cc, tcp->current, inflight, timeout);
+		tcp->ssthresh = tcp->cc->ssthresh;
+		tcp->cwnd = icc_cwnd(tcp->cc);
+	}	else {
+		tcp->ssthresh = _imax(inflight / 2, 2 * tcp->mss);
+		tcp->cwnd = timeout? tcp->mss : tcp->ssthresh;
+	}
 }
 
 
@@ -814,6 +989,158 @@ static int itcp_rtt_update(itcpcb *tcp, long rtt)
 }
 
 
+//---------------------------------------------------------------------
+// rack: remember the most recently sent segment that got delivered
+//---------------------------------------------------------------------
+static void itcp_rack_update(itcpcb *tcp, const ISEGOUT *seg)
+{
+	long rtt;
+	if (seg->xmit == 0) return;
+	rtt = itimediff(tcp->current, seg->ts);
+	if (rtt < 0) rtt = 0;
+	// acked faster than min rtt: the original arrived, loss was spurious
+	if (seg->xmit > 1 && tcp->rack_ok && rtt < (long)tcp->rack_minrtt) {
+		tcp->rack_reord = 1;
+		if (tcp->rack_mult < 8) tcp->rack_mult++;
+		return;
+	}
+	if (seg->xmit == 1) {
+		if (tcp->rack_ok == 0 || rtt < (long)tcp->rack_minrtt) {
+			tcp->rack_minrtt = rtt;
+		}
+		// delivered behind a later segment without retransmission
+		if (tcp->rack_ok && seg->seq + seg->len < tcp->rack_end) {
+			tcp->rack_reord = 1;
+		}
+	}
+	if (tcp->rack_ok == 0 || itimediff(seg->ts, tcp->rack_ts) > 0 ||
+		(seg->ts == tcp->rack_ts && seg->seq + seg->len > tcp->rack_end)) {
+		tcp->rack_ts = seg->ts;
+		tcp->rack_end = seg->seq + seg->len;
+		tcp->rack_rtt = rtt;
+		tcp->rack_ok = 1;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// mark segments covered by incoming sack blocks
+//---------------------------------------------------------------------
+static void itcp_sack_update(itcpcb *tcp, const ISEGMENT *seg)
+{
+	IUINT32 i;
+	for (i = 0; i < seg->nsack; i++) {
+		IUINT32 left = seg->sack[i * 2 + 0];
+		IUINT32 right = seg->sack[i * 2 + 1];
+		ilist_head *it;
+		if (left >= right || left < tcp->snd_una || right > tcp->snd_nxt) {
+			continue;
+		}
+		for (it = tcp->slist.next; it != &tcp->slist; it = it->next) {
+			ISEGOUT *segout = ilist_entry(it, ISEGOUT, head);
+			if (segout->seq >= right || segout->xmit == 0) break;
+			if (segout->sacked || segout->seq < left) continue;
+			if (segout->seq + segout->len > right) break;
+			segout->sacked = 1;
+			tcp->sack_bytes += segout->len;
+			if (segout->lost) {
+				segout->lost = 0;
+				tcp->lost_bytes -= segout->len;
+			}
+			itcp_rack_update(tcp, segout);
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------
+// rack: time based loss detection, returns count of new lost segments
+//---------------------------------------------------------------------
+static int itcp_rack_detect(itcpcb *tcp)
+{
+	IUINT32 now = tcp->current;
+	long reo_wnd, timeout = 0;
+	ilist_head *it;
+	int count = 0;
+
+	tcp->rack_timer = 0;
+	if (tcp->rack_ok == 0) return 0;
+
+	// reordering window: zero once dupthresh segments are sacked on a
+	// link without reordering, otherwise a quarter of min rtt per step
+	if (tcp->rack_reord == 0 && tcp->sack_bytes >= 3 * tcp->mss) {
+		reo_wnd = 0;
+	}	else {
+		reo_wnd = (tcp->rack_minrtt / 4) * (tcp->rack_mult + 1);
+		if (tcp->rx_srtt > 0) reo_wnd = _imin(reo_wnd, tcp->rx_srtt);
+		reo_wnd = _imax(reo_wnd, 1);
+	}
+
+	for (it = tcp->slist.next; it != &tcp->slist; it = it->next) {
+		ISEGOUT *seg = ilist_entry(it, ISEGOUT, head);
+		long remain;
+		if (seg->xmit == 0) break;
+		if (seg->sacked || seg->lost) continue;
+		if (itimediff(seg->ts, tcp->rack_ts) > 0) continue;
+		if (seg->ts == tcp->rack_ts && 
+			seg->seq + seg->len >= tcp->rack_end) continue;
+		remain = itimediff(seg->ts + tcp->rack_rtt + reo_wnd, now);
+		if (remain <= 0) {
+			seg->lost = 1;
+			tcp->lost_bytes += seg->len;
+			count++;
+		}
+		else if (timeout == 0 || remain < timeout) {
+			timeout = remain;
+		}
+	}
+
+	if (timeout > 0) {
+		tcp->rack_timer = now + timeout;
+	}
+
+	if (count > 0 && tcp->rack_recovery == 0) {
+		itcp_cc_loss(tcp, 0);
+		tcp->recover = tcp->snd_nxt;
+		tcp->rack_recovery = 1;
+		if (tcp->logmask & ILOG_WINDOW) {
+			itcp_log(tcp, ILOG_WINDOW, "[%d] enter sack recovery lost=%u",
+				tcp->id, tcp->lost_bytes);
+		}
+	}
+
+	return count;
+}
+
+
+//---------------------------------------------------------------------
+// feed congestion control: bytes newly cumulatively acked or sacked
+//---------------------------------------------------------------------
+static void itcp_cc_ack(itcpcb *tcp, const ISEGMENT *seg, IUINT32 una, 
+	IUINT32 delivered)
+{
+	IUINT32 now = tcp->current;
+	IUINT32 total = tcp->snd_una + tcp->sack_bytes;
+	struct ICCSAMPLE sample;
+
+	if (itimediff(total, delivered) <= 0) return;
+
+	sample.now = now;
+	sample.acked = total - delivered;
+	sample.inflight = tcp->snd_nxt - tcp->snd_una - tcp->sack_bytes;
+	sample.rtt = -1;
+	if (tcp->snd_una != una && seg->tsecr) {
+		sample.rtt = (IINT32)itimediff(now, seg->tsecr);
+	}
+	sample.recovery = (tcp->dup_acks >= 3 || tcp->rack_recovery);
+	icc_on_ack(tcp->cc, &sample);
+
+	if (tcp->dup_acks < 3) {
+		tcp->cwnd = icc_cwnd(tcp->cc);
+	}
+}
+
+
 //---------------------------------------------------------------------
 // update ack
 //---------------------------------------------------------------------
@@ -821,7 +1148,6 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 {
 	IUINT32 now = tcp->current;
 	ISEGOUT *segout;
-	int inflight;
 
 	// check if this is a valueable ack
 	if (seg->ack > tcp->snd_una && seg->ack <= tcp->snd_nxt) {
@@ -859,6 +1185,8 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 			ASSERT(!ilist_is_empty(&tcp->slist));
 			segout = ilist_entry(tcp->slist.next, ISEGOUT, head);
 			if (nfree < segout->len) {
+				if (segout->sacked) tcp->sack_bytes -= nfree;
+				if (segout->lost) tcp->lost_bytes -= nfree;
 				segout->len -= nfree;
 				segout->seq += nfree;		// important fixed
 				nfree = 0;
@@ -866,6 +1194,9 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 				if (segout->len > tcp->largest) {
 					tcp->largest = segout->len;
 				}
+				if (segout->sacked) tcp->sack_bytes -= segout->len;
+				else if (tcp->sack_ok) itcp_rack_update(tcp, segout);
+				if (segout->lost) tcp->lost_bytes -= segout->len;
 				nfree -= segout->len;
 				ilist_del(&segout->head);
 				itcp_del_segout(tcp, segout);
@@ -876,6 +1207,7 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 			if (tcp->snd_una >= tcp->recover) {
 				IUINT32 inflight = tcp->snd_nxt - tcp->snd_una;
 				tcp->cwnd = _imin(inflight + tcp->mss, tcp->ssthresh);
+				if (tcp->cc) tcp->cwnd = icc_cwnd(tcp->cc);
 				tcp->dup_acks = 0;
 				if (tcp->logmask & ILOG_WINDOW) {
 					itcp_log(tcp, ILOG_WINDOW, "[%d] exit recovery",
@@ -896,6 +1228,18 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 				vv = tcp->mss - _imin(nacked, tcp->cwnd);
 				if (vv > 0) tcp->cwnd += tcp->mss - _imin(nacked, tcp->cwnd);
 			}
+		}
+		else if (tcp->rack_recovery) {
+			if (tcp->snd_una >= tcp->recover) {
+				tcp->rack_recovery = 0;
+				if (tcp->logmask & ILOG_WINDOW) {
+					itcp_log(tcp, ILOG_WINDOW, "[%d] exit sack recovery",
+						tcp->id);
+				}
+			}
+		}	
+		else if (tcp->cc) {
+			tcp->dup_acks = 0;
 		}	else {
 			tcp->dup_acks = 0;
 			if (tcp->cwnd < tcp->ssthresh) {
@@ -926,6 +1270,9 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 		if (seg->len > 0) {
 			// dup ack
 		}	
+		else if (tcp->sack_ok) {
+			// loss detection is driven by sack blocks and rack
+		}
 		else if (tcp->snd_una != tcp->snd_nxt) {
 			tcp->dup_acks += 1;
 			if (tcp->dup_acks == 3) {
@@ -942,9 +1289,8 @@ static int itcp_ack_update(itcpcb *tcp, ISEGMENT *seg, int bconnect)
 					}
 				}
 				tcp->recover = tcp->snd_nxt;
-				inflight = tcp->snd_nxt - tcp->snd_una;
-				tcp->ssthresh = _imax(inflight / 2, 2 * tcp->mss);
-				tcp->cwnd = tcp->ssthresh + 3 * tcp->mss;
+				itcp_cc_loss(tcp, 0);
+				tcp->cwnd = tcp->cwnd + 3 * tcp->mss;
 			}	
 			else if (tcp->dup_acks > 3) {
 				tcp->cwnd += tcp->mss;
@@ -990,6 +1336,7 @@ void itcp_slist(itcpcb *tcp)
 int itcp_process(itcpcb *tcp, ISEGMENT *seg)
 {
 	IUINT32 now = tcp->current;
+	IUINT32 una, delivered;
 	ISEGIN *segin = 0;
 	int bconnect = 0;
 	int adjust = 0;
@@ -1029,13 +1376,16 @@ int itcp_process(itcpcb *tcp, ISEGMENT *seg)
 			return -4;
 		}	else if (seg->data[0] == ITCP_CTL_CONNECT) {
 			bconnect = 1;
+			if (seg->len >= 2 && (seg->data[1] & ITCP_CAP_SACK)) {
+				tcp->sack_ok = tcp->sack;
+			}	else {
+				tcp->sack_ok = 0;
+			}
 			if (tcp->state == ITCP_LISTEN) {
-				char buffer[1];
 				tcp->state = ITCP_SYN_RECV;
 				itcp_log(tcp, ILOG_STATE, 
 					"[%d] state: TCP_SYN_RECV", tcp->id);
-				buffer[0] = ITCP_CTL_CONNECT;
-				itcp_send_queue(tcp, buffer, 1, 1);
+				itcp_send_connect(tcp);
 			}	
 			else if (tcp->state == ITCP_SYN_SENT) {
 				tcp->state = ITCP_ESTAB;
@@ -1060,11 +1410,25 @@ int itcp_process(itcpcb *tcp, ISEGMENT *seg)
 	}
 
 	// update acknowledge
+	una = tcp->snd_una;
+	delivered = tcp->snd_una + tcp->sack_bytes;
 	retval = itcp_ack_update(tcp, seg, bconnect);
 
 	if (retval != 0) 
 		return retval;
 
+	// selective ack and time based loss detection
+	if (tcp->sack_ok) {
+		if (seg->nsack > 0) {
+			itcp_sack_update(tcp, seg);
+		}
+		itcp_rack_detect(tcp);
+	}
+
+	if (tcp->cc) {
+		itcp_cc_ack(tcp, seg, una, delivered);
+	}
+
 	sflag = ISFLAG_NONE;
 
 #if 1
@@ -1194,6 +1558,23 @@ int itcp_input(itcpcb *tcp, const char *data, long size)
 	idecode32u_msb(data + 20, &seg.tsecr);
 	seg.data = (char*)(data + 24);
 	seg.len = size - IHEADER_SIZE;
+	seg.nsack = 0;
+
+	// sack trailer: [blocks n*8][n]
+	if (seg.flags & ITCP_FLAG_SACK) {
+		const char *ptr;
+		IUINT32 i;
+		if (seg.len < 1) return -1;
+		seg.nsack = (IUINT8)data[size - 1];
+		if (seg.nsack > ITCP_SACK_MAX || seg.len < seg.nsack * 8 + 1) {
+			return -1;
+		}
+		seg.len -= seg.nsack * 8 + 1;
+		ptr = seg.data + seg.len;
+		for (i = 0; i < seg.nsack * 2; i++, ptr += 4) {
+			idecode32u_msb(ptr, &seg.sack[i]);
+		}
+	}
 
 	if (tcp->logmask & ILOG_PACKET) {
 		itcp_log(tcp, ILOG_PACKET, 
@@ -1217,14 +1598,12 @@ int itcp_input(itcpcb *tcp, const char *data, long size)
 //---------------------------------------------------------------------
 int itcp_connect(itcpcb *tcp)
 {
-	char buffer[1];
 	if (tcp->state != ITCP_LISTEN) {
 		tcp->errcode = IEINVAL;
 		return -1;
 	}
 	tcp->state = ITCP_SYN_SENT;
-	buffer[0] = ITCP_CTL_CONNECT;
-	itcp_send_queue(tcp, buffer, 1, 1);
+	itcp_send_connect(tcp);
 	itcp_send_newdata(tcp, ISFLAG_NONE);
 	return 0;
 }
@@ -1378,9 +1757,22 @@ void itcp_update(itcpcb *tcp, IUINT32 millisec)
 				return;
 			}
 			if (result == ITR_OK) {
-				IUINT32 inflight = tcp->snd_nxt - tcp->snd_una;
-				tcp->ssthresh = _imax(inflight / 2, tcp->mss * 2);
-				tcp->cwnd = tcp->mss;
+				itcp_cc_loss(tcp, 1);
+				if (tcp->sack_ok) {
+					ilist_head *it;
+					for (it = seg->head.next; it != &tcp->slist; ) {
+						ISEGOUT *lseg = ilist_entry(it, ISEGOUT, head);
+						if (lseg->xmit == 0) break;
+						if (lseg->sacked == 0 && lseg->lost == 0) {
+							lseg->lost = 1;
+							tcp->lost_bytes += lseg->len;
+						}
+						it = it->next;
+					}
+					tcp->recover = tcp->snd_nxt;
+					tcp->rack_recovery = 0;
+					tcp->rack_timer = 0;
+				}
 			}
 			rto_limit = ITCP_MAX_RTO;
 			if (result == ITR_WAIT || tcp->state < ITCP_ESTAB) 
@@ -1395,6 +1787,19 @@ void itcp_update(itcpcb *tcp, IUINT32 millisec)
 		}
 	}
 
+	// paced data
+	if (tcp->pace_timer && itimediff(tcp->pace_timer, now) <= 0) {
+		tcp->pace_timer = 0;
+		itcp_send_newdata(tcp, ISFLAG_NONE);
+	}
+
+	// rack reordering timer
+	if (tcp->rack_timer && itimediff(tcp->rack_timer, now) <= 0) {
+		if (itcp_rack_detect(tcp) > 0) {
+			itcp_send_newdata(tcp, ISFLAG_NONE);
+		}
+	}
+
 	// probe window
 	if (tcp->snd_wnd == 0) {
 		if (itimediff(tcp->last_send + tcp->rx_rto, now) <= 0) {
@@ -1458,6 +1863,43 @@ void itcp_option(itcpcb *tcp, int nodelay, int keepalive)
 }
 
 
+//---------------------------------------------------------------------
+// enable/disable selective ack (must be set before connecting)
+//---------------------------------------------------------------------
+void itcp_setsack(itcpcb *tcp, int enable)
+{
+	tcp->sack = enable? 1 : 0;
+	if (tcp->sack == 0) tcp->sack_ok = 0;
+}
+
+
+//---------------------------------------------------------------------
+// select congestion control algorithm
+//---------------------------------------------------------------------
+int itcp_setcc(itcpcb *tcp, const struct ICCOPS *ops)
+{
+	if (ops == NULL) {
+		if (tcp->cc) {
+			itcp_free(tcp->cc);
+			tcp->cc = NULL;
+		}
+		// builtin reno restarts from the initial window
+		tcp->cwnd = 2 * tcp->mss;
+		tcp->ssthresh = ITCP_DEF_BUFSIZE;
+		tcp->pace_timer = 0;
+		return 0;
+	}
+	if (tcp->cc == NULL) {
+		tcp->cc = (struct ICCSTATE*)itcp_malloc(sizeof(struct ICCSTATE));
+		if (tcp->cc == NULL) return -1;
+	}
+	icc_init(tcp->cc, ops, tcp->mss);
+	tcp->cwnd = icc_cwnd(tcp->cc);
+	tcp->ssthresh = tcp->cc->ssthresh;
+	return 0;
+}
+
+
 //---------------------------------------------------------------------
 // how many bytes can write to send buffer
 //---------------------------------------------------------------------
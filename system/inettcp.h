@@ -15,6 +15,7 @@
 #include <assert.h>
 
 #include "imemdata.h"
+#include "inetcc.h"
 
 
 //=====================================================================
@@ -66,6 +67,8 @@ typedef unsigned char IUINT8;
 
 #define ITCP_CIRCLE
 
+#define ITCP_SACK_MAX	4
+
 
 #ifndef ASSERT
 #define ASSERT(x) assert((x))
@@ -82,6 +85,8 @@ struct ISEGMENT
 	IUINT32 tsval, tsecr;
 	IUINT32 len;
 	char *data;
+	IUINT32 nsack;
+	IUINT32 sack[ITCP_SACK_MAX * 2];
 };
 
 //---------------------------------------------------------------------
@@ -94,6 +99,9 @@ struct ISEGOUT
 	IUINT32 len;
 	IUINT16 xmit;
 	IUINT16 bctl;
+	IUINT32 ts;
+	IUINT16 sacked;
+	IUINT16 lost;
 };
 
 //---------------------------------------------------------------------
@@ -156,6 +164,16 @@ struct ITCPCB
 	IUINT32 recover;
 	IUINT32 t_ack;
 
+	int sack, sack_ok;
+	IUINT32 sack_bytes, lost_bytes;
+	IUINT32 rack_ts, rack_end, rack_rtt, rack_minrtt;
+	IUINT32 rack_timer;
+	int rack_ok, rack_reord, rack_recovery, rack_mult;
+	IUINT32 cnt_retrans;
+
+	struct ICCSTATE *cc;
+	IUINT32 pace_timer;
+
 	void *user;
 	void *extra;
 	int errcode, logmask, id;
@@ -201,6 +219,13 @@ long itcp_canwrite(const itcpcb *tcp);
 
 void itcp_option(itcpcb *tcp, int nodelay, int keepalive);
 
+// enable/disable selective ack (must be set before connecting)
+void itcp_setsack(itcpcb *tcp, int enable);
+
+// congestion control: NULL for the built-in one, or &icc_newreno,
+// &icc_cubic, &icc_bbr
+int itcp_setcc(itcpcb *tcp, const struct ICCOPS *ops);
+
 
 
 #ifdef __cplusplus
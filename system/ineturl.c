@@ -36,6 +36,7 @@ IHTTPSOCK *ihttpsock_new(struct IMEMNODE *nodes)
 	}
 	ims_init(&httpsock->sendmsg, nodes, 0, 0);
 	ims_init(&httpsock->recvmsg, nodes, 0, 0);
+	ilist_init(&httpsock->files);
 	httpsock->proxy_type = ISOCKPROXY_TYPE_NONE;
 	httpsock->proxy_user = NULL;
 	httpsock->proxy_pass = NULL;
@@ -56,6 +57,7 @@ void ihttpsock_delete(IHTTPSOCK *httpsock)
 	httpsock->proxy = NULL;
 	ims_destroy(&httpsock->sendmsg);
 	ims_destroy(&httpsock->recvmsg);
+	async_file_clear(&httpsock->files);
 	if (httpsock->proxy_user) ikmem_free(httpsock->proxy_user);
 	if (httpsock->proxy_pass) ikmem_free(httpsock->proxy_pass);
 	httpsock->proxy_user = NULL;
@@ -77,6 +79,7 @@ int ihttpsock_connect(IHTTPSOCK *httpsock, const struct sockaddr *remote)
 	}
 	ims_clear(&httpsock->sendmsg);
 	ims_clear(&httpsock->recvmsg);
+	async_file_clear(&httpsock->files);
 	httpsock->sock = socket(AF_INET, SOCK_STREAM, 0);
 	if (httpsock->sock < 0) return -2;
 	isocket_enable(httpsock->sock, ISOCK_NOBLOCK);
@@ -137,6 +140,7 @@ int ihttpsock_assign(IHTTPSOCK *httpsock, int sock)
 	}
 	ims_clear(&httpsock->sendmsg);
 	ims_clear(&httpsock->recvmsg);
+	async_file_clear(&httpsock->files);
 	httpsock->sock = sock;
 	if (httpsock->sock < 0) return -2;
 	isocket_enable(httpsock->sock, ISOCK_NOBLOCK);
@@ -180,32 +184,17 @@ static void ihttpsock_try_connect(IHTTPSOCK *httpsock)
 	}
 }
 
-// try sending
+// try sending: sendmsg and file segments are flushed in order
 static void ihttpsock_try_send(IHTTPSOCK *httpsock)
 {
-	void *ptr;
-	char *flat;
-	long size;
-	int retval;
+	int error = 0;
 
 	if (httpsock->state != IHTTPSOCK_STATE_CONNECTED) return;
 
-	while (1) {
-		size = ims_flat(&httpsock->sendmsg, &ptr);
-		if (size <= 0) break;
-		flat = (char*)ptr;
-		retval = isend(httpsock->sock, flat, size, 0);
-		if (retval < 0) {
-			retval = ierrno();
-			if (retval == IEAGAIN) retval = 0;
-			else {
-				retval = -1;
-				ihttpsock_close(httpsock);
-				httpsock->error = retval;
-				break;
-			}
-		}
-		ims_drop(&httpsock->sendmsg, retval);
+	if (async_file_flush(httpsock->sock, &httpsock->sendmsg, 
+		&httpsock->files, &error) != 0) {
+		ihttpsock_close(httpsock);
+		httpsock->error = error;
 	}
 }
 
@@ -290,6 +279,7 @@ long ihttpsock_send(IHTTPSOCK *httpsock, const void *data, long size)
 {
 	if (httpsock->state == IHTTPSOCK_STATE_CLOSED) {
 		ims_clear(&httpsock->sendmsg);
+		async_file_clear(&httpsock->files);
 		return -1;
 	}
 
@@ -298,6 +288,23 @@ long ihttpsock_send(IHTTPSOCK *httpsock, const void *data, long size)
 	return 0;
 }
 
+// send file segment
+long ihttpsock_send_file(IHTTPSOCK *httpsock, int fd, IINT64 offset,
+	IINT64 length)
+{
+	if (httpsock->state == IHTTPSOCK_STATE_CLOSED) {
+		ims_clear(&httpsock->sendmsg);
+		async_file_clear(&httpsock->files);
+		return -1;
+	}
+
+	if (async_file_queue(&httpsock->files, &httpsock->sendmsg, fd,
+		offset, length, NULL, -1, -1, NULL) != 0) 
+		return -2;
+
+	return 0;
+}
+
 // poll socket
 int ihttpsock_poll(IHTTPSOCK *httpsock, int event, int millsec)
 {
@@ -308,8 +315,14 @@ int ihttpsock_poll(IHTTPSOCK *httpsock, int event, int millsec)
 // get data size in send buffer (nbytes of data which hasn't been sent)
 long ihttpsock_dsize(const IHTTPSOCK *httpsock)
 {
+	IINT64 size;
 	assert(httpsock);
-	return ims_dsize(&httpsock->sendmsg);
+	size = ims_dsize(&httpsock->sendmsg);
+	if (!ilist_is_empty(&httpsock->files)) {
+		size += async_file_remain(&httpsock->files);
+		if (size > 0x7fffffff) size = 0x7fffffff;
+	}
+	return (long)size;
 }
 
 // change buffer size
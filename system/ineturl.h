@@ -45,6 +45,7 @@ struct IHTTPSOCK
 	struct sockaddr remote;
 	struct IMSTREAM sendmsg;
 	struct IMSTREAM recvmsg;
+	struct ILISTHEAD files;
 };
 
 typedef struct IHTTPSOCK IHTTPSOCK;
@@ -88,6 +89,11 @@ long ihttpsock_recv(IHTTPSOCK *httpsock, void *data, long size);
 // send data
 long ihttpsock_send(IHTTPSOCK *httpsock, const void *data, long size);
 
+// send length bytes of file fd from offset after queued data, by 
+// sendfile when possible. fd is duplicated, returns 0 for success
+long ihttpsock_send_file(IHTTPSOCK *httpsock, int fd, IINT64 offset,
+	IINT64 length);
+
 // poll socket
 int ihttpsock_poll(IHTTPSOCK *httpsock, int event, int millsec);
 
@@ -1052,6 +1052,487 @@ int iposix_file_save_content(const char *filename, const void *data, long size)
 
 
 
+/*-------------------------------------------------------------------*/
+/* Memory Mapped File                                                */
+/*-------------------------------------------------------------------*/
+#ifdef __unix
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+static char iposix_mmap_empty[8];
+
+/* map a whole file */
+iposix_mmap_t *iposix_mmap_open(const char *path, int mode, IINT64 size)
+{
+	iposix_mmap_t *map;
+	int writable = (mode == IPOSIX_MMAP_READ)? 0 : 1;
+
+	map = (iposix_mmap_t*)malloc(sizeof(iposix_mmap_t));
+	if (map == NULL) return NULL;
+
+	map->data = NULL;
+	map->size = 0;
+	map->mode = mode;
+	map->fd = -1;
+	map->handle = NULL;
+	map->file = NULL;
+
+#ifdef __unix
+	{
+		struct stat st;
+		int flags = writable? O_RDWR : O_RDONLY;
+		void *ptr;
+		if (mode == IPOSIX_MMAP_CREATE) flags |= O_CREAT;
+	#ifdef O_CLOEXEC
+		flags |= O_CLOEXEC;
+	#endif
+		map->fd = open(path, flags, 0644);
+		if (map->fd < 0) {
+			free(map);
+			return NULL;
+		}
+		if (mode == IPOSIX_MMAP_CREATE) {
+			if (size < 0 || ftruncate(map->fd, (off_t)size) != 0) {
+				close(map->fd);
+				free(map);
+				return NULL;
+			}
+		}
+		if (fstat(map->fd, &st) != 0 || (IINT64)((size_t)st.st_size) 
+			!= (IINT64)st.st_size) {
+			close(map->fd);
+			free(map);
+			return NULL;
+		}
+		map->size = (IINT64)st.st_size;
+		if (map->size == 0) {
+			map->data = iposix_mmap_empty;
+			return map;
+		}
+		ptr = mmap(NULL, (size_t)map->size, 
+			writable? (PROT_READ | PROT_WRITE) : PROT_READ, 
+			MAP_SHARED, map->fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(map->fd);
+			free(map);
+			return NULL;
+		}
+		map->data = (char*)ptr;
+	}
+#else
+	{
+		DWORD access = writable? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+		DWORD create = (mode == IPOSIX_MMAP_CREATE)? OPEN_ALWAYS : OPEN_EXISTING;
+		LARGE_INTEGER fsize;
+		HANDLE hfile, hmap;
+		void *ptr;
+		hfile = CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, create, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hfile == INVALID_HANDLE_VALUE) {
+			free(map);
+			return NULL;
+		}
+		if (mode == IPOSIX_MMAP_CREATE) {
+			fsize.QuadPart = size;
+			if (size < 0 || SetFilePointerEx(hfile, fsize, NULL, 
+				FILE_BEGIN) == 0 || SetEndOfFile(hfile) == 0) {
+				CloseHandle(hfile);
+				free(map);
+				return NULL;
+			}
+		}
+		if (GetFileSizeEx(hfile, &fsize) == 0 || 
+			(IINT64)((size_t)fsize.QuadPart) != (IINT64)fsize.QuadPart) {
+			CloseHandle(hfile);
+			free(map);
+			return NULL;
+		}
+		map->size = (IINT64)fsize.QuadPart;
+		map->file = (void*)hfile;
+		if (map->size == 0) {
+			map->data = iposix_mmap_empty;
+			return map;
+		}
+		hmap = CreateFileMappingA(hfile, NULL, 
+			writable? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+		if (hmap == NULL) {
+			CloseHandle(hfile);
+			free(map);
+			return NULL;
+		}
+		ptr = MapViewOfFile(hmap, writable? FILE_MAP_WRITE : FILE_MAP_READ,
+			0, 0, 0);
+		if (ptr == NULL) {
+			CloseHandle(hmap);
+			CloseHandle(hfile);
+			free(map);
+			return NULL;
+		}
+		map->handle = (void*)hmap;
+		map->data = (char*)ptr;
+	}
+#endif
+
+	return map;
+}
+
+/* unmap and close */
+void iposix_mmap_close(iposix_mmap_t *map)
+{
+	if (map == NULL) return;
+#ifdef __unix
+	if (map->data != NULL && map->data != iposix_mmap_empty) {
+		munmap(map->data, (size_t)map->size);
+	}
+	if (map->fd >= 0) close(map->fd);
+#else
+	if (map->data != NULL && map->data != iposix_mmap_empty) {
+		UnmapViewOfFile(map->data);
+	}
+	if (map->handle) CloseHandle((HANDLE)map->handle);
+	if (map->file) CloseHandle((HANDLE)map->file);
+#endif
+	map->data = NULL;
+	map->fd = -1;
+	map->handle = NULL;
+	map->file = NULL;
+	free(map);
+}
+
+/* access pattern hint */
+int iposix_mmap_advise(iposix_mmap_t *map, IINT64 offset, IINT64 size, 
+		int advice)
+{
+	if (map == NULL || offset < 0 || offset > map->size) return -1;
+	if (size <= 0 || offset + size > map->size) size = map->size - offset;
+	if (size == 0 || map->data == iposix_mmap_empty) return 0;
+#if defined(__unix) && defined(MADV_NORMAL)
+	{
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t start = (size_t)offset & ~(page - 1);
+		size_t length = (size_t)(offset + size) - start;
+		int how = MADV_NORMAL;
+		switch (advice) {
+		case IPOSIX_MADV_SEQUENTIAL: how = MADV_SEQUENTIAL; break;
+		case IPOSIX_MADV_RANDOM: how = MADV_RANDOM; break;
+		case IPOSIX_MADV_WILLNEED: how = MADV_WILLNEED; break;
+		case IPOSIX_MADV_DONTNEED: how = MADV_DONTNEED; break;
+		}
+		return madvise(map->data + start, length, how);
+	}
+#else
+	return 0;
+#endif
+}
+
+/* write dirty pages back */
+int iposix_mmap_sync(iposix_mmap_t *map, int async)
+{
+	if (map == NULL) return -1;
+	if (map->mode == IPOSIX_MMAP_READ) return 0;
+	if (map->size == 0 || map->data == iposix_mmap_empty) return 0;
+#ifdef __unix
+	return msync(map->data, (size_t)map->size, async? MS_ASYNC : MS_SYNC);
+#else
+	if (FlushViewOfFile(map->data, 0) == 0) return -1;
+	if (async == 0 && FlushFileBuffers((HANDLE)map->file) == 0) return -1;
+	return 0;
+#endif
+}
+
+
+
+/*-------------------------------------------------------------------*/
+/* Buffered File Stream                                              */
+/*-------------------------------------------------------------------*/
+#ifdef _WIN32
+#include <fcntl.h>
+#define iposix_fd_open		_open
+#define iposix_fd_close		_close
+#define iposix_fd_read(fd, p, n)	_read(fd, p, (unsigned int)(n))
+#define iposix_fd_write(fd, p, n)	_write(fd, p, (unsigned int)(n))
+#define iposix_fd_seek		_lseeki64
+#else
+#define iposix_fd_open		open
+#define iposix_fd_close		close
+#define iposix_fd_read(fd, p, n)	read(fd, p, (size_t)(n))
+#define iposix_fd_write(fd, p, n)	write(fd, p, (size_t)(n))
+#define iposix_fd_seek		lseek
+#endif
+
+/* open stream */
+iposix_fstream_t *iposix_fstream_open(const char *path, int mode, 
+		long bufsize)
+{
+	iposix_fstream_t *fs;
+	int direct = (mode & IPOSIX_FSTREAM_DIRECT)? 1 : 0;
+	int flags;
+#if defined(__APPLE__) && defined(F_NOCACHE)
+	int nocache = direct;
+#endif
+
+	mode &= ~IPOSIX_FSTREAM_DIRECT;
+	if (mode < IPOSIX_FSTREAM_READ || mode > IPOSIX_FSTREAM_APPEND) 
+		return NULL;
+
+	if (bufsize <= 0) bufsize = IPOSIX_FSTREAM_BUFSIZE;
+	bufsize = (bufsize + IPOSIX_FSTREAM_ALIGN - 1) & 
+		~((long)IPOSIX_FSTREAM_ALIGN - 1);
+
+	fs = (iposix_fstream_t*)malloc(sizeof(iposix_fstream_t));
+	if (fs == NULL) return NULL;
+
+	fs->origin = (char*)malloc(bufsize + IPOSIX_FSTREAM_ALIGN);
+	if (fs->origin == NULL) {
+		free(fs);
+		return NULL;
+	}
+
+	fs->buffer = (char*)(((size_t)fs->origin + IPOSIX_FSTREAM_ALIGN - 1) &
+		~((size_t)IPOSIX_FSTREAM_ALIGN - 1));
+
+	switch (mode) {
+	case IPOSIX_FSTREAM_READ: flags = O_RDONLY; break;
+	case IPOSIX_FSTREAM_WRITE: flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+	default: flags = O_WRONLY | O_CREAT; break;
+	}
+
+#ifdef _WIN32
+	flags |= _O_BINARY;
+#endif
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC;
+#endif
+#ifndef O_DIRECT
+	if (direct) direct = 0;
+#endif
+
+	fs->fd = -1;
+
+#ifdef O_DIRECT
+	if (direct) {
+		fs->fd = iposix_fd_open(path, flags | O_DIRECT, 0644);
+		if (fs->fd < 0) direct = 0;
+	}
+#endif
+
+	if (fs->fd < 0) {
+		fs->fd = iposix_fd_open(path, flags, 0644);
+	}
+
+	if (fs->fd < 0) {
+		free(fs->origin);
+		free(fs);
+		return NULL;
+	}
+
+#if defined(__APPLE__) && defined(F_NOCACHE)
+	if (nocache) fcntl(fs->fd, F_NOCACHE, 1);
+#endif
+
+	fs->mode = mode;
+	fs->direct = direct;
+	fs->eof = 0;
+	fs->error = 0;
+	fs->bufsize = bufsize;
+	fs->pos = 0;
+	fs->end = 0;
+	fs->offset = 0;
+
+	if (mode == IPOSIX_FSTREAM_APPEND) {
+		IINT64 end = (IINT64)iposix_fd_seek(fs->fd, 0, SEEK_END);
+		fs->offset = (end < 0)? 0 : end;
+		if (direct && (fs->offset & (IPOSIX_FSTREAM_ALIGN - 1))) {
+			/* unaligned file end: O_DIRECT can't append there */
+			iposix_fstream_close(fs);
+			return iposix_fstream_open(path, mode, bufsize);
+		}
+	}
+
+	return fs;
+}
+
+/* write all bytes of ptr */
+static int iposix_fstream_put(iposix_fstream_t *fs, const char *ptr,
+		long size)
+{
+	while (size > 0) {
+		long hr = (long)iposix_fd_write(fs->fd, ptr, size);
+		if (hr <= 0) {
+			fs->error = 1;
+			return -1;
+		}
+		ptr += hr;
+		size -= hr;
+	}
+	return 0;
+}
+
+/* write buffered data, final for the unaligned tail of direct streams */
+static int iposix_fstream_drain(iposix_fstream_t *fs, int final)
+{
+	long size = fs->pos;
+	if (fs->mode == IPOSIX_FSTREAM_READ || size == 0) return 0;
+	if (fs->direct) {
+		size &= ~((long)IPOSIX_FSTREAM_ALIGN - 1);
+	}
+	if (size > 0) {
+		if (iposix_fstream_put(fs, fs->buffer, size) != 0) return -1;
+		fs->offset += size;
+		fs->pos -= size;
+		if (fs->pos > 0) {
+			memmove(fs->buffer, fs->buffer + size, fs->pos);
+		}
+	}
+	if (fs->pos > 0 && final) {
+	#if defined(O_DIRECT) && defined(F_SETFL) && defined(F_GETFL)
+		int flags = fcntl(fs->fd, F_GETFL);
+		fcntl(fs->fd, F_SETFL, flags & ~O_DIRECT);
+	#endif
+		fs->direct = 0;
+		if (iposix_fstream_put(fs, fs->buffer, fs->pos) != 0) return -1;
+		fs->offset += fs->pos;
+		fs->pos = 0;
+	}
+	return 0;
+}
+
+/* flush and close */
+int iposix_fstream_close(iposix_fstream_t *fs)
+{
+	int hr = 0;
+	if (fs == NULL) return -1;
+	if (iposix_fstream_drain(fs, 1) != 0) hr = -1;
+	if (fs->error) hr = -1;
+	if (fs->fd >= 0) iposix_fd_close(fs->fd);
+	free(fs->origin);
+	free(fs);
+	return hr;
+}
+
+/* refill read buffer */
+static long iposix_fstream_fill(iposix_fstream_t *fs)
+{
+	long hr;
+	if (fs->mode != IPOSIX_FSTREAM_READ || fs->error) return -1;
+	if (fs->eof) return 0;
+	fs->offset += fs->end;
+	fs->pos = 0;
+	fs->end = 0;
+	/* direct reads: whole aligned blocks, a short one is the end */
+	hr = (long)iposix_fd_read(fs->fd, fs->buffer, fs->bufsize);
+	if (hr < 0) {
+		fs->error = 1;
+		return -1;
+	}
+	if (hr == 0) fs->eof = 1;
+	fs->end = hr;
+	return hr;
+}
+
+/* read data */
+long iposix_fstream_read(iposix_fstream_t *fs, void *ptr, long size)
+{
+	char *lptr = (char*)ptr;
+	long total = 0;
+	while (size > 0) {
+		long canread = fs->end - fs->pos;
+		if (canread <= 0) {
+			/* large reads go straight into the user buffer */
+			if (size >= fs->bufsize && fs->direct == 0 && 
+				fs->mode == IPOSIX_FSTREAM_READ && !fs->eof) {
+				long hr = (long)iposix_fd_read(fs->fd, lptr, size);
+				if (hr < 0) {
+					fs->error = 1;
+					return total > 0? total : -1;
+				}
+				if (hr == 0) {
+					fs->eof = 1;
+					break;
+				}
+				fs->offset += hr;
+				lptr += hr;
+				size -= hr;
+				total += hr;
+				continue;
+			}
+			canread = iposix_fstream_fill(fs);
+			if (canread < 0) return total > 0? total : -1;
+			if (canread == 0) break;
+		}
+		if (canread > size) canread = size;
+		memcpy(lptr, fs->buffer + fs->pos, canread);
+		fs->pos += canread;
+		lptr += canread;
+		size -= canread;
+		total += canread;
+	}
+	return total;
+}
+
+/* zero copy read */
+long iposix_fstream_peek(iposix_fstream_t *fs, const char **ptr)
+{
+	long size = fs->end - fs->pos;
+	if (size <= 0) {
+		size = iposix_fstream_fill(fs);
+		if (size <= 0) return size;
+	}
+	if (ptr) ptr[0] = fs->buffer + fs->pos;
+	return size;
+}
+
+/* consume peeked data */
+void iposix_fstream_skip(iposix_fstream_t *fs, long size)
+{
+	long canskip = fs->end - fs->pos;
+	if (size > canskip) size = canskip;
+	if (size > 0) fs->pos += size;
+}
+
+/* write data */
+long iposix_fstream_write(iposix_fstream_t *fs, const void *ptr, long size)
+{
+	const char *lptr = (const char*)ptr;
+	long total = size;
+	if (fs->mode == IPOSIX_FSTREAM_READ || fs->error) return -1;
+	while (size > 0) {
+		long canwrite = fs->bufsize - fs->pos;
+		/* large writes bypass the buffer when nothing is held */
+		if (fs->pos == 0 && size >= fs->bufsize && fs->direct == 0) {
+			if (iposix_fstream_put(fs, lptr, size) != 0) return -1;
+			fs->offset += size;
+			break;
+		}
+		if (canwrite > size) canwrite = size;
+		memcpy(fs->buffer + fs->pos, lptr, canwrite);
+		fs->pos += canwrite;
+		lptr += canwrite;
+		size -= canwrite;
+		if (fs->pos >= fs->bufsize) {
+			if (iposix_fstream_drain(fs, 0) != 0) return -1;
+		}
+	}
+	return total;
+}
+
+/* write buffered data */
+int iposix_fstream_flush(iposix_fstream_t *fs)
+{
+	if (fs->mode == IPOSIX_FSTREAM_READ) return 0;
+	if (fs->error) return -1;
+	return iposix_fstream_drain(fs, 0);
+}
+
+/* current stream position */
+IINT64 iposix_fstream_tell(const iposix_fstream_t *fs)
+{
+	return fs->offset + fs->pos;
+}
+
+
+
 #endif
 
 
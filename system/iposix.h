@@ -386,6 +386,108 @@ int iposix_get_proc_pathname(char *ptr, int size);
 
 
 
+//---------------------------------------------------------------------
+// Memory Mapped File
+//---------------------------------------------------------------------
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+
+#define IPOSIX_MMAP_READ		0		// read-only
+#define IPOSIX_MMAP_WRITE		1		// read-write, changes go to file
+#define IPOSIX_MMAP_CREATE		2		// read-write, create or resize
+
+#define IPOSIX_MADV_NORMAL		0
+#define IPOSIX_MADV_SEQUENTIAL	1		// read ahead aggressively
+#define IPOSIX_MADV_RANDOM		2		// no read ahead
+#define IPOSIX_MADV_WILLNEED	3		// prefetch now
+#define IPOSIX_MADV_DONTNEED	4		// pages can be dropped
+
+struct IPOSIX_MMAP
+{
+	char *data;						// mapped content
+	IINT64 size;					// file size
+	int mode;						// IPOSIX_MMAP_*
+	int fd;
+	void *handle;					// file mapping handle (win32)
+	void *file;						// file handle (win32)
+};
+
+typedef struct IPOSIX_MMAP iposix_mmap_t;
+
+// map a whole file, size is the new file size for IPOSIX_MMAP_CREATE
+// (ignored otherwise). empty files map to a zero length valid pointer.
+// returns NULL for error
+iposix_mmap_t *iposix_mmap_open(const char *path, int mode, IINT64 size);
+
+// unmap and close
+void iposix_mmap_close(iposix_mmap_t *map);
+
+// access pattern hint for range, size <= 0 for to the end
+int iposix_mmap_advise(iposix_mmap_t *map, IINT64 offset, IINT64 size, 
+		int advice);
+
+// write dirty pages back, async for not waiting
+int iposix_mmap_sync(iposix_mmap_t *map, int async);
+
+
+//---------------------------------------------------------------------
+// Buffered File Stream
+//---------------------------------------------------------------------
+#define IPOSIX_FSTREAM_READ		0		// read
+#define IPOSIX_FSTREAM_WRITE	1		// create or truncate, write
+#define IPOSIX_FSTREAM_APPEND	2		// create, write at end
+#define IPOSIX_FSTREAM_DIRECT	8		// bypass page cache (O_DIRECT)
+
+#define IPOSIX_FSTREAM_ALIGN	4096	// buffer / block alignment
+#define IPOSIX_FSTREAM_BUFSIZE	0x100000
+
+struct IPOSIX_FSTREAM
+{
+	int fd;
+	int mode;
+	int direct;						// O_DIRECT (or F_NOCACHE) active
+	int eof;
+	int error;
+	char *buffer;					// aligned to IPOSIX_FSTREAM_ALIGN
+	char *origin;					// allocated pointer of buffer
+	long bufsize;					// multiple of IPOSIX_FSTREAM_ALIGN
+	long pos;						// read: next byte, write: bytes held
+	long end;						// read: bytes in buffer
+	IINT64 offset;					// file offset of buffer[0]
+};
+
+typedef struct IPOSIX_FSTREAM iposix_fstream_t;
+
+// open stream, bufsize <= 0 for IPOSIX_FSTREAM_BUFSIZE, mode can be 
+// or'ed with IPOSIX_FSTREAM_DIRECT (ignored where not supported)
+iposix_fstream_t *iposix_fstream_open(const char *path, int mode, 
+		long bufsize);
+
+// flush and close, returns 0 for success, -1 if any write failed
+int iposix_fstream_close(iposix_fstream_t *fs);
+
+// read up to size bytes, returns bytes read, 0 for eof, -1 for error
+long iposix_fstream_read(iposix_fstream_t *fs, void *ptr, long size);
+
+// zero copy read: points *ptr to buffered data (refilled when empty),
+// returns its size, 0 for eof, -1 for error. iposix_fstream_skip 
+// consumes bytes of it
+long iposix_fstream_peek(iposix_fstream_t *fs, const char **ptr);
+void iposix_fstream_skip(iposix_fstream_t *fs, long size);
+
+// write data, returns size for success, -1 for error
+long iposix_fstream_write(iposix_fstream_t *fs, const void *ptr, long size);
+
+// write buffered data to the file, direct streams keep the unaligned 
+// tail until close. returns 0 for success, -1 for error
+int iposix_fstream_flush(iposix_fstream_t *fs);
+
+// current stream position
+IINT64 iposix_fstream_tell(const iposix_fstream_t *fs);
+
+#endif
+
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,8 +10,13 @@
 //
 //=====================================================================
 #include "isecure.h"
+#include "imembase.h"
 #include <stdlib.h>
 
+#ifdef ICPU_X86
+#include <immintrin.h>
+#endif
+
 
 //=====================================================================
 // INLINE
@@ -324,19 +329,32 @@ void HASH_MD5_Update(HASH_MD5_CTX *ctx, const void *input, unsigned int len)
 	ctx->i[0] += ((IUINT32)inLen << 3);
 	ctx->i[1] += ((IUINT32)inLen >> 29);
 
-	while (inLen--)
+	while (inLen > 0)
 	{
-		/* Add new character to buffer, increment mdi */
-		ctx->in[mdi++] = *inBuf++;
+		const unsigned char *block = inBuf;
+		unsigned int size = 0x40;
+
+		/* Whole blocks are taken straight from input */
+		if (mdi > 0 || inLen < 0x40)
+		{
+			size = 0x40 - mdi;
+			if (size > inLen) size = inLen;
+			memcpy(ctx->in + mdi, inBuf, size);
+			mdi += size;
+			block = ctx->in;
+		}
+
+		inBuf += size;
+		inLen -= size;
 
 		/* Transform if necessary */
-		if (mdi == 0x40)
+		if (block != ctx->in || mdi == 0x40)
 		{
 			for (i = 0, ii = 0; i < 16; i++, ii += 4)
-				in[i] = (((IUINT32)ctx->in[ii+3]) << 24) |
-					(((IUINT32)ctx->in[ii+2]) << 16) |
-					(((IUINT32)ctx->in[ii+1]) << 8) |
-					((IUINT32)ctx->in[ii]);
+				in[i] = (((IUINT32)block[ii+3]) << 24) |
+					(((IUINT32)block[ii+2]) << 16) |
+					(((IUINT32)block[ii+1]) << 8) |
+					((IUINT32)block[ii]);
 
 			HASH_MD5_Transform (ctx->buf, in);
 			mdi = 0;
@@ -387,12 +405,8 @@ void HASH_MD5_Final(HASH_MD5_CTX *ctx, unsigned char digest[16])
 
 /* SHA1_BLK0() and SHA1_BLK() perform the initial expand. */
 /* I got the idea of expanding during the round function from SSLeay */
-#if !IWORDS_BIG_ENDIAN
-#define SHA1_BLK0(i) (block->l[i] = (SHA1_ROL(block->l[i],24)&0xFF00FF00) \
-    |(SHA1_ROL(block->l[i],8)&0x00FF00FF))
-#else
+/* the block is loaded as big-endian words on every byte order */
 #define SHA1_BLK0(i) block->l[i]
-#endif
 #define SHA1_BLK(i) (block->l[i&15] = SHA1_ROL(block->l[(i+13)&15]^block->l[(i+8)&15] \
     ^block->l[(i+2)&15]^block->l[i&15],1))
 
@@ -418,9 +432,8 @@ void HASH_SHA1_Transform(IUINT32 state[5], const unsigned char buffer[64])
 		b = buffer[(e << 2) + 1];
 		c = buffer[(e << 2) + 2];
 		d = buffer[(e << 2) + 3];
-		block->l[e] = a | (b << 8) | (c << 16) | (d << 24);
+		block->l[e] = (a << 24) | (b << 16) | (c << 8) | d;
 	}
-    block = (CHAR64LONG16*)buffer;
     /* Copy ctx->state[] to working vars */
     a = state[0];
     b = state[1];
@@ -461,6 +474,109 @@ void HASH_SHA1_Transform(IUINT32 state[5], const unsigned char buffer[64])
 }
 
 
+#ifdef ICPU_X86
+
+/* 4 rounds with sha-ni: e for them in ea, next abcd copy goes to eb */
+#define SHA1_NI_ROUNDS(ea, eb, m0, m1, m2, m3, f) do { \
+		ea = _mm_sha1nexte_epu32(ea, m0); eb = abcd; \
+		m1 = _mm_sha1msg2_epu32(m1, m0); \
+		abcd = _mm_sha1rnds4_epu32(abcd, ea, f); \
+		m3 = _mm_sha1msg1_epu32(m3, m0); \
+		m2 = _mm_xor_si128(m2, m0); \
+	}	while (0)
+
+/* Hash blocks with sha-ni (sha + sse4.1) */
+ICPU_TARGET("sha,sse4.1")
+static void HASH_SHA1_Blocks_NI(IUINT32 state[5], const unsigned char *data,
+	size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 
+		0x08090a0b0c0d0e0fULL);
+	__m128i abcd, e0, e1, abcd_save, e_save, m0, m1, m2, m3;
+
+	abcd = _mm_loadu_si128((const __m128i*)state);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for (; blocks > 0; blocks--, data += 64) {
+		abcd_save = abcd;
+		e_save = e0;
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), mask);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)),
+				mask);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)),
+				mask);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)),
+				mask);
+		/* rounds 0-15: the schedule starts */
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+		SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 0);
+		/* rounds 16-67 */
+		SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 0);
+		SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 1);
+		SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 1);
+		SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 1);
+		SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 1);
+		SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 2);
+		SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 2);
+		SHA1_NI_ROUNDS(e1, e0, m1, m2, m3, m0, 2);
+		SHA1_NI_ROUNDS(e0, e1, m2, m3, m0, m1, 2);
+		SHA1_NI_ROUNDS(e1, e0, m3, m0, m1, m2, 3);
+		SHA1_NI_ROUNDS(e0, e1, m0, m1, m2, m3, 3);
+		/* rounds 68-79: the schedule ends */
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		m2 = _mm_sha1msg2_epu32(m2, m1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		m3 = _mm_xor_si128(m3, m1);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		m3 = _mm_sha1msg2_epu32(m3, m2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		e0 = _mm_sha1nexte_epu32(e0, e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i*)state, abcd);
+	state[4] = (IUINT32)_mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+/* Hash whole blocks, with sha-ni when present */
+static void HASH_SHA1_Blocks(IUINT32 state[5], const unsigned char *data,
+	size_t blocks)
+{
+#ifdef ICPU_X86
+	int need = ICPU_SHA | ICPU_SSE41 | ICPU_SSSE3;
+	if ((icpu_features() & need) == need) {
+		HASH_SHA1_Blocks_NI(state, data, blocks);
+		return;
+	}
+#endif
+	for (; blocks > 0; blocks--, data += 64) {
+		HASH_SHA1_Transform(state, data);
+	}
+}
+
+
 /* HASH_SHA1_Init - Initialize new ctx */
 void HASH_SHA1_Init(HASH_SHA1_CTX* ctx)
 {
@@ -485,8 +601,9 @@ void HASH_SHA1_Update(HASH_SHA1_CTX* ctx, const void *input, unsigned int len)
     if ((j + len) > 63) {
         memcpy(&ctx->buffer[j], data, (i = 64-j));
         HASH_SHA1_Transform(ctx->state, ctx->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            HASH_SHA1_Transform(ctx->state, &data[i]);
+        if (i + 63 < len) {
+            HASH_SHA1_Blocks(ctx->state, &data[i], (len - i) >> 6);
+            i += (len - i) & ~63u;
         }
         j = 0;
     }
@@ -524,6 +641,534 @@ void HASH_SHA1_Final(HASH_SHA1_CTX* ctx, unsigned char digest[20])
 
 
 
+//=====================================================================
+// SHA256 (FIPS 180-4)
+//=====================================================================
+static const IUINT32 HASH_SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* Hash a single 512-bit block */
+static void HASH_SHA256_Transform(IUINT32 state[8], const unsigned char *data)
+{
+	IUINT32 w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+	for (i = 0; i < 16; i++, data += 4) {
+		w[i] = ((IUINT32)data[0] << 24) | ((IUINT32)data[1] << 16) |
+			((IUINT32)data[2] << 8) | ((IUINT32)data[3]);
+	}
+	for (i = 16; i < 64; i++) {
+		IUINT32 s0 = SHA256_ROR(w[i - 15], 7) ^ SHA256_ROR(w[i - 15], 18) ^
+			(w[i - 15] >> 3);
+		IUINT32 s1 = SHA256_ROR(w[i - 2], 17) ^ SHA256_ROR(w[i - 2], 19) ^
+			(w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+		t1 = h + (SHA256_ROR(e, 6) ^ SHA256_ROR(e, 11) ^ SHA256_ROR(e, 25)) +
+			(g ^ (e & (f ^ g))) + HASH_SHA256_K[i] + w[i];
+		t2 = (SHA256_ROR(a, 2) ^ SHA256_ROR(a, 13) ^ SHA256_ROR(a, 22)) +
+			((a & b) | (c & (a | b)));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#ifdef ICPU_X86
+
+/* 4 rounds with sha-ni, k is the index of the first round */
+#define SHA256_NI_ROUNDS(m, k) do { \
+		msg = _mm_add_epi32(m, \
+			_mm_loadu_si128((const __m128i*)(HASH_SHA256_K + (k)))); \
+		s1 = _mm_sha256rnds2_epu32(s1, s0, msg); \
+		msg = _mm_shuffle_epi32(msg, 0x0e); \
+		s0 = _mm_sha256rnds2_epu32(s0, s1, msg); \
+	}	while (0)
+
+/* next schedule words: mn from mp and m (after the first 2 rnds2) */
+#define SHA256_NI_SCHEDULE(m, mp, mn, k) do { \
+		msg = _mm_add_epi32(m, \
+			_mm_loadu_si128((const __m128i*)(HASH_SHA256_K + (k)))); \
+		s1 = _mm_sha256rnds2_epu32(s1, s0, msg); \
+		mn = _mm_add_epi32(mn, _mm_alignr_epi8(m, mp, 4)); \
+		mn = _mm_sha256msg2_epu32(mn, m); \
+		msg = _mm_shuffle_epi32(msg, 0x0e); \
+		s0 = _mm_sha256rnds2_epu32(s0, s1, msg); \
+	}	while (0)
+
+/* Hash blocks with sha-ni (sha + sse4.1) */
+ICPU_TARGET("sha,sse4.1")
+static void HASH_SHA256_Blocks_NI(IUINT32 state[8], 
+	const unsigned char *data, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 
+		0x0405060700010203ULL);
+	__m128i s0, s1, t, msg, save0, save1, m0, m1, m2, m3;
+
+	t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xb1);
+	s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 
+			0x1b);
+	s0 = _mm_alignr_epi8(t, s1, 8);			/* abef */
+	s1 = _mm_blend_epi16(s1, t, 0xf0);		/* cdgh */
+
+	for (; blocks > 0; blocks--, data += 64) {
+		save0 = s0;
+		save1 = s1;
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), mask);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)),
+				mask);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)),
+				mask);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)),
+				mask);
+		SHA256_NI_ROUNDS(m0, 0);
+		SHA256_NI_ROUNDS(m1, 4);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+		SHA256_NI_ROUNDS(m2, 8);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+		SHA256_NI_SCHEDULE(m3, m2, m0, 12);
+		m2 = _mm_sha256msg1_epu32(m2, m3);
+		SHA256_NI_SCHEDULE(m0, m3, m1, 16);
+		m3 = _mm_sha256msg1_epu32(m3, m0);
+		SHA256_NI_SCHEDULE(m1, m0, m2, 20);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+		SHA256_NI_SCHEDULE(m2, m1, m3, 24);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+		SHA256_NI_SCHEDULE(m3, m2, m0, 28);
+		m2 = _mm_sha256msg1_epu32(m2, m3);
+		SHA256_NI_SCHEDULE(m0, m3, m1, 32);
+		m3 = _mm_sha256msg1_epu32(m3, m0);
+		SHA256_NI_SCHEDULE(m1, m0, m2, 36);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+		SHA256_NI_SCHEDULE(m2, m1, m3, 40);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+		SHA256_NI_SCHEDULE(m3, m2, m0, 44);
+		m2 = _mm_sha256msg1_epu32(m2, m3);
+		SHA256_NI_SCHEDULE(m0, m3, m1, 48);
+		m3 = _mm_sha256msg1_epu32(m3, m0);
+		SHA256_NI_SCHEDULE(m1, m0, m2, 52);
+		SHA256_NI_SCHEDULE(m2, m1, m3, 56);
+		SHA256_NI_ROUNDS(m3, 60);
+		s0 = _mm_add_epi32(s0, save0);
+		s1 = _mm_add_epi32(s1, save1);
+	}
+
+	t = _mm_shuffle_epi32(s0, 0x1b);		/* feba */
+	s1 = _mm_shuffle_epi32(s1, 0xb1);		/* dchg */
+	s0 = _mm_blend_epi16(t, s1, 0xf0);		/* dcba */
+	s1 = _mm_alignr_epi8(s1, t, 8);			/* hgfe */
+	_mm_storeu_si128((__m128i*)state, s0);
+	_mm_storeu_si128((__m128i*)(state + 4), s1);
+}
+
+#endif
+
+/* Hash whole blocks, with sha-ni when present */
+static void HASH_SHA256_Blocks(IUINT32 state[8], const unsigned char *data,
+	size_t blocks)
+{
+#ifdef ICPU_X86
+	int need = ICPU_SHA | ICPU_SSE41 | ICPU_SSSE3;
+	if ((icpu_features() & need) == need) {
+		HASH_SHA256_Blocks_NI(state, data, blocks);
+		return;
+	}
+#endif
+	for (; blocks > 0; blocks--, data += 64) {
+		HASH_SHA256_Transform(state, data);
+	}
+}
+
+void HASH_SHA256_Init(HASH_SHA256_CTX *ctx)
+{
+	static const IUINT32 init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	memcpy(ctx->state, init, sizeof(init));
+	ctx->count = 0;
+}
+
+void HASH_SHA256_Update(HASH_SHA256_CTX *ctx, const void *input, 
+	unsigned int len)
+{
+	const unsigned char *data = (const unsigned char*)input;
+	unsigned int used = (unsigned int)(ctx->count & 63);
+	ctx->count += len;
+	if (used > 0) {
+		unsigned int size = 64 - used;
+		if (len < size) {
+			memcpy(ctx->buffer + used, data, len);
+			return;
+		}
+		memcpy(ctx->buffer + used, data, size);
+		HASH_SHA256_Blocks(ctx->state, ctx->buffer, 1);
+		data += size;
+		len -= size;
+	}
+	if (len >= 64) {
+		HASH_SHA256_Blocks(ctx->state, data, len >> 6);
+		data += len & ~63u;
+		len &= 63;
+	}
+	memcpy(ctx->buffer, data, len);
+}
+
+void HASH_SHA256_Final(HASH_SHA256_CTX *ctx, unsigned char digest[32])
+{
+	IUINT64 bits = ctx->count << 3;
+	unsigned int used = (unsigned int)(ctx->count & 63);
+	int i;
+	ctx->buffer[used++] = 0x80;
+	if (used > 56) {
+		memset(ctx->buffer + used, 0, 64 - used);
+		HASH_SHA256_Blocks(ctx->state, ctx->buffer, 1);
+		used = 0;
+	}
+	memset(ctx->buffer + used, 0, 56 - used);
+	for (i = 0; i < 8; i++) {
+		ctx->buffer[56 + i] = (unsigned char)(bits >> ((7 - i) * 8));
+	}
+	HASH_SHA256_Blocks(ctx->state, ctx->buffer, 1);
+	for (i = 0; i < 32; i++) {
+		digest[i] = (unsigned char)(ctx->state[i >> 2] >> ((3 - (i & 3)) * 8));
+	}
+	memset(ctx, 0, sizeof(HASH_SHA256_CTX));
+}
+
+
+//=====================================================================
+// MULTI-BUFFER: 8 independent messages in the lanes of avx2 registers
+//=====================================================================
+#ifdef ICPU_X86
+
+#define HASH_MB_LANES	8
+
+/* 8 lanes of 32-bit words: load & transpose word w of every lane */
+ICPU_TARGET("avx2")
+static inline void hash_mb_load(const unsigned char * const p[8], int off,
+	__m256i w[8])
+{
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7, u0, u1, u2, u3, u4, u5, u6, u7;
+	t0 = _mm256_loadu_si256((const __m256i*)(p[0] + off));
+	t1 = _mm256_loadu_si256((const __m256i*)(p[1] + off));
+	t2 = _mm256_loadu_si256((const __m256i*)(p[2] + off));
+	t3 = _mm256_loadu_si256((const __m256i*)(p[3] + off));
+	t4 = _mm256_loadu_si256((const __m256i*)(p[4] + off));
+	t5 = _mm256_loadu_si256((const __m256i*)(p[5] + off));
+	t6 = _mm256_loadu_si256((const __m256i*)(p[6] + off));
+	t7 = _mm256_loadu_si256((const __m256i*)(p[7] + off));
+	u0 = _mm256_unpacklo_epi32(t0, t1);
+	u1 = _mm256_unpackhi_epi32(t0, t1);
+	u2 = _mm256_unpacklo_epi32(t2, t3);
+	u3 = _mm256_unpackhi_epi32(t2, t3);
+	u4 = _mm256_unpacklo_epi32(t4, t5);
+	u5 = _mm256_unpackhi_epi32(t4, t5);
+	u6 = _mm256_unpacklo_epi32(t6, t7);
+	u7 = _mm256_unpackhi_epi32(t6, t7);
+	t0 = _mm256_unpacklo_epi64(u0, u2);
+	t1 = _mm256_unpackhi_epi64(u0, u2);
+	t2 = _mm256_unpacklo_epi64(u1, u3);
+	t3 = _mm256_unpackhi_epi64(u1, u3);
+	t4 = _mm256_unpacklo_epi64(u4, u6);
+	t5 = _mm256_unpackhi_epi64(u4, u6);
+	t6 = _mm256_unpacklo_epi64(u5, u7);
+	t7 = _mm256_unpackhi_epi64(u5, u7);
+	w[0] = _mm256_permute2x128_si256(t0, t4, 0x20);
+	w[1] = _mm256_permute2x128_si256(t1, t5, 0x20);
+	w[2] = _mm256_permute2x128_si256(t2, t6, 0x20);
+	w[3] = _mm256_permute2x128_si256(t3, t7, 0x20);
+	w[4] = _mm256_permute2x128_si256(t0, t4, 0x31);
+	w[5] = _mm256_permute2x128_si256(t1, t5, 0x31);
+	w[6] = _mm256_permute2x128_si256(t2, t6, 0x31);
+	w[7] = _mm256_permute2x128_si256(t3, t7, 0x31);
+}
+
+#define HASH_MB_ROTL(x, n) \
+	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+static const IUINT32 HASH_MD5_K[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+/* md5 one block for 8 lanes, lanes not in mask keep their state */
+ICPU_TARGET("avx2")
+static void hash_mb_md5_block(IUINT32 state[4][8], 
+	const unsigned char * const p[8], __m256i mask)
+{
+	static const int shift[4][4] = {
+		{ 7, 12, 17, 22 }, { 5, 9, 14, 20 }, 
+		{ 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+	__m256i m[16], s[4], a, b, c, d, f;
+	int i, k;
+	hash_mb_load(p, 0, m);
+	hash_mb_load(p, 32, m + 8);
+	for (k = 0; k < 4; k++) {
+		s[k] = _mm256_loadu_si256((const __m256i*)state[k]);
+	}
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	for (i = 0; i < 64; i++) {
+		int r = i >> 4, g;
+		__m256i n, x;
+		if (r == 0) {
+			f = _mm256_xor_si256(d, _mm256_and_si256(b, 
+				_mm256_xor_si256(c, d)));
+			g = i;
+		}
+		else if (r == 1) {
+			f = _mm256_xor_si256(c, _mm256_and_si256(d, 
+				_mm256_xor_si256(b, c)));
+			g = (5 * i + 1) & 15;
+		}
+		else if (r == 2) {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			g = (3 * i + 5) & 15;
+		}
+		else {
+			f = _mm256_xor_si256(c, _mm256_or_si256(b, 
+				_mm256_xor_si256(d, _mm256_set1_epi32(-1))));
+			g = (7 * i) & 15;
+		}
+		x = _mm256_add_epi32(_mm256_add_epi32(a, f), 
+			_mm256_add_epi32(m[g], _mm256_set1_epi32((int)HASH_MD5_K[i])));
+		n = _mm256_set1_epi32(shift[r][i & 3]);
+		x = _mm256_or_si256(_mm256_sllv_epi32(x, n), _mm256_srlv_epi32(x,
+			_mm256_sub_epi32(_mm256_set1_epi32(32), n)));
+		a = d; d = c; c = b;
+		b = _mm256_add_epi32(b, x);
+	}
+	s[0] = _mm256_blendv_epi8(s[0], _mm256_add_epi32(s[0], a), mask);
+	s[1] = _mm256_blendv_epi8(s[1], _mm256_add_epi32(s[1], b), mask);
+	s[2] = _mm256_blendv_epi8(s[2], _mm256_add_epi32(s[2], c), mask);
+	s[3] = _mm256_blendv_epi8(s[3], _mm256_add_epi32(s[3], d), mask);
+	for (k = 0; k < 4; k++) {
+		_mm256_storeu_si256((__m256i*)state[k], s[k]);
+	}
+}
+
+/* sha1 one block for 8 lanes, lanes not in mask keep their state */
+ICPU_TARGET("avx2")
+static void hash_mb_sha1_block(IUINT32 state[5][8], 
+	const unsigned char * const p[8], __m256i mask)
+{
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 
+		11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 
+		11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i w[16], s[5], a, b, c, d, e, f, k, t;
+	int i;
+	hash_mb_load(p, 0, w);
+	hash_mb_load(p, 32, w + 8);
+	for (i = 0; i < 16; i++) w[i] = _mm256_shuffle_epi8(w[i], bswap);
+	for (i = 0; i < 5; i++) {
+		s[i] = _mm256_loadu_si256((const __m256i*)state[i]);
+	}
+	a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4];
+	for (i = 0; i < 80; i++) {
+		if (i >= 16) {
+			t = _mm256_xor_si256(_mm256_xor_si256(w[(i + 13) & 15], 
+				w[(i + 8) & 15]), _mm256_xor_si256(w[(i + 2) & 15], 
+				w[i & 15]));
+			w[i & 15] = HASH_MB_ROTL(t, 1);
+		}
+		if (i < 20) {
+			f = _mm256_xor_si256(d, _mm256_and_si256(b, 
+				_mm256_xor_si256(c, d)));
+			k = _mm256_set1_epi32(0x5a827999);
+		}
+		else if (i < 40) {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32(0x6ed9eba1);
+		}
+		else if (i < 60) {
+			f = _mm256_or_si256(_mm256_and_si256(b, c), 
+				_mm256_and_si256(d, _mm256_or_si256(b, c)));
+			k = _mm256_set1_epi32((int)0x8f1bbcdc);
+		}
+		else {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32((int)0xca62c1d6);
+		}
+		t = _mm256_add_epi32(_mm256_add_epi32(HASH_MB_ROTL(a, 5), f),
+			_mm256_add_epi32(_mm256_add_epi32(e, k), w[i & 15]));
+		e = d; d = c; 
+		c = HASH_MB_ROTL(b, 30);
+		b = a; a = t;
+	}
+	s[0] = _mm256_blendv_epi8(s[0], _mm256_add_epi32(s[0], a), mask);
+	s[1] = _mm256_blendv_epi8(s[1], _mm256_add_epi32(s[1], b), mask);
+	s[2] = _mm256_blendv_epi8(s[2], _mm256_add_epi32(s[2], c), mask);
+	s[3] = _mm256_blendv_epi8(s[3], _mm256_add_epi32(s[3], d), mask);
+	s[4] = _mm256_blendv_epi8(s[4], _mm256_add_epi32(s[4], e), mask);
+	for (i = 0; i < 5; i++) {
+		_mm256_storeu_si256((__m256i*)state[i], s[i]);
+	}
+}
+
+/* padded tail blocks of one lane */
+typedef struct {
+	const unsigned char *data;
+	unsigned int full;				/* blocks taken from data */
+	unsigned int total;				/* full + tail blocks */
+	unsigned char tail[128];
+}	HASH_MB_LANE;
+
+/* hash up to 8 messages: words is 4 (md5, lsb length) or 5 (sha1) */
+ICPU_TARGET("avx2")
+static void hash_mb_run(int count, const void * const in[], 
+	const unsigned int len[], unsigned char *digest, int words)
+{
+	static const unsigned char zero[64] = { 0 };
+	HASH_MB_LANE lanes[HASH_MB_LANES];
+	IUINT32 state[5][HASH_MB_LANES];
+	const unsigned char *p[HASH_MB_LANES];
+	IUINT32 active[HASH_MB_LANES];
+	unsigned int step, steps = 0;
+	int i, j;
+
+	for (i = 0; i < HASH_MB_LANES; i++) {
+		HASH_MB_LANE *lane = &lanes[i];
+		IUINT64 bits;
+		unsigned int size, rest;
+		static const IUINT32 iv[5] = { 0x67452301, 0xefcdab89, 
+			0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+		for (j = 0; j < 5; j++) state[j][i] = iv[j];
+		if (i >= count) {
+			lane->full = lane->total = 0;
+			continue;
+		}
+		size = len[i];
+		rest = size & 63;
+		lane->data = (const unsigned char*)in[i];
+		lane->full = size >> 6;
+		lane->total = lane->full + ((rest < 56)? 1 : 2);
+		memset(lane->tail, 0, sizeof(lane->tail));
+		memcpy(lane->tail, lane->data + (size & ~63u), rest);
+		lane->tail[rest] = 0x80;
+		bits = ((IUINT64)size) << 3;
+		rest = (lane->total - lane->full) * 64 - 8;
+		for (j = 0; j < 8; j++) {
+			int shift = (words == 4)? (j * 8) : ((7 - j) * 8);
+			lane->tail[rest + j] = (unsigned char)(bits >> shift);
+		}
+		if (lane->total > steps) steps = lane->total;
+	}
+
+	for (step = 0; step < steps; step++) {
+		__m256i mask;
+		for (i = 0; i < HASH_MB_LANES; i++) {
+			HASH_MB_LANE *lane = &lanes[i];
+			active[i] = (step < lane->total)? 0xffffffff : 0;
+			if (step < lane->full) {
+				p[i] = lane->data + ((size_t)step << 6);
+			}
+			else if (step < lane->total) {
+				p[i] = lane->tail + ((step - lane->full) << 6);
+			}
+			else {
+				p[i] = zero;
+			}
+		}
+		mask = _mm256_loadu_si256((const __m256i*)active);
+		if (words == 4) {
+			hash_mb_md5_block(state, p, mask);
+		}	else {
+			hash_mb_sha1_block(state, p, mask);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		unsigned char *out = digest + i * words * 4;
+		for (j = 0; j < words * 4; j++) {
+			IUINT32 x = state[j >> 2][i];
+			int shift = (words == 4)? ((j & 3) * 8) : ((3 - (j & 3)) * 8);
+			out[j] = (unsigned char)(x >> shift);
+		}
+	}
+}
+
+#endif
+
+// hash count messages into digest + i * 16, 8 at a time with avx2
+void hash_md5_multi(int count, const void * const in[], 
+	const unsigned int len[], unsigned char *digest)
+{
+	int i;
+#ifdef ICPU_X86
+	if (icpu_features() & ICPU_AVX2) {
+		for (i = 0; i < count; i += HASH_MB_LANES) {
+			int n = (count - i < HASH_MB_LANES)? count - i : HASH_MB_LANES;
+			hash_mb_run(n, in + i, len + i, digest + i * 16, 4);
+		}
+		return;
+	}
+#endif
+	for (i = 0; i < count; i++) {
+		HASH_MD5_CTX ctx;
+		HASH_MD5_Init(&ctx, 0);
+		HASH_MD5_Update(&ctx, in[i], len[i]);
+		HASH_MD5_Final(&ctx, digest + i * 16);
+	}
+}
+
+// hash count messages into digest + i * 20, 8 at a time with avx2
+void hash_sha1_multi(int count, const void * const in[], 
+	const unsigned int len[], unsigned char *digest)
+{
+	int i;
+#ifdef ICPU_X86
+	if (icpu_features() & ICPU_AVX2) {
+		for (i = 0; i < count; i += HASH_MB_LANES) {
+			int n = (count - i < HASH_MB_LANES)? count - i : HASH_MB_LANES;
+			hash_mb_run(n, in + i, len + i, digest + i * 20, 5);
+		}
+		return;
+	}
+#endif
+	for (i = 0; i < count; i++) {
+		HASH_SHA1_CTX ctx;
+		HASH_SHA1_Init(&ctx);
+		HASH_SHA1_Update(&ctx, in[i], len[i]);
+		HASH_SHA1_Final(&ctx, digest + i * 20);
+	}
+}
+
+
 //=====================================================================
 // UTILITIES
 //=====================================================================
@@ -566,6 +1211,19 @@ char* hash_sha1sum(const void *in, unsigned int len, char *out)
 	return hash_digest_to_string(digest, 20, out);
 }
 
+// calculate sha256sum and convert digests to string
+char* hash_sha256sum(const void *in, unsigned int len, char *out)
+{
+	static char text[72];
+	unsigned char digest[32];
+	HASH_SHA256_CTX ctx;
+	HASH_SHA256_Init(&ctx);
+	HASH_SHA256_Update(&ctx, in, len);
+	HASH_SHA256_Final(&ctx, digest);
+	if (out == NULL) out = text;
+	return hash_digest_to_string(digest, 32, out);
+}
+
 // crc32
 
 /* Need an unsigned type capable of holding 32 bits; */
@@ -950,20 +1608,284 @@ IUINT32 RANDOM_PCG_Next(RANDOM_PCG *pcg)
 }
 
 
+// one pcg step on a local state
+static inline IUINT32 random_pcg_step(IUINT64 *state, IUINT64 inc)
+{
+	IUINT64 x = *state;
+	IUINT32 xorshifted = (IUINT32)(((x >> 18) ^ x) >> 27);
+	IUINT32 rot = (IUINT32)(x >> 59);
+	*state = x * 6364136223846793005u + inc;
+	return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+}
+
+
+// Lemire's nearly divisionless mapping of r into 0 <= x < bound: the
+// high half of r * bound, rejects only when the low half < 2^32 % bound
+#define RANDOM_LEMIRE(r, bound, next) do { \
+		IUINT64 __m = ((IUINT64)(r)) * (bound); \
+		IUINT32 __l = (IUINT32)__m; \
+		if (__l < (bound)) { \
+			IUINT32 __t = (0u - (bound)) % (bound); \
+			while (__l < __t) { \
+				__m = ((IUINT64)(next)) * (bound); \
+				__l = (IUINT32)__m; \
+			} \
+		} \
+		(r) = (IUINT32)(__m >> 32); \
+	}	while (0)
+
+
 // next random number within 0 <= x < bound
 IUINT32 RANDOM_PCG_RANGE(RANDOM_PCG *pcg, IUINT32 bound)
 {
-	IUINT32 threshold, hr = 0;
+	IUINT32 r;
 	if (bound <= 1) return 0;
-	threshold = (((0xffffffff - bound)) + 1) % bound;
-	while (1) {
-        IUINT32 r = RANDOM_PCG_Next(pcg);
-        if (r >= threshold) {
-            hr = r % bound;
-			break;
+	r = RANDOM_PCG_Next(pcg);
+	RANDOM_LEMIRE(r, bound, RANDOM_PCG_Next(pcg));
+	return r;
+}
+
+
+// fill n random numbers
+void RANDOM_PCG_Fill(RANDOM_PCG *pcg, IUINT32 *buf, size_t n)
+{
+	IUINT64 state = pcg->state, inc = pcg->inc;
+	for (; n >= 4; n -= 4, buf += 4) {
+		buf[0] = random_pcg_step(&state, inc);
+		buf[1] = random_pcg_step(&state, inc);
+		buf[2] = random_pcg_step(&state, inc);
+		buf[3] = random_pcg_step(&state, inc);
+	}
+	for (; n > 0; n--) {
+		*buf++ = random_pcg_step(&state, inc);
+	}
+	pcg->state = state;
+}
+
+
+// fill n random numbers within 0 <= x < bound
+void RANDOM_PCG_FillRange(RANDOM_PCG *pcg, IUINT32 *buf, size_t n,
+	IUINT32 bound)
+{
+	IUINT64 state = pcg->state, inc = pcg->inc;
+	if (bound <= 1) {
+		memset(buf, 0, n * sizeof(IUINT32));
+		return;
+	}
+	for (; n > 0; n--) {
+		IUINT32 r = random_pcg_step(&state, inc);
+		RANDOM_LEMIRE(r, bound, random_pcg_step(&state, inc));
+		*buf++ = r;
+	}
+	pcg->state = state;
+}
+
+
+// source for iSimRandom in inetsim.h, user is a RANDOM_PCG
+long random_pcg_source(void *user, long range)
+{
+	if (range <= 1) return 0;
+	return (long)RANDOM_PCG_RANGE((RANDOM_PCG*)user, (IUINT32)range);
+}
+
+
+//=====================================================================
+// XOSHIRO256++: https://prng.di.unimi.it, 8 interleaved streams
+//=====================================================================
+#define RANDOM_XOSHIRO_ROTL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static IUINT64 random_splitmix64(IUINT64 *seed)
+{
+	IUINT64 z = (*seed += 0x9e3779b97f4a7c15u);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+	return z ^ (z >> 31);
+}
+
+// n steps of every lane, out[step * 8 + lane]
+static void random_xoshiro_blocks_c(IUINT64 s[4][8], IUINT64 *out, 
+	size_t n)
+{
+	int i;
+	for (; n > 0; n--, out += 8) {
+		for (i = 0; i < 8; i++) {
+			IUINT64 s0 = s[0][i], s1 = s[1][i], s2 = s[2][i], s3 = s[3][i];
+			IUINT64 t = s1 << 17;
+			out[i] = RANDOM_XOSHIRO_ROTL(s0 + s3, 23) + s0;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= t;
+			s[0][i] = s0; s[1][i] = s1; s[2][i] = s2; 
+			s[3][i] = RANDOM_XOSHIRO_ROTL(s3, 45);
 		}
-    }
-	return hr;
+	}
+}
+
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+
+#define RANDOM_XOSHIRO_ROTL_AVX2(x, n) \
+	_mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - (n)))
+
+#define RANDOM_XOSHIRO_STEP_AVX2(s0, s1, s2, s3, r) do { \
+		__m256i __t = _mm256_slli_epi64(s1, 17); \
+		r = _mm256_add_epi64(RANDOM_XOSHIRO_ROTL_AVX2( \
+			_mm256_add_epi64(s0, s3), 23), s0); \
+		s2 = _mm256_xor_si256(s2, s0); \
+		s3 = _mm256_xor_si256(s3, s1); \
+		s1 = _mm256_xor_si256(s1, s2); \
+		s0 = _mm256_xor_si256(s0, s3); \
+		s2 = _mm256_xor_si256(s2, __t); \
+		s3 = RANDOM_XOSHIRO_ROTL_AVX2(s3, 45); \
+	}	while (0)
+
+// lanes 0-3 and 4-7 in two registers per state word
+ICPU_TARGET("avx2")
+static void random_xoshiro_blocks_avx2(IUINT64 s[4][8], IUINT64 *out, 
+	size_t n)
+{
+	__m256i a0 = _mm256_loadu_si256((const __m256i*)(s[0] + 0));
+	__m256i a1 = _mm256_loadu_si256((const __m256i*)(s[1] + 0));
+	__m256i a2 = _mm256_loadu_si256((const __m256i*)(s[2] + 0));
+	__m256i a3 = _mm256_loadu_si256((const __m256i*)(s[3] + 0));
+	__m256i b0 = _mm256_loadu_si256((const __m256i*)(s[0] + 4));
+	__m256i b1 = _mm256_loadu_si256((const __m256i*)(s[1] + 4));
+	__m256i b2 = _mm256_loadu_si256((const __m256i*)(s[2] + 4));
+	__m256i b3 = _mm256_loadu_si256((const __m256i*)(s[3] + 4));
+	for (; n > 0; n--, out += 8) {
+		__m256i ra, rb;
+		RANDOM_XOSHIRO_STEP_AVX2(a0, a1, a2, a3, ra);
+		RANDOM_XOSHIRO_STEP_AVX2(b0, b1, b2, b3, rb);
+		_mm256_storeu_si256((__m256i*)(out + 0), ra);
+		_mm256_storeu_si256((__m256i*)(out + 4), rb);
+	}
+	_mm256_storeu_si256((__m256i*)(s[0] + 0), a0);
+	_mm256_storeu_si256((__m256i*)(s[1] + 0), a1);
+	_mm256_storeu_si256((__m256i*)(s[2] + 0), a2);
+	_mm256_storeu_si256((__m256i*)(s[3] + 0), a3);
+	_mm256_storeu_si256((__m256i*)(s[0] + 4), b0);
+	_mm256_storeu_si256((__m256i*)(s[1] + 4), b1);
+	_mm256_storeu_si256((__m256i*)(s[2] + 4), b2);
+	_mm256_storeu_si256((__m256i*)(s[3] + 4), b3);
+}
+
+#endif
+
+static void random_xoshiro_blocks(IUINT64 s[4][8], IUINT64 *out, size_t n)
+{
+#if defined(ICPU_X86) && (IWORDS_BIG_ENDIAN == 0)
+	if (icpu_features() & ICPU_AVX2) {
+		random_xoshiro_blocks_avx2(s, out, n);
+		return;
+	}
+#endif
+	random_xoshiro_blocks_c(s, out, n);
+}
+
+
+// initialize: lane 0 from splitmix64(seed), every next lane is the 
+// previous one advanced by 2^128 steps, so the streams never overlap
+void RANDOM_XOSHIRO_Init(RANDOM_XOSHIRO *x, IUINT64 seed)
+{
+	static const IUINT64 jump[4] = {
+		0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 
+		0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+	IUINT64 s[4];
+	int lane, i, b, k;
+	for (i = 0; i < 4; i++) s[i] = random_splitmix64(&seed);
+	for (lane = 0; lane < RANDOM_XOSHIRO_LANES; lane++) {
+		IUINT64 t[4] = { 0, 0, 0, 0 };
+		for (i = 0; i < 4; i++) x->s[i][lane] = s[i];
+		for (i = 0; i < 4; i++) {
+			for (b = 0; b < 64; b++) {
+				IUINT64 u = s[1] << 17;
+				if (jump[i] & (((IUINT64)1) << b)) {
+					for (k = 0; k < 4; k++) t[k] ^= s[k];
+				}
+				s[2] ^= s[0];
+				s[3] ^= s[1];
+				s[1] ^= s[2];
+				s[0] ^= s[3];
+				s[2] ^= u;
+				s[3] = RANDOM_XOSHIRO_ROTL(s[3], 45);
+			}
+		}
+		for (k = 0; k < 4; k++) s[k] = t[k];
+	}
+	x->avail = 0;
+}
+
+
+// next random number (lanes are taken in turn)
+IUINT64 RANDOM_XOSHIRO_Next(RANDOM_XOSHIRO *x)
+{
+	if (x->avail == 0) {
+		random_xoshiro_blocks(x->s, x->cache, 1);
+		x->avail = RANDOM_XOSHIRO_LANES;
+	}
+	return x->cache[RANDOM_XOSHIRO_LANES - (x->avail--)];
+}
+
+
+// fill n random numbers, same sequence as calling Next n times
+void RANDOM_XOSHIRO_Fill(RANDOM_XOSHIRO *x, IUINT64 *buf, size_t n)
+{
+	size_t blocks;
+	for (; n > 0 && x->avail > 0; n--) {
+		*buf++ = RANDOM_XOSHIRO_Next(x);
+	}
+	blocks = n / RANDOM_XOSHIRO_LANES;
+	if (blocks > 0) {
+		random_xoshiro_blocks(x->s, buf, blocks);
+		buf += blocks * RANDOM_XOSHIRO_LANES;
+		n -= blocks * RANDOM_XOSHIRO_LANES;
+	}
+	for (; n > 0; n--) {
+		*buf++ = RANDOM_XOSHIRO_Next(x);
+	}
+}
+
+
+// next random number within 0 <= x < bound
+IUINT32 RANDOM_XOSHIRO_RANGE(RANDOM_XOSHIRO *x, IUINT32 bound)
+{
+	IUINT32 r;
+	if (bound <= 1) return 0;
+	r = (IUINT32)(RANDOM_XOSHIRO_Next(x) >> 32);
+	RANDOM_LEMIRE(r, bound, RANDOM_XOSHIRO_Next(x) >> 32);
+	return r;
+}
+
+
+// fill n random numbers within 0 <= x < bound
+void RANDOM_XOSHIRO_FillRange(RANDOM_XOSHIRO *x, IUINT32 *buf, size_t n,
+	IUINT32 bound)
+{
+	IUINT64 cache[256];
+	if (bound <= 1) {
+		memset(buf, 0, n * sizeof(IUINT32));
+		return;
+	}
+	while (n > 0) {
+		size_t size = (n < 256)? n : 256, i;
+		RANDOM_XOSHIRO_Fill(x, cache, size);
+		for (i = 0; i < size; i++) {
+			IUINT32 r = (IUINT32)(cache[i] >> 32);
+			RANDOM_LEMIRE(r, bound, RANDOM_XOSHIRO_Next(x) >> 32);
+			buf[i] = r;
+		}
+		buf += size;
+		n -= size;
+	}
+}
+
+
+// source for iSimRandom in inetsim.h, user is a RANDOM_XOSHIRO
+long random_xoshiro_source(void *user, long range)
+{
+	if (range <= 1) return 0;
+	return (long)RANDOM_XOSHIRO_RANGE((RANDOM_XOSHIRO*)user, (IUINT32)range);
 }
 
 
@@ -193,6 +193,20 @@ void HASH_SHA1_Update(HASH_SHA1_CTX *ctx, const void *input, unsigned int len);
 void HASH_SHA1_Final(HASH_SHA1_CTX *ctx, unsigned char digest[20]);
 
 
+//=====================================================================
+// SHA256 (FIPS 180-4), SHA1 and SHA256 use sha-ni when present
+//=====================================================================
+typedef struct {
+	IUINT32 state[8];
+	IUINT64 count;					/* bytes handled */
+	unsigned char buffer[64];
+}	HASH_SHA256_CTX;
+
+void HASH_SHA256_Init(HASH_SHA256_CTX *ctx);
+void HASH_SHA256_Update(HASH_SHA256_CTX *ctx, const void *input, unsigned int len);
+void HASH_SHA256_Final(HASH_SHA256_CTX *ctx, unsigned char digest[32]);
+
+
 //=====================================================================
 // UTILITIES
 //=====================================================================
@@ -206,6 +220,18 @@ char* hash_md5sum(const void *in, unsigned int len, char *out);
 // calculate sha1sum and convert digests to string
 char* hash_sha1sum(const void *in, unsigned int len, char *out);
 
+// calculate sha256sum and convert digests to string
+char* hash_sha256sum(const void *in, unsigned int len, char *out);
+
+// md5 of count independent messages into digest + i * 16, hashed 8 at
+// a time in the lanes of avx2 registers when present (batch workloads)
+void hash_md5_multi(int count, const void * const in[], 
+	const unsigned int len[], unsigned char *digest);
+
+// sha1 of count independent messages into digest + i * 20, see above
+void hash_sha1_multi(int count, const void * const in[], 
+	const unsigned int len[], unsigned char *digest);
+
 // calculate crc32 and return result
 IUINT32 hash_crc32(const void *in, unsigned int len);
 
@@ -318,9 +344,52 @@ void RANDOM_PCG_Init(RANDOM_PCG *pcg, IUINT64 initstate, IUINT64 initseq);
 // next random number 
 IUINT32 RANDOM_PCG_Next(RANDOM_PCG *pcg);
 
-// next random number within 0 <= x < bound
+// next random number within 0 <= x < bound (Lemire's method)
 IUINT32 RANDOM_PCG_RANGE(RANDOM_PCG *pcg, IUINT32 bound);
 
+// fill n random numbers, same sequence as calling Next n times
+void RANDOM_PCG_Fill(RANDOM_PCG *pcg, IUINT32 *buf, size_t n);
+
+// fill n random numbers within 0 <= x < bound
+void RANDOM_PCG_FillRange(RANDOM_PCG *pcg, IUINT32 *buf, size_t n, 
+	IUINT32 bound);
+
+// random source for isim_random (iSimRandom in inetsim.h): user is a
+// RANDOM_PCG, returns 0 <= x < range
+long random_pcg_source(void *user, long range);
+
+
+//=====================================================================
+// XOSHIRO256++: 8 independent streams stepped together (avx2 if any)
+//=====================================================================
+#define RANDOM_XOSHIRO_LANES	8
+
+typedef struct
+{
+	IUINT64 s[4][RANDOM_XOSHIRO_LANES];    // lane states
+	IUINT64 cache[RANDOM_XOSHIRO_LANES];   // last step for Next
+	int avail;                             // unread numbers in cache
+}	RANDOM_XOSHIRO;
+
+// initialize from seed, streams are 2^128 apart
+void RANDOM_XOSHIRO_Init(RANDOM_XOSHIRO *x, IUINT64 seed);
+
+// next random number 
+IUINT64 RANDOM_XOSHIRO_Next(RANDOM_XOSHIRO *x);
+
+// fill n random numbers, same sequence as calling Next n times
+void RANDOM_XOSHIRO_Fill(RANDOM_XOSHIRO *x, IUINT64 *buf, size_t n);
+
+// next random number within 0 <= x < bound
+IUINT32 RANDOM_XOSHIRO_RANGE(RANDOM_XOSHIRO *x, IUINT32 bound);
+
+// fill n random numbers within 0 <= x < bound
+void RANDOM_XOSHIRO_FillRange(RANDOM_XOSHIRO *x, IUINT32 *buf, size_t n,
+	IUINT32 bound);
+
+// random source for isim_random: user is a RANDOM_XOSHIRO
+long random_xoshiro_source(void *user, long range);
+
 
 #ifdef __cplusplus
 }
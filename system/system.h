@@ -33,6 +33,7 @@
 // TaskPool          线程池任务管理器
 //
 // CsvReader         CSV文件读取
+// CsvParallel       CSV并行解析
 // CsvWriter         CSV文件写入
 // HttpRequest       反照 Python的 urllib，非阻塞和阻塞模式
 // Path              仿照 Python的 os.path 路径连接，绝对路径等
@@ -1051,6 +1052,27 @@ public:
 		return async_core_send_vector(_core, hid, vecptr, veclen, count, mask);
 	}
 
+	// 发送文件片段：作为一条消息排在已有数据之后，sendfile 直接发送，
+	// rc4 加密时分块读出加密，fd 会被复制，调用后即可关闭
+	long send_file(long hid, int fd, IINT64 offset, IINT64 length, int mask = 0) {
+		return async_core_send_file(_core, hid, fd, offset, length, mask);
+	}
+
+	// 广播：数据只存一份引用计数缓存，被各连接的发送队列共享
+	long broadcast(const long hids[], int count, const void *data, long size) {
+		return async_core_broadcast(_core, hids, count, data, size);
+	}
+
+	// 其他线程投递发送：不抢 wait 的锁，由 wait 线程按顺序执行
+	long submit(long hid, const void *data, long size) {
+		return async_core_submit(_core, hid, data, size);
+	}
+
+	// 其他线程投递关闭
+	int submit_close(long hid, int code) {
+		return async_core_submit_close(_core, hid, code);
+	}
+
 	// 建立一个新的对外连接，返回 hid，错误返回 <0
 	long new_connect(const struct sockaddr *addr, int len, int header = 0) {
 		return async_core_new_connect(_core, addr, len, header);
@@ -1160,6 +1182,11 @@ public:
 		async_core_rc4_set_rkey(_core, hid, key, len);
 	}
 
+	// 设置分帧编解码器（async_codec_varint/http/websocket），NULL 恢复头部模式
+	int set_codec(long hid, const CAsyncCodec *codec) {
+		return async_core_codec(_core, hid, codec);
+	}
+
 	// 得到有多少个连接
 	long nfds() const {
 		return async_core_nfds(_core);
@@ -1425,14 +1452,100 @@ protected:
 };
 #endif
 
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+//---------------------------------------------------------------------
+// 内存映射文件
+//---------------------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile() { _map = NULL; }
+	virtual ~MappedFile() { close(); }
+
+	// 映射整个文件：IPOSIX_MMAP_READ/WRITE/CREATE，CREATE 时 size 为新大小
+	bool open(const char *filename, int mode = IPOSIX_MMAP_READ, IINT64 size = 0) {
+		close();
+		_map = iposix_mmap_open(filename, mode, size);
+		return (_map != NULL);
+	}
+
+	void close() {
+		if (_map) iposix_mmap_close(_map);
+		_map = NULL;
+	}
+
+	// 访问模式提示：IPOSIX_MADV_SEQUENTIAL 等
+	bool advise(int advice, IINT64 offset = 0, IINT64 size = 0) {
+		return iposix_mmap_advise(_map, offset, size, advice) == 0;
+	}
+
+	bool sync(bool async = false) {
+		return iposix_mmap_sync(_map, async? 1 : 0) == 0;
+	}
+
+	bool is_open() const { return _map != NULL; }
+	char *data() { return _map? _map->data : NULL; }
+	const char *data() const { return _map? _map->data : NULL; }
+	IINT64 size() const { return _map? _map->size : 0; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile& operator=(const MappedFile &);
+	iposix_mmap_t *_map;
+};
+
+
+//---------------------------------------------------------------------
+// 缓冲文件流：大块对齐缓存，可选 IPOSIX_FSTREAM_DIRECT
+//---------------------------------------------------------------------
+class FileStream
+{
+public:
+	FileStream() { _fs = NULL; }
+	virtual ~FileStream() { close(); }
+
+	bool open(const char *filename, int mode = IPOSIX_FSTREAM_READ, long bufsize = 0) {
+		close();
+		_fs = iposix_fstream_open(filename, mode, bufsize);
+		return (_fs != NULL);
+	}
+
+	// 关闭时写入剩余数据，返回是否全部写成功
+	bool close() {
+		int hr = 0;
+		if (_fs) hr = iposix_fstream_close(_fs);
+		_fs = NULL;
+		return hr == 0;
+	}
+
+	long read(void *ptr, long size) { return iposix_fstream_read(_fs, ptr, size); }
+	long write(const void *ptr, long size) { return iposix_fstream_write(_fs, ptr, size); }
+	bool flush() { return iposix_fstream_flush(_fs) == 0; }
+	IINT64 tell() const { return iposix_fstream_tell(_fs); }
+
+	// 零拷贝读取：返回缓存中的数据，用 skip 消费
+	long peek(const char **ptr) { return iposix_fstream_peek(_fs, ptr); }
+	void skip(long size) { iposix_fstream_skip(_fs, size); }
+
+	bool is_open() const { return _fs != NULL; }
+
+private:
+	FileStream(const FileStream &);
+	FileStream& operator=(const FileStream &);
+	iposix_fstream_t *_fs;
+};
+
+#endif
+
+
 //---------------------------------------------------------------------
-// CSV READER
+// CSV READER：字段是缓存内的切片，只有取值时才解码
 //---------------------------------------------------------------------
 class CsvReader
 {
 public:
 	CsvReader() {
-		_reader = NULL;
+		_opened = false;
 		_index = 0;
 		_count = 0;
 		_readed = false;
@@ -1443,35 +1556,44 @@ public:
 	}
 
 	void close() {
-		if (_reader) icsv_reader_close(_reader);
-		_reader = NULL;
+		if (_opened) icsv_scan_destroy(&_scan);
+		_opened = false;
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+		_file.close();
+#endif
 		_index = 0;
 		_count = 0;
 		_readed = false;
 	}
 
-	// 打开 CSV文件
-	bool open(const char *filename) {
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+	// 打开 CSV文件：映射后直接解析
+	bool open(const char *filename, int sep = ',') {
 		close();
-		_reader = icsv_reader_open_file(filename);
-		if (_reader == NULL) return false;
-		_readed = false;
-		return true;
+		if (!_file.open(filename)) return false;
+		_file.advise(IPOSIX_MADV_SEQUENTIAL);
+		return attach(_file.data(), (ilong)_file.size(), sep);
 	}
 
-	// 打开内存
-	bool open(const char *text, ilong size) {
+	// 打开映射文件：file 需在读取期间保持打开
+	bool open(MappedFile &file, int sep = ',') {
 		close();
-		_reader = icsv_reader_open_memory(text, size);
-		if (_reader == NULL) return false;
-		_readed = false;
-		return true;
+		if (!file.is_open()) return false;
+		file.advise(IPOSIX_MADV_SEQUENTIAL);
+		return attach(file.data(), (ilong)file.size(), sep);
+	}
+#endif
+
+	// 打开内存：不复制，text 需在读取期间有效
+	bool open(const char *text, ilong size, int sep = ',') {
+		close();
+		return attach(text, size, sep);
 	}
 
 	// 读取一行：返回多少列
 	int read() {
-		if (_reader == NULL) return -1;
-		int retval = icsv_reader_read(_reader);
+		if (_opened == false) return -1;
+		int retval = icsv_scan_next(&_scan);
 		if (retval >= 0) _count = retval;
 		else _count = 0;
 		_index = 0;
@@ -1486,8 +1608,8 @@ public:
 
 	// 判断是否文件结束
 	bool eof() const {
-		if (_reader == NULL) return true;
-		return icsv_reader_eof(_reader)? true : false;
+		if (_opened == false) return true;
+		return (_scan.start >= _scan.size);
 	}
 
 	// 流操作符
@@ -1507,58 +1629,161 @@ public:
 	// 行复位
 	void reset() { _index = 0; }
 
+	// 原始字段（零拷贝，引号和转义未处理），下一次 read 之前有效
+	bool slice(int pos, const char *&ptr, ilong &size) const {
+		if (pos < 0 || pos >= _count) return false;
+		ptr = _scan.fields[pos].ptr;
+		size = _scan.fields[pos].size;
+		return true;
+	}
+
+	// 解码后的字段，以 '\0' 结尾，越界返回 NULL
+	const char *cstr(int pos, ilong *size = NULL) {
+		if (pos < 0 || pos >= _count) return NULL;
+		const icsv_field_t *field = &_scan.fields[pos];
+		if (_buffer.size() < (size_t)field->size + 1)
+			_buffer.resize((size_t)field->size + 1);
+		ilong hr = icsv_field_load(field->ptr, field->size, &_buffer[0]);
+		if (size) *size = hr;
+		return &_buffer[0];
+	}
+
 	bool get(int pos, char *ptr, int size) {
-		return icsv_reader_get_cstr(_reader, pos, ptr, size) >= 0? true : false;
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		strncpy(ptr, text, size);
+		ptr[size - 1] = 0;
+		return true;
 	}
 
 	bool get(int pos, ivalue_t *str) {
-		return icsv_reader_get_string(_reader, pos, str) >= 0? true : false;
+		ilong size;
+		const char *text = cstr(pos, &size);
+		if (text == NULL) return false;
+		it_strcpyc(str, text, size);
+		return true;
 	}
 
 	bool get(int pos, std::string& str) {
-		const ivalue_t *src = icsv_reader_get_const(_reader, pos);
-		if (src == NULL) {
+		const char *ptr;
+		ilong size;
+		if (slice(pos, ptr, size) == false) {
 			str.assign("");
 			return false;
 		}
-		str.assign(it_str(src), (size_t)it_size(src));
+		if (icsv_field_load(ptr, size, NULL) >= 0) {
+			str.assign(ptr, (size_t)size);
+			return true;
+		}
+		ptr = cstr(pos, &size);
+		str.assign(ptr, (size_t)size);
 		return true;
 	}
 
 	bool get(int pos, long &value) {
-		return icsv_reader_get_long(_reader, pos, &value) < 0? false : true;
+		IINT64 x;
+		if (parse(pos, x) && (IINT64)((long)x) == x) {
+			value = (long)x;
+			return true;
+		}
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = istrtol(text, NULL, 10);
+		return true;
 	}
 
 	bool get(int pos, unsigned long &value) {
-		return icsv_reader_get_ulong(_reader, pos, &value) < 0? false : true;
+		IUINT64 x;
+		if (parse(pos, x) && (IUINT64)((unsigned long)x) == x) {
+			value = (unsigned long)x;
+			return true;
+		}
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = istrtoul(text, NULL, 10);
+		return true;
 	}
 
 	bool get(int pos, IINT64 &value) {
-		return icsv_reader_get_int64(_reader, pos, &value) < 0? false : true;
+		if (parse(pos, value)) return true;
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = istrtoll(text, NULL, 10);
+		return true;
 	}
 
 	bool get(int pos, IUINT64 &value) {
-		return icsv_reader_get_uint64(_reader, pos, &value) < 0? false : true;
+		if (parse(pos, value)) return true;
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = istrtoull(text, NULL, 10);
+		return true;
 	}
 
 	bool get(int pos, int &value) {
-		return icsv_reader_get_int(_reader, pos, &value) < 0? false : true;
+		long x = 0;
+		if (get(pos, x) == false) return false;
+		value = (int)x;
+		return true;
 	}
 
 	bool get(int pos, unsigned int &value) {
-		return icsv_reader_get_uint(_reader, pos, &value) < 0? false : true;
+		unsigned long x = 0;
+		if (get(pos, x) == false) return false;
+		value = (unsigned int)x;
+		return true;
 	}
 
 	bool get(int pos, float &value) {
-		return icsv_reader_get_float(_reader, pos, &value) < 0? false : true;
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = (float)strtod(text, NULL);
+		return true;
 	}
 
 	bool get(int pos, double &value) {
-		return icsv_reader_get_double(_reader, pos, &value) < 0? false : true;
+		const char *text = cstr(pos);
+		if (text == NULL) return false;
+		value = strtod(text, NULL);
+		return true;
+	}
+
+protected:
+	// 整个字段就是一个十进制数时直接在原文上解析，其余交给 istrto*
+	bool parse(int pos, IINT64 &value) {
+		const char *ptr;
+		ilong size;
+		IINT64 x;
+		if (slice(pos, ptr, size) == false || size <= 0) return false;
+		if (iparse_i64(ptr, size, &x) != size) return false;
+		value = x;
+		return true;
+	}
+
+	bool parse(int pos, IUINT64 &value) {
+		const char *ptr;
+		ilong size;
+		IUINT64 x;
+		if (slice(pos, ptr, size) == false || size <= 0) return false;
+		if (iparse_u64(ptr, size, &x) != size) return false;
+		value = x;
+		return true;
+	}
+
+	bool attach(const char *text, ilong size, int sep) {
+		if (icsv_scan_init(&_scan, text, size, sep) != 0) return false;
+		_opened = true;
+		_readed = false;
+		return true;
 	}
 
 protected:
-	iCsvReader *_reader;
+	icsv_scan_t _scan;
+	bool _opened;
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+	MappedFile _file;
+#endif
+	std::string _buffer;
 	int _index;
 	int _count;
 	bool _readed;
@@ -1568,6 +1793,68 @@ protected:
 #define CsvNextRow ((const void*)0)
 
 
+//---------------------------------------------------------------------
+// CSV 并行解析：在引号外的行边界切块，每块一个线程
+//---------------------------------------------------------------------
+class CsvParallel
+{
+public:
+	// 在各自线程中调用，scan 只覆盖第 index 块，用 icsv_scan_next 读行
+	typedef void (*Handler)(icsv_scan_t *scan, int index, void *user);
+
+	// 切成 count 块，第 0 块在当前线程处理，全部完成后返回
+	static bool run(const char *text, ilong size, int count,
+			Handler handler, void *user, int sep = ',') {
+		if (count < 1) count = 1;
+		std::vector<ilong> bounds(count + 1);
+		std::vector<Task> tasks(count);
+		std::vector<Thread*> threads;
+		icsv_split(text, size, &bounds[0], count);
+		bool ok = true;
+		for (int i = 0; i < count; i++) {
+			Task *task = &tasks[i];
+			task->handler = handler;
+			task->user = user;
+			task->index = i;
+			task->ok = (icsv_scan_init(&task->scan, text + bounds[i], 
+				bounds[i + 1] - bounds[i], sep) == 0);
+			if (task->ok == false) ok = false;
+		}
+		if (ok) {
+			for (int i = 1; i < count; i++) {
+				Thread *thread = new Thread(entry, &tasks[i], "csv");
+				threads.push_back(thread);
+				thread->start();
+			}
+			entry(&tasks[0]);
+			for (size_t i = 0; i < threads.size(); i++) {
+				threads[i]->join();
+				delete threads[i];
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			if (tasks[i].ok) icsv_scan_destroy(&tasks[i].scan);
+		}
+		return ok;
+	}
+
+private:
+	struct Task {
+		icsv_scan_t scan;
+		Handler handler;
+		void *user;
+		int index;
+		bool ok;
+	};
+
+	static int entry(void *parameter) {
+		Task *task = (Task*)parameter;
+		task->handler(&task->scan, task->index, task->user);
+		return 0;
+	}
+};
+
+
 //---------------------------------------------------------------------
 // CSV WRITER
 //---------------------------------------------------------------------
@@ -2201,6 +2488,19 @@ static inline std::string Qword2String(IINT64 x, int base = 10) {
 	return s;
 }
 
+// 浮点数到字符串，最短且能原样读回
+static inline void StringFromDouble(std::string &out, double x) {
+	char text[32];
+	int size = idtoa(x, text);
+	out.assign(text, (size_t)size);
+}
+
+static inline std::string Double2String(double x) {
+	std::string s;
+	StringFromDouble(s, x);
+	return s;
+}
+
 static inline void StringUpper(std::string &s) {
 	for (size_t i = 0; i < s.size(); i++) {
 		if (s[i] >= 'a' && s[i] <= 'z') s[i] -= 'a' - 'A';
@@ -2214,6 +2514,16 @@ static inline void StringLower(std::string &s) {
 }
 
 static inline bool LoadContent(const char *filename, std::string &content) {
+#ifndef IDISABLE_FILE_SYSTEM_ACCESS
+	// 映射后直接拷入 string，省掉一次中间缓存
+	iposix_mmap_t *map = iposix_mmap_open(filename, IPOSIX_MMAP_READ, 0);
+	if (map != NULL) {
+		iposix_mmap_advise(map, 0, 0, IPOSIX_MADV_SEQUENTIAL);
+		content.assign(map->data, (size_t)map->size);
+		iposix_mmap_close(map);
+		return true;
+	}
+#endif
 	long size = 0;
 	void *text = iposix_file_load_content(filename, &size);
 	if (text == NULL) return false;
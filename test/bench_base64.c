@@ -0,0 +1,210 @@
+//=====================================================================
+//
+// bench_base64.c - base64/base16 codecs: simd vs scalar and streaming
+// vs one shot fuzz equivalence under every cpu feature mask, and MB/s
+//
+// gcc -O2 -I../system bench_base64.c ../system/imemdata.c
+//     ../system/imembase.c -o bench_base64
+//
+//=====================================================================
+#include "imemdata.h"
+#include "imembase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+static double clock_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// scalar first: it is the reference of the others
+static const int feature_masks[4] = { 0, ICPU_SSE2,
+	ICPU_SSE2 | ICPU_SSSE3, -1 };
+
+static const char *feature_names[4] = { "scalar", "sse2", "ssse3", "all" };
+
+#define FUZZ_MAX 60000
+
+static unsigned char plain[FUZZ_MAX];
+static char text64[FUZZ_MAX * 2], text16[FUZZ_MAX * 3];
+static unsigned char ref[FUZZ_MAX * 3], out[FUZZ_MAX * 3];
+
+// padding, separators and foreign chars send blocks to the scalar loop
+static void mutate(char *text, ilong size, int lower)
+{
+	static const char noise[] = "ABCxyz09+/=\r\n -_*";
+	int i;
+	if (size <= 0) return;
+	if (rand() & 1) {
+		for (i = rand() % 4; i > 0; i--) {
+			text[rand() % size] = noise[rand() % (sizeof(noise) - 1)];
+		}
+	}
+	if (lower && (rand() & 1)) {
+		for (i = 0; i < size; i++) {
+			if (rand() % 3 == 0) text[i] = (char)tolower(text[i]);
+		}
+	}
+}
+
+// feed src in random chunks of 0..99 bytes
+static ilong stream_encode(const unsigned char *src, ilong size, char *dst)
+{
+	ibase64_state_t state;
+	ilong pos = 0, n = 0;
+	ibase64_state_init(&state);
+	while (pos < size) {
+		ilong chunk = rand() % 100;
+		if (chunk > size - pos) chunk = size - pos;
+		n += ibase64_encode_update(&state, src + pos, chunk, dst + n);
+		pos += chunk;
+	}
+	n += ibase64_encode_final(&state, dst + n);
+	return n;
+}
+
+static ilong stream_decode(const char *src, ilong size, unsigned char *dst)
+{
+	ibase64_state_t state;
+	ilong pos = 0, n = 0;
+	ibase64_state_init(&state);
+	while (pos < size) {
+		ilong chunk = rand() % 100;
+		if (chunk > size - pos) chunk = size - pos;
+		n += ibase64_decode_update(&state, src + pos, chunk, dst + n);
+		pos += chunk;
+	}
+	return n;
+}
+
+#define CHECK(name, x, y, a, b) do { \
+		if ((x) != (y) || memcmp(a, b, (size_t)(x)) != 0) { \
+			printf("%s mismatch: case=%d mask=%s size=%ld\n", name, k, \
+				feature_names[m], (long)size); \
+			return 1; \
+		} \
+	}	while (0)
+
+static int fuzz(int rounds)
+{
+	int k, m;
+	for (k = 0; k < rounds; k++) {
+		ilong size = rand() % ((k % 10 == 0)? FUZZ_MAX : 300);
+		ilong n64, n16, i, x, y;
+		for (i = 0; i < size; i++) plain[i] = (unsigned char)rand();
+
+		icpu_features_mask(0);
+		n64 = ibase64_encode(plain, size, text64);
+		n16 = ibase16_encode(plain, size, text16);
+		mutate(text64, n64, 0);
+		mutate(text16, n16, 1);
+		if ((rand() & 3) == 0 && n64 > 0) n64 -= rand() % 3;
+		if ((rand() & 3) == 0 && n16 > 0) n16 -= rand() % 3;
+
+		for (m = 1; m < 4; m++) {
+			icpu_features_mask(0);
+			x = ibase64_encode(plain, size, (char*)ref);
+			icpu_features_mask(feature_masks[m]);
+			y = ibase64_encode(plain, size, (char*)out);
+			CHECK("base64 encode", x, y, ref, out);
+			icpu_features_mask(0);
+			x = ibase64_decode(text64, n64, ref);
+			icpu_features_mask(feature_masks[m]);
+			y = ibase64_decode(text64, n64, out);
+			CHECK("base64 decode", x, y, ref, out);
+			icpu_features_mask(0);
+			x = ibase16_encode(plain, size, (char*)ref);
+			icpu_features_mask(feature_masks[m]);
+			y = ibase16_encode(plain, size, (char*)out);
+			CHECK("base16 encode", x, y, ref, out);
+			icpu_features_mask(0);
+			x = ibase16_decode(text16, n16, ref);
+			icpu_features_mask(feature_masks[m]);
+			y = ibase16_decode(text16, n16, out);
+			CHECK("base16 decode", x, y, ref, out);
+		}
+
+		for (m = 0; m < 4; m++) {
+			icpu_features_mask(feature_masks[m]);
+			x = ibase64_encode(plain, size, (char*)ref);
+			y = stream_encode(plain, size, (char*)out);
+			CHECK("base64 stream encode", x, y, ref, out);
+			x = ibase64_decode(text64, n64, ref);
+			y = stream_decode(text64, n64, out);
+			CHECK("base64 stream decode", x, y, ref, out);
+		}
+	}
+	icpu_features_mask(-1);
+	return 0;
+}
+
+#undef CHECK
+
+#define BENCH_SIZE (8 << 20)
+
+static void bench(int repeat)
+{
+	unsigned char *src = (unsigned char*)malloc(BENCH_SIZE);
+	char *text = (char*)malloc(BENCH_SIZE * 2 + 64);
+	unsigned char *dst = (unsigned char*)malloc(BENCH_SIZE + 64);
+	double mb = (double)repeat / 1048576.0, ts;
+	ilong i, n;
+	int m, r;
+
+	for (i = 0; i < BENCH_SIZE; i++) src[i] = (unsigned char)rand();
+
+	printf("8 MB buffers, MB/s:\n");
+	printf("%-8s %10s %10s %10s %10s %10s %10s\n", "", "b64 enc",
+		"b64 dec", "b16 enc", "b16 dec", "b32 enc", "b32 dec");
+
+	for (m = 0; m < 4; m++) {
+		icpu_features_mask(feature_masks[m]);
+		printf("%-8s", feature_names[m]);
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) n = ibase64_encode(src, BENCH_SIZE, text);
+		printf(" %10.0f", BENCH_SIZE * mb / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) ibase64_decode(text, n, dst);
+		printf(" %10.0f", n * mb / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) n = ibase16_encode(src, BENCH_SIZE, text);
+		printf(" %10.0f", BENCH_SIZE * mb / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) ibase16_decode(text, n, dst);
+		printf(" %10.0f", n * mb / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) n = ibase32_encode(src, BENCH_SIZE, text);
+		printf(" %10.0f", BENCH_SIZE * mb / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) ibase32_decode(text, n, dst);
+		printf(" %10.0f\n", n * mb / (clock_now() - ts));
+	}
+
+	icpu_features_mask(-1);
+	free(src);
+	free(text);
+	free(dst);
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = (argc > 1)? atoi(argv[1]) : 20000;
+	int repeat = (argc > 2)? atoi(argv[2]) : 10;
+
+	srand(7);
+	printf("cpu features: 0x%x\n", icpu_features());
+
+	if (fuzz(rounds) != 0) return 1;
+	printf("fuzz: %d cases, simd == scalar, stream == one shot\n", rounds);
+
+	if (repeat > 0) bench(repeat);
+
+	return 0;
+}
+
@@ -0,0 +1,141 @@
+//=====================================================================
+//
+// bench_cdict.c - icdict vs idict under one global mutex: lookups per
+// second of 1, 2, 4 and 8 reader threads, read only and with 1% writes
+//
+// gcc -O2 -I../system bench_cdict.c ../system/imemdata.c
+//     ../system/imembase.c ../system/inetbase.c -lpthread -lrt
+//     -o bench_cdict
+//
+// (builds with -fsanitize=thread as well)
+//
+//=====================================================================
+#include "imemdata.h"
+#include "imembase.h"
+#include "inetbase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define KEY_COUNT	65536
+#define MAX_THREADS	8
+
+#define MODE_CDICT	0		// icdict_search_ii / icdict_update_ii
+#define MODE_MUTEX	1		// idict_search_ii / idict_update_ii under a mutex
+
+static const char *mode_names[2] = { "icdict", "idict + mutex" };
+
+static icdict_t *cdict;
+static idict_t *dict;
+static IMUTEX_TYPE lock;
+
+static int mode;
+static int write_permille;
+static ilong lookups;
+static volatile ilong errors;
+
+// every key maps to key * 3, writers store the same value again
+static void worker(void *arg)
+{
+	IUINT32 seed = (IUINT32)(size_t)arg * 2654435761u + 1;
+	ilong i, bad = 0;
+	for (i = 0; i < lookups; i++) {
+		ilong key, val = -1;
+		int hr;
+		seed = seed * 1103515245 + 12345;
+		key = (ilong)((seed >> 8) % KEY_COUNT);
+		if ((ilong)((seed >> 4) % 1000) < write_permille) {
+			if (mode == MODE_CDICT) {
+				icdict_update_ii(cdict, key, key * 3);
+			}	else {
+				IMUTEX_LOCK(&lock);
+				idict_update_ii(dict, key, key * 3);
+				IMUTEX_UNLOCK(&lock);
+			}
+			continue;
+		}
+		if (mode == MODE_CDICT) {
+			hr = icdict_search_ii(cdict, key, &val);
+		}	else {
+			IMUTEX_LOCK(&lock);
+			hr = idict_search_ii(dict, key, &val);
+			IMUTEX_UNLOCK(&lock);
+		}
+		if (hr != 0 || val != key * 3) bad++;
+	}
+	iatomic_add(&errors, bad);
+}
+
+// returns M operations per second of all threads together
+static double bench(int which, int threads, int permille, ilong count)
+{
+	ilong ids[MAX_THREADS];
+	IINT64 ts;
+	int i;
+
+	mode = which;
+	write_permille = permille;
+	lookups = count;
+
+	ts = iclockrt();
+	for (i = 0; i < threads; i++) {
+		ithread_create(&ids[i], worker, 0, (void*)(size_t)(i + 1));
+	}
+	for (i = 0; i < threads; i++) {
+		ithread_join(ids[i]);
+		ithread_close(ids[i]);
+	}
+	ts = iclockrt() - ts;
+
+	return (double)count * threads / (double)ts;
+}
+
+int main(int argc, char *argv[])
+{
+	ilong count = (argc > 1)? atol(argv[1]) : 2000000;
+	static const int thread_counts[4] = { 1, 2, 4, 8 };
+	static const int permilles[2] = { 0, 10 };
+	ilong i;
+	int m, p, t;
+
+	IMUTEX_INIT(&lock);
+	cdict = icdict_create(-1);
+	dict = idict_create();
+	for (i = 0; i < KEY_COUNT; i++) {
+		icdict_update_ii(cdict, i, i * 3);
+		idict_update_ii(dict, i, i * 3);
+	}
+
+#ifndef _WIN32
+	printf("online cpus: %ld, ", sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+	printf("%d keys, %ld operations per thread, M ops/s:\n",
+		KEY_COUNT, (long)count);
+
+	for (p = 0; p < 2; p++) {
+		printf("%-14s %3d%% writes:", "", permilles[p] / 10);
+		for (t = 0; t < 4; t++) printf(" %7d thr", thread_counts[t]);
+		printf("\n");
+		for (m = 0; m < 2; m++) {
+			printf("%-26s", mode_names[m]);
+			for (t = 0; t < 4; t++) {
+				printf(" %11.2f", bench(m, thread_counts[t], permilles[p],
+					count));
+				fflush(stdout);
+			}
+			printf("\n");
+		}
+	}
+
+	printf("lookup errors: %ld\n", (long)errors);
+
+	icdict_delete(cdict);
+	idict_delete(dict);
+	IMUTEX_DESTROY(&lock);
+	return (errors == 0)? 0 : 1;
+}
+
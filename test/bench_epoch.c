@@ -0,0 +1,240 @@
+//=====================================================================
+//
+// bench_epoch.c - IEPOCH: stress of 2 EBR and 2 QSBR readers walking a
+// list while one writer unlinks and retires nodes, then read side cost
+//
+// gcc -O2 -I../system bench_epoch.c ../system/imembase.c
+//     ../system/inetbase.c -lpthread -lrt -o bench_epoch
+//
+// (build with -fsanitize=thread: a node destroyed while a reader can
+// still see it shows up as a race on its canary, or as bad > 0)
+//
+//=====================================================================
+#include "imembase.h"
+#include "inetbase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CANARY_LIVE		0x600d
+#define CANARY_DEAD		0xdead
+#define LIST_LENGTH		16
+
+struct NODE
+{
+	volatile ilong canary;
+	ilong value;
+	void * volatile next;
+};
+
+static iepoch_t *epoch;
+static void * volatile head;
+static volatile ilong stop;
+static volatile ilong bad;
+static volatile ilong reads;
+static volatile ilong destroyed;
+static volatile ilong retired;
+
+// destructor: poison the canary before the memory goes back
+static void node_destroy(void *ptr)
+{
+	struct NODE *node = (struct NODE*)ptr;
+	node->canary = CANARY_DEAD;
+	ikmem_free(node);
+	iatomic_add(&destroyed, 1);
+}
+
+static struct NODE *node_new(ilong value, void *next)
+{
+	struct NODE *node = (struct NODE*)ikmem_malloc(sizeof(struct NODE));
+	node->canary = CANARY_LIVE;
+	node->value = value;
+	node->next = next;
+	return node;
+}
+
+// walk the whole list once, counts nodes with a dead canary
+static ilong walk(void)
+{
+	struct NODE *node = (struct NODE*)iatomic_ptr_get(&head);
+	ilong dead = 0;
+	for (; node; node = (struct NODE*)iatomic_ptr_get(&node->next)) {
+		if (node->canary != CANARY_LIVE) dead++;
+	}
+	return dead;
+}
+
+// arg 0: EBR, enter / exit around every walk
+static void reader_ebr(void *arg)
+{
+	iepoch_thread_t *th = iepoch_register(epoch);
+	ilong count = 0, dead = 0;
+	while (iatomic_get(&stop) == 0) {
+		iepoch_enter(th);
+		dead += walk();
+		iepoch_exit(th);
+		count++;
+	}
+	iepoch_unregister(th);
+	iatomic_add(&bad, dead);
+	iatomic_add(&reads, count);
+}
+
+// QSBR: stay inside, report a quiescent state between walks
+static void reader_qsbr(void *arg)
+{
+	iepoch_thread_t *th = iepoch_register(epoch);
+	ilong count = 0, dead = 0;
+	iepoch_enter(th);
+	while (iatomic_get(&stop) == 0) {
+		dead += walk();
+		iepoch_quiescent(th);
+		count++;
+	}
+	iepoch_exit(th);
+	iepoch_unregister(th);
+	iatomic_add(&bad, dead);
+	iatomic_add(&reads, count);
+}
+
+// single writer: replace the head and one inner node per round
+static void writer(void *arg)
+{
+	iepoch_thread_t *th = iepoch_register(epoch);
+	IUINT32 seed = 7;
+	ilong value = 0, count = 0;
+	while (iatomic_get(&stop) == 0) {
+		struct NODE *old = (struct NODE*)head, *node, *prev, *victim;
+		int k;
+		node = node_new(value++, old->next);
+		iatomic_ptr_set(&head, node);
+		iepoch_retire(th, old, node_destroy);
+		seed = seed * 1103515245 + 12345;
+		prev = node;
+		for (k = (seed >> 8) % (LIST_LENGTH - 2); k > 0; k--) {
+			prev = (struct NODE*)prev->next;
+		}
+		victim = (struct NODE*)prev->next;
+		iatomic_ptr_set(&prev->next, node_new(value++, victim->next));
+		iepoch_retire(th, victim, node_destroy);
+		count += 2;
+		if ((count & 1023) == 0) iepoch_collect(th);
+	}
+	iepoch_unregister(th);
+	iatomic_add(&retired, count);
+}
+
+static int stress(int millisec)
+{
+	static const ITHREADPROC procs[5] = { reader_ebr, reader_ebr,
+		reader_qsbr, reader_qsbr, writer };
+	struct NODE *node;
+	ilong ids[5], during, leaked;
+	int i;
+
+	epoch = iepoch_create();
+	for (i = 0; i < LIST_LENGTH; i++) {
+		head = node_new(-i, head);
+	}
+
+	for (i = 0; i < 5; i++) {
+		ithread_create(&ids[i], procs[i], 0, NULL);
+	}
+	isleep(millisec);
+	iatomic_set(&stop, 1);
+	for (i = 0; i < 5; i++) {
+		ithread_join(ids[i]);
+		ithread_close(ids[i]);
+	}
+
+	during = destroyed;
+	iepoch_delete(epoch);
+	leaked = retired - destroyed;
+
+	for (node = (struct NODE*)head; node; ) {
+		struct NODE *next = (struct NODE*)node->next;
+		ikmem_free(node);
+		node = next;
+	}
+
+	printf("stress: %ld walks, %ld retired, %ld destroyed while running, "
+		"%ld not destroyed, bad=%ld\n", (long)reads, (long)retired,
+		(long)during, (long)leaked, (long)bad);
+
+	return (bad == 0 && leaked == 0)? 0 : 1;
+}
+
+// ns per read: plain load, EBR enter / exit, QSBR and lock baselines
+static void bench(ilong count)
+{
+	static ilong data[16] = { 1 };
+	void * volatile shared = data;
+	volatile ilong sink = 0;
+	iepoch_t *ep = iepoch_create();
+	iepoch_thread_t *th = iepoch_register(ep);
+	IRWLOCK_TYPE rwlock;
+	IMUTEX_TYPE mutex;
+	IINT64 ts;
+	ilong i;
+
+	IRWLOCK_INIT(&rwlock);
+	IMUTEX_INIT(&mutex);
+
+	ts = iclockrt();
+	for (i = 0; i < count; i++) {
+		sink += ((ilong*)iatomic_ptr_get(&shared))[0];
+	}
+	printf("plain load         %6.2f ns\n", (iclockrt() - ts) * 1e3 / count);
+
+	ts = iclockrt();
+	for (i = 0; i < count; i++) {
+		iepoch_enter(th);
+		sink += ((ilong*)iatomic_ptr_get(&shared))[0];
+		iepoch_exit(th);
+	}
+	printf("ebr enter/exit     %6.2f ns\n", (iclockrt() - ts) * 1e3 / count);
+
+	ts = iclockrt();
+	iepoch_enter(th);
+	for (i = 0; i < count; i++) {
+		sink += ((ilong*)iatomic_ptr_get(&shared))[0];
+		if ((i & 1023) == 0) iepoch_quiescent(th);
+	}
+	iepoch_exit(th);
+	printf("qsbr (1 per 1024)  %6.2f ns\n", (iclockrt() - ts) * 1e3 / count);
+
+	ts = iclockrt();
+	for (i = 0; i < count; i++) {
+		IRWLOCK_RDLOCK(&rwlock);
+		sink += ((ilong*)shared)[0];
+		IRWLOCK_RDUNLOCK(&rwlock);
+	}
+	printf("rwlock read        %6.2f ns\n", (iclockrt() - ts) * 1e3 / count);
+
+	ts = iclockrt();
+	for (i = 0; i < count; i++) {
+		IMUTEX_LOCK(&mutex);
+		sink += ((ilong*)shared)[0];
+		IMUTEX_UNLOCK(&mutex);
+	}
+	printf("mutex              %6.2f ns\n", (iclockrt() - ts) * 1e3 / count);
+
+	IRWLOCK_DESTROY(&rwlock);
+	IMUTEX_DESTROY(&mutex);
+	iepoch_unregister(th);
+	iepoch_delete(ep);
+}
+
+int main(int argc, char *argv[])
+{
+	int millisec = (argc > 1)? atoi(argv[1]) : 2000;
+	ilong count = (argc > 2)? atol(argv[2]) : 20000000;
+	int hr;
+
+	hr = stress(millisec);
+	if (count > 0) bench(count);
+
+	return hr;
+}
+
@@ -0,0 +1,211 @@
+//=====================================================================
+//
+// bench_hash.c - isecure digests: known answers, simd vs scalar
+// equivalence under every cpu feature mask, and GB/s of each path
+//
+// gcc -O2 -I../system bench_hash.c ../system/isecure.c
+//     ../system/imembase.c -o bench_hash
+//
+//=====================================================================
+#include "isecure.h"
+#include "imembase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double clock_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// fips 180 / rfc 1321 vectors
+static const char *vector_text[3] = { "", "abc",
+	"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq" };
+
+static const char *vector_md5[3] = {
+	"d41d8cd98f00b204e9800998ecf8427e",
+	"900150983cd24fb0d6963f7d28e17f72",
+	"8215ef0796a20bcaaae116d3876c664a" };
+
+static const char *vector_sha1[3] = {
+	"da39a3ee5e6b4b0d3255bfef95601890afd80709",
+	"a9993e364706816aba3e25717850c26c9cd0d89d",
+	"84983e441c3bd26ebaae4aa1f95129e5e54670f1" };
+
+static const char *vector_sha256[3] = {
+	"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+	"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+	"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" };
+
+// scalar only, sha-ni without avx2, everything
+static const int feature_masks[3] = { 0,
+	ICPU_SSE2 | ICPU_SSSE3 | ICPU_SSE41 | ICPU_SHA, -1 };
+
+#define BUFSIZE (1 << 20)
+
+static unsigned char buffer[BUFSIZE];
+
+static int check_vectors(void)
+{
+	char out[80];
+	int i, bad = 0;
+	for (i = 0; i < 3; i++) {
+		unsigned int size = (unsigned int)strlen(vector_text[i]);
+		if (strcmp(hash_md5sum(vector_text[i], size, out),
+			vector_md5[i]) != 0) bad++;
+		if (strcmp(hash_sha1sum(vector_text[i], size, out),
+			vector_sha1[i]) != 0) bad++;
+		if (strcmp(hash_sha256sum(vector_text[i], size, out),
+			vector_sha256[i]) != 0) bad++;
+	}
+	return bad;
+}
+
+// one shot under mask vs split updates and the scalar digests
+static int check_random(int rounds)
+{
+	int k, m, bad = 0;
+	for (k = 0; k < rounds; k++) {
+		unsigned int size = rand() % 5000;
+		unsigned int split = (size > 0)? rand() % size : 0;
+		const unsigned char *ptr = buffer + rand() % 100;
+		char ref[3][80], out[80];
+		unsigned char digest[32];
+		HASH_MD5_CTX md5;
+		HASH_SHA1_CTX sha1;
+		HASH_SHA256_CTX sha256;
+		icpu_features_mask(0);
+		hash_md5sum(ptr, size, ref[0]);
+		hash_sha1sum(ptr, size, ref[1]);
+		hash_sha256sum(ptr, size, ref[2]);
+		for (m = 0; m < 3; m++) {
+			icpu_features_mask(feature_masks[m]);
+			if (strcmp(hash_md5sum(ptr, size, out), ref[0])) bad++;
+			if (strcmp(hash_sha1sum(ptr, size, out), ref[1])) bad++;
+			if (strcmp(hash_sha256sum(ptr, size, out), ref[2])) bad++;
+			HASH_MD5_Init(&md5, 0);
+			HASH_MD5_Update(&md5, ptr, split);
+			HASH_MD5_Update(&md5, ptr + split, size - split);
+			HASH_MD5_Final(&md5, digest);
+			hash_digest_to_string(digest, 16, out);
+			if (strcmp(out, ref[0])) bad++;
+			HASH_SHA1_Init(&sha1);
+			HASH_SHA1_Update(&sha1, ptr, split);
+			HASH_SHA1_Update(&sha1, ptr + split, size - split);
+			HASH_SHA1_Final(&sha1, digest);
+			hash_digest_to_string(digest, 20, out);
+			if (strcmp(out, ref[1])) bad++;
+			HASH_SHA256_Init(&sha256);
+			HASH_SHA256_Update(&sha256, ptr, split);
+			HASH_SHA256_Update(&sha256, ptr + split, size - split);
+			HASH_SHA256_Final(&sha256, digest);
+			hash_digest_to_string(digest, 32, out);
+			if (strcmp(out, ref[2])) bad++;
+		}
+	}
+	icpu_features_mask(-1);
+	return bad;
+}
+
+// multi buffer digests vs one message at a time
+static int check_multi(int rounds)
+{
+	static unsigned char ref[40 * 20], out[40 * 20];
+	int k, i, m, bad = 0;
+	for (k = 0; k < rounds; k++) {
+		const void *in[40];
+		unsigned int size[40];
+		int count = rand() % 40;
+		for (i = 0; i < count; i++) {
+			size[i] = rand() % ((k & 1)? 300 : 3000);
+			in[i] = buffer + rand() % 1000;
+		}
+		for (m = 0; m < 3; m++) {
+			icpu_features_mask(feature_masks[m]);
+			for (i = 0; i < count; i++) {
+				HASH_MD5_CTX md5;
+				HASH_MD5_Init(&md5, 0);
+				HASH_MD5_Update(&md5, in[i], size[i]);
+				HASH_MD5_Final(&md5, ref + i * 16);
+			}
+			hash_md5_multi(count, in, size, out);
+			if (memcmp(ref, out, count * 16) != 0) bad++;
+			for (i = 0; i < count; i++) {
+				HASH_SHA1_CTX sha1;
+				HASH_SHA1_Init(&sha1);
+				HASH_SHA1_Update(&sha1, in[i], size[i]);
+				HASH_SHA1_Final(&sha1, ref + i * 20);
+			}
+			hash_sha1_multi(count, in, size, out);
+			if (memcmp(ref, out, count * 20) != 0) bad++;
+		}
+	}
+	icpu_features_mask(-1);
+	return bad;
+}
+
+static void bench(const char *name, int mask, int repeat)
+{
+	static unsigned char digest[64 * 20];
+	const void *in[64];
+	unsigned int size[64];
+	double ts, gb = repeat / 1024.0;
+	char out[80];
+	int i;
+
+	icpu_features_mask(mask);
+	for (i = 0; i < 64; i++) {
+		in[i] = buffer + i * (BUFSIZE / 64);
+		size[i] = BUFSIZE / 64;
+	}
+
+	printf("%-8s", name);
+	ts = clock_now();
+	for (i = 0; i < repeat; i++) hash_md5sum(buffer, BUFSIZE, out);
+	printf("  md5 %5.2f", gb / (clock_now() - ts));
+	ts = clock_now();
+	for (i = 0; i < repeat; i++) hash_sha1sum(buffer, BUFSIZE, out);
+	printf("  sha1 %5.2f", gb / (clock_now() - ts));
+	ts = clock_now();
+	for (i = 0; i < repeat; i++) hash_sha256sum(buffer, BUFSIZE, out);
+	printf("  sha256 %5.2f", gb / (clock_now() - ts));
+	ts = clock_now();
+	for (i = 0; i < repeat; i++) hash_md5_multi(64, in, size, digest);
+	printf("  md5x64 %5.2f", gb / (clock_now() - ts));
+	ts = clock_now();
+	for (i = 0; i < repeat; i++) hash_sha1_multi(64, in, size, digest);
+	printf("  sha1x64 %5.2f GB/s\n", gb / (clock_now() - ts));
+	icpu_features_mask(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	int repeat = (argc > 1)? atoi(argv[1]) : 100;
+	int i, bad;
+
+	srand(1);
+	for (i = 0; i < BUFSIZE; i++) buffer[i] = (unsigned char)rand();
+
+	printf("cpu features: 0x%x\n", icpu_features());
+
+	bad = check_vectors();
+	printf("known answers: bad=%d\n", bad);
+	i = check_random(300);
+	printf("simd vs scalar, split updates: bad=%d\n", i);
+	bad += i;
+	i = check_multi(200);
+	printf("multi buffer: bad=%d\n", i);
+	bad += i;
+
+	printf("1 MB messages, 64 x 16 KB for multi:\n");
+	bench("scalar", 0, repeat);
+	bench("sha-ni", feature_masks[1], repeat);
+	bench("all", -1, repeat);
+
+	return (bad == 0)? 0 : 1;
+}
+
@@ -0,0 +1,192 @@
+//=====================================================================
+//
+// bench_notify.c - async_notify_call round trip latency: two notify
+// instances over loopback in one thread, log2 histogram per depth
+//
+// gcc -O2 -I../system bench_notify.c ../system/inetnot.c
+//     ../system/inetcode.c ../system/inetbase.c ../system/imemdata.c
+//     ../system/imembase.c ../system/itimer.c -lpthread -lrt
+//     -o bench_notify
+//
+//=====================================================================
+#include "inetnot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#define CMD_ECHO	1
+#define CMD_DROP	2
+#define WINDOW		4096
+
+static CAsyncNotify *client, *server;
+static char buffer[0x10000];
+
+// serve calls: echo the request, leave CMD_DROP unanswered
+static void server_pump(void)
+{
+	int event;
+	long wparam, lparam, hr;
+	async_notify_wait(server, 0);
+	while (1) {
+		hr = async_notify_read(server, &event, &wparam, &lparam,
+			buffer, sizeof(buffer));
+		if (hr < 0) break;
+		if (event != ASYNC_NOTIFY_EVT_CALL || lparam != CMD_ECHO) continue;
+		async_notify_reply(server, buffer, 7,
+			buffer + ASYNC_NOTIFY_TOKEN_SIZE,
+			hr - ASYNC_NOTIFY_TOKEN_SIZE);
+	}
+}
+
+// wait for the result of one call, returns its code, id 0 only pumps
+// both sides for limit millisecs
+static long call_result(long id, IUINT32 limit)
+{
+	IINT64 start = iclockrt();
+	while (iclockrt() - start < (IINT64)limit * 1000) {
+		int event;
+		long wparam, lparam;
+		async_notify_wait(client, 1);
+		server_pump();
+		while (async_notify_read(client, &event, &wparam, &lparam,
+			buffer, sizeof(buffer)) >= 0) {
+			if (event == ASYNC_NOTIFY_EVT_RESULT && wparam == id) {
+				return lparam;
+			}
+		}
+	}
+	return -100;
+}
+
+static void bench_depth(int depth, int count, int size)
+{
+	static IINT64 sent[WINDOW];
+	static long ids[WINDOW];
+	long histogram[64];
+	int done = 0, inflight = 0, issued = 0, bad = 0, i;
+	IINT64 ts, total = 0;
+	long accum = 0;
+	int p50 = -1, p99 = -1, p999 = -1;
+	char request[0x1000];
+
+	memset(histogram, 0, sizeof(histogram));
+	memset(request, 0x5a, sizeof(request));
+	ts = iclockrt();
+
+	while (done < count) {
+		int event;
+		long wparam, lparam, hr;
+		while (inflight < depth && issued < count) {
+			long id = async_notify_call(client, 2, CMD_ECHO, request,
+				size, 5000);
+			if (id <= 0) {
+				printf("call failed: %ld\n", id);
+				exit(1);
+			}
+			sent[id % WINDOW] = iclockrt();
+			ids[id % WINDOW] = id;
+			inflight++;
+			issued++;
+		}
+		async_notify_wait(client, 0);
+		server_pump();
+		async_notify_wait(client, 0);
+		while (1) {
+			IINT64 delta;
+			int bucket = 0;
+			hr = async_notify_read(client, &event, &wparam, &lparam,
+				buffer, sizeof(buffer));
+			if (hr < 0) break;
+			if (event != ASYNC_NOTIFY_EVT_RESULT) continue;
+			if (lparam != 7 || hr != size || ids[wparam % WINDOW] != wparam) {
+				bad++;
+			}
+			delta = iclockrt() - sent[wparam % WINDOW];
+			while (((IINT64)1 << bucket) <= delta && bucket < 63) bucket++;
+			histogram[bucket]++;
+			total += delta;
+			inflight--;
+			done++;
+		}
+	}
+
+	ts = iclockrt() - ts;
+
+	for (i = 0; i < 64; i++) {
+		accum += histogram[i];
+		if (p50 < 0 && accum * 2 >= count) p50 = i;
+		if (p99 < 0 && accum * 100 >= (long)count * 99) p99 = i;
+		if (p999 < 0 && accum * 1000 >= (long)count * 999) p999 = i;
+	}
+
+	printf("depth %3d: %8.0f calls/s  mean %7.1f us  p50 < %lld  "
+		"p99 < %lld  p99.9 < %lld us  bad=%d\n", depth,
+		count * 1e6 / (double)ts, (double)total / count,
+		1LL << p50, 1LL << p99, 1LL << p999, bad);
+}
+
+static int run(long shm_size, int count, int size)
+{
+	struct sockaddr_in addr;
+	long listen_id, code;
+	int port;
+
+	client = async_notify_new(1);
+	server = async_notify_new(2);
+	async_notify_option(client, ASYNC_NOTIFY_OPT_SHM_SIZE, shm_size);
+	async_notify_option(server, ASYNC_NOTIFY_OPT_SHM_SIZE, shm_size);
+
+	isockaddr_makeup((struct sockaddr*)&addr, "127.0.0.1", 0);
+	listen_id = async_notify_listen(server, (struct sockaddr*)&addr, 0, 1);
+	port = async_notify_get_port(server, listen_id);
+	isockaddr_makeup((struct sockaddr*)&addr, "127.0.0.1", port);
+	async_notify_sid_add(client, 2, (struct sockaddr*)&addr, 0);
+
+	// connect, login and let the transport settle
+	code = call_result(async_notify_call(client, 2, CMD_ECHO, "x", 1, 0),
+		3000);
+	if (code != 7) {
+		printf("link failed: %ld\n", code);
+		return 1;
+	}
+	call_result(0, 200);
+
+	printf("%s, %d bytes requests:\n", (shm_size > 0)?
+		"shared memory if available" : "tcp", size);
+	bench_depth(1, count, size);
+	bench_depth(16, count, size);
+	bench_depth(256, count, size);
+
+	code = call_result(async_notify_call(client, 2, CMD_DROP, "x", 1, 100),
+		2000);
+	printf("unanswered call: code=%ld (expect %d)\n", code,
+		ASYNC_NOTIFY_CALL_TIMEOUT);
+
+	async_notify_delete(client);
+	async_notify_delete(server);
+	return (code == ASYNC_NOTIFY_CALL_TIMEOUT)? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int count = (argc > 1)? atoi(argv[1]) : 100000;
+	int size = (argc > 2)? atoi(argv[2]) : 32;
+	int hr = 0;
+
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	if (size < 1) size = 1;
+	if (size > 0x1000) size = 0x1000;
+
+	hr |= run(0, count, size);
+	hr |= run(ASYNC_NOTIFY_SHM_DEFAULT, count, size);
+
+	return hr;
+}
+
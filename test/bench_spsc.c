@@ -0,0 +1,202 @@
+//=====================================================================
+//
+// bench_spsc.c - ISPSC vs IRING + mutex: one producer and one consumer
+// thread move a byte stream through a 64 KB ring, every byte is checked
+// in a first pass, the timed pass only copies
+//
+// gcc -O2 -I../system bench_spsc.c ../system/imemdata.c
+//     ../system/imembase.c ../system/inetbase.c -lpthread -lrt
+//     -o bench_spsc
+//
+// (builds with -fsanitize=thread as well)
+//
+//=====================================================================
+#include "imemdata.h"
+#include "imembase.h"
+#include "inetbase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_SIZE	0x10000
+
+#define MODE_COPY	0		// ispsc_write / ispsc_read
+#define MODE_INPLACE	1		// ispsc_reserve+commit / ispsc_ptr+drop
+#define MODE_MUTEX	2		// iring_write / iring_read under a mutex
+
+static const char *mode_names[3] = { "ispsc write/read",
+	"ispsc reserve/ptr", "iring + mutex" };
+
+static char ring_buffer[RING_SIZE];
+static struct ISPSC spsc;
+static struct IRING ring;
+static IMUTEX_TYPE lock;
+
+static int mode;
+static int verify;
+static ilong message_size;
+static IINT64 total_size;
+static IINT64 errors;
+
+// stream byte at position pos
+#define STREAM_BYTE(pos) ((unsigned char)(((pos) * 7) >> 3))
+
+static char pattern[0x4000];
+
+static void fill(char *dst, IINT64 pos, ilong size)
+{
+	ilong i;
+	if (verify == 0) {
+		memcpy(dst, pattern, size);
+		return;
+	}
+	for (i = 0; i < size; i++) dst[i] = (char)STREAM_BYTE(pos + i);
+}
+
+static ilong check(const char *src, IINT64 pos, ilong size)
+{
+	ilong i, bad = 0;
+	if (verify == 0) return 0;
+	for (i = 0; i < size; i++) {
+		if ((unsigned char)src[i] != STREAM_BYTE(pos + i)) bad++;
+	}
+	return bad;
+}
+
+static void producer(void *arg)
+{
+	char message[0x4000];
+	IINT64 sent = 0;
+	while (sent < total_size) {
+		ilong size = message_size, hr = 0;
+		if (size > total_size - sent) size = (ilong)(total_size - sent);
+		if (mode == MODE_COPY) {
+			fill(message, sent, size);
+			hr = ispsc_write(&spsc, message, size);
+		}
+		else if (mode == MODE_INPLACE) {
+			char *p1, *p2;
+			ilong s1, s2;
+			if (ispsc_reserve(&spsc, size, &p1, &s1, &p2, &s2) >= size) {
+				if (s1 >= size) {
+					fill(p1, sent, size);
+				}	else {
+					fill(p1, sent, s1);
+					fill(p2, sent + s1, size - s1);
+				}
+				ispsc_commit(&spsc, size);
+				hr = size;
+			}
+		}
+		else {
+			fill(message, sent, size);
+			IMUTEX_LOCK(&lock);
+			if (iring_fsize(&ring) >= size) {
+				hr = iring_write(&ring, message, size);
+			}
+			IMUTEX_UNLOCK(&lock);
+		}
+		if (hr == 0) {
+			isleep(0);
+			continue;
+		}
+		sent += hr;
+	}
+}
+
+static void consumer(void *arg)
+{
+	char message[RING_SIZE];
+	IINT64 got = 0, bad = 0;
+	while (got < total_size) {
+		ilong hr;
+		if (mode == MODE_COPY) {
+			hr = ispsc_read(&spsc, message, sizeof(message));
+			bad += check(message, got, hr);
+		}
+		else if (mode == MODE_INPLACE) {
+			char *p1, *p2;
+			ilong s1, s2;
+			hr = ispsc_ptr(&spsc, &p1, &s1, &p2, &s2);
+			if (hr > 0) {
+				bad += check(p1, got, s1);
+				bad += check(p2, got + s1, s2);
+				ispsc_drop(&spsc, hr);
+			}
+		}
+		else {
+			IMUTEX_LOCK(&lock);
+			hr = iring_read(&ring, message, sizeof(message));
+			IMUTEX_UNLOCK(&lock);
+			bad += check(message, got, hr);
+		}
+		if (hr == 0) {
+			isleep(0);
+			continue;
+		}
+		got += hr;
+	}
+	errors = bad;
+}
+
+static void bench(int which, ilong size, IINT64 total, int checked)
+{
+	ilong t1, t2;
+	IINT64 ts;
+	double seconds;
+
+	mode = which;
+	verify = checked;
+	message_size = size;
+	total_size = total;
+	errors = 0;
+	ispsc_init(&spsc, ring_buffer, RING_SIZE);
+	iring_init(&ring, ring_buffer, RING_SIZE);
+
+	ts = iclockrt();
+	ithread_create(&t1, producer, 0, NULL);
+	ithread_create(&t2, consumer, 0, NULL);
+	ithread_join(t1);
+	ithread_join(t2);
+	ithread_close(t1);
+	ithread_close(t2);
+	seconds = (iclockrt() - ts) * 1e-6;
+
+	if (checked) {
+		printf("%-18s msg %5ld: checked, bad=%ld\n", mode_names[which],
+			(long)size, (long)errors);
+	}	else {
+		printf("%-18s msg %5ld: %6.2f GB/s %7.2f M msg/s\n",
+			mode_names[which], (long)size, total / seconds / 1e9,
+			total / size / seconds / 1e6);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	IINT64 total = (argc > 1)? (IINT64)atol(argv[1]) << 20 : (1 << 30);
+	static const ilong sizes[3] = { 64, 1024, 0x4000 };
+	IINT64 bad = 0;
+	int i, k;
+
+	IMUTEX_INIT(&lock);
+	memset(pattern, 0x5a, sizeof(pattern));
+
+	for (k = 0; k < 3; k++) {
+		for (i = 0; i < 3; i++) {
+			bench(i, sizes[k], 64 << 20, 1);
+			bad += errors;
+		}
+	}
+
+	for (k = 0; k < 3; k++) {
+		for (i = 0; i < 3; i++) {
+			bench(i, sizes[k], total, 0);
+		}
+	}
+
+	IMUTEX_DESTROY(&lock);
+	return (bad == 0)? 0 : 1;
+}
+
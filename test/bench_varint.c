@@ -0,0 +1,170 @@
+//=====================================================================
+//
+// bench_varint.c - iencodeu_array / idecodeu_array: round trip against
+// the single value coder, then values per second of each path
+//
+// gcc -O2 -I../system bench_varint.c ../system/imemdata.c
+//     ../system/imembase.c -o bench_varint
+//
+// (add -fsanitize=address: encoding goes to buffers of the exact size)
+//
+//=====================================================================
+#include "imemdata.h"
+#include "imembase.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double clock_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static IUINT64 random64(void)
+{
+	return ((IUINT64)rand() << 42) ^ ((IUINT64)rand() << 21) ^ rand();
+}
+
+#define KIND_COUNT 4
+
+static const char *kind_names[KIND_COUNT] = { "1 byte (<128)",
+	"2 bytes (<16384)", "mixed 1-10 bytes", "10% 10 bytes" };
+
+static IUINT64 random_value(int kind)
+{
+	switch (kind) {
+	case 0: return rand() & 0x7f;
+	case 1: return rand() & 0x3fff;
+	case 2: return random64() >> (rand() % 64);
+	default: break;
+	}
+	if (rand() % 10 == 0) return random64() | ((IUINT64)1 << 63);
+	return rand() % 300;
+}
+
+static int check(int rounds)
+{
+	static IUINT64 values[200], decoded[200];
+	static IINT64 svalues[200], sdecoded[200];
+	static char ref[200 * 10];
+	int k, m;
+	for (k = 0; k < rounds; k++) {
+		ilong count = rand() % 200, i, size;
+		int kind = rand() % KIND_COUNT;
+		char *buf, *end, *p = ref;
+		for (i = 0; i < count; i++) values[i] = random_value(kind);
+		for (i = 0; i < count; i++) p = iencodeu(p, values[i]);
+		size = (ilong)(p - ref);
+		// exact size: any store beyond the encoded end is an overrun
+		buf = (char*)malloc(size + 1);
+		end = iencodeu_array(buf, values, count);
+		if (end - buf != size || memcmp(buf, ref, size) != 0) {
+			printf("encode mismatch: case=%d\n", k);
+			return 1;
+		}
+		for (m = 0; m < 2; m++) {
+			icpu_features_mask(m? -1 : 0);
+			memset(decoded, 0, sizeof(decoded));
+			if (idecodeu_array(buf, end, decoded, count) != end ||
+				memcmp(values, decoded, count * 8) != 0) {
+				printf("decode mismatch: case=%d mask=%d\n", k, m);
+				return 1;
+			}
+			if (count > 0 && idecodeu_array(buf, end - 1, decoded,
+				count) != NULL) {
+				printf("truncation not detected: case=%d\n", k);
+				return 1;
+			}
+		}
+		free(buf);
+		for (i = 0; i < count; i++) {
+			svalues[i] = (IINT64)random_value(kind) * ((rand() & 1)? -1 : 1);
+		}
+		end = iencodei_delta(ref, svalues, count, 7);
+		if (idecodei_delta(ref, end, sdecoded, count, 7) != end ||
+			memcmp(svalues, sdecoded, count * 8) != 0) {
+			printf("delta mismatch: case=%d\n", k);
+			return 1;
+		}
+	}
+	icpu_features_mask(-1);
+	return 0;
+}
+
+#define BENCH_COUNT 1000000
+
+static void bench(int repeat)
+{
+	IUINT64 *values = (IUINT64*)malloc(BENCH_COUNT * 8);
+	IUINT64 *decoded = (IUINT64*)malloc(BENCH_COUNT * 8);
+	char *buf = (char*)malloc(BENCH_COUNT * 10 + 16);
+	double mv = (double)BENCH_COUNT * repeat / 1e6, ts;
+	int kind, r;
+
+	printf("%d values, M values/s:\n", BENCH_COUNT);
+	printf("%-18s %9s %9s %9s %9s %9s %6s\n", "", "enc loop", "enc array",
+		"dec loop", "dec sclr", "dec simd", "B/int");
+
+	for (kind = 0; kind < KIND_COUNT; kind++) {
+		const char *q;
+		char *end = buf, *p;
+		ilong i;
+		for (i = 0; i < BENCH_COUNT; i++) values[i] = random_value(kind);
+		printf("%-18s", kind_names[kind]);
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) {
+			for (p = buf, i = 0; i < BENCH_COUNT; i++) {
+				p = iencodeu(p, values[i]);
+			}
+		}
+		printf(" %9.0f", mv / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) {
+			end = iencodeu_array(buf, values, BENCH_COUNT);
+		}
+		printf(" %9.0f", mv / (clock_now() - ts));
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) {
+			for (q = buf, i = 0; i < BENCH_COUNT; i++) {
+				q = idecodeu(q, &decoded[i]);
+			}
+		}
+		printf(" %9.0f", mv / (clock_now() - ts));
+		icpu_features_mask(0);
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) {
+			idecodeu_array(buf, end, decoded, BENCH_COUNT);
+		}
+		printf(" %9.0f", mv / (clock_now() - ts));
+		icpu_features_mask(-1);
+		ts = clock_now();
+		for (r = 0; r < repeat; r++) {
+			idecodeu_array(buf, end, decoded, BENCH_COUNT);
+		}
+		printf(" %9.0f", mv / (clock_now() - ts));
+		printf(" %6.2f\n", (double)(end - buf) / BENCH_COUNT);
+	}
+
+	free(values);
+	free(decoded);
+	free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = (argc > 1)? atoi(argv[1]) : 20000;
+	int repeat = (argc > 2)? atoi(argv[2]) : 20;
+
+	srand(5);
+	if (check(rounds) != 0) return 1;
+	printf("round trip: %d cases ok\n", rounds);
+
+	if (repeat > 0) bench(repeat);
+
+	return 0;
+}
+